@@ -0,0 +1,17 @@
+#!/bin/sh
+# make check: runs vqe-bench-create against the fake backend and fails if
+# the buffer pool has stopped recycling, both plain and with a timeshift
+# window, which mustn't keep hold of the pool's buffers.  How long create()
+# takes depends on the machine and whatever else it's running, so that's
+# only checked, and loosely, with VQE_CHECK_TIMING=1; use the JSON it prints
+# for anything finer.
+set -e
+timing=
+if [ -n "$VQE_CHECK_TIMING" ] && [ "$VQE_CHECK_TIMING" != 0 ]; then
+  timing="--max-ns-per-datagram 20000"
+fi
+./vqe-bench-create -n 20000 -L check $timing \
+    --max-allocations-per-buffer 0.05
+exec ./vqe-bench-create -n 20000 -L check-timeshift \
+    --vqesrc "timeshift-duration=60000000000" \
+    --max-allocations-per-buffer 0.05
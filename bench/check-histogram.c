@@ -0,0 +1,120 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * make check: the power of two buckets behind vqesrc's stats and the
+ * benchmarks' percentiles.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqehistogram.h"
+
+static void
+test_buckets (void)
+{
+  GstVQEHistogram hist;
+  gchar *str;
+
+  gst_vqe_histogram_reset (&hist);
+  str = gst_vqe_histogram_to_string (&hist);
+  g_assert_cmpstr (str, ==, "");
+  g_free (str);
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&hist, 50), ==, 0);
+
+  gst_vqe_histogram_add (&hist, 0);
+  gst_vqe_histogram_add (&hist, 1);
+  gst_vqe_histogram_add (&hist, 2);
+  gst_vqe_histogram_add (&hist, 3);
+  gst_vqe_histogram_add_n (&hist, 1000, 10);
+  gst_vqe_histogram_add_n (&hist, 1024, 0);
+  g_assert_cmpuint (hist.count, ==, 14);
+  g_assert_cmpuint (hist.sum, ==, 10006);
+  g_assert_cmpuint (hist.max, ==, 1000);
+  g_assert_cmpuint (hist.buckets[0], ==, 1);
+  g_assert_cmpuint (hist.buckets[1], ==, 1);
+  g_assert_cmpuint (hist.buckets[2], ==, 2);
+  g_assert_cmpuint (hist.buckets[10], ==, 10);
+
+  str = gst_vqe_histogram_to_string (&hist);
+  g_assert_cmpstr (str, ==, "<=0:1 <=1:1 <=3:2 <=1023:10");
+  g_free (str);
+
+  gst_vqe_histogram_add (&hist, G_MAXUINT64);
+  g_assert_cmpuint (hist.buckets[64], ==, 1);
+  g_assert_cmpuint (hist.max, ==, G_MAXUINT64);
+}
+
+static void
+test_percentile (void)
+{
+  GstVQEHistogram hist;
+  guint i;
+
+  gst_vqe_histogram_reset (&hist);
+  for (i = 1; i <= 100; i++)
+    gst_vqe_histogram_add (&hist, i);
+
+  /* the top of the bucket it falls in */
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&hist, 0), ==, 1);
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&hist, 10), ==, 15);
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&hist, 50), ==, 63);
+  /* but no more than the largest value seen */
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&hist, 99), ==, 100);
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&hist, 100), ==, 100);
+}
+
+static void
+test_merge (void)
+{
+  GstVQEHistogram a, b;
+
+  gst_vqe_histogram_reset (&a);
+  gst_vqe_histogram_reset (&b);
+  gst_vqe_histogram_add_n (&a, 5, 3);
+  gst_vqe_histogram_add_n (&b, 5, 1);
+  gst_vqe_histogram_add (&b, 5000);
+
+  gst_vqe_histogram_merge (&a, &b);
+  g_assert_cmpuint (a.count, ==, 5);
+  g_assert_cmpuint (a.sum, ==, 5020);
+  g_assert_cmpuint (a.max, ==, 5000);
+  g_assert_cmpuint (a.buckets[3], ==, 4);
+  g_assert_cmpuint (a.buckets[13], ==, 1);
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&a, 80), ==, 7);
+  g_assert_cmpuint (gst_vqe_histogram_percentile (&a, 100), ==, 5000);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/histogram/buckets", test_buckets);
+  g_test_add_func ("/histogram/percentile", test_percentile);
+  g_test_add_func ("/histogram/merge", test_merge);
+
+  return g_test_run ();
+}
@@ -0,0 +1,225 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * make check: the ring vqesrc shares with gst-vqe-daemon, with this process
+ * playing the daemon: it answers the tune request with a ring of its own
+ * and publishes into it by hand, with no VQE-C involved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqeipc.h"
+
+#include <glib/gstdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define N_SLOTS 4
+#define SLOT_SIZE 1316
+#define SDP "v=0\r\n"
+
+typedef struct {
+  gint listen_sock;
+  gint sock;
+  GstVQEIpcRing *ring;
+  gint ring_fd;
+  gint event_fd;
+} FakeDaemon;
+
+/* What the daemon does on a connection, without tuning anything */
+static gpointer
+fake_daemon_tune (gpointer data)
+{
+  FakeDaemon *d = data;
+  guint8 msg[sizeof (GstVQEIpcTuneRequest) + sizeof (SDP)];
+  GstVQEIpcTuneRequest req;
+  GstVQEIpcTuneReply reply;
+  gint fds[2];
+
+  d->sock = accept (d->listen_sock, NULL, NULL);
+  g_assert_cmpint (d->sock, >=, 0);
+  g_assert_cmpint (recv (d->sock, msg, sizeof (msg), 0), ==,
+      sizeof (req) + strlen (SDP));
+  memcpy (&req, msg, sizeof (req));
+  g_assert_cmpuint (req.magic, ==, GST_VQE_IPC_MAGIC);
+  g_assert_cmpuint (req.version, ==, GST_VQE_IPC_VERSION);
+  g_assert_cmpuint (req.slot_size, ==, SLOT_SIZE);
+  g_assert_cmpuint (req.n_slots, ==, N_SLOTS);
+  g_assert_true (memcmp (msg + sizeof (req), SDP, strlen (SDP)) == 0);
+
+  d->ring = gst_vqe_ipc_ring_new (req.slot_size, req.n_slots, &d->ring_fd);
+  g_assert_nonnull (d->ring);
+  d->event_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  g_assert_cmpint (d->event_fd, >=, 0);
+
+  memset (&reply, 0, sizeof (reply));
+  reply.magic = GST_VQE_IPC_MAGIC;
+  g_strlcpy (reply.stream_uri, "rtp://239.1.1.1:50000",
+      sizeof (reply.stream_uri));
+  fds[0] = d->ring_fd;
+  fds[1] = d->event_fd;
+  g_assert_true (gst_vqe_ipc_send_fds (d->sock, &reply, sizeof (reply), fds,
+          2));
+  return NULL;
+}
+
+static void
+publish (FakeDaemon * d, guint8 fill, gsize size)
+{
+  guint64 one = 1;
+  guint8 *slot = gst_vqe_ipc_ring_reserve (d->ring);
+
+  g_assert_nonnull (slot);
+  memset (slot, fill, size);
+  gst_vqe_ipc_ring_publish (d->ring, size);
+  g_assert_cmpint (write (d->event_fd, &one, sizeof (one)), ==, sizeof (one));
+}
+
+static void
+test_ring (void)
+{
+  FakeDaemon d;
+  GstVQEIpcClient *client;
+  GError *error = NULL;
+  struct sockaddr_un addr;
+  gchar *dir, *path;
+  GThread *thread;
+  const guint8 *data;
+  gsize size;
+  gpointer slots[N_SLOTS];
+  gpointer slot;
+  guint i;
+
+  d.ring = gst_vqe_ipc_ring_new (SLOT_SIZE, N_SLOTS, &d.ring_fd);
+  if (!d.ring) {
+    g_test_skip ("No memfd_create");
+    return;
+  }
+  gst_vqe_ipc_ring_free (d.ring);
+  close (d.ring_fd);
+
+  dir = g_dir_make_tmp ("vqe-check-ipc-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "sock", NULL);
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+  d.listen_sock = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  g_assert_cmpint (bind (d.listen_sock, (struct sockaddr *) &addr,
+          sizeof (addr)), ==, 0);
+  g_assert_cmpint (listen (d.listen_sock, 1), ==, 0);
+
+  g_assert_null (gst_vqe_ipc_client_connect (path, "", SLOT_SIZE, N_SLOTS,
+          NULL));
+
+  thread = g_thread_new ("fake-daemon", fake_daemon_tune, &d);
+  client = gst_vqe_ipc_client_connect (path, SDP, SLOT_SIZE, N_SLOTS, &error);
+  g_thread_join (thread);
+  g_assert_no_error (error);
+  g_assert_nonnull (client);
+  g_assert_cmpstr (gst_vqe_ipc_client_get_stream_uri (client), ==,
+      "rtp://239.1.1.1:50000");
+
+  /* nothing yet */
+  g_assert_cmpint (gst_vqe_ipc_client_receive (client, 0, &data, &size,
+          &slot), ==, 0);
+
+  /* fill the ring, which holds the daemon off until slots are released */
+  for (i = 0; i < N_SLOTS; i++)
+    publish (&d, i + 1, 100 * (i + 1));
+  g_assert_null (gst_vqe_ipc_ring_reserve (d.ring));
+
+  for (i = 0; i < N_SLOTS; i++) {
+    g_assert_cmpint (gst_vqe_ipc_client_receive (client, 1000, &data, &size,
+            &slots[i]), ==, 1);
+    g_assert_cmpuint (size, ==, 100 * (i + 1));
+    g_assert_cmpuint (data[0], ==, i + 1);
+    g_assert_cmpuint (data[size - 1], ==, i + 1);
+  }
+  g_assert_cmpint (gst_vqe_ipc_client_receive (client, 0, &data, &size,
+          &slot), ==, 0);
+
+  /* the tail only moves past a contiguous run of released slots */
+  gst_vqe_ipc_client_release (slots[1]);
+  g_assert_cmpint (d.ring->tail, ==, 0);
+  g_assert_null (gst_vqe_ipc_ring_reserve (d.ring));
+  gst_vqe_ipc_client_release (slots[0]);
+  g_assert_cmpint (d.ring->tail, ==, 2);
+  gst_vqe_ipc_client_release (slots[3]);
+  g_assert_cmpint (d.ring->tail, ==, 2);
+
+  /* round again, with the slots wrapping */
+  publish (&d, 5, SLOT_SIZE);
+  publish (&d, 6, 1);
+  g_assert_null (gst_vqe_ipc_ring_reserve (d.ring));
+  gst_vqe_ipc_client_release (slots[2]);
+  g_assert_cmpint (d.ring->tail, ==, 4);
+  for (i = 0; i < 2; i++) {
+    g_assert_cmpint (gst_vqe_ipc_client_receive (client, 1000, &data, &size,
+            &slot), ==, 1);
+    g_assert_cmpuint (size, ==, i ? 1 : SLOT_SIZE);
+    g_assert_cmpuint (data[size - 1], ==, 5 + i);
+    gst_vqe_ipc_client_release (slot);
+  }
+  g_assert_cmpint (d.ring->tail, ==, 6);
+
+  /* a size bigger than the slot is clamped to what was agreed */
+  memset (gst_vqe_ipc_ring_reserve (d.ring), 7, SLOT_SIZE);
+  gst_vqe_ipc_ring_publish (d.ring, 1 << 20);
+  g_assert_cmpint (gst_vqe_ipc_client_receive (client, 1000, &data, &size,
+          &slot), ==, 1);
+  g_assert_cmpuint (size, ==, SLOT_SIZE);
+  gst_vqe_ipc_client_release (slot);
+
+  /* the daemon going away */
+  close (d.sock);
+  g_assert_cmpint (gst_vqe_ipc_client_receive (client, 1000, &data, &size,
+          &slot), ==, -1);
+
+  gst_vqe_ipc_client_unref (client);
+  gst_vqe_ipc_ring_free (d.ring);
+  close (d.ring_fd);
+  close (d.event_fd);
+  close (d.listen_sock);
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/ipc/ring", test_ring);
+
+  return g_test_run ();
+}
@@ -0,0 +1,342 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * make check: vqesrc's merge of two feeds of the same RTP stream, fed by
+ * hand so that arrival order and timing are exactly what each test says.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqemerge.h"
+
+#include <string.h>
+
+#define SLOT_SIZE 64
+#define DELAY 1000
+
+/* An RTP packet whose one byte payload is the low byte of its seq */
+static gsize
+make_packet (guint8 * data, guint16 seq)
+{
+  memset (data, 0, GST_VQE_RTP_HEADER_SIZE);
+  data[0] = 0x80;
+  data[1] = 33;
+  data[2] = seq >> 8;
+  data[3] = seq & 0xff;
+  data[GST_VQE_RTP_HEADER_SIZE] = seq & 0xff;
+  return GST_VQE_RTP_HEADER_SIZE + 1;
+}
+
+static gboolean
+push (GstVQEMerge * merge, guint path, guint16 seq, gint64 now)
+{
+  guint8 data[GST_VQE_RTP_HEADER_SIZE + 1];
+  gsize size = make_packet (data, seq);
+
+  return gst_vqe_merge_push (merge, path, data, size, now);
+}
+
+/* Pops the next packet, checking it is the payload of @seq */
+static void
+assert_pop (GstVQEMerge * merge, gint64 now, guint16 seq)
+{
+  guint8 out[SLOT_SIZE];
+  gint64 wake;
+
+  g_assert_cmpuint (gst_vqe_merge_pop (merge, now, DELAY, out, sizeof (out),
+          &wake), ==, 1);
+  g_assert_cmpuint (out[0], ==, seq & 0xff);
+}
+
+static void
+assert_empty (GstVQEMerge * merge, gint64 now, gint64 expect_wake)
+{
+  guint8 out[SLOT_SIZE];
+  gint64 wake;
+
+  g_assert_cmpuint (gst_vqe_merge_pop (merge, now, DELAY, out, sizeof (out),
+          &wake), ==, 0);
+  g_assert_cmpint (wake, ==, expect_wake);
+}
+
+static void
+test_rtp_parse (void)
+{
+  guint8 data[64];
+  guint16 seq;
+  gsize offset, payload_size;
+
+  make_packet (data, 0x1234);
+  g_assert_true (gst_vqe_rtp_parse (data, 13, &seq, &offset, &payload_size));
+  g_assert_cmpuint (seq, ==, 0x1234);
+  g_assert_cmpuint (offset, ==, 12);
+  g_assert_cmpuint (payload_size, ==, 1);
+
+  /* two CSRCs, an extension of one word and two bytes of padding */
+  memset (data, 0, sizeof (data));
+  data[0] = 0x80 | 0x20 | 0x10 | 2;
+  data[12 + 8 + 3] = 1;
+  data[40 - 1] = 2;
+  g_assert_true (gst_vqe_rtp_parse (data, 40, &seq, &offset, &payload_size));
+  g_assert_cmpuint (offset, ==, 12 + 8 + 8);
+  g_assert_cmpuint (payload_size, ==, 40 - 28 - 2);
+
+  /* TS, and a truncated header */
+  data[0] = 0x47;
+  g_assert_false (gst_vqe_rtp_parse (data, 40, &seq, &offset, &payload_size));
+  data[0] = 0x80;
+  g_assert_false (gst_vqe_rtp_parse (data, 11, &seq, &offset, &payload_size));
+}
+
+/* Each packet is output once, from whichever path has it first, and in
+   order across the sequence number wrapping */
+static void
+test_dedupe (void)
+{
+  GstVQEMerge merge;
+  guint16 seq;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+  assert_empty (&merge, 0, -1);
+
+  for (seq = 65530; seq != 6; seq++) {
+    g_assert_true (push (&merge, seq & 1, seq, 0));
+    g_assert_false (push (&merge, !(seq & 1), seq, 0));
+  }
+  for (seq = 65530; seq != 6; seq++)
+    assert_pop (&merge, 0, seq);
+  assert_empty (&merge, 0, -1);
+
+  /* late copies of what's been output are still duplicates */
+  g_assert_false (push (&merge, 1, 5, 0));
+  g_assert_false (push (&merge, 1, 65530, 0));
+
+  g_assert_cmpuint (merge.output, ==, 12);
+  g_assert_cmpuint (merge.lost, ==, 0);
+  g_assert_cmpuint (merge.resyncs, ==, 0);
+  g_assert_cmpuint (merge.paths[0].used, ==, 6);
+  g_assert_cmpuint (merge.paths[1].used, ==, 6);
+  g_assert_cmpuint (merge.paths[0].duplicates, ==, 6);
+  g_assert_cmpuint (merge.paths[1].duplicates, ==, 8);
+  g_assert_cmpuint (merge.paths[0].lost, ==, 0);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* A packet missing from one path is filled in from the other; one missing
+   from both is waited for for the delay and then given up on */
+static void
+test_gaps (void)
+{
+  GstVQEMerge merge;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+
+  push (&merge, 0, 100, 0);
+  push (&merge, 0, 102, 10);
+  assert_pop (&merge, 10, 100);
+  /* 101 is still to come */
+  assert_empty (&merge, 10, 10 + DELAY);
+  g_assert_true (push (&merge, 1, 101, 20));
+  assert_pop (&merge, 20, 101);
+  assert_pop (&merge, 20, 102);
+  g_assert_cmpuint (merge.paths[0].lost, ==, 1);
+
+  /* 103 never comes */
+  push (&merge, 0, 104, 100);
+  push (&merge, 1, 104, 110);
+  assert_empty (&merge, 100 + DELAY - 1, 100 + DELAY);
+  assert_pop (&merge, 100 + DELAY, 104);
+  g_assert_cmpuint (merge.lost, ==, 1);
+  /* and is a duplicate if it turns up after all */
+  g_assert_false (push (&merge, 1, 103, 100 + DELAY));
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* A stray packet from far away is dropped without disturbing the rest */
+static void
+test_stray (void)
+{
+  GstVQEMerge merge;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+
+  push (&merge, 0, 1000, 0);
+  g_assert_false (push (&merge, 0, 30000, 0));
+  g_assert_false (push (&merge, 1, 1000 - 100, 0));
+  g_assert_true (push (&merge, 0, 1001, 0));
+  assert_pop (&merge, 0, 1000);
+  assert_pop (&merge, 0, 1001);
+  g_assert_cmpuint (merge.resyncs, ==, 0);
+  g_assert_cmpuint (merge.lost, ==, 0);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* A jump further than the window, e.g. the head end restarting, starts
+   again from there once it's clear it isn't a stray */
+static void
+test_jump (void)
+{
+  GstVQEMerge merge;
+  guint i;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+
+  push (&merge, 0, 1000, 0);
+  push (&merge, 0, 1002, 0);
+  for (i = 0; i < GST_VQE_MERGE_RESYNC - 1; i++)
+    g_assert_false (push (&merge, i & 1, 30000 + i / 2, 0));
+  g_assert_cmpuint (merge.resyncs, ==, 0);
+  g_assert_true (push (&merge, 0, 30000 + i / 2, 0));
+  g_assert_cmpuint (merge.resyncs, ==, 1);
+  /* what was held will never be output */
+  g_assert_cmpuint (merge.lost, ==, 2);
+  assert_pop (&merge, 0, 30000 + i / 2);
+  g_assert_true (push (&merge, 1, 30001 + i / 2, 0));
+  assert_pop (&merge, 0, 30001 + i / 2);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* Going back less than the window looks like late duplicates at first, but
+   a run of them with nothing new means the stream went back */
+static void
+test_jump_back (void)
+{
+  GstVQEMerge merge;
+  guint16 seq;
+  guint i;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+
+  for (seq = 65500; seq != 100; seq++) {
+    push (&merge, 0, seq, 0);
+    assert_pop (&merge, 0, seq);
+  }
+  /* back across the wrap, on both paths */
+  for (i = 0; i < GST_VQE_MERGE_RESYNC - 1; i++)
+    g_assert_false (push (&merge, i & 1, 65450 + i / 2, 0));
+  g_assert_cmpuint (merge.resyncs, ==, 0);
+  g_assert_cmpuint (merge.paths[0].duplicates + merge.paths[1].duplicates,
+      ==, GST_VQE_MERGE_RESYNC - 1);
+  g_assert_true (push (&merge, 1, 65450 + i / 2, 0));
+  g_assert_cmpuint (merge.resyncs, ==, 1);
+  g_assert_cmpuint (merge.lost, ==, 0);
+  assert_pop (&merge, 0, 65450 + i / 2);
+  g_assert_true (push (&merge, 0, 65451 + i / 2, 0));
+  assert_pop (&merge, 0, 65451 + i / 2);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* A path lagging the other by more than the window only ever delivers
+   packets too late to use, which mustn't be taken for a jump */
+static void
+test_lagging_path (void)
+{
+  GstVQEMerge merge;
+  guint i;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+
+  for (i = 0; i < 4 * GST_VQE_MERGE_WINDOW; i++) {
+    g_assert_true (push (&merge, 0, 1000 + GST_VQE_MERGE_WINDOW + i, 0));
+    assert_pop (&merge, 0, 1000 + GST_VQE_MERGE_WINDOW + i);
+    g_assert_false (push (&merge, 1, 1000 + i, 0));
+  }
+  g_assert_cmpuint (merge.resyncs, ==, 0);
+  g_assert_cmpuint (merge.paths[1].used, ==, 0);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* Datagrams which aren't RTP are passed through from path 0 */
+static void
+test_not_rtp (void)
+{
+  GstVQEMerge merge;
+  guint8 ts[188] = { 0x47, 1 };
+  guint8 out[SLOT_SIZE];
+  gint64 wake;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+
+  g_assert_true (gst_vqe_merge_push (&merge, 0, ts, SLOT_SIZE, 0));
+  g_assert_false (gst_vqe_merge_push (&merge, 1, ts, SLOT_SIZE, 0));
+  g_assert_cmpuint (gst_vqe_merge_pop (&merge, 0, DELAY, out, sizeof (out),
+          &wake), ==, SLOT_SIZE);
+  g_assert_cmpuint (out[1], ==, 1);
+  g_assert_cmpuint (merge.paths[0].not_rtp, ==, 1);
+  g_assert_cmpuint (merge.paths[1].not_rtp, ==, 1);
+
+  /* too big for where it's popped to */
+  g_assert_true (gst_vqe_merge_push (&merge, 0, ts, SLOT_SIZE, 0));
+  g_assert_cmpuint (gst_vqe_merge_pop (&merge, 0, DELAY, out, 10, &wake), ==,
+      0);
+  g_assert_cmpuint (merge.lost, ==, 1);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+/* With keep_rtp the whole packet is output */
+static void
+test_keep_rtp (void)
+{
+  GstVQEMerge merge;
+  guint8 out[SLOT_SIZE];
+  gint64 wake;
+
+  gst_vqe_merge_init (&merge, SLOT_SIZE);
+  merge.keep_rtp = TRUE;
+
+  push (&merge, 0, 7, 0);
+  g_assert_cmpuint (gst_vqe_merge_pop (&merge, 0, DELAY, out, sizeof (out),
+          &wake), ==, GST_VQE_RTP_HEADER_SIZE + 1);
+  g_assert_cmpuint (out[0], ==, 0x80);
+  g_assert_cmpuint (out[3], ==, 7);
+
+  gst_vqe_merge_clear (&merge);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/merge/rtp-parse", test_rtp_parse);
+  g_test_add_func ("/merge/dedupe", test_dedupe);
+  g_test_add_func ("/merge/gaps", test_gaps);
+  g_test_add_func ("/merge/stray", test_stray);
+  g_test_add_func ("/merge/jump", test_jump);
+  g_test_add_func ("/merge/jump-back", test_jump_back);
+  g_test_add_func ("/merge/lagging-path", test_lagging_path);
+  g_test_add_func ("/merge/not-rtp", test_not_rtp);
+  g_test_add_func ("/merge/keep-rtp", test_keep_rtp);
+
+  return g_test_run ();
+}
@@ -0,0 +1,163 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * make check: the synthetic stream and loss models the benchmarks are built
+ * on, so that what they measure is what they think it is.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqesynth.h"
+
+#include <string.h>
+
+#define RTP GST_VQE_SYNTH_RTP_HEADER_SIZE
+#define PROBE(data) \
+  ((data) + (GST_VQE_SYNTH_TS_PER_DATAGRAM - 1) * 188)
+
+static void
+test_stream (void)
+{
+  GstVQESynthStream stream;
+  GstVQESynthProbe probe;
+  guint8 data[RTP + GST_VQE_SYNTH_DATAGRAM_SIZE];
+  guint i;
+
+  /* 10 datagrams a second, so one every 100ms */
+  gst_vqe_synth_stream_init (&stream, 7, 8 * GST_VQE_SYNTH_DATAGRAM_SIZE * 10,
+      500, 1000000);
+  g_assert_cmpuint (stream.rap_interval, ==, 5);
+
+  for (i = 0; i < 70000; i++) {
+    g_assert_cmpint (gst_vqe_synth_stream_due (&stream), ==,
+        1000000 + (gint64) i * 100000);
+    g_assert_cmpuint (gst_vqe_synth_stream_next (&stream, data, TRUE), ==,
+        RTP + GST_VQE_SYNTH_DATAGRAM_SIZE);
+
+    /* the RTP header counts datagrams, wrapping */
+    g_assert_cmpuint (data[0], ==, 0x80);
+    g_assert_cmpuint (data[1], ==, GST_VQE_SYNTH_RTP_PT);
+    g_assert_cmpuint ((data[2] << 8) | data[3], ==, i & 0xffff);
+    g_assert_cmpuint (data[RTP], ==, 0x47);
+
+    g_assert_true (gst_vqe_synth_probe_parse (PROBE (data + RTP), &probe));
+    g_assert_cmpuint (probe.channel, ==, 7);
+    g_assert_cmpuint (probe.seq, ==, i);
+    g_assert_cmpint (probe.time, ==, 1000000 + (gint64) i * 100000);
+
+    /* PAT first at each random access point, video otherwise */
+    g_assert_cmpuint (((data[RTP + 1] & 0x1f) << 8) | data[RTP + 2], ==,
+        i % 5 == 0 ? 0 : GST_VQE_SYNTH_PID_VIDEO);
+  }
+
+  g_assert_cmpuint (gst_vqe_synth_stream_next (&stream, data, FALSE), ==,
+      GST_VQE_SYNTH_DATAGRAM_SIZE);
+  g_assert_true (gst_vqe_synth_probe_parse (PROBE (data), &probe));
+  g_assert_false (gst_vqe_synth_probe_parse (data, &probe));
+}
+
+static void
+test_loss_parse (void)
+{
+  GstVQESynthLoss loss;
+
+  g_assert_true (gst_vqe_synth_loss_parse (&loss, NULL, 0));
+  g_assert_cmpint (loss.type, ==, GST_VQE_SYNTH_LOSS_NONE);
+  g_assert_true (gst_vqe_synth_loss_parse (&loss, "none", 0));
+  g_assert_true (gst_vqe_synth_loss_parse (&loss, "uniform:0.5", 0));
+  g_assert_cmpint (loss.type, ==, GST_VQE_SYNTH_LOSS_UNIFORM);
+  g_assert_true (gst_vqe_synth_loss_parse (&loss, "gilbert:0.01:0.5", 0));
+  g_assert_cmpint (loss.type, ==, GST_VQE_SYNTH_LOSS_GILBERT);
+  g_assert_true (gst_vqe_synth_loss_parse (&loss, "periodic:10", 0));
+  g_assert_cmpint (loss.type, ==, GST_VQE_SYNTH_LOSS_PERIODIC);
+
+  g_assert_false (gst_vqe_synth_loss_parse (&loss, "uniform", 0));
+  g_assert_false (gst_vqe_synth_loss_parse (&loss, "uniform:2", 0));
+  g_assert_false (gst_vqe_synth_loss_parse (&loss, "gilbert:0.1", 0));
+  g_assert_false (gst_vqe_synth_loss_parse (&loss, "periodic:0", 0));
+  g_assert_false (gst_vqe_synth_loss_parse (&loss, "bursty:0.1", 0));
+}
+
+static void
+test_loss_drop (void)
+{
+  GstVQESynthLoss a, b;
+  guint i, dropped = 0;
+
+  gst_vqe_synth_loss_parse (&a, "periodic:4", 0);
+  for (i = 1; i <= 100; i++)
+    g_assert_cmpint (gst_vqe_synth_loss_drop (&a), ==, i % 4 == 0);
+
+  /* the same seed drops the same packets, at about the rate asked for */
+  gst_vqe_synth_loss_parse (&a, "uniform:0.1", 42);
+  gst_vqe_synth_loss_parse (&b, "uniform:0.1", 42);
+  for (i = 0; i < 100000; i++) {
+    gboolean drop = gst_vqe_synth_loss_drop (&a);
+
+    g_assert_cmpint (drop, ==, gst_vqe_synth_loss_drop (&b));
+    dropped += drop;
+  }
+  g_assert_cmpuint (dropped, >, 9000);
+  g_assert_cmpuint (dropped, <, 11000);
+
+  gst_vqe_synth_loss_parse (&a, "gilbert:0.5:0", 1);
+  for (i = 0; i < 100 && !gst_vqe_synth_loss_drop (&a); i++);
+  /* never recovers */
+  for (i = 0; i < 100; i++)
+    g_assert_true (gst_vqe_synth_loss_drop (&a));
+
+  gst_vqe_synth_loss_parse (&a, "none", 1);
+  for (i = 0; i < 100; i++)
+    g_assert_false (gst_vqe_synth_loss_drop (&a));
+}
+
+static void
+test_sdp (void)
+{
+  gchar *sdp = gst_vqe_synth_sdp (3, "239.1.1.1", 50000, "127.0.0.1",
+      4000000);
+
+  g_assert_nonnull (strstr (sdp, "m=video 50000 RTP/AVPF 33\r\n"));
+  g_assert_nonnull (strstr (sdp, "a=rtcp:50001 IN IP4 127.0.0.1\r\n"));
+  g_assert_nonnull (strstr (sdp,
+          "a=source-filter: incl IN IP4 239.1.1.1 127.0.0.1\r\n"));
+  g_assert_nonnull (strstr (sdp, "m=video 50002 RTP/AVPF 96\r\n"));
+  g_assert_nonnull (strstr (sdp, "b=AS:4000\r\n"));
+  g_free (sdp);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/synth/stream", test_stream);
+  g_test_add_func ("/synth/loss-parse", test_loss_parse);
+  g_test_add_func ("/synth/loss-drop", test_loss_drop);
+  g_test_add_func ("/synth/sdp", test_sdp);
+
+  return g_test_run ();
+}
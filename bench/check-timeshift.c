@@ -0,0 +1,278 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * make check: vqesrc's timeshift window, in memory and in segment files.
+ * Buffer n is filled with the byte n and captured at n tenths of a second,
+ * with a random access point every tenth buffer.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqetimeshift.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define BUFFER_SIZE 1000
+#define TIME(n) ((GstClockTime) (n) * 100 * GST_MSECOND)
+
+static void
+append (GstVQETimeshift * ts, guint n)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, BUFFER_SIZE, NULL);
+  GstVQETimeshiftEntry e;
+  GError *error = NULL;
+
+  gst_buffer_memset (buffer, 0, n & 0xff, BUFFER_SIZE);
+  g_assert_true (gst_vqe_timeshift_write (ts, buffer, TIME (n),
+          n % 10 ? -1 : 0, &e, &error));
+  g_assert_no_error (error);
+  /* the window has its own copy */
+  gst_buffer_unref (buffer);
+
+  gst_vqe_timeshift_append (ts, &e);
+  gst_vqe_timeshift_release (ts);
+}
+
+static void
+assert_buffer (GstBuffer * buffer, guint n)
+{
+  GstMapInfo info;
+  gsize i;
+
+  g_assert_true (gst_buffer_map (buffer, &info, GST_MAP_READ));
+  g_assert_cmpuint (info.size, ==, BUFFER_SIZE);
+  for (i = 0; i < info.size; i++)
+    if (info.data[i] != (n & 0xff))
+      g_assert_cmpuint (info.data[i], ==, n & 0xff);
+  gst_buffer_unmap (buffer, &info);
+}
+
+/* Checks the next buffer played back is buffer @n, and whether playback
+   starts or jumps to it */
+static void
+assert_next (GstVQETimeshift * ts, guint n, gboolean rap)
+{
+  GstBuffer *buffer;
+  gssize offset;
+
+  buffer = gst_vqe_timeshift_next (ts, &offset);
+  g_assert_nonnull (buffer);
+  g_assert_cmpint (offset, ==, rap ? 0 : -1);
+  assert_buffer (buffer, n);
+  gst_buffer_unref (buffer);
+}
+
+static void
+check_window (GstVQETimeshift * ts)
+{
+  GstClockTime start;
+  GstBuffer *held;
+  gssize offset;
+  guint n;
+
+  for (n = 0; n < 100; n++)
+    append (ts, n);
+  g_assert_cmpuint (ts->length, ==, 100);
+  g_assert_cmpuint (ts->bytes, ==, 100 * BUFFER_SIZE);
+  g_assert_cmpuint (gst_vqe_timeshift_start (ts), ==, TIME (0));
+  g_assert_cmpuint (gst_vqe_timeshift_end (ts), ==, TIME (99));
+
+  /* from the random access point before, and on to live */
+  g_assert_true (gst_vqe_timeshift_seek (ts, TIME (55) + 1, &start));
+  g_assert_cmpuint (start, ==, TIME (50));
+  g_assert_cmpuint (gst_vqe_timeshift_delay (ts), ==, TIME (49));
+  assert_next (ts, 50, TRUE);
+  for (n = 51; n < 100; n++)
+    assert_next (ts, n, FALSE);
+  g_assert_null (gst_vqe_timeshift_next (ts, &offset));
+  g_assert_cmpuint (gst_vqe_timeshift_delay (ts), ==, 0);
+
+  /* nothing newer than live */
+  g_assert_false (gst_vqe_timeshift_seek (ts, TIME (100), &start));
+
+  /* playing back right behind live, and the buffer played back outliving
+     its place in the window */
+  g_assert_true (gst_vqe_timeshift_seek (ts, TIME (99), &start));
+  g_assert_cmpuint (start, ==, TIME (90));
+  for (n = 90; n < 99; n++)
+    assert_next (ts, n, n == 90);
+  append (ts, 100);
+  assert_next (ts, 99, FALSE);
+  held = gst_vqe_timeshift_next (ts, &offset);
+  g_assert_nonnull (held);
+
+  /* the oldest go once the window is longer than its duration, and
+     playback which falls out of it jumps to the oldest random access
+     point left */
+  g_assert_true (gst_vqe_timeshift_seek (ts, TIME (0), &start));
+  g_assert_cmpuint (start, ==, TIME (0));
+  assert_next (ts, 0, TRUE);
+  for (n = 101; n < 215; n++)
+    append (ts, n);
+  g_assert_cmpuint (gst_vqe_timeshift_start (ts), ==, TIME (114));
+  g_assert_cmpuint (ts->length, ==, 101);
+  assert_next (ts, 120, TRUE);
+  assert_next (ts, 121, FALSE);
+
+  gst_buffer_unref (held);
+}
+
+static void
+test_memory (void)
+{
+  GstVQETimeshift ts;
+
+  gst_vqe_timeshift_init (&ts, 10 * GST_SECOND, 1024 * 1024);
+  check_window (&ts);
+  gst_vqe_timeshift_free (&ts);
+}
+
+/* Oldest first once it holds more than its bytes, but always the newest */
+static void
+test_max_bytes (void)
+{
+  GstVQETimeshift ts;
+  GstClockTime start;
+  guint n;
+
+  gst_vqe_timeshift_init (&ts, 10 * GST_SECOND, 25 * BUFFER_SIZE);
+  for (n = 0; n < 50; n++)
+    append (&ts, n);
+  g_assert_cmpuint (ts.length, ==, 25);
+  g_assert_cmpuint (ts.bytes, ==, 25 * BUFFER_SIZE);
+  g_assert_cmpuint (gst_vqe_timeshift_start (&ts), ==, TIME (25));
+  g_assert_true (gst_vqe_timeshift_seek (&ts, TIME (0), &start));
+  g_assert_cmpuint (start, ==, TIME (30));
+
+  gst_vqe_timeshift_clear (&ts);
+  g_assert_cmpuint (ts.length, ==, 0);
+  g_assert_false (gst_vqe_timeshift_seek (&ts, TIME (0), &start));
+  gst_vqe_timeshift_init (&ts, 10 * GST_SECOND, BUFFER_SIZE / 2);
+  append (&ts, 0);
+  append (&ts, 1);
+  g_assert_cmpuint (ts.length, ==, 1);
+
+  gst_vqe_timeshift_free (&ts);
+}
+
+static void
+test_files (void)
+{
+  GstVQETimeshift ts;
+  GError *error = NULL;
+  GstClockTime start;
+  GstBuffer *held;
+  gssize offset;
+  gchar *location;
+  GDir *dir;
+  guint n;
+
+  location = g_dir_make_tmp ("vqe-check-timeshift-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  gst_vqe_timeshift_init (&ts, 10 * GST_SECOND, 1024 * 1024);
+  g_assert_false (gst_vqe_timeshift_use_files (&ts, "/nonexistent", NULL));
+  g_assert_true (gst_vqe_timeshift_use_files (&ts, location, &error));
+  g_assert_no_error (error);
+  check_window (&ts);
+  gst_vqe_timeshift_free (&ts);
+
+  /* a buffer played back from the stage outlives the stage being written
+     out and filled again */
+  gst_vqe_timeshift_init (&ts, 1000 * GST_SECOND, 16 * 1024 * 1024);
+  g_assert_true (gst_vqe_timeshift_use_files (&ts, location, &error));
+  append (&ts, 0);
+  g_assert_true (gst_vqe_timeshift_seek (&ts, TIME (0), &start));
+  held = gst_vqe_timeshift_next (&ts, &offset);
+  g_assert_nonnull (held);
+  for (n = 1; n < 3000; n++)
+    append (&ts, n);
+  assert_buffer (held, 0);
+  gst_buffer_unref (held);
+  g_assert_true (gst_vqe_timeshift_seek (&ts, TIME (0), &start));
+  for (n = 0; n < 3000; n++)
+    assert_next (&ts, n, n == 0);
+  gst_vqe_timeshift_free (&ts);
+
+  /* the segment files go with the window */
+  dir = g_dir_open (location, 0, &error);
+  g_assert_no_error (error);
+  g_assert_null (g_dir_read_name (dir));
+  g_dir_close (dir);
+  g_rmdir (location);
+  g_free (location);
+}
+
+/* Pausing carries on from where it left off, however much is appended
+   meanwhile, until that falls out of the window */
+static void
+test_hold (void)
+{
+  GstVQETimeshift ts;
+  gssize offset;
+  guint n;
+
+  gst_vqe_timeshift_init (&ts, 10 * GST_SECOND, 1024 * 1024);
+  for (n = 0; n < 10; n++)
+    append (&ts, n);
+  gst_vqe_timeshift_hold (&ts);
+  for (n = 10; n < 50; n++)
+    append (&ts, n);
+  g_assert_cmpuint (gst_vqe_timeshift_delay (&ts), ==, TIME (39));
+  for (n = 10; n < 50; n++)
+    assert_next (&ts, n, FALSE);
+  g_assert_null (gst_vqe_timeshift_next (&ts, &offset));
+
+  /* held for longer than the window, so from the oldest random access
+     point left */
+  gst_vqe_timeshift_hold (&ts);
+  for (n = 50; n < 200; n++)
+    append (&ts, n);
+  assert_next (&ts, 100, TRUE);
+  assert_next (&ts, 101, FALSE);
+
+  /* already behind live, so it stays where it is */
+  gst_vqe_timeshift_hold (&ts);
+  append (&ts, 200);
+  assert_next (&ts, 102, FALSE);
+
+  gst_vqe_timeshift_free (&ts);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/timeshift/memory", test_memory);
+  g_test_add_func ("/timeshift/max-bytes", test_max_bytes);
+  g_test_add_func ("/timeshift/files", test_files);
+  g_test_add_func ("/timeshift/hold", test_hold);
+
+  return g_test_run ();
+}
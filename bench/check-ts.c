@@ -0,0 +1,199 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * make check: finds its way round a synthetic stream with gstvqets, the way
+ * vqesrc does round the post-repair stream.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqesynth.h"
+#include "gstvqets.h"
+
+#include <string.h>
+
+#define PKT(data, i) ((data) + (i) * GST_VQE_TS_PACKET_SIZE)
+
+/* A datagram at a random access point is PAT, PMT, then video with a PCR
+   and the random access indicator set */
+static void
+test_rap (void)
+{
+  GstVQESynthStream stream;
+  GstVQETSScanner scanner;
+  guint8 data[GST_VQE_SYNTH_DATAGRAM_SIZE];
+  guint64 pcr;
+
+  gst_vqe_synth_stream_init (&stream, 1, 4000000, 1000, 1000);
+  gst_vqe_ts_scanner_reset (&scanner);
+  g_assert_cmpuint (scanner.pmt_pid, ==, GST_VQE_TS_PID_INVALID);
+  g_assert_false (scanner.have_pat);
+
+  g_assert_cmpuint (gst_vqe_synth_stream_next (&stream, data, FALSE), ==,
+      GST_VQE_SYNTH_DATAGRAM_SIZE);
+
+  /* video before the PMT means nothing */
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 2)),
+      ==, 0);
+
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 0)),
+      ==, GST_VQE_TS_PACKET_PAT);
+  g_assert_true (scanner.have_pat);
+  g_assert_cmpuint (scanner.pmt_pid, ==, GST_VQE_SYNTH_PID_PMT);
+
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 1)),
+      ==, GST_VQE_TS_PACKET_PMT);
+  g_assert_true (scanner.have_pmt);
+  g_assert_cmpuint (scanner.video_pid, ==, GST_VQE_SYNTH_PID_VIDEO);
+  g_assert_cmpuint (scanner.pcr_pid, ==, GST_VQE_SYNTH_PID_VIDEO);
+  g_assert_cmpuint (scanner.video_stream_type, ==, 0x1b);
+
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 2)),
+      ==, GST_VQE_TS_PACKET_RAP | GST_VQE_TS_PACKET_PCR);
+  g_assert_true (gst_vqe_ts_packet_get_pcr (PKT (data, 2), &pcr));
+  g_assert_cmpuint (pcr, ==, 1000 * 27);
+
+  /* the rest of the video and the probe are nothing special */
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 3)),
+      ==, 0);
+  g_assert_false (gst_vqe_ts_packet_get_pcr (PKT (data, 3), &pcr));
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 6)),
+      ==, 0);
+}
+
+/* Between random access points there's only a PCR, and repeated PSI is
+   recognised as the same */
+static void
+test_pcr (void)
+{
+  GstVQESynthStream stream;
+  GstVQETSScanner scanner;
+  guint8 rap[GST_VQE_SYNTH_DATAGRAM_SIZE];
+  guint8 data[GST_VQE_SYNTH_DATAGRAM_SIZE];
+  guint8 pat[GST_VQE_TS_PACKET_SIZE];
+  guint64 pcr, last_pcr = 0;
+  guint i, j, raps = 0;
+
+  /* a RAP every 4 datagrams */
+  gst_vqe_synth_stream_init (&stream, 1, 8 * GST_VQE_SYNTH_DATAGRAM_SIZE * 4,
+      1000, 0);
+  g_assert_cmpuint (stream.rap_interval, ==, 4);
+  gst_vqe_ts_scanner_reset (&scanner);
+
+  gst_vqe_synth_stream_next (&stream, rap, FALSE);
+  for (j = 0; j < GST_VQE_SYNTH_TS_PER_DATAGRAM; j++)
+    gst_vqe_ts_scanner_scan_packet (&scanner, PKT (rap, j));
+  memcpy (pat, scanner.pat, sizeof (pat));
+  g_assert_true (gst_vqe_ts_psi_equal (pat, PKT (rap, 0)));
+
+  for (i = 1; i < 12; i++) {
+    GstVQETSPacketFlags flags = 0;
+
+    gst_vqe_synth_stream_next (&stream, data, FALSE);
+    for (j = 0; j < GST_VQE_SYNTH_TS_PER_DATAGRAM; j++)
+      flags |= gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, j));
+
+    g_assert_true (flags & GST_VQE_TS_PACKET_PCR);
+    if (flags & GST_VQE_TS_PACKET_RAP) {
+      g_assert_cmpuint (i % 4, ==, 0);
+      g_assert_true (flags & GST_VQE_TS_PACKET_PAT);
+      /* the continuity counter differs but the table doesn't */
+      g_assert_true (gst_vqe_ts_psi_equal (pat, PKT (data, 0)));
+      raps++;
+    } else {
+      g_assert_cmpuint (flags, ==, GST_VQE_TS_PACKET_PCR);
+      g_assert_true (gst_vqe_ts_packet_get_pcr (PKT (data, 0), &pcr));
+      g_assert_cmpuint (pcr, >, last_pcr);
+      last_pcr = pcr;
+    }
+  }
+  g_assert_cmpuint (raps, ==, 2);
+}
+
+/* A PAT section too long for one packet can't be used */
+static void
+test_psi_split (void)
+{
+  GstVQESynthStream stream;
+  GstVQETSScanner scanner;
+  guint8 data[GST_VQE_SYNTH_DATAGRAM_SIZE];
+
+  gst_vqe_synth_stream_init (&stream, 1, 4000000, 1000, 0);
+  gst_vqe_synth_stream_next (&stream, data, FALSE);
+  gst_vqe_ts_scanner_reset (&scanner);
+
+  /* section_length past the end of the packet */
+  data[6] = 0xb0 | 0x01;
+  data[7] = 0xff;
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, PKT (data, 0)),
+      ==, GST_VQE_TS_PACKET_PSI_SPLIT);
+  g_assert_false (scanner.have_pat);
+  g_assert_cmpuint (scanner.pmt_pid, ==, GST_VQE_TS_PID_INVALID);
+}
+
+/* Flagging a discontinuity in a PAT makes room for an adaptation field
+   without changing the table */
+static void
+test_discontinuity (void)
+{
+  GstVQESynthStream stream;
+  GstVQETSScanner scanner;
+  guint8 data[GST_VQE_SYNTH_DATAGRAM_SIZE];
+  guint8 pat[GST_VQE_TS_PACKET_SIZE];
+
+  gst_vqe_synth_stream_init (&stream, 1, 4000000, 1000, 0);
+  gst_vqe_synth_stream_next (&stream, data, FALSE);
+  memcpy (pat, PKT (data, 0), sizeof (pat));
+  g_assert_false (pat[3] & 0x20);
+
+  g_assert_true (gst_vqe_ts_packet_set_discontinuity (pat));
+  g_assert_true (pat[3] & 0x20);
+  g_assert_cmpuint (pat[4], ==, 1);
+  g_assert_cmpuint (pat[5], ==, 0x80);
+  g_assert_true (gst_vqe_ts_psi_equal (pat, PKT (data, 0)));
+
+  gst_vqe_ts_scanner_reset (&scanner);
+  g_assert_cmpuint (gst_vqe_ts_scanner_scan_packet (&scanner, pat), ==,
+      GST_VQE_TS_PACKET_PAT);
+  g_assert_cmpuint (scanner.pmt_pid, ==, GST_VQE_SYNTH_PID_PMT);
+
+  /* the video packet already has one */
+  g_assert_true (gst_vqe_ts_packet_set_discontinuity (PKT (data, 2)));
+  g_assert_true (PKT (data, 2)[5] & 0x80);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/ts/rap", test_rap);
+  g_test_add_func ("/ts/pcr", test_pcr);
+  g_test_add_func ("/ts/psi-split", test_psi_split);
+  g_test_add_func ("/ts/discontinuity", test_discontinuity);
+
+  return g_test_run ();
+}
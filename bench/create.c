@@ -0,0 +1,266 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * vqe-bench-create: measures what vqesrc's create() costs per datagram, with
+ * no network or VQE-C involved.  The source runs against the fake backend
+ * (GSTVQE_BACKEND=fake), unpaced so that it is only ever waiting on itself,
+ * for a fixed number of buffers into a fakesink, and the result is reported
+ * as JSON: wall and CPU nanoseconds per datagram and buffer pool allocations
+ * per buffer.  Timing starts with the first buffer so tuning isn't counted.
+ * Given thresholds it also fails when they are exceeded, which is how
+ * `make check` runs it.
+ *
+ *   vqe-bench-create -n 200000
+ *   vqe-bench-create -n 200000 --vqesrc "buffer-size=65536" -L big-buffers
+ *   vqe-bench-create -n 20000 --max-ns-per-datagram 5000
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqesynth.h"
+
+#include <gst/gst.h>
+
+#include <sys/resource.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  /* updated from the streaming thread */
+  guint64 buffers;
+  guint64 bytes;
+  gint64 first;                 /* 0 until the first buffer */
+  gdouble first_cpu;
+  gint64 last;
+  gdouble last_cpu;
+} BenchCreate;
+
+static gdouble
+cpu_seconds (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static GstPadProbeReturn
+bench_probe (GstPad * pad, GstPadProbeInfo * info, BenchCreate * b)
+{
+  gint64 now = g_get_monotonic_time ();
+  gdouble cpu = cpu_seconds ();
+
+  /* the first buffer only starts the clock */
+  if (!b->first) {
+    b->first = now;
+    b->first_cpu = cpu;
+    return GST_PAD_PROBE_OK;
+  }
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    b->buffers++;
+    b->bytes += gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+  } else {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i;
+
+    b->buffers += gst_buffer_list_length (list);
+    for (i = 0; i < gst_buffer_list_length (list); i++)
+      b->bytes += gst_buffer_get_size (gst_buffer_list_get (list, i));
+  }
+  b->last = now;
+  b->last_cpu = cpu;
+  return GST_PAD_PROBE_OK;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint n_buffers = 100000;
+  guint64 bitrate = 4000000;
+  gchar *fake = NULL;
+  gchar *label = NULL;
+  gchar *output = NULL;
+  gchar *src_args = NULL;
+  gdouble max_ns = 0;
+  gdouble max_allocations = -1;
+  GOptionEntry entries[] = {
+    {"num-buffers", 'n', 0, G_OPTION_ARG_INT, &n_buffers,
+        "Buffers to run for", "N"},
+    {"bitrate", 'b', 0, G_OPTION_ARG_INT64, &bitrate,
+        "Bits per second the SDP advertises, which sizes vqesrc's buffers",
+        "BPS"},
+    {"fake", 0, 0, G_OPTION_ARG_STRING, &fake,
+        "Extra fake backend options, e.g. \"loss=uniform:0.01\"", "OPTS"},
+    {"vqesrc", 0, 0, G_OPTION_ARG_STRING, &src_args,
+        "Extra vqesrc properties, e.g. \"buffer-size=65536\"", "PROPS"},
+    {"label", 'L', 0, G_OPTION_ARG_STRING, &label,
+        "Identifies the build in the results", "TEXT"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write results here rather than to stdout", "FILE"},
+    {"max-ns-per-datagram", 0, 0, G_OPTION_ARG_DOUBLE, &max_ns,
+        "Fail if a datagram takes longer than this on average", "NS"},
+    {"max-allocations-per-buffer", 0, 0, G_OPTION_ARG_DOUBLE,
+          &max_allocations,
+        "Fail if the buffer pool allocates more often than this", "N"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  GstElement *pipeline, *src, *sink;
+  GstMessage *message;
+  GstBus *bus;
+  GstPad *pad;
+  BenchCreate b = { 0 };
+  gchar *desc, *sdp, *fake_opts;
+  guint allocations = 0, fallbacks = 0;
+  guint64 datagrams;
+  gdouble elapsed, cpu;
+  GString *json;
+  gint exit_code = 0;
+
+  ctx = g_option_context_new ("- benchmark vqesrc's create()");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (n_buffers < 2) {
+    fprintf (stderr, "Need at least two buffers\n");
+    return 1;
+  }
+
+  /* vqesrc picks its backend when its class is first used, which is after
+     this however the plugin is loaded */
+  g_setenv ("GSTVQE_BACKEND", "fake", TRUE);
+  fake_opts = g_strdup_printf ("paced=0,bitrate=%" G_GUINT64_FORMAT "%s%s",
+      bitrate, fake ? "," : "", fake ? fake : "");
+  g_setenv ("GSTVQE_FAKE", fake_opts, TRUE);
+  g_free (fake_opts);
+
+  desc = g_strdup_printf ("vqesrc name=src num-buffers=%d %s ! "
+      "fakesink name=sink sync=false", n_buffers, src_args ? src_args : "");
+  pipeline = gst_parse_launch (desc, &error);
+  g_free (desc);
+  if (!pipeline) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  sdp = gst_vqe_synth_sdp (0, "239.255.0.1", 50000, "127.0.0.1", bitrate);
+  g_object_set (src, "sdp", sdp, NULL);
+  g_free (sdp);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_BUFFER_LIST, (GstPadProbeCallback) bench_probe, &b,
+      NULL);
+  gst_object_unref (pad);
+  gst_object_unref (sink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  bus = gst_element_get_bus (pipeline);
+  message = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (message, &error, NULL);
+    fprintf (stderr, "Error from %s: %s\n", GST_OBJECT_NAME (message->src),
+        error->message);
+    g_error_free (error);
+    exit_code = 1;
+  }
+  gst_message_unref (message);
+  gst_object_unref (bus);
+
+  /* before stopping, which may reset the pool */
+  g_object_get (src, "pool-allocations", &allocations,
+      "allocator-fallbacks", &fallbacks, NULL);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (src);
+  gst_object_unref (pipeline);
+
+  elapsed = (b.last - b.first) * 1e3;
+  cpu = (b.last_cpu - b.first_cpu) * 1e9;
+  datagrams = b.bytes / GST_VQE_SYNTH_DATAGRAM_SIZE;
+
+  json = g_string_new ("{\n");
+  g_string_append_printf (json, "  \"label\": \"%s\",\n", label ? label : "");
+  g_string_append_printf (json, "  \"buffers\": %" G_GUINT64_FORMAT ",\n",
+      b.buffers);
+  g_string_append_printf (json, "  \"datagrams\": %" G_GUINT64_FORMAT ",\n",
+      datagrams);
+  g_string_append_printf (json, "  \"datagrams_per_buffer\": %.2f,\n",
+      b.buffers ? (gdouble) datagrams / b.buffers : 0);
+  g_string_append_printf (json, "  \"ns_per_datagram\": %.1f,\n",
+      datagrams ? elapsed / datagrams : 0);
+  g_string_append_printf (json, "  \"cpu_ns_per_datagram\": %.1f,\n",
+      datagrams ? cpu / datagrams : 0);
+  g_string_append_printf (json, "  \"pool_allocations\": %u,\n",
+      allocations);
+  g_string_append_printf (json, "  \"allocator_fallbacks\": %u,\n",
+      fallbacks);
+  g_string_append_printf (json, "  \"allocations_per_buffer\": %.4f\n}\n",
+      (gdouble) allocations / n_buffers);
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &error)) {
+      fprintf (stderr, "%s\n", error->message);
+      exit_code = 1;
+    }
+  } else {
+    fputs (json->str, stdout);
+  }
+
+  /* with too few datagrams the figures below mean nothing */
+  if (!exit_code && (max_ns > 0 || max_allocations >= 0)) {
+    if (datagrams < (guint64) n_buffers / 2) {
+      fprintf (stderr, "Only %" G_GUINT64_FORMAT " datagrams arrived\n",
+          datagrams);
+      exit_code = 1;
+    }
+    if (max_ns > 0 && datagrams && elapsed / datagrams > max_ns) {
+      fprintf (stderr, "%.1f ns per datagram, more than %.1f\n",
+          elapsed / datagrams, max_ns);
+      exit_code = 1;
+    }
+    if (max_allocations >= 0 &&
+        (gdouble) allocations / n_buffers > max_allocations) {
+      fprintf (stderr, "%.4f pool allocations per buffer, more than %.4f\n",
+          (gdouble) allocations / n_buffers, max_allocations);
+      exit_code = 1;
+    }
+  }
+
+  g_string_free (json, TRUE);
+  g_free (fake);
+  g_free (label);
+  g_free (output);
+  g_free (src_args);
+  return exit_code;
+}
@@ -0,0 +1,327 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * vqe-bench-harness: runs any number of vqesrc ! fakesink pipelines in one
+ * process against the channels of vqe-bench-sender and reports, as JSON,
+ * what they cost and how well they did: CPU per Mbit/s received, pushes per
+ * second, end to end latency percentiles and datagrams lost after repair.
+ * The output of two builds can be diffed directly.
+ *
+ *   vqe-bench-harness -n 8 -t 30 /tmp/channels/channel-*.sdp
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqesynth.h"
+#include "gstvqehistogram.h"
+
+#include <gst/gst.h>
+
+#include <sys/resource.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  GstElement *pipeline;
+  GstElement *src;
+
+  /* updated from the streaming thread */
+  GMutex lock;
+  guint64 buffers;
+  guint64 bytes;
+  GstVQEHistogram latency;      /* microseconds */
+  guint64 lost;
+  gboolean have_seq;
+  guint32 last_seq;
+} BenchPipeline;
+
+static const gchar *vqesrc_counters[] = {
+  "primary-rtp-drops", "primary-rtp-drops-late", "repair-rtp-drops-late",
+  "tuner-queue-drops", "underruns", "pre-repair-losses", "post-repair-losses",
+  NULL
+};
+
+static GMainLoop *loop;
+static gint exit_code = 0;
+
+static void
+bench_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    BenchPipeline * p)
+{
+  gint64 now = g_get_monotonic_time ();
+  GstMapInfo info;
+  gsize i;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ))
+    return;
+
+  g_mutex_lock (&p->lock);
+  p->buffers++;
+  p->bytes += info.size;
+  for (i = 0; i + 188 <= info.size; i += 188) {
+    GstVQESynthProbe probe;
+
+    if (!gst_vqe_synth_probe_parse (&info.data[i], &probe))
+      continue;
+    gst_vqe_histogram_add (&p->latency, MAX (now - probe.time, 0));
+    if (p->have_seq && probe.seq > p->last_seq + 1)
+      p->lost += probe.seq - p->last_seq - 1;
+    p->have_seq = TRUE;
+    p->last_seq = probe.seq;
+  }
+  g_mutex_unlock (&p->lock);
+
+  gst_buffer_unmap (buffer, &info);
+}
+
+static gboolean
+bench_bus_message (GstBus * bus, GstMessage * message, gpointer data)
+{
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR) {
+    GError *error = NULL;
+
+    gst_message_parse_error (message, &error, NULL);
+    fprintf (stderr, "Error from %s: %s\n", GST_OBJECT_NAME (message->src),
+        error->message);
+    g_error_free (error);
+    exit_code = 1;
+    g_main_loop_quit (loop);
+  }
+  return TRUE;
+}
+
+/* Start counting from here, so warm-up doesn't count */
+static void
+bench_reset (BenchPipeline * p)
+{
+  g_mutex_lock (&p->lock);
+  p->buffers = p->bytes = p->lost = 0;
+  gst_vqe_histogram_reset (&p->latency);
+  g_mutex_unlock (&p->lock);
+}
+
+static gboolean
+bench_quit (gpointer data)
+{
+  g_main_loop_quit (loop);
+  return FALSE;
+}
+
+static gdouble
+cpu_seconds (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint n_pipelines = 0;
+  gint duration = 10;
+  gint warmup = 2;
+  gchar *cfg = NULL;
+  gchar *label = NULL;
+  gchar *output = NULL;
+  gchar *src_args = NULL;
+  gchar **sdp_files = NULL;
+  GOptionEntry entries[] = {
+    {"pipelines", 'n', 0, G_OPTION_ARG_INT, &n_pipelines,
+        "Number of pipelines, each tuned to the next channel in turn "
+          "(default one per SDP)", "N"},
+    {"duration", 't', 0, G_OPTION_ARG_INT, &duration,
+        "Seconds to measure for", "S"},
+    {"warmup", 'w', 0, G_OPTION_ARG_INT, &warmup,
+        "Seconds to run before measuring", "S"},
+    {"cfg", 'c', 0, G_OPTION_ARG_FILENAME, &cfg,
+        "VQE-C channel configuration for vqesrc's cfg property", "FILE"},
+    {"vqesrc", 0, 0, G_OPTION_ARG_STRING, &src_args,
+        "Extra vqesrc properties, e.g. \"buffer-duration=20000000\"",
+        "PROPS"},
+    {"label", 'L', 0, G_OPTION_ARG_STRING, &label,
+        "Identifies the build in the results", "TEXT"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write results here rather than to stdout", "FILE"},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &sdp_files,
+        NULL, "SDP..."},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  BenchPipeline *pipelines;
+  GstVQEHistogram latency;
+  guint64 buffers = 0, bytes = 0, lost = 0;
+  guint64 counters[G_N_ELEMENTS (vqesrc_counters)] = { 0 };
+  gdouble cpu, elapsed, mbps;
+  gint64 start;
+  GString *json;
+  guint n_sdps;
+  gint i, j;
+
+  ctx = g_option_context_new ("- benchmark vqesrc pipelines");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (!sdp_files || !(n_sdps = g_strv_length (sdp_files))) {
+    fprintf (stderr, "No SDP files given\n");
+    return 1;
+  }
+  if (n_pipelines <= 0)
+    n_pipelines = n_sdps;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipelines = g_new0 (BenchPipeline, n_pipelines);
+  for (i = 0; i < n_pipelines; i++) {
+    BenchPipeline *p = &pipelines[i];
+    gchar *sdp, *desc;
+    GstElement *sink;
+    GstBus *bus;
+
+    if (!g_file_get_contents (sdp_files[i % n_sdps], &sdp, NULL, &error)) {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+    desc = g_strdup_printf ("vqesrc name=src %s ! fakesink name=sink "
+        "sync=false signal-handoffs=true", src_args ? src_args : "");
+    p->pipeline = gst_parse_launch (desc, &error);
+    g_free (desc);
+    if (!p->pipeline) {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+    p->src = gst_bin_get_by_name (GST_BIN (p->pipeline), "src");
+    g_object_set (p->src, "sdp", sdp, NULL);
+    if (cfg)
+      g_object_set (p->src, "cfg", cfg, NULL);
+    g_free (sdp);
+
+    g_mutex_init (&p->lock);
+    sink = gst_bin_get_by_name (GST_BIN (p->pipeline), "sink");
+    g_signal_connect (sink, "handoff", G_CALLBACK (bench_handoff), p);
+    gst_object_unref (sink);
+
+    bus = gst_element_get_bus (p->pipeline);
+    gst_bus_add_watch (bus, bench_bus_message, NULL);
+    gst_object_unref (bus);
+
+    gst_element_set_state (p->pipeline, GST_STATE_PLAYING);
+  }
+
+  g_timeout_add_seconds (warmup, bench_quit, NULL);
+  g_main_loop_run (loop);
+
+  for (i = 0; i < n_pipelines; i++)
+    bench_reset (&pipelines[i]);
+  start = g_get_monotonic_time ();
+  cpu = cpu_seconds ();
+
+  if (!exit_code) {
+    g_timeout_add_seconds (duration, bench_quit, NULL);
+    g_main_loop_run (loop);
+  }
+
+  cpu = cpu_seconds () - cpu;
+  elapsed = (g_get_monotonic_time () - start) / 1e6;
+
+  gst_vqe_histogram_reset (&latency);
+  for (i = 0; i < n_pipelines; i++) {
+    BenchPipeline *p = &pipelines[i];
+
+    g_mutex_lock (&p->lock);
+    buffers += p->buffers;
+    bytes += p->bytes;
+    lost += p->lost;
+    gst_vqe_histogram_merge (&latency, &p->latency);
+    g_mutex_unlock (&p->lock);
+
+    /* VQE-C's counters for the whole run, warm-up included */
+    for (j = 0; vqesrc_counters[j]; j++) {
+      guint64 v = 0;
+
+      g_object_get (p->src, vqesrc_counters[j], &v, NULL);
+      counters[j] += v;
+    }
+
+    gst_element_set_state (p->pipeline, GST_STATE_NULL);
+    gst_object_unref (p->src);
+    gst_object_unref (p->pipeline);
+    g_mutex_clear (&p->lock);
+  }
+
+  mbps = bytes * 8 / 1e6 / elapsed;
+  json = g_string_new ("{\n");
+  g_string_append_printf (json, "  \"label\": \"%s\",\n", label ? label : "");
+  g_string_append_printf (json, "  \"pipelines\": %d,\n", n_pipelines);
+  g_string_append_printf (json, "  \"seconds\": %.3f,\n", elapsed);
+  g_string_append_printf (json, "  \"mbit_per_second\": %.3f,\n", mbps);
+  g_string_append_printf (json, "  \"cpu_seconds\": %.3f,\n", cpu);
+  g_string_append_printf (json, "  \"cpu_percent\": %.2f,\n",
+      100 * cpu / elapsed);
+  g_string_append_printf (json, "  \"cpu_percent_per_mbit\": %.4f,\n",
+      mbps > 0 ? 100 * cpu / elapsed / mbps : 0);
+  g_string_append_printf (json, "  \"pushes_per_second\": %.1f,\n",
+      buffers / elapsed);
+  g_string_append_printf (json, "  \"latency_us\": { \"count\": %"
+      G_GUINT64_FORMAT ", \"p50\": %" G_GUINT64_FORMAT ", \"p90\": %"
+      G_GUINT64_FORMAT ", \"p99\": %" G_GUINT64_FORMAT ", \"max\": %"
+      G_GUINT64_FORMAT " },\n", latency.count,
+      gst_vqe_histogram_percentile (&latency, 50),
+      gst_vqe_histogram_percentile (&latency, 90),
+      gst_vqe_histogram_percentile (&latency, 99), latency.max);
+  g_string_append_printf (json, "  \"datagrams_lost\": %" G_GUINT64_FORMAT
+      ",\n", lost);
+  g_string_append (json, "  \"vqesrc\": {");
+  for (j = 0; vqesrc_counters[j]; j++)
+    g_string_append_printf (json, "%s\n    \"%s\": %" G_GUINT64_FORMAT,
+        j ? "," : "", vqesrc_counters[j], counters[j]);
+  g_string_append (json, "\n  }\n}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &error)) {
+      fprintf (stderr, "%s\n", error->message);
+      exit_code = 1;
+    }
+  } else {
+    fputs (json->str, stdout);
+  }
+
+  g_string_free (json, TRUE);
+  g_free (pipelines);
+  g_main_loop_unref (loop);
+  g_strfreev (sdp_files);
+  g_free (cfg);
+  g_free (label);
+  g_free (output);
+  g_free (src_args);
+  return exit_code;
+}
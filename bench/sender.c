@@ -0,0 +1,368 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * vqe-bench-sender: multicasts synthetic MPEG-TS over RTP on any number of
+ * channels at a fixed bitrate, optionally losing some of it, and writes an
+ * SDP for each channel for vqesrc to tune to.  Everything stays on the
+ * loopback interface by default so benchmarks can run on a machine with no
+ * network.
+ *
+ * It also stands in for the retransmission server: generic NACKs sent to the
+ * RTCP port of the primary stream are answered with RFC 4588 retransmissions
+ * of the datagrams still in its history, lost or not, to the retransmission
+ * port of the SDP at the address the NACK came from.  Rapid channel change
+ * uses VQE's own RTCP extensions and isn't emulated, so RCC requests go
+ * unanswered and VQE-C falls back to joining the multicast.
+ *
+ *   vqe-bench-sender -n 8 -b 4000000 -l uniform:0.001 -d /tmp/channels
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqesynth.h"
+
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* datagrams kept for retransmission, a power of two */
+#define HISTORY 1024
+#define RTX_PT 96
+#define DATAGRAM_SIZE \
+  (GST_VQE_SYNTH_RTP_HEADER_SIZE + GST_VQE_SYNTH_DATAGRAM_SIZE)
+
+typedef struct {
+  GstVQESynthStream stream;
+  GstVQESynthLoss loss;
+  struct sockaddr_in dest;
+  guint64 sent;
+  guint64 dropped;
+
+  guint8 (*history)[DATAGRAM_SIZE];
+  guint16 rtx_seq;
+  guint64 nacked;
+  guint64 repaired;
+} BenchChannel;
+
+static volatile gint quit = 0;
+
+static void
+bench_quit (int sig)
+{
+  quit = 1;
+}
+
+static gboolean
+bench_write_sdp (const gchar * dir, guint channel, const gchar * group,
+    guint port, const gchar * source, guint64 bitrate)
+{
+  gchar *name = g_strdup_printf ("channel-%u.sdp", channel);
+  gchar *path = g_build_filename (dir, name, NULL);
+  gchar *sdp;
+  GError *error = NULL;
+  gboolean ok;
+
+  sdp = gst_vqe_synth_sdp (channel, group, port, source, bitrate);
+
+  ok = g_file_set_contents (path, sdp, -1, &error);
+  if (!ok) {
+    fprintf (stderr, "%s\n", error->message);
+    g_error_free (error);
+  }
+  g_free (sdp);
+  g_free (path);
+  g_free (name);
+  return ok;
+}
+
+static guint8 *
+bench_history (BenchChannel * c, guint16 seq)
+{
+  guint8 *data = c->history[seq & (HISTORY - 1)];
+
+  /* the slot may since have been reused, or never filled */
+  if (data[0] != 0x80 || data[2] != (seq >> 8) || data[3] != (seq & 0xff))
+    return NULL;
+  return data;
+}
+
+static void
+bench_retransmit (BenchChannel * c, gint sock, guint16 seq,
+    const struct sockaddr_in *to)
+{
+  guint8 rtx[DATAGRAM_SIZE + 2];
+  guint8 *orig = bench_history (c, seq);
+
+  c->nacked++;
+  if (!orig)
+    return;
+
+  /* RFC 4588: our own sequence numbers and SSRC, the original sequence
+     number at the start of the payload */
+  memcpy (rtx, orig, GST_VQE_SYNTH_RTP_HEADER_SIZE);
+  rtx[1] = RTX_PT;
+  rtx[2] = c->rtx_seq >> 8;
+  rtx[3] = c->rtx_seq & 0xff;
+  rtx[8] ^= 0x80;
+  rtx[12] = orig[2];
+  rtx[13] = orig[3];
+  memcpy (&rtx[14], &orig[GST_VQE_SYNTH_RTP_HEADER_SIZE],
+      GST_VQE_SYNTH_DATAGRAM_SIZE);
+  c->rtx_seq++;
+
+  if (sendto (sock, rtx, sizeof (rtx), 0, (struct sockaddr *) to,
+          sizeof (*to)) == sizeof (rtx))
+    c->repaired++;
+}
+
+/* Answers the generic NACKs (RTPFB, FMT 1) in a compound RTCP packet and
+   ignores everything else */
+static void
+bench_handle_rtcp (BenchChannel * channels, gint n_channels, gint sock,
+    gint rtx_port)
+{
+  guint8 buf[1500];
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof (from);
+  gssize size;
+  gsize off = 0;
+
+  size = recvfrom (sock, buf, sizeof (buf), MSG_DONTWAIT,
+      (struct sockaddr *) &from, &fromlen);
+  if (size <= 0)
+    return;
+  from.sin_port = htons (rtx_port);
+
+  while (off + 4 <= (gsize) size) {
+    gsize len = 4 * (((buf[off + 2] << 8) | buf[off + 3]) + 1);
+    guint32 media;
+    gsize fci;
+
+    if ((buf[off] >> 6) != 2 || off + len > (gsize) size)
+      break;
+    if (buf[off + 1] != 205 || (buf[off] & 0x1f) != 1 || len < 16)
+      goto next;
+
+    media = (buf[off + 8] << 24) | (buf[off + 9] << 16) |
+        (buf[off + 10] << 8) | buf[off + 11];
+    if ((media & 0xffff0000) != 0x56510000 ||
+        (media & 0xffff) >= (guint) n_channels)
+      goto next;
+
+    for (fci = off + 12; fci + 4 <= off + len; fci += 4) {
+      BenchChannel *c = &channels[media & 0xffff];
+      guint16 pid = (buf[fci] << 8) | buf[fci + 1];
+      guint16 blp = (buf[fci + 2] << 8) | buf[fci + 3];
+      gint bit;
+
+      bench_retransmit (c, sock, pid, &from);
+      for (bit = 0; bit < 16; bit++)
+        if (blp & (1 << bit))
+          bench_retransmit (c, sock, pid + bit + 1, &from);
+    }
+  next:
+    off += len;
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *group = NULL;
+  gchar *source = NULL;
+  gchar *loss = NULL;
+  gchar *sdp_dir = NULL;
+  gint port = 50000;
+  gint n_channels = 1;
+  gint64 bitrate = 4000000;
+  gint rap_interval = 500;
+  gint duration = 0;
+  gint seed = 1;
+  GOptionEntry entries[] = {
+    {"group", 'g', 0, G_OPTION_ARG_STRING, &group,
+        "Multicast group of the first channel, incremented for each of the "
+          "others (default 239.255.0.1)", "ADDR"},
+    {"port", 'p', 0, G_OPTION_ARG_INT, &port,
+        "RTP port; RTCP and retransmission use the next three", "PORT"},
+    {"source", 's', 0, G_OPTION_ARG_STRING, &source,
+        "Address of the interface to send from (default 127.0.0.1)", "ADDR"},
+    {"channels", 'n', 0, G_OPTION_ARG_INT, &n_channels,
+        "Number of channels", "N"},
+    {"bitrate", 'b', 0, G_OPTION_ARG_INT64, &bitrate,
+        "Bits per second of each channel", "BPS"},
+    {"rap-interval", 'r', 0, G_OPTION_ARG_INT, &rap_interval,
+        "Milliseconds between random access points", "MS"},
+    {"loss", 'l', 0, G_OPTION_ARG_STRING, &loss,
+        "Datagrams not to send: none, uniform:P, gilbert:P:R or periodic:N",
+        "PATTERN"},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &seed,
+        "Seed for the loss pattern of the first channel", "N"},
+    {"sdp-dir", 'd', 0, G_OPTION_ARG_FILENAME, &sdp_dir,
+        "Write channel-N.sdp for each channel to this directory", "DIR"},
+    {"duration", 't', 0, G_OPTION_ARG_INT, &duration,
+        "Seconds to run for, or until interrupted if 0", "S"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  BenchChannel *channels;
+  struct sockaddr_in addr;
+  struct pollfd pfd;
+  struct in_addr group_addr, source_addr;
+  struct sigaction sa;
+  guchar ttl = 1, loop = 1;
+  gint64 start, end;
+  gint sock, rtcp, i;
+
+  ctx = g_option_context_new ("- send synthetic RTP channels for benchmarks");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (!group)
+    group = g_strdup ("239.255.0.1");
+  if (!source)
+    source = g_strdup ("127.0.0.1");
+  if (n_channels < 1 || port < 1 || port > 65532 || bitrate <= 0 ||
+      !inet_aton (group, &group_addr) || !inet_aton (source, &source_addr)) {
+    fprintf (stderr, "Invalid arguments\n");
+    return 1;
+  }
+
+  sock = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr = source_addr;
+  if (sock < 0 || bind (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+      setsockopt (sock, IPPROTO_IP, IP_MULTICAST_IF, &source_addr,
+          sizeof (source_addr)) < 0 ||
+      setsockopt (sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof (ttl)) < 0
+      || setsockopt (sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+          sizeof (loop)) < 0) {
+    fprintf (stderr, "Failed to set up socket on %s: %s\n", source,
+        g_strerror (errno));
+    return 1;
+  }
+
+  /* repair requests for every channel come here */
+  rtcp = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  addr.sin_port = htons (port + 1);
+  if (rtcp < 0 || bind (rtcp, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+    fprintf (stderr, "Failed to listen for RTCP on %s:%d: %s\n", source,
+        port + 1, g_strerror (errno));
+    return 1;
+  }
+  pfd.fd = rtcp;
+  pfd.events = POLLIN;
+
+  start = g_get_monotonic_time ();
+  channels = g_new0 (BenchChannel, n_channels);
+  for (i = 0; i < n_channels; i++) {
+    BenchChannel *c = &channels[i];
+    gchar ip[INET_ADDRSTRLEN];
+
+    gst_vqe_synth_stream_init (&c->stream, i, bitrate, rap_interval, start);
+    if (!gst_vqe_synth_loss_parse (&c->loss, loss, seed + i)) {
+      fprintf (stderr, "Invalid loss pattern: %s\n", loss);
+      return 1;
+    }
+    c->dest.sin_family = AF_INET;
+    c->dest.sin_addr.s_addr = htonl (ntohl (group_addr.s_addr) + i);
+    c->dest.sin_port = htons (port);
+    c->history = g_malloc0 (HISTORY * DATAGRAM_SIZE);
+
+    inet_ntop (AF_INET, &c->dest.sin_addr, ip, sizeof (ip));
+    if (sdp_dir && !bench_write_sdp (sdp_dir, i, ip, port, source, bitrate))
+      return 1;
+  }
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = bench_quit;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+
+  end = duration > 0 ? start + (gint64) duration * G_USEC_PER_SEC : G_MAXINT64;
+  while (!quit) {
+    BenchChannel *next = &channels[0];
+    guint8 *data;
+    gint64 due, now;
+
+    /* all channels run at the same rate so this is round robin, but it
+       stays right if that ever changes */
+    for (i = 1; i < n_channels; i++)
+      if (gst_vqe_synth_stream_due (&channels[i].stream) <
+          gst_vqe_synth_stream_due (&next->stream))
+        next = &channels[i];
+
+    due = gst_vqe_synth_stream_due (&next->stream);
+    if (due >= end)
+      break;
+    /* answer repair requests until it's time to send */
+    while (!quit && (now = g_get_monotonic_time ()) < due) {
+      if (poll (&pfd, 1, (due - now + 999) / 1000) > 0)
+        bench_handle_rtcp (channels, n_channels, rtcp, port + 2);
+    }
+
+    /* kept whether or not the loss pattern lets it through, so that it can
+       be repaired */
+    data = next->history[next->stream.datagrams & (HISTORY - 1)];
+    gst_vqe_synth_stream_next (&next->stream, data, TRUE);
+    if (gst_vqe_synth_loss_drop (&next->loss)) {
+      next->dropped++;
+      continue;
+    }
+    if (sendto (sock, data, DATAGRAM_SIZE, 0,
+            (struct sockaddr *) &next->dest, sizeof (next->dest)) < 0 &&
+        errno != ENOBUFS && errno != EAGAIN)
+      g_warning ("sendto failed: %s", g_strerror (errno));
+    next->sent++;
+  }
+
+  for (i = 0; i < n_channels; i++)
+    fprintf (stderr, "channel %d: sent %" G_GUINT64_FORMAT " dropped %"
+        G_GUINT64_FORMAT " nacked %" G_GUINT64_FORMAT " repaired %"
+        G_GUINT64_FORMAT "\n", i, channels[i].sent, channels[i].dropped,
+        channels[i].nacked, channels[i].repaired);
+
+  for (i = 0; i < n_channels; i++)
+    g_free (channels[i].history);
+  close (rtcp);
+  close (sock);
+  g_free (channels);
+  g_free (group);
+  g_free (source);
+  g_free (loss);
+  g_free (sdp_dir);
+  return 0;
+}
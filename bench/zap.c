@@ -0,0 +1,302 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * vqe-bench-zap: zaps one pipeline round a list of channels, typically those
+ * of vqe-bench-sender, many times and reports, as JSON, the distributions of
+ * time to PLAYING, to the first byte out of the source and to the first
+ * random access point, all from the moment the zap was asked for.
+ *
+ *   vqe-bench-zap -z 200 --dwell 1000 /tmp/channels/channel-*.sdp
+ *   vqe-bench-zap --sdpdemux -z 200 /tmp/channels/channel-*.sdp
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqets.h"
+#include "gstvqehistogram.h"
+
+#include <gst/gst.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* give up on a zap which hasn't produced a random access point by now */
+#define ZAP_TIMEOUT (5 * G_USEC_PER_SEC)
+
+typedef struct {
+  GMutex lock;
+  GCond cond;
+  gint64 start;
+  gint64 first_byte;            /* 0 until seen */
+  gint64 first_rap;
+  GstVQETSScanner scanner;
+} BenchZap;
+
+static void
+bench_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    BenchZap * zap)
+{
+  gint64 now = g_get_monotonic_time ();
+  GstMapInfo info;
+  gsize i;
+
+  g_mutex_lock (&zap->lock);
+  if (zap->first_rap || !gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    g_mutex_unlock (&zap->lock);
+    return;
+  }
+
+  if (info.size > 0 && !zap->first_byte)
+    zap->first_byte = now;
+  for (i = 0; i + GST_VQE_TS_PACKET_SIZE <= info.size;
+      i += GST_VQE_TS_PACKET_SIZE) {
+    if (gst_vqe_ts_scanner_scan_packet (&zap->scanner, &info.data[i]) &
+        GST_VQE_TS_PACKET_RAP) {
+      zap->first_rap = now;
+      g_cond_signal (&zap->cond);
+      break;
+    }
+  }
+  gst_buffer_unmap (buffer, &info);
+  g_mutex_unlock (&zap->lock);
+}
+
+/* vqesdpdemux only adds its source pad once it has parsed the SDP, which
+   gst_parse_launch() links up the first time only, so in that mode each zap
+   gets a new pipeline as an application would. */
+static GstElement *
+bench_build_pipeline (gboolean sdpdemux, const gchar * cfg, BenchZap * zap,
+    GstElement ** tuner)
+{
+  GError *error = NULL;
+  GstElement *pipeline, *sink;
+
+  pipeline = gst_parse_launch (sdpdemux ?
+      "filesrc name=tuner ! vqesdpdemux ! fakesink name=sink sync=false "
+      "signal-handoffs=true" :
+      "vqesrc name=tuner ! fakesink name=sink sync=false signal-handoffs=true",
+      &error);
+  if (!pipeline) {
+    fprintf (stderr, "%s\n", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+  *tuner = gst_bin_get_by_name (GST_BIN (pipeline), "tuner");
+  if (cfg && !sdpdemux)
+    g_object_set (*tuner, "cfg", cfg, NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (bench_handoff), zap);
+  gst_object_unref (sink);
+  return pipeline;
+}
+
+static void
+bench_append_histogram (GString * json, const gchar * name,
+    GstVQEHistogram * hist, gboolean last)
+{
+  g_string_append_printf (json, "  \"%s\": { \"count\": %" G_GUINT64_FORMAT
+      ", \"mean\": %" G_GUINT64_FORMAT ", \"p50\": %" G_GUINT64_FORMAT
+      ", \"p90\": %" G_GUINT64_FORMAT ", \"p99\": %" G_GUINT64_FORMAT
+      ", \"max\": %" G_GUINT64_FORMAT " }%s\n", name, hist->count,
+      hist->count ? hist->sum / hist->count : 0,
+      gst_vqe_histogram_percentile (hist, 50),
+      gst_vqe_histogram_percentile (hist, 90),
+      gst_vqe_histogram_percentile (hist, 99), hist->max, last ? "" : ",");
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint n_zaps = 100;
+  gint dwell = 500;
+  gboolean sdpdemux = FALSE;
+  gchar *cfg = NULL;
+  gchar *label = NULL;
+  gchar *output = NULL;
+  gchar **sdp_files = NULL;
+  GOptionEntry entries[] = {
+    {"zaps", 'z', 0, G_OPTION_ARG_INT, &n_zaps,
+        "Number of channel changes", "N"},
+    {"dwell", 'd', 0, G_OPTION_ARG_INT, &dwell,
+        "Milliseconds to stay on each channel once it has a random access "
+          "point", "MS"},
+    {"sdpdemux", 0, 0, G_OPTION_ARG_NONE, &sdpdemux,
+        "Tune with filesrc ! vqesdpdemux rather than vqesrc directly", NULL},
+    {"cfg", 'c', 0, G_OPTION_ARG_FILENAME, &cfg,
+        "VQE-C channel configuration for vqesrc's cfg property", "FILE"},
+    {"label", 'L', 0, G_OPTION_ARG_STRING, &label,
+        "Identifies the build in the results", "TEXT"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write results here rather than to stdout", "FILE"},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &sdp_files,
+        NULL, "SDP..."},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  GstElement *pipeline = NULL, *tuner = NULL;
+  GstVQEHistogram to_playing, to_first_byte, to_first_rap;
+  BenchZap zap;
+  guint n_sdps, failures = 0;
+  gchar **sdps;
+  GString *json;
+  gint i, exit_code = 0;
+
+  ctx = g_option_context_new ("- benchmark channel changes");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (!sdp_files || !(n_sdps = g_strv_length (sdp_files))) {
+    fprintf (stderr, "No SDP files given\n");
+    return 1;
+  }
+
+  sdps = g_new0 (gchar *, n_sdps + 1);
+  for (i = 0; i < (gint) n_sdps; i++) {
+    if (!g_file_get_contents (sdp_files[i], &sdps[i], NULL, &error)) {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  }
+
+  memset (&zap, 0, sizeof (zap));
+  g_mutex_init (&zap.lock);
+  g_cond_init (&zap.cond);
+
+  gst_vqe_histogram_reset (&to_playing);
+  gst_vqe_histogram_reset (&to_first_byte);
+  gst_vqe_histogram_reset (&to_first_rap);
+
+  for (i = 0; i < n_zaps; i++) {
+    GstMessage *msg;
+    GstBus *bus;
+    gint64 playing, deadline;
+
+    if (sdpdemux && pipeline) {
+      gst_element_set_state (pipeline, GST_STATE_NULL);
+      gst_object_unref (tuner);
+      gst_object_unref (pipeline);
+      pipeline = NULL;
+    }
+    if (!pipeline) {
+      pipeline = bench_build_pipeline (sdpdemux, cfg, &zap, &tuner);
+      if (!pipeline) {
+        exit_code = 1;
+        break;
+      }
+    }
+
+    gst_element_set_state (pipeline, GST_STATE_READY);
+    gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+    if (sdpdemux)
+      g_object_set (tuner, "location", sdp_files[i % n_sdps], NULL);
+    else
+      g_object_set (tuner, "sdp", sdps[i % n_sdps], NULL);
+
+    g_mutex_lock (&zap.lock);
+    gst_vqe_ts_scanner_reset (&zap.scanner);
+    zap.first_byte = zap.first_rap = 0;
+    zap.start = g_get_monotonic_time ();
+    g_mutex_unlock (&zap.lock);
+
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+    gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+    playing = g_get_monotonic_time ();
+
+    g_mutex_lock (&zap.lock);
+    deadline = zap.start + ZAP_TIMEOUT;
+    while (!zap.first_rap) {
+      if (!g_cond_wait_until (&zap.cond, &zap.lock, deadline))
+        break;
+    }
+    gst_vqe_histogram_add (&to_playing, playing - zap.start);
+    if (zap.first_byte)
+      gst_vqe_histogram_add (&to_first_byte, zap.first_byte - zap.start);
+    if (zap.first_rap)
+      gst_vqe_histogram_add (&to_first_rap, zap.first_rap - zap.start);
+    else
+      failures++;
+    g_mutex_unlock (&zap.lock);
+
+    bus = gst_element_get_bus (pipeline);
+    msg = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+    gst_bus_set_flushing (bus, TRUE);
+    gst_bus_set_flushing (bus, FALSE);
+    gst_object_unref (bus);
+    if (msg) {
+      gst_message_parse_error (msg, &error, NULL);
+      fprintf (stderr, "Error from %s: %s\n", GST_OBJECT_NAME (msg->src),
+          error->message);
+      g_error_free (error);
+      gst_message_unref (msg);
+      exit_code = 1;
+      break;
+    }
+
+    g_usleep ((gulong) dwell * 1000);
+  }
+
+  if (pipeline) {
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (tuner);
+    gst_object_unref (pipeline);
+  }
+
+  json = g_string_new ("{\n");
+  g_string_append_printf (json, "  \"label\": \"%s\",\n", label ? label : "");
+  g_string_append_printf (json, "  \"mode\": \"%s\",\n",
+      sdpdemux ? "vqesdpdemux" : "vqesrc");
+  g_string_append_printf (json, "  \"zaps\": %d,\n", i);
+  g_string_append_printf (json, "  \"timeouts\": %u,\n", failures);
+  bench_append_histogram (json, "to_playing_us", &to_playing, FALSE);
+  bench_append_histogram (json, "to_first_byte_us", &to_first_byte, FALSE);
+  bench_append_histogram (json, "to_first_rap_us", &to_first_rap, TRUE);
+  g_string_append (json, "}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &error)) {
+      fprintf (stderr, "%s\n", error->message);
+      exit_code = 1;
+    }
+  } else {
+    fputs (json->str, stdout);
+  }
+
+  g_string_free (json, TRUE);
+  g_mutex_clear (&zap.lock);
+  g_cond_clear (&zap.cond);
+  g_strfreev (sdps);
+  g_strfreev (sdp_files);
+  g_free (cfg);
+  g_free (label);
+  g_free (output);
+  return exit_code;
+}
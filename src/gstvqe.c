@@ -27,6 +27,8 @@
 
 #include "gstvqesrc.h"
 #include "gstvqesdpdemux.h"
+#include "gstvqerelay.h"
+#include "gstvqetracer.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
@@ -35,6 +37,12 @@ plugin_init (GstPlugin * plugin)
     return FALSE;
   if (!gst_element_register (plugin, "vqesdpdemux", GST_RANK_PRIMARY, GST_TYPE_VQE_SDP_DEMUX))
     return FALSE;
+  if (!gst_element_register (plugin, "vqerelay", GST_RANK_NONE, GST_TYPE_VQE_RELAY))
+    return FALSE;
+#if GST_CHECK_VERSION(1,8,0)
+  if (!gst_tracer_register (plugin, "vqetracer", GST_TYPE_VQE_TRACER))
+    return FALSE;
+#endif
 
   return TRUE;
 }
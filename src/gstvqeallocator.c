@@ -0,0 +1,327 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* memfd_create */
+#endif
+
+#include "gstvqeallocator.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (vqeallocator_debug);
+#define GST_CAT_DEFAULT (vqeallocator_debug)
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+  GstMemory mem;
+
+  guint8 *data;
+  gint slot;            /* -1 for memory shared from another */
+} GstVQEMemory;
+
+#define gst_vqe_allocator_parent_class parent_class
+G_DEFINE_TYPE (GstVQEAllocator, gst_vqe_allocator, GST_TYPE_ALLOCATOR);
+
+GType
+gst_vqe_allocator_backing_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_VQE_ALLOCATOR_BACKING_SYSTEM, "Normal system memory", "system"},
+    {GST_VQE_ALLOCATOR_BACKING_MEMFD,
+        "Pre-faulted memfd region, shareable by fd", "memfd"},
+    {GST_VQE_ALLOCATOR_BACKING_HUGEPAGE,
+        "Pre-faulted hugepage memfd region, shareable by fd", "hugepage"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&type)) {
+    GType tmp = g_enum_register_static ("GstVQEAllocatorBacking", values);
+    g_once_init_leave (&type, tmp);
+  }
+  return type;
+}
+
+static GstMemory *
+gst_vqe_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  GstVQEAllocator *alloc = GST_VQE_ALLOCATOR (allocator);
+  GstVQEMemory *mem;
+  gsize maxsize = params->prefix + size + params->padding;
+  gint slot = -1;
+
+  /* the region is page aligned, so slots are as aligned as their stride */
+  if (maxsize <= alloc->slot_size && (alloc->stride & params->align) == 0) {
+    g_mutex_lock (&alloc->lock);
+    if (alloc->n_free > 0)
+      slot = alloc->free_slots[--alloc->n_free];
+    g_mutex_unlock (&alloc->lock);
+  }
+
+  if (slot < 0) {
+    g_atomic_int_inc (&alloc->fallbacks);
+    GST_DEBUG_OBJECT (alloc, "No slot for %" G_GSIZE_FORMAT " bytes aligned "
+        "to %" G_GSIZE_FORMAT ", falling back to system memory", maxsize,
+        params->align + 1);
+    return gst_allocator_alloc (NULL, size, params);
+  }
+
+  mem = g_slice_new (GstVQEMemory);
+  gst_memory_init (GST_MEMORY_CAST (mem), params->flags, allocator, NULL,
+      alloc->slot_size, params->align, params->prefix, size);
+  mem->data = alloc->region + slot * alloc->stride;
+  mem->slot = slot;
+
+  return GST_MEMORY_CAST (mem);
+}
+
+static void
+gst_vqe_allocator_free (GstAllocator * allocator, GstMemory * memory)
+{
+  GstVQEAllocator *alloc = GST_VQE_ALLOCATOR (allocator);
+  GstVQEMemory *mem = (GstVQEMemory *) memory;
+
+  if (mem->slot >= 0) {
+    g_mutex_lock (&alloc->lock);
+    alloc->free_slots[alloc->n_free++] = mem->slot;
+    g_mutex_unlock (&alloc->lock);
+  }
+  g_slice_free (GstVQEMemory, mem);
+}
+
+static gpointer
+gst_vqe_memory_map (GstMemory * memory, gsize maxsize, GstMapFlags flags)
+{
+  return ((GstVQEMemory *) memory)->data;
+}
+
+static void
+gst_vqe_memory_unmap (GstMemory * memory)
+{
+}
+
+static GstMemory *
+gst_vqe_memory_share (GstMemory * memory, gssize offset, gssize size)
+{
+  GstVQEMemory *mem = (GstVQEMemory *) memory;
+  GstVQEMemory *sub;
+  GstMemory *parent;
+
+  if (size == -1)
+    size = memory->size - offset;
+  if ((parent = memory->parent) == NULL)
+    parent = memory;
+
+  sub = g_slice_new (GstVQEMemory);
+  gst_memory_init (GST_MEMORY_CAST (sub),
+      GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+      memory->allocator, parent, memory->maxsize, memory->align,
+      memory->offset + offset, size);
+  sub->data = mem->data;
+  sub->slot = -1;
+
+  return GST_MEMORY_CAST (sub);
+}
+
+static void
+gst_vqe_allocator_finalize (GObject * object)
+{
+  GstVQEAllocator *alloc = GST_VQE_ALLOCATOR (object);
+
+  if (alloc->region)
+    munmap (alloc->region, alloc->region_size);
+  if (alloc->fd >= 0)
+    close (alloc->fd);
+  g_free (alloc->free_slots);
+  g_mutex_clear (&alloc->lock);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_vqe_allocator_class_init (GstVQEAllocatorClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (vqeallocator_debug, "vqeallocator", 0,
+      "VQE memfd/hugepage allocator");
+
+  gobject_class->finalize = gst_vqe_allocator_finalize;
+
+  allocator_class->alloc = gst_vqe_allocator_alloc;
+  allocator_class->free = gst_vqe_allocator_free;
+}
+
+static void
+gst_vqe_allocator_init (GstVQEAllocator * alloc)
+{
+  GstAllocator *allocator = GST_ALLOCATOR_CAST (alloc);
+
+  allocator->mem_type = GST_VQE_ALLOCATOR_MEMTYPE;
+  allocator->mem_map = gst_vqe_memory_map;
+  allocator->mem_unmap = gst_vqe_memory_unmap;
+  allocator->mem_share = gst_vqe_memory_share;
+
+  GST_OBJECT_FLAG_SET (alloc, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+
+  alloc->backing = GST_VQE_ALLOCATOR_BACKING_SYSTEM;
+  alloc->fd = -1;
+  alloc->region = NULL;
+  alloc->region_size = 0;
+  alloc->fallbacks = 0;
+  g_mutex_init (&alloc->lock);
+}
+
+/* Create, size and fault in the region.  Returns FALSE if the kernel won't
+   give us what we asked for, e.g. because no hugepages are reserved. */
+static gboolean
+gst_vqe_allocator_setup_region (GstVQEAllocator * alloc,
+    GstVQEAllocatorBacking backing)
+{
+#ifdef HAVE_MEMFD_CREATE
+  unsigned int flags = MFD_CLOEXEC;
+  gsize page_size = getpagesize ();
+
+  if (backing == GST_VQE_ALLOCATOR_BACKING_HUGEPAGE) {
+#ifdef MFD_HUGETLB
+    flags |= MFD_HUGETLB;
+    page_size = HUGEPAGE_SIZE;
+#else
+    return FALSE;
+#endif
+  }
+
+  alloc->region_size = (alloc->stride * alloc->n_slots + page_size - 1) /
+      page_size * page_size;
+
+  alloc->fd = memfd_create ("gst-vqe", flags);
+  if (alloc->fd < 0)
+    goto failed;
+  if (ftruncate (alloc->fd, alloc->region_size) < 0)
+    goto failed;
+
+  /* MAP_POPULATE faults the whole region in now rather than in the
+     streaming thread */
+  alloc->region = mmap (NULL, alloc->region_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, alloc->fd, 0);
+  if (alloc->region == MAP_FAILED) {
+    alloc->region = NULL;
+    goto failed;
+  }
+
+  alloc->backing = backing;
+  return TRUE;
+
+failed:
+  GST_WARNING_OBJECT (alloc, "Failed to set up %" G_GSIZE_FORMAT " byte %s "
+      "region: %s", alloc->region_size,
+      backing == GST_VQE_ALLOCATOR_BACKING_HUGEPAGE ? "hugepage" : "memfd",
+      g_strerror (errno));
+  if (alloc->fd >= 0)
+    close (alloc->fd);
+  alloc->fd = -1;
+  return FALSE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * gst_vqe_allocator_new:
+ *
+ * Returns: an allocator with @n_slots slots of @slot_size bytes, each aligned
+ * to the GstAllocationParams alignment mask @align or the default memory
+ * alignment if that's more, using the requested backing or failing that
+ * memfd, or NULL if neither is available and the caller should use the
+ * default allocator.
+ */
+GstAllocator *
+gst_vqe_allocator_new (GstVQEAllocatorBacking backing, gsize slot_size,
+    guint n_slots, gsize align)
+{
+  GstVQEAllocator *alloc;
+  guint i;
+
+  if (backing == GST_VQE_ALLOCATOR_BACKING_SYSTEM)
+    return NULL;
+
+  alloc = g_object_new (GST_TYPE_VQE_ALLOCATOR, NULL);
+  gst_object_ref_sink (alloc);
+  alloc->slot_size = slot_size;
+  align |= gst_memory_alignment;
+  alloc->stride = (slot_size + align) & ~align;
+  alloc->n_slots = n_slots;
+
+  if (!gst_vqe_allocator_setup_region (alloc, backing) &&
+      (backing != GST_VQE_ALLOCATOR_BACKING_HUGEPAGE ||
+          !gst_vqe_allocator_setup_region (alloc,
+              GST_VQE_ALLOCATOR_BACKING_MEMFD))) {
+    gst_object_unref (alloc);
+    return NULL;
+  }
+
+  alloc->free_slots = g_new (guint, n_slots);
+  for (i = 0; i < n_slots; i++)
+    alloc->free_slots[i] = n_slots - 1 - i;
+  alloc->n_free = n_slots;
+
+  GST_INFO_OBJECT (alloc, "%u x %" G_GSIZE_FORMAT " byte slots %"
+      G_GSIZE_FORMAT " apart in %" G_GSIZE_FORMAT " byte %s region", n_slots,
+      slot_size, alloc->stride, alloc->region_size,
+      alloc->backing == GST_VQE_ALLOCATOR_BACKING_HUGEPAGE ? "hugepage" :
+      "memfd");
+
+  return GST_ALLOCATOR_CAST (alloc);
+}
+
+/**
+ * gst_vqe_allocator_memory_get_fd:
+ *
+ * Finds where the data of @mem lives in the allocator's memfd so that it can
+ * be passed to and mapped by another process.  @offset is that of the first
+ * byte of the memory's current view.
+ */
+gboolean
+gst_vqe_allocator_memory_get_fd (GstMemory * mem, gint * fd, gsize * offset)
+{
+  GstVQEAllocator *alloc;
+
+  if (!mem->allocator || !GST_IS_VQE_ALLOCATOR (mem->allocator))
+    return FALSE;
+  alloc = GST_VQE_ALLOCATOR (mem->allocator);
+
+  *fd = alloc->fd;
+  *offset = (((GstVQEMemory *) mem)->data - alloc->region) + mem->offset;
+  return TRUE;
+}
@@ -0,0 +1,97 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_ALLOCATOR_H__
+#define __GST_VQE_ALLOCATOR_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_VQE_ALLOCATOR \
+  (gst_vqe_allocator_get_type())
+#define GST_VQE_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_VQE_ALLOCATOR,GstVQEAllocator))
+#define GST_IS_VQE_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_VQE_ALLOCATOR))
+
+#define GST_TYPE_VQE_ALLOCATOR_BACKING \
+  (gst_vqe_allocator_backing_get_type())
+
+#define GST_VQE_ALLOCATOR_MEMTYPE "VQEMemory"
+
+typedef enum {
+  GST_VQE_ALLOCATOR_BACKING_SYSTEM,
+  GST_VQE_ALLOCATOR_BACKING_MEMFD,
+  GST_VQE_ALLOCATOR_BACKING_HUGEPAGE
+} GstVQEAllocatorBacking;
+
+typedef struct _GstVQEAllocator GstVQEAllocator;
+typedef struct _GstVQEAllocatorClass GstVQEAllocatorClass;
+
+/*
+ * Hands out fixed size slots of one region which is allocated and faulted in
+ * up front, so that growing the buffer pool doesn't page fault and the whole
+ * region can be covered by a handful of (huge) TLB entries.  The region is a
+ * memfd so it can be passed to other processes.  Slots start a multiple of
+ * the alignment given at creation apart.  Allocations which don't fit in a
+ * slot, want more alignment than that, or arrive when all slots are in use,
+ * fall back to system memory.
+ */
+struct _GstVQEAllocator {
+  GstAllocator parent;
+
+  GstVQEAllocatorBacking backing;
+  gint fd;
+  guint8 *region;
+  gsize region_size;
+  gsize slot_size;
+  gsize stride;                 /* slot_size rounded up to the alignment */
+  guint n_slots;
+
+  GMutex lock;
+  guint *free_slots;
+  guint n_free;
+
+  /* updated atomically */
+  gint fallbacks;
+};
+
+struct _GstVQEAllocatorClass {
+  GstAllocatorClass parent_class;
+};
+
+GType         gst_vqe_allocator_get_type         (void);
+GType         gst_vqe_allocator_backing_get_type (void);
+
+GstAllocator *gst_vqe_allocator_new       (GstVQEAllocatorBacking backing,
+                                           gsize slot_size, guint n_slots,
+                                           gsize align);
+
+gboolean      gst_vqe_allocator_memory_get_fd (GstMemory * mem, gint * fd,
+                                               gsize * offset);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_ALLOCATOR_H__ */
@@ -0,0 +1,243 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqebackend.h"
+#include "gstvqesynth.h"
+
+#ifdef HAVE_VQEC_DROP_SIM
+#include <vqec_drop.h>
+#endif
+
+/* Thin wrappers rather than pointers straight at the library so that the
+   table doesn't depend on the exact prototypes of any given VQE-C release */
+
+#ifdef HAVE_VQEC_DROP_SIM
+static void gst_vqe_backend_vqec_drop_sim_release (vqec_tunerid_t id);
+#endif
+
+static vqec_error_t
+gst_vqe_backend_vqec_init (const char *config)
+{
+  return vqec_ifclient_init (config);
+}
+
+static void
+gst_vqe_backend_vqec_start (void)
+{
+  vqec_ifclient_start ();
+}
+
+static void
+gst_vqe_backend_vqec_stop (void)
+{
+  vqec_ifclient_stop ();
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_tuner_create (vqec_tunerid_t * id, const char *name)
+{
+  return vqec_ifclient_tuner_create (id, name);
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_tuner_destroy (vqec_tunerid_t id)
+{
+#ifdef HAVE_VQEC_DROP_SIM
+  gst_vqe_backend_vqec_drop_sim_release (id);
+#endif
+  return vqec_ifclient_tuner_destroy (id);
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_tuner_bind_chan_cfg (vqec_tunerid_t id,
+    vqec_chan_cfg_t * cfg, vqec_bind_params_t * bp)
+{
+  return vqec_ifclient_tuner_bind_chan_cfg (id, cfg, bp);
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_tuner_unbind_chan (vqec_tunerid_t id)
+{
+  return vqec_ifclient_tuner_unbind_chan (id);
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_tuner_recvmsg (vqec_tunerid_t id, vqec_iobuf_t * iobuf,
+    int32_t iobuf_num, int32_t * len, int32_t timeout)
+{
+  return vqec_ifclient_tuner_recvmsg (id, iobuf, iobuf_num, len, timeout);
+}
+
+#ifdef HAVE_VQEC_DROP_SIM
+/* The drop simulator is shared by every tuner in the process, so each
+   stream's settings belong to the tuner which last set a pattern on it, and
+   only that tuner turns them off again.  Tuners without a pattern leave
+   them alone. */
+enum {
+  DROP_SIM_PRIMARY,
+  DROP_SIM_REPAIR,
+  DROP_SIM_STREAMS
+};
+
+static const vqec_input_stream_type_t drop_sim_stream[DROP_SIM_STREAMS] = {
+  VQEC_INPUT_STREAM_PRIMARY,
+  VQEC_INPUT_STREAM_REPAIR
+};
+
+G_LOCK_DEFINE_STATIC (drop_sim);
+static gboolean drop_sim_owned[DROP_SIM_STREAMS];
+static vqec_tunerid_t drop_sim_owner[DROP_SIM_STREAMS];
+
+/* VQE-C's drop simulator can drop a whole percentage at random or a run of
+   packets every so many, so a Gilbert-Elliott pattern becomes runs of its
+   mean burst length at its mean spacing.  Called with the drop_sim lock. */
+static gboolean
+gst_vqe_backend_vqec_drop_sim_set (guint slot, vqec_tunerid_t id,
+    const gchar * spec)
+{
+  vqec_input_stream_type_t stream = drop_sim_stream[slot];
+  GstVQESynthLoss loss;
+
+  gst_vqe_synth_loss_parse (&loss, spec, 1);
+  switch (loss.type) {
+    case GST_VQE_SYNTH_LOSS_NONE:
+      if (drop_sim_owned[slot] && drop_sim_owner[slot] == id) {
+        vqec_set_drop_enable (stream, FALSE);
+        drop_sim_owned[slot] = FALSE;
+      }
+      return TRUE;
+    case GST_VQE_SYNTH_LOSS_UNIFORM:{
+      guint percent = (guint) (loss.p * 100 + 0.5);
+
+      if (!percent) {
+        g_warning ("VQE-C's drop simulator can't drop less than 1%% of "
+            "packets, ignoring loss pattern \"%s\"", spec);
+        return FALSE;
+      }
+      if (ABS (loss.p * 100 - percent) > 1e-6)
+        g_warning ("VQE-C's drop simulator only drops whole percentages of "
+            "packets, so \"%s\" drops %u%%", spec, percent);
+      vqec_set_drop_interval (stream, 0, 0);
+      vqec_set_drop_ratio (stream, percent);
+      break;
+    }
+    case GST_VQE_SYNTH_LOSS_GILBERT:{
+      guint burst = MAX ((guint) (1 / MAX (loss.r, 0.001) + 0.5), 1);
+      guint gap = (guint) (1 / MAX (loss.p, 0.001) + 0.5);
+
+      vqec_set_drop_ratio (stream, 0);
+      vqec_set_drop_interval (stream, burst, burst + gap);
+      break;
+    }
+    case GST_VQE_SYNTH_LOSS_PERIODIC:
+      vqec_set_drop_ratio (stream, 0);
+      vqec_set_drop_interval (stream, 1, loss.period);
+      break;
+  }
+  vqec_set_drop_enable (stream, TRUE);
+  drop_sim_owned[slot] = TRUE;
+  drop_sim_owner[slot] = id;
+  return TRUE;
+}
+
+static void
+gst_vqe_backend_vqec_drop_sim_release (vqec_tunerid_t id)
+{
+  guint slot;
+
+  G_LOCK (drop_sim);
+  for (slot = 0; slot < DROP_SIM_STREAMS; slot++)
+    gst_vqe_backend_vqec_drop_sim_set (slot, id, NULL);
+  G_UNLOCK (drop_sim);
+}
+#endif
+
+/* The drop simulator is process wide, so a pattern set here affects every
+   tuner until this one clears it or is destroyed */
+static gboolean
+gst_vqe_backend_vqec_tuner_set_loss (vqec_tunerid_t id, const gchar * primary,
+    const gchar * repair)
+{
+#ifdef HAVE_VQEC_DROP_SIM
+  gboolean ret;
+
+  G_LOCK (drop_sim);
+  ret = gst_vqe_backend_vqec_drop_sim_set (DROP_SIM_PRIMARY, id, primary);
+  ret &= gst_vqe_backend_vqec_drop_sim_set (DROP_SIM_REPAIR, id, repair);
+  G_UNLOCK (drop_sim);
+  return ret;
+#else
+  return !primary && !repair;
+#endif
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_get_stats (vqec_ifclient_stats_t * stats)
+{
+  return vqec_ifclient_get_stats (stats);
+}
+
+static vqec_error_t
+gst_vqe_backend_vqec_get_stats_channel (const char *url,
+    vqec_ifclient_stats_channel_t * stats)
+{
+  return vqec_ifclient_get_stats_channel (url, stats);
+}
+
+static void
+gst_vqe_backend_vqec_set_tr135_params_channel (const char *url,
+    vqec_ifclient_tr135_params_t * params)
+{
+  vqec_ifclient_set_tr135_params_channel (url, params);
+}
+
+const GstVQEBackend gst_vqe_backend_vqec = {
+  "vqec",
+  gst_vqe_backend_vqec_init,
+  gst_vqe_backend_vqec_start,
+  gst_vqe_backend_vqec_stop,
+  gst_vqe_backend_vqec_tuner_create,
+  gst_vqe_backend_vqec_tuner_destroy,
+  gst_vqe_backend_vqec_tuner_bind_chan_cfg,
+  gst_vqe_backend_vqec_tuner_unbind_chan,
+  gst_vqe_backend_vqec_tuner_recvmsg,
+  gst_vqe_backend_vqec_tuner_set_loss,
+  gst_vqe_backend_vqec_get_stats,
+  gst_vqe_backend_vqec_get_stats_channel,
+  gst_vqe_backend_vqec_set_tr135_params_channel
+};
+
+/* Returns the named backend, or the real one if @name is NULL or unknown */
+const GstVQEBackend *
+gst_vqe_backend_get (const gchar * name)
+{
+  if (name && g_str_equal (name, gst_vqe_backend_fake.name))
+    return &gst_vqe_backend_fake;
+  if (name && !g_str_equal (name, gst_vqe_backend_vqec.name))
+    g_warning ("Unknown VQE-C backend \"%s\", using the real one", name);
+  return &gst_vqe_backend_vqec;
+}
@@ -0,0 +1,80 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_BACKEND_H__
+#define __GST_VQE_BACKEND_H__
+
+#include <glib.h>
+#include <vqec_ifclient.h>
+#include <vqec_ifclient_read.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The parts of VQE-C which vqesrc needs that touch the network or the
+ * clock, so that they can be swapped for a fake.  Parsing SDP and building
+ * bind parameters is left to the real library whichever backend is in use.
+ *
+ * The backend is picked once per process, by the GSTVQE_BACKEND environment
+ * variable: "vqec" (the default) or "fake".
+ */
+typedef struct {
+  const gchar *name;
+
+  vqec_error_t (*init)                (const char *config);
+  void         (*start)               (void);   /* the event loop */
+  void         (*stop)                (void);
+
+  vqec_error_t (*tuner_create)        (vqec_tunerid_t * id, const char *name);
+  vqec_error_t (*tuner_destroy)       (vqec_tunerid_t id);
+  vqec_error_t (*tuner_bind_chan_cfg) (vqec_tunerid_t id,
+                                       vqec_chan_cfg_t * cfg,
+                                       vqec_bind_params_t * bp);
+  vqec_error_t (*tuner_unbind_chan)   (vqec_tunerid_t id);
+  vqec_error_t (*tuner_recvmsg)       (vqec_tunerid_t id,
+                                       vqec_iobuf_t * iobuf,
+                                       int32_t iobuf_num, int32_t * len,
+                                       int32_t timeout);
+  /* Drops datagrams of the primary and repair streams to the given
+     patterns (see gst_vqe_synth_loss_parse(), NULL for none) from now
+     until the tuner is next bound.  FALSE if the backend can't. */
+  gboolean     (*tuner_set_loss)      (vqec_tunerid_t id,
+                                       const gchar * primary,
+                                       const gchar * repair);
+
+  vqec_error_t (*get_stats)           (vqec_ifclient_stats_t * stats);
+  vqec_error_t (*get_stats_channel)   (const char *url,
+                                       vqec_ifclient_stats_channel_t * stats);
+  void         (*set_tr135_params_channel) (const char *url,
+                                       vqec_ifclient_tr135_params_t * params);
+} GstVQEBackend;
+
+extern const GstVQEBackend gst_vqe_backend_vqec;
+extern const GstVQEBackend gst_vqe_backend_fake;
+
+const GstVQEBackend *gst_vqe_backend_get (const gchar * name);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_BACKEND_H__ */
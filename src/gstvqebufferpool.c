@@ -0,0 +1,155 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqebufferpool.h"
+
+GST_DEBUG_CATEGORY_STATIC (vqebufferpool_debug);
+#define GST_CAT_DEFAULT (vqebufferpool_debug)
+
+#define gst_vqe_buffer_pool_parent_class parent_class
+G_DEFINE_TYPE (GstVQEBufferPool, gst_vqe_buffer_pool, GST_TYPE_BUFFER_POOL);
+
+static gboolean
+gst_vqe_buffer_pool_set_config (GstBufferPool * pool, GstStructure * config)
+{
+  GstVQEBufferPool *vpool = GST_VQE_BUFFER_POOL (pool);
+  guint size;
+
+  if (!gst_buffer_pool_config_get_params (config, NULL, &size, NULL, NULL))
+    return FALSE;
+  vpool->size = size;
+
+  return GST_BUFFER_POOL_CLASS (parent_class)->set_config (pool, config);
+}
+
+static gboolean
+gst_vqe_buffer_pool_start (GstBufferPool * pool)
+{
+  GstVQEBufferPool *vpool = GST_VQE_BUFFER_POOL (pool);
+  gboolean ret;
+
+  /* the base class preallocates min-buffers here, which don't count as
+     misses */
+  vpool->started = FALSE;
+  ret = GST_BUFFER_POOL_CLASS (parent_class)->start (pool);
+  vpool->started = TRUE;
+  return ret;
+}
+
+static GstFlowReturn
+gst_vqe_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstVQEBufferPool *vpool = GST_VQE_BUFFER_POOL (pool);
+
+  g_atomic_int_inc (&vpool->allocations);
+  if (vpool->started) {
+    g_atomic_int_inc (&vpool->misses);
+    GST_DEBUG_OBJECT (pool, "Pool empty, allocating another %u byte buffer",
+        vpool->size);
+  }
+
+  return GST_BUFFER_POOL_CLASS (parent_class)->alloc_buffer (pool, buffer,
+      params);
+}
+
+static void
+gst_vqe_buffer_pool_reset_buffer (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstVQEBufferPool *vpool = GST_VQE_BUFFER_POOL (pool);
+  gsize offset, maxsize;
+
+  /* clears flags, timestamps and any metadata not tagged as pooled */
+  GST_BUFFER_POOL_CLASS (parent_class)->reset_buffer (pool, buffer);
+
+  /* We shrink buffers to what was read from VQE-C; grow them back so that
+     the next acquire gets the whole thing. */
+  if (gst_buffer_get_sizes (buffer, &offset, &maxsize) != vpool->size &&
+      maxsize >= vpool->size)
+    gst_buffer_resize (buffer, -offset, vpool->size);
+}
+
+static void
+gst_vqe_buffer_pool_release_buffer (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstVQEBufferPool *vpool = GST_VQE_BUFFER_POOL (pool);
+
+  /* The base class frees rather than pools buffers which have had their
+     memory replaced or are still shared; count those as they'll cost an
+     allocation later. */
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_TAG_MEMORY) ||
+      gst_buffer_get_size (buffer) != vpool->size ||
+      !gst_buffer_is_all_memory_writable (buffer)) {
+    g_atomic_int_inc (&vpool->discards);
+    GST_DEBUG_OBJECT (pool, "Buffer %p can't be reused", buffer);
+  }
+
+  GST_BUFFER_POOL_CLASS (parent_class)->release_buffer (pool, buffer);
+}
+
+static void
+gst_vqe_buffer_pool_class_init (GstVQEBufferPoolClass * klass)
+{
+  GstBufferPoolClass *pool_class = (GstBufferPoolClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (vqebufferpool_debug, "vqebufferpool", 0,
+      "VQE buffer pool");
+
+  pool_class->set_config = gst_vqe_buffer_pool_set_config;
+  pool_class->start = gst_vqe_buffer_pool_start;
+  pool_class->alloc_buffer = gst_vqe_buffer_pool_alloc_buffer;
+  pool_class->reset_buffer = gst_vqe_buffer_pool_reset_buffer;
+  pool_class->release_buffer = gst_vqe_buffer_pool_release_buffer;
+}
+
+static void
+gst_vqe_buffer_pool_init (GstVQEBufferPool * pool)
+{
+  pool->size = 0;
+  pool->started = FALSE;
+  pool->allocations = 0;
+  pool->misses = 0;
+  pool->discards = 0;
+}
+
+GstBufferPool *
+gst_vqe_buffer_pool_new (void)
+{
+  GstBufferPool *pool = g_object_new (GST_TYPE_VQE_BUFFER_POOL, NULL);
+
+  gst_object_ref_sink (pool);
+  return pool;
+}
+
+void
+gst_vqe_buffer_pool_get_stats (GstVQEBufferPool * pool, guint * allocations,
+    guint * misses, guint * discards)
+{
+  *allocations = g_atomic_int_get (&pool->allocations);
+  *misses = g_atomic_int_get (&pool->misses);
+  *discards = g_atomic_int_get (&pool->discards);
+}
@@ -0,0 +1,75 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_BUFFER_POOL_H__
+#define __GST_VQE_BUFFER_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_VQE_BUFFER_POOL \
+  (gst_vqe_buffer_pool_get_type())
+#define GST_VQE_BUFFER_POOL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_VQE_BUFFER_POOL,GstVQEBufferPool))
+#define GST_IS_VQE_BUFFER_POOL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_VQE_BUFFER_POOL))
+
+typedef struct _GstVQEBufferPool GstVQEBufferPool;
+typedef struct _GstVQEBufferPoolClass GstVQEBufferPoolClass;
+
+/*
+ * A buffer pool which makes sure buffers come back in a state where they can
+ * be reused as is (full size, no metadata) and counts every time it has to go
+ * to the allocator, so that we can tell if the receive path has stopped being
+ * allocation free.
+ */
+struct _GstVQEBufferPool {
+  GstBufferPool parent;
+
+  guint size;
+  gboolean started;
+
+  /* updated atomically */
+  gint allocations;     /* buffers allocated, including preallocation     */
+  gint misses;          /* allocations because the pool was empty         */
+  gint discards;        /* buffers which came back unusable and were freed */
+};
+
+struct _GstVQEBufferPoolClass {
+  GstBufferPoolClass parent_class;
+};
+
+GType          gst_vqe_buffer_pool_get_type (void);
+
+GstBufferPool *gst_vqe_buffer_pool_new      (void);
+
+void           gst_vqe_buffer_pool_get_stats (GstVQEBufferPool * pool,
+                                              guint * allocations,
+                                              guint * misses,
+                                              guint * discards);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_BUFFER_POOL_H__ */
@@ -0,0 +1,151 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqecfg.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+struct _GstVQECfg {
+  GHashTable *settings;
+};
+
+/* Parses each "key = value;" (or "key: value;") line of the file into
+ * settings, with surrounding whitespace, quotes and the terminating
+ * semicolon removed from the value.  The first setting of a key wins. */
+GstVQECfg *
+gst_vqe_cfg_load (const gchar * path)
+{
+  GstVQECfg *cfg;
+  gchar *contents = NULL;
+  gchar **lines, **line;
+
+  if (!path || !g_file_get_contents (path, &contents, NULL, NULL))
+    return NULL;
+
+  cfg = g_new (GstVQECfg, 1);
+  cfg->settings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      g_free);
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (line = lines; *line; line++) {
+    gchar *p = g_strstrip (*line);
+    gchar *key = p, *end;
+    gsize key_len;
+
+    key_len = strspn (p, "abcdefghijklmnopqrstuvwxyz"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-*");
+    if (key_len == 0)
+      continue;
+    p = g_strchug (p + key_len);
+    if (*p != '=' && *p != ':')
+      continue;
+    key[key_len] = '\0';
+    p = g_strchug (p + 1);
+
+    /* strip trailing comments and the terminating semicolon */
+    if ((end = strstr (p, "#")) || (end = strstr (p, "//")))
+      *end = '\0';
+    if ((end = strchr (p, ';')))
+      *end = '\0';
+    g_strstrip (p);
+    if (*p == '"') {
+      p++;
+      if ((end = strchr (p, '"')))
+        *end = '\0';
+    }
+    if (!g_hash_table_contains (cfg->settings, key))
+      g_hash_table_insert (cfg->settings, g_strdup (key), g_strdup (p));
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+  return cfg;
+}
+
+void
+gst_vqe_cfg_free (GstVQECfg * cfg)
+{
+  if (!cfg)
+    return;
+  g_hash_table_destroy (cfg->settings);
+  g_free (cfg);
+}
+
+gboolean
+gst_vqe_cfg_lookup_uint (GstVQECfg * cfg, const gchar * key, guint * value)
+{
+  const gchar *str = cfg ? g_hash_table_lookup (cfg->settings, key) : NULL;
+  gchar *end = NULL;
+  gulong v;
+
+  if (!str)
+    return FALSE;
+  v = strtoul (str, &end, 0);
+  if (end == str || *end != '\0')
+    return FALSE;
+  *value = v;
+  return TRUE;
+}
+
+gboolean
+gst_vqe_cfg_lookup_boolean (GstVQECfg * cfg, const gchar * key,
+    gboolean * value)
+{
+  const gchar *str = cfg ? g_hash_table_lookup (cfg->settings, key) : NULL;
+
+  if (!str)
+    return FALSE;
+  if (g_ascii_strcasecmp (str, "true") == 0 || strcmp (str, "1") == 0)
+    *value = TRUE;
+  else if (g_ascii_strcasecmp (str, "false") == 0 || strcmp (str, "0") == 0)
+    *value = FALSE;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+gboolean
+gst_vqe_cfg_get_uint (const gchar * path, const gchar * key, guint * value)
+{
+  GstVQECfg *cfg = gst_vqe_cfg_load (path);
+  gboolean ret = gst_vqe_cfg_lookup_uint (cfg, key, value);
+
+  gst_vqe_cfg_free (cfg);
+  return ret;
+}
+
+gboolean
+gst_vqe_cfg_get_boolean (const gchar * path, const gchar * key,
+    gboolean * value)
+{
+  GstVQECfg *cfg = gst_vqe_cfg_load (path);
+  gboolean ret = gst_vqe_cfg_lookup_boolean (cfg, key, value);
+
+  gst_vqe_cfg_free (cfg);
+  return ret;
+}
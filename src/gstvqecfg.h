@@ -0,0 +1,56 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_CFG_H__
+#define __GST_VQE_CFG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * VQE-C keeps its configuration to itself once it has been initialised, so
+ * where we need to know a value (e.g. to report latency) we read it back out
+ * of the libconfig style file ourselves.  Only simple "key = value;" settings
+ * at the top level are understood.
+ */
+
+gboolean gst_vqe_cfg_get_uint    (const gchar * path, const gchar * key,
+                                  guint * value);
+gboolean gst_vqe_cfg_get_boolean (const gchar * path, const gchar * key,
+                                  gboolean * value);
+
+/* For reading several settings out of the one file, parsing it only once */
+typedef struct _GstVQECfg GstVQECfg;
+
+GstVQECfg *gst_vqe_cfg_load           (const gchar * path);
+void       gst_vqe_cfg_free           (GstVQECfg * cfg);
+gboolean   gst_vqe_cfg_lookup_uint    (GstVQECfg * cfg, const gchar * key,
+                                       guint * value);
+gboolean   gst_vqe_cfg_lookup_boolean (GstVQECfg * cfg, const gchar * key,
+                                       gboolean * value);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_CFG_H__ */
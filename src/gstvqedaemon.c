@@ -0,0 +1,404 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * gst-vqe-daemon: hosts VQE-C and its tuners so that any number of pipeline
+ * processes can share one repair engine, and a crash in one of them doesn't
+ * take the others' tuners with it.  vqesrc attaches with its daemon-socket
+ * property; see gstvqeipc.h for the protocol.
+ *
+ *   gst-vqe-daemon [-c vqe-c.cfg] [-s /var/run/gst-vqe.sock]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqeipc.h"
+
+#include <vqec_ifclient.h>
+#include <vqec_ifclient_read.h>
+#include <vqec_ifclient_defs.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const guint min_slot_size = VQEC_MSG_MAX_DATAGRAM_LEN * 2;
+static const guint max_slot_size = 5 * 1024 * 1024;
+static const guint min_slots = 4;
+/* a client mustn't be able to make us map more than this for it */
+static const gsize max_ring_size = 64 * 1024 * 1024;
+
+static volatile gint quit = 0;
+static gint tuner_count = 0;
+
+/* client threads still using VQE-C, which main waits for before stopping
+   it */
+static GMutex clients_lock;
+static GCond clients_cond;
+static guint n_clients = 0;
+
+typedef struct {
+  gint sock;
+  vqec_tunerid_t tuner;
+  gboolean bound;
+  GstVQEIpcRing *ring;
+  gint ring_fd;
+  gint event_fd;
+} VqeDaemonClient;
+
+static gpointer
+vqe_daemon_worker (gpointer data)
+{
+  vqec_ifclient_start ();
+  return NULL;
+}
+
+/* Wake the client.  The eventfd is non-blocking, and EAGAIN only means its
+   counter is so high there are plenty of wakeups pending already. */
+static void
+vqe_daemon_notify (VqeDaemonClient * c)
+{
+  guint64 one = 1;
+
+  if (write (c->event_fd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+    g_warning ("Failed to wake client: %s", g_strerror (errno));
+}
+
+static void
+vqe_daemon_reply_error (gint sock, const gchar * error)
+{
+  GstVQEIpcTuneReply reply;
+
+  memset (&reply, 0, sizeof (reply));
+  reply.magic = GST_VQE_IPC_MAGIC;
+  reply.status = -1;
+  g_strlcpy (reply.error, error, sizeof (reply.error));
+  gst_vqe_ipc_send_fds (sock, &reply, sizeof (reply), NULL, 0);
+  g_warning ("%s", error);
+}
+
+/* Receive the tune request, bind a tuner to it and hand over the ring.
+   Replies with an error and returns FALSE if any of that fails. */
+static gboolean
+vqe_daemon_tune (VqeDaemonClient * c)
+{
+  gchar *msg = g_malloc (sizeof (GstVQEIpcTuneRequest) +
+      GST_VQE_IPC_MAX_SDP_LEN + 1);
+  GstVQEIpcTuneRequest *req = (GstVQEIpcTuneRequest *) msg;
+  GstVQEIpcTuneReply reply;
+  gchar *sdp;
+  gssize len;
+  vqec_chan_cfg_t cfg;
+  vqec_bind_params_t *bp = NULL;
+  vqec_error_t err;
+  gchar name[64];
+  guint slot_size, n_slots;
+  gint fds[2];
+  gboolean ret = FALSE;
+
+  len = recv (c->sock, msg, sizeof (*req) + GST_VQE_IPC_MAX_SDP_LEN, 0);
+  if (len < (gssize) sizeof (*req) || req->magic != GST_VQE_IPC_MAGIC ||
+      req->version != GST_VQE_IPC_VERSION) {
+    vqe_daemon_reply_error (c->sock, "Bad tune request");
+    goto out;
+  }
+  msg[len] = '\0';
+  sdp = msg + sizeof (*req);
+
+  g_snprintf (name, sizeof (name), "vqed%d",
+      g_atomic_int_add (&tuner_count, 1));
+  err = vqec_ifclient_tuner_create (&c->tuner, name);
+  if (err) {
+    vqe_daemon_reply_error (c->sock, vqec_err2str (err));
+    goto out;
+  }
+
+  bp = vqec_ifclient_bind_params_create ();
+  if (!bp || !vqec_ifclient_chan_cfg_parse_sdp (&cfg, sdp,
+          VQEC_CHAN_TYPE_LINEAR)) {
+    vqe_daemon_reply_error (c->sock, "Failed to parse SDP");
+    goto out;
+  }
+  err = vqec_ifclient_tuner_bind_chan_cfg (c->tuner, &cfg, bp);
+  if (err) {
+    vqe_daemon_reply_error (c->sock, vqec_err2str (err));
+    goto out;
+  }
+  c->bound = TRUE;
+
+  /* n_slots has to be a power of two */
+  slot_size = CLAMP (req->slot_size, min_slot_size, max_slot_size);
+  n_slots = CLAMP (req->n_slots, min_slots, GST_VQE_IPC_MAX_SLOTS);
+  n_slots = 1 << g_bit_storage (n_slots - 1);
+  while (n_slots > min_slots &&
+      GST_VQE_IPC_RING_SIZE (slot_size, n_slots) > max_ring_size)
+    n_slots /= 2;
+  c->ring = gst_vqe_ipc_ring_new (slot_size, n_slots, &c->ring_fd);
+  c->event_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (!c->ring || c->event_fd < 0) {
+    vqe_daemon_reply_error (c->sock, g_strerror (errno));
+    goto out;
+  }
+
+  memset (&reply, 0, sizeof (reply));
+  reply.magic = GST_VQE_IPC_MAGIC;
+  reply.status = 0;
+  g_snprintf (reply.stream_uri, sizeof (reply.stream_uri), "rtp://%s:%d",
+      inet_ntoa (cfg.primary_dest_addr), (int) ntohs (cfg.primary_dest_port));
+  fds[0] = c->ring_fd;
+  fds[1] = c->event_fd;
+  if (!gst_vqe_ipc_send_fds (c->sock, &reply, sizeof (reply), fds, 2))
+    goto out;
+
+  g_message ("%s: %s, %u x %u byte slots", name, reply.stream_uri, n_slots,
+      slot_size);
+  ret = TRUE;
+out:
+  if (bp)
+    vqec_ifclient_bind_params_destroy (bp);
+  g_free (msg);
+  return ret;
+}
+
+/* The client never sends anything after the request, so anything readable
+   is the hangup. */
+static gboolean
+vqe_daemon_client_gone (VqeDaemonClient * c)
+{
+  gchar byte;
+  gssize ret = recv (c->sock, &byte, 1, MSG_DONTWAIT | MSG_PEEK);
+
+  return ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+      errno != EINTR);
+}
+
+static gpointer
+vqe_daemon_serve (gpointer data)
+{
+  VqeDaemonClient *c = data;
+  guint8 *scratch = NULL;
+  guint limit;
+
+  if (!vqe_daemon_tune (c))
+    goto out;
+
+  /* compound like vqesrc does: read again while there's room for another
+     datagram */
+  limit = c->ring->slot_size - VQEC_MSG_MAX_DATAGRAM_LEN;
+
+  while (!quit && !vqe_daemon_client_gone (c)) {
+    guint8 *slot = gst_vqe_ipc_ring_reserve (c->ring);
+    gboolean overrun = (slot == NULL);
+    guint32 compounded = 0;
+    vqec_iobuf_t iobuf;
+    int32_t bytes_read;
+    vqec_error_t err = VQEC_OK;
+
+    /* A client which has fallen behind loses data rather than holding up
+       VQE-C, which would then lose it for everyone. */
+    if (overrun) {
+      if (!scratch)
+        scratch = g_malloc (c->ring->slot_size);
+      slot = scratch;
+    }
+
+    while (compounded <= limit) {
+      bytes_read = 0;
+      memset (&iobuf, 0, sizeof (iobuf));
+      iobuf.buf_ptr = slot + compounded;
+      iobuf.buf_len = c->ring->slot_size - compounded;
+      err = vqec_ifclient_tuner_recvmsg (c->tuner, &iobuf, 1, &bytes_read,
+          VQEC_MSG_MAX_RECV_TIMEOUT);
+      if (err || bytes_read == 0)
+        break;
+      compounded += bytes_read;
+    }
+
+    if (err) {
+      g_warning ("Error receiving from VQE-C: %s", vqec_err2str (err));
+      break;
+    }
+    if (compounded == 0)
+      continue;
+
+    if (overrun) {
+      g_atomic_int_inc (&c->ring->overruns);
+      continue;
+    }
+    gst_vqe_ipc_ring_publish (c->ring, compounded);
+    vqe_daemon_notify (c);
+  }
+
+out:
+  if (c->ring) {
+    g_atomic_int_set (&c->ring->closed, 1);
+    if (c->event_fd >= 0)
+      vqe_daemon_notify (c);
+    gst_vqe_ipc_ring_free (c->ring);
+  }
+  if (c->bound)
+    vqec_ifclient_tuner_unbind_chan (c->tuner);
+  if (c->tuner != VQEC_TUNERID_INVALID)
+    vqec_ifclient_tuner_destroy (c->tuner);
+  if (c->ring_fd >= 0)
+    close (c->ring_fd);
+  if (c->event_fd >= 0)
+    close (c->event_fd);
+  close (c->sock);
+  g_free (scratch);
+  g_free (c);
+
+  g_mutex_lock (&clients_lock);
+  n_clients--;
+  g_cond_signal (&clients_cond);
+  g_mutex_unlock (&clients_lock);
+  return NULL;
+}
+
+static void
+vqe_daemon_quit (int signum)
+{
+  quit = 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *config = NULL;
+  gchar *path = NULL;
+  GOptionEntry entries[] = {
+    {"config", 'c', 0, G_OPTION_ARG_FILENAME, &config,
+        "VQE-C configuration file", "FILE"},
+    {"socket", 's', 0, G_OPTION_ARG_FILENAME, &path,
+        "Socket to listen on (default " GST_VQE_IPC_DEFAULT_SOCKET ")", "PATH"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  GThread *worker;
+  vqec_error_t err;
+  gint sock;
+  mode_t old_umask;
+  gboolean bound;
+  /* the request follows the connect straight away; a client which never
+     sends it mustn't hold up shutdown */
+  const struct timeval request_timeout = { 1, 0 };
+
+  ctx = g_option_context_new ("- share VQE-C tuners between processes");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (!config)
+    config = g_strdup (CONFIG_DIR "/vqe-c/vqe-c.cfg");
+  if (!path)
+    path = g_strdup (GST_VQE_IPC_DEFAULT_SOCKET);
+
+  err = vqec_ifclient_init (config);
+  if (err) {
+    fprintf (stderr, "Failed to initialise VQE-C with %s: %s\n", config,
+        vqec_err2str (err));
+    return 1;
+  }
+  worker = g_thread_new ("vqec", vqe_daemon_worker, NULL);
+
+  /* no SA_RESTART so that accept() returns */
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = vqe_daemon_quit;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  signal (SIGPIPE, SIG_IGN);
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen (path) >= sizeof (addr.sun_path)) {
+    fprintf (stderr, "Socket path too long: %s\n", path);
+    return 1;
+  }
+  strcpy (addr.sun_path, path);
+  unlink (path);
+  sock = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  /* only our user and group may connect, and so tune */
+  old_umask = umask (S_IRWXO | S_IXUSR | S_IXGRP);
+  bound = sock >= 0 && bind (sock, (struct sockaddr *) &addr,
+      sizeof (addr)) == 0;
+  umask (old_umask);
+  if (!bound || listen (sock, 16) < 0) {
+    fprintf (stderr, "Failed to listen on %s: %s\n", path, g_strerror (errno));
+    return 1;
+  }
+
+  while (!quit) {
+    VqeDaemonClient *c;
+    gint fd = accept (sock, NULL, NULL);
+
+    if (fd < 0) {
+      if (errno != EINTR) {
+        g_warning ("accept failed: %s", g_strerror (errno));
+        g_usleep (G_USEC_PER_SEC / 10);
+      }
+      continue;
+    }
+
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &request_timeout,
+        sizeof (request_timeout));
+    c = g_new0 (VqeDaemonClient, 1);
+    c->sock = fd;
+    c->tuner = VQEC_TUNERID_INVALID;
+    c->ring_fd = -1;
+    c->event_fd = -1;
+    g_mutex_lock (&clients_lock);
+    n_clients++;
+    g_mutex_unlock (&clients_lock);
+    g_thread_unref (g_thread_new ("vqed-client", vqe_daemon_serve, c));
+  }
+
+  /* clients see their rings closed as their threads notice quit, within a
+     receive timeout, and VQE-C has to outlive them */
+  close (sock);
+  unlink (path);
+  g_mutex_lock (&clients_lock);
+  while (n_clients > 0)
+    g_cond_wait (&clients_cond, &clients_lock);
+  g_mutex_unlock (&clients_lock);
+  vqec_ifclient_stop ();
+  g_thread_join (worker);
+
+  g_free (config);
+  g_free (path);
+  return 0;
+}
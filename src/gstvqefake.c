@@ -0,0 +1,453 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A stand-in for VQE-C which needs no network: each bound tuner hands out
+ * the synthetic stream of gstvqesynth.h, post-repair and without RTP
+ * headers as VQE-C would, losing datagrams to a configurable pattern and
+ * delivering the rest a fixed delay, plus some jitter, after they're due.
+ * That loss happens upstream of the repair server, so is never repaired.
+ * Datagrams dropped by tuner_set_loss()'s primary pattern are, a repair
+ * round trip late, unless its repair pattern drops the retransmission too.
+ * Selected with GSTVQE_BACKEND=fake and configured with GSTVQE_FAKE, a comma
+ * separated list of:
+ *
+ *   bitrate=BPS        of each channel (default 4000000)
+ *   rap-interval=MS    between random access points (default 500)
+ *   loss=PATTERN       none, uniform:P, gilbert:P:R or periodic:N
+ *   delay=MS, jitter=MS
+ *   repair-rtt=MS      (default 20)
+ *   rtp=1              leave the RTP headers on, as VQE-C does with
+ *                      strip_rtp = false
+ *   paced=0            hand datagrams out as fast as they're asked for
+ *                      rather than at the bitrate, for microbenchmarks
+ *   seed=N             for the loss pattern and jitter
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqebackend.h"
+#include "gstvqesynth.h"
+
+#include <vqec_ifclient_defs.h>
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FAKE_MAX_TUNERS 64
+
+typedef struct {
+  gboolean used;
+  gboolean bound;
+  gchar url[128];
+  GstVQESynthStream stream;
+  GstVQESynthLoss loss;
+  GstVQESynthLoss primary_loss;
+  GstVQESynthLoss repair_loss;
+  gboolean in_loss, in_loss_before_ec;
+  gint64 release;               /* of the next datagram, or -1 */
+  gint64 last_release;
+  gboolean decided;             /* the next datagram's fate is known */
+  gboolean lost;
+  guint32 jitter_state;
+  vqec_ifclient_stats_channel_t stats;
+} FakeTuner;
+
+static struct {
+  guint64 bitrate;
+  guint rap_interval;
+  gchar *loss;
+  gint64 delay;
+  gint64 jitter;
+  gint64 repair_rtt;
+  gboolean rtp;
+  gboolean paced;
+  guint32 seed;
+} fake_config = {
+4000000, 500, NULL, 0, 0, 20000, FALSE, TRUE, 1};
+
+/* guards everything but a tuner's stream, which only its reader uses */
+static GMutex fake_lock;
+static GCond fake_cond;
+static gboolean fake_running = FALSE;
+static FakeTuner fake_tuners[FAKE_MAX_TUNERS];
+
+static vqec_error_t
+fake_init (const char *config)
+{
+  const gchar *env = g_getenv ("GSTVQE_FAKE");
+  gchar **opts, **opt;
+
+  if (!env)
+    return VQEC_OK;
+
+  opts = g_strsplit (env, ",", -1);
+  for (opt = opts; *opt; opt++) {
+    gchar *value = strchr (*opt, '=');
+
+    if (!value) {
+      g_warning ("Ignoring fake VQE-C option without a value: %s", *opt);
+      continue;
+    }
+    *value++ = '\0';
+    if (g_str_equal (*opt, "bitrate"))
+      fake_config.bitrate = g_ascii_strtoull (value, NULL, 10);
+    else if (g_str_equal (*opt, "rap-interval"))
+      fake_config.rap_interval = atoi (value);
+    else if (g_str_equal (*opt, "loss")) {
+      GstVQESynthLoss loss;
+
+      if (gst_vqe_synth_loss_parse (&loss, value, 1)) {
+        g_free (fake_config.loss);
+        fake_config.loss = g_strdup (value);
+      } else {
+        g_warning ("Invalid fake VQE-C loss pattern: %s", value);
+      }
+    } else if (g_str_equal (*opt, "delay"))
+      fake_config.delay = atoi (value) * G_GINT64_CONSTANT (1000);
+    else if (g_str_equal (*opt, "jitter"))
+      fake_config.jitter = atoi (value) * G_GINT64_CONSTANT (1000);
+    else if (g_str_equal (*opt, "repair-rtt"))
+      fake_config.repair_rtt = atoi (value) * G_GINT64_CONSTANT (1000);
+    else if (g_str_equal (*opt, "rtp"))
+      fake_config.rtp = atoi (value) != 0;
+    else if (g_str_equal (*opt, "paced"))
+      fake_config.paced = atoi (value) != 0;
+    else if (g_str_equal (*opt, "seed"))
+      fake_config.seed = atoi (value);
+    else
+      g_warning ("Unknown fake VQE-C option: %s", *opt);
+  }
+  g_strfreev (opts);
+
+  return VQEC_OK;
+}
+
+/* There are no timers to run, so the event loop just waits to be told to
+   stop, as vqec_ifclient_start() would */
+static void
+fake_start (void)
+{
+  g_mutex_lock (&fake_lock);
+  fake_running = TRUE;
+  while (fake_running)
+    g_cond_wait (&fake_cond, &fake_lock);
+  g_mutex_unlock (&fake_lock);
+}
+
+static void
+fake_stop (void)
+{
+  g_mutex_lock (&fake_lock);
+  fake_running = FALSE;
+  g_cond_broadcast (&fake_cond);
+  g_mutex_unlock (&fake_lock);
+}
+
+static vqec_error_t
+fake_tuner_create (vqec_tunerid_t * id, const char *name)
+{
+  vqec_tunerid_t i;
+
+  g_mutex_lock (&fake_lock);
+  for (i = 0; i < FAKE_MAX_TUNERS && fake_tuners[i].used; i++);
+  if (i == FAKE_MAX_TUNERS) {
+    g_mutex_unlock (&fake_lock);
+    return VQEC_ERR_MAXLIMITTUNER;
+  }
+  memset (&fake_tuners[i], 0, sizeof (FakeTuner));
+  fake_tuners[i].used = TRUE;
+  g_mutex_unlock (&fake_lock);
+
+  *id = i;
+  return VQEC_OK;
+}
+
+static FakeTuner *
+fake_get_tuner (vqec_tunerid_t id)
+{
+  if (id < 0 || id >= FAKE_MAX_TUNERS || !fake_tuners[id].used)
+    return NULL;
+  return &fake_tuners[id];
+}
+
+static vqec_error_t
+fake_tuner_destroy (vqec_tunerid_t id)
+{
+  FakeTuner *t;
+
+  g_mutex_lock (&fake_lock);
+  if ((t = fake_get_tuner (id)))
+    t->used = FALSE;
+  g_mutex_unlock (&fake_lock);
+  return t ? VQEC_OK : VQEC_ERR_NOSUCHTUNER;
+}
+
+static vqec_error_t
+fake_tuner_bind_chan_cfg (vqec_tunerid_t id, vqec_chan_cfg_t * cfg,
+    vqec_bind_params_t * bp)
+{
+  FakeTuner *t;
+
+  g_mutex_lock (&fake_lock);
+  if (!(t = fake_get_tuner (id))) {
+    g_mutex_unlock (&fake_lock);
+    return VQEC_ERR_NOSUCHTUNER;
+  }
+
+  /* the same uri vqesrc asks for stats by */
+  snprintf (t->url, sizeof (t->url), "rtp://%s:%d",
+      inet_ntoa (cfg->primary_dest_addr), (int) ntohs (cfg->primary_dest_port));
+  gst_vqe_synth_stream_init (&t->stream, id, fake_config.bitrate,
+      fake_config.rap_interval, g_get_monotonic_time ());
+  gst_vqe_synth_loss_parse (&t->loss, fake_config.loss,
+      fake_config.seed + id);
+  gst_vqe_synth_loss_parse (&t->primary_loss, NULL, 0);
+  gst_vqe_synth_loss_parse (&t->repair_loss, NULL, 0);
+  t->jitter_state = fake_config.seed + id;
+  t->in_loss = t->in_loss_before_ec = FALSE;
+  t->release = -1;
+  t->last_release = 0;
+  t->decided = FALSE;
+  memset (&t->stats, 0, sizeof (t->stats));
+  t->bound = TRUE;
+  g_mutex_unlock (&fake_lock);
+
+  return VQEC_OK;
+}
+
+static vqec_error_t
+fake_tuner_unbind_chan (vqec_tunerid_t id)
+{
+  FakeTuner *t;
+
+  g_mutex_lock (&fake_lock);
+  if ((t = fake_get_tuner (id)))
+    t->bound = FALSE;
+  g_mutex_unlock (&fake_lock);
+  return t ? VQEC_OK : VQEC_ERR_NOSUCHTUNER;
+}
+
+/* When the next datagram comes out: due, plus the delay and some jitter,
+   but never before the one in front of it */
+static gint64
+fake_release_time (FakeTuner * t)
+{
+  if (t->release < 0) {
+    gint64 jitter = 0;
+
+    if (fake_config.jitter > 0) {
+      t->jitter_state ^= t->jitter_state << 13;
+      t->jitter_state ^= t->jitter_state >> 17;
+      t->jitter_state ^= t->jitter_state << 5;
+      jitter = t->jitter_state % fake_config.jitter;
+    }
+    t->release = MAX (t->last_release,
+        gst_vqe_synth_stream_due (&t->stream) + fake_config.delay + jitter);
+  }
+  return t->release;
+}
+
+/* Decides what happens to the next datagram, counting it as VQE-C would.
+   Returns TRUE if it's to be repaired. */
+static gboolean
+fake_decide (FakeTuner * t)
+{
+  gboolean lost_before_ec = FALSE, repaired = FALSE;
+
+  t->lost = FALSE;
+  t->stats.tr135_packets_expected++;
+  if (gst_vqe_synth_loss_drop (&t->loss)) {
+    t->lost = lost_before_ec = TRUE;
+  } else {
+    t->stats.primary_udp_inputs++;
+    if (gst_vqe_synth_loss_drop (&t->primary_loss)) {
+      /* the drop simulator counts as a drop by VQE-C */
+      t->stats.primary_rtp_drops++;
+      t->stats.repairs_requested++;
+      lost_before_ec = TRUE;
+      if (gst_vqe_synth_loss_drop (&t->repair_loss)) {
+        t->stats.repair_rtp_drops++;
+        t->lost = TRUE;
+      } else {
+        t->stats.repair_rtp_inputs++;
+        repaired = TRUE;
+      }
+    } else {
+      t->stats.primary_rtp_inputs++;
+    }
+  }
+
+  if (lost_before_ec) {
+    t->stats.pre_repair_losses++;
+    t->stats.tr135_packets_lost_before_ec++;
+    if (!t->in_loss_before_ec)
+      t->stats.tr135_loss_events_before_ec++;
+  }
+  if (t->lost) {
+    t->stats.post_repair_losses++;
+    t->stats.tr135_packets_lost++;
+    if (!t->in_loss)
+      t->stats.tr135_loss_events++;
+  } else {
+    t->stats.post_repair_outputs++;
+    t->stats.tr135_packets_received++;
+  }
+  t->in_loss_before_ec = lost_before_ec;
+  t->in_loss = t->lost;
+
+  return repaired;
+}
+
+static vqec_error_t
+fake_tuner_recvmsg (vqec_tunerid_t id, vqec_iobuf_t * iobuf,
+    int32_t iobuf_num, int32_t * len, int32_t timeout)
+{
+  guint8 datagram[GST_VQE_SYNTH_RTP_HEADER_SIZE + GST_VQE_SYNTH_DATAGRAM_SIZE];
+  gint64 deadline = g_get_monotonic_time () + (gint64) timeout * 1000;
+  FakeTuner *t;
+  gsize size;
+
+  *len = 0;
+  if (iobuf_num < 1 || iobuf[0].buf_len < sizeof (datagram))
+    return VQEC_ERR_INVALIDARGS;
+
+  g_mutex_lock (&fake_lock);
+  if (!(t = fake_get_tuner (id))) {
+    g_mutex_unlock (&fake_lock);
+    return VQEC_ERR_NOSUCHTUNER;
+  }
+
+  for (;;) {
+    gint64 release, now;
+
+    if (!t->bound) {
+      g_mutex_unlock (&fake_lock);
+      g_usleep (MAX (deadline - g_get_monotonic_time (), 0));
+      return VQEC_OK;
+    }
+
+    release = fake_release_time (t);
+    if (fake_config.paced && release > (now = g_get_monotonic_time ())) {
+      g_mutex_unlock (&fake_lock);
+      if (release > deadline) {
+        g_usleep (MAX (deadline - now, 0));
+        return VQEC_OK;
+      }
+      g_usleep (release - now);
+      g_mutex_lock (&fake_lock);
+      continue;
+    }
+
+    /* each datagram is only lost or not once it's due, and a repaired one
+       comes out a round trip later */
+    if (!t->decided) {
+      t->decided = TRUE;
+      if (fake_decide (t) && fake_config.paced && fake_config.repair_rtt) {
+        t->release += fake_config.repair_rtt;
+        continue;
+      }
+    }
+
+    size = gst_vqe_synth_stream_next (&t->stream, datagram, fake_config.rtp);
+    t->last_release = t->release;
+    t->release = -1;
+    t->decided = FALSE;
+    if (!t->lost)
+      break;
+  }
+  g_mutex_unlock (&fake_lock);
+
+  memcpy (iobuf[0].buf_ptr, datagram, size);
+  iobuf[0].buf_wrlen = size;
+  *len = size;
+  return VQEC_OK;
+}
+
+static gboolean
+fake_tuner_set_loss (vqec_tunerid_t id, const gchar * primary,
+    const gchar * repair)
+{
+  FakeTuner *t;
+
+  g_mutex_lock (&fake_lock);
+  if ((t = fake_get_tuner (id))) {
+    gst_vqe_synth_loss_parse (&t->primary_loss, primary,
+        fake_config.seed + id + FAKE_MAX_TUNERS);
+    gst_vqe_synth_loss_parse (&t->repair_loss, repair,
+        fake_config.seed + id + 2 * FAKE_MAX_TUNERS);
+  }
+  g_mutex_unlock (&fake_lock);
+  return t != NULL;
+}
+
+static vqec_error_t
+fake_get_stats (vqec_ifclient_stats_t * stats)
+{
+  memset (stats, 0, sizeof (*stats));
+  return VQEC_OK;
+}
+
+static vqec_error_t
+fake_get_stats_channel (const char *url, vqec_ifclient_stats_channel_t * stats)
+{
+  vqec_tunerid_t i;
+
+  g_mutex_lock (&fake_lock);
+  for (i = 0; i < FAKE_MAX_TUNERS; i++) {
+    if (fake_tuners[i].used && fake_tuners[i].bound &&
+        g_str_equal (fake_tuners[i].url, url)) {
+      *stats = fake_tuners[i].stats;
+      g_mutex_unlock (&fake_lock);
+      return VQEC_OK;
+    }
+  }
+  g_mutex_unlock (&fake_lock);
+  return VQEC_ERR_NOSUCHTUNER;
+}
+
+static void
+fake_set_tr135_params_channel (const char *url,
+    vqec_ifclient_tr135_params_t * params)
+{
+}
+
+const GstVQEBackend gst_vqe_backend_fake = {
+  "fake",
+  fake_init,
+  fake_start,
+  fake_stop,
+  fake_tuner_create,
+  fake_tuner_destroy,
+  fake_tuner_bind_chan_cfg,
+  fake_tuner_unbind_chan,
+  fake_tuner_recvmsg,
+  fake_tuner_set_loss,
+  fake_get_stats,
+  fake_get_stats_channel,
+  fake_set_tr135_params_channel
+};
@@ -0,0 +1,116 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqehistogram.h"
+
+#include <string.h>
+
+/* largest value which falls in @bucket */
+static guint64
+bucket_upper (guint bucket)
+{
+  if (bucket == 0)
+    return 0;
+  if (bucket == 64)
+    return G_MAXUINT64;
+  return (G_GUINT64_CONSTANT (1) << bucket) - 1;
+}
+
+void
+gst_vqe_histogram_reset (GstVQEHistogram * hist)
+{
+  memset (hist, 0, sizeof (*hist));
+}
+
+void
+gst_vqe_histogram_add (GstVQEHistogram * hist, guint64 value)
+{
+  gst_vqe_histogram_add_n (hist, value, 1);
+}
+
+/* Counts @value @n times */
+void
+gst_vqe_histogram_add_n (GstVQEHistogram * hist, guint64 value, guint64 n)
+{
+  if (!n)
+    return;
+  hist->buckets[value ? g_bit_storage (value) : 0] += n;
+  hist->count += n;
+  hist->sum += value * n;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+void
+gst_vqe_histogram_merge (GstVQEHistogram * hist, const GstVQEHistogram * other)
+{
+  guint i;
+
+  for (i = 0; i < GST_VQE_HISTOGRAM_BUCKETS; i++)
+    hist->buckets[i] += other->buckets[i];
+  hist->count += other->count;
+  hist->sum += other->sum;
+  hist->max = MAX (hist->max, other->max);
+}
+
+/* Returns the upper bound of the bucket the percentile falls in, but never
+   more than the largest value seen. */
+guint64
+gst_vqe_histogram_percentile (const GstVQEHistogram * hist,
+    gdouble percentile)
+{
+  guint64 target, seen = 0;
+  guint i;
+
+  if (hist->count == 0)
+    return 0;
+
+  target = (guint64) (hist->count * percentile / 100.0 + 0.5);
+  target = CLAMP (target, 1, hist->count);
+  for (i = 0; i < GST_VQE_HISTOGRAM_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= target)
+      return MIN (bucket_upper (i), hist->max);
+  }
+  return hist->max;
+}
+
+/* "<=upper:count" for each non-empty bucket, e.g. "<=1023:10 <=2047:3" */
+gchar *
+gst_vqe_histogram_to_string (const GstVQEHistogram * hist)
+{
+  GString *str = g_string_new (NULL);
+  guint i;
+
+  for (i = 0; i < GST_VQE_HISTOGRAM_BUCKETS; i++) {
+    if (hist->buckets[i])
+      g_string_append_printf (str, "%s<=%" G_GUINT64_FORMAT ":%"
+          G_GUINT64_FORMAT, str->len ? " " : "", bucket_upper (i),
+          hist->buckets[i]);
+  }
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,60 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_HISTOGRAM_H__
+#define __GST_VQE_HISTOGRAM_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GST_VQE_HISTOGRAM_BUCKETS 65
+
+/*
+ * A histogram with power of two buckets: bucket n counts values which need n
+ * bits, i.e. 0 is on its own and bucket n > 0 holds [2^(n-1), 2^n).  Cheap
+ * enough to update on every buffer and coarse enough that percentiles are
+ * only good to within a factor of two, which is plenty to see where time
+ * goes.  Not thread safe.
+ */
+typedef struct {
+  guint64 count;
+  guint64 sum;
+  guint64 max;
+  guint64 buckets[GST_VQE_HISTOGRAM_BUCKETS];
+} GstVQEHistogram;
+
+void     gst_vqe_histogram_reset      (GstVQEHistogram * hist);
+void     gst_vqe_histogram_add        (GstVQEHistogram * hist, guint64 value);
+void     gst_vqe_histogram_add_n      (GstVQEHistogram * hist, guint64 value,
+                                       guint64 n);
+void     gst_vqe_histogram_merge      (GstVQEHistogram * hist,
+                                       const GstVQEHistogram * other);
+guint64  gst_vqe_histogram_percentile (const GstVQEHistogram * hist,
+                                       gdouble percentile);
+gchar   *gst_vqe_histogram_to_string  (const GstVQEHistogram * hist);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_HISTOGRAM_H__ */
@@ -0,0 +1,489 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* memfd_create */
+#endif
+
+#include "gstvqeipc.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+typedef struct {
+  GstVQEIpcClient *client;
+  guint index;
+} GstVQEIpcSlotRef;
+
+struct _GstVQEIpcClient {
+  gint refcount;
+
+  gint sock;
+  gint event_fd;
+  GstVQEIpcRing *ring;
+  gsize ring_size;
+  /* the ring's geometry as validated on connecting, as the daemon could
+     change what the shared header says afterwards */
+  guint n_slots;
+  gsize slot_size;
+  guint mask;
+  guint next;                   /* receive counter, runs ahead of ring->tail */
+  gchar stream_uri[128];
+
+  /* slots can be freed downstream in any order but the tail only moves past
+     a contiguous run of released ones */
+  GMutex lock;
+  gboolean *released;
+  GstVQEIpcSlotRef *slots;
+};
+
+GQuark
+gst_vqe_ipc_error_quark (void)
+{
+  return g_quark_from_static_string ("gst-vqe-ipc-error-quark");
+}
+
+static inline GstVQEIpcSlot *
+gst_vqe_ipc_ring_slot (GstVQEIpcRing * ring, guint counter)
+{
+  return (GstVQEIpcSlot *) ((guint8 *) ring + sizeof (GstVQEIpcRing) +
+      (gsize) (counter & (ring->n_slots - 1)) *
+      GST_VQE_IPC_SLOT_STRIDE (ring->slot_size));
+}
+
+/*
+ *  Daemon side
+ */
+
+GstVQEIpcRing *
+gst_vqe_ipc_ring_new (guint slot_size, guint n_slots, gint * fd)
+{
+#ifdef HAVE_MEMFD_CREATE
+  GstVQEIpcRing *ring;
+  gsize size;
+
+  g_return_val_if_fail (n_slots > 0 && (n_slots & (n_slots - 1)) == 0, NULL);
+
+  size = GST_VQE_IPC_RING_SIZE (slot_size, n_slots);
+  *fd = memfd_create ("gst-vqe-ring", MFD_CLOEXEC);
+  if (*fd < 0)
+    return NULL;
+  if (ftruncate (*fd, size) < 0)
+    goto failed;
+  ring = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      *fd, 0);
+  if (ring == MAP_FAILED)
+    goto failed;
+
+  ring->n_slots = n_slots;
+  ring->slot_size = slot_size;
+  ring->closed = 0;
+  ring->overruns = 0;
+  ring->head = 0;
+  ring->tail = 0;
+  g_atomic_int_set ((gint *) & ring->magic, GST_VQE_IPC_MAGIC);
+  return ring;
+
+failed:
+  close (*fd);
+  *fd = -1;
+  return NULL;
+#else
+  errno = ENOSYS;
+  *fd = -1;
+  return NULL;
+#endif
+}
+
+void
+gst_vqe_ipc_ring_free (GstVQEIpcRing * ring)
+{
+  munmap (ring, GST_VQE_IPC_RING_SIZE (ring->slot_size, ring->n_slots));
+}
+
+/* Returns where to write the next slot's data, or NULL if the client hasn't
+   released enough for there to be a free one. */
+guint8 *
+gst_vqe_ipc_ring_reserve (GstVQEIpcRing * ring)
+{
+  guint head = ring->head;
+  guint tail = g_atomic_int_get (&ring->tail);
+
+  if (head - tail >= ring->n_slots)
+    return NULL;
+  return (guint8 *) (gst_vqe_ipc_ring_slot (ring, head) + 1);
+}
+
+void
+gst_vqe_ipc_ring_publish (GstVQEIpcRing * ring, gsize size)
+{
+  guint head = ring->head;
+
+  gst_vqe_ipc_ring_slot (ring, head)->size = size;
+  /* the barrier makes sure the data is visible before the new head */
+  g_atomic_int_set (&ring->head, head + 1);
+}
+
+gboolean
+gst_vqe_ipc_send_fds (gint sock, gconstpointer msg, gsize size,
+    const gint * fds, guint n_fds)
+{
+  struct msghdr mh;
+  struct iovec iov;
+  union {
+    struct cmsghdr align;
+    gchar buf[CMSG_SPACE (sizeof (gint) * 4)];
+  } control;
+  struct cmsghdr *cmsg;
+
+  g_return_val_if_fail (n_fds <= 4, FALSE);
+
+  memset (&mh, 0, sizeof (mh));
+  iov.iov_base = (gpointer) msg;
+  iov.iov_len = size;
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+
+  if (n_fds > 0) {
+    mh.msg_control = control.buf;
+    mh.msg_controllen = CMSG_SPACE (sizeof (gint) * n_fds);
+    cmsg = CMSG_FIRSTHDR (&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (gint) * n_fds);
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (gint) * n_fds);
+  }
+
+  return sendmsg (sock, &mh, MSG_NOSIGNAL) == (gssize) size;
+}
+
+/*
+ *  Client side
+ */
+
+static gssize
+gst_vqe_ipc_recv_fds (gint sock, gpointer msg, gsize size, gint * fds,
+    guint n_fds, guint * n_received)
+{
+  struct msghdr mh;
+  struct iovec iov;
+  union {
+    struct cmsghdr align;
+    gchar buf[CMSG_SPACE (sizeof (gint) * 4)];
+  } control;
+  struct cmsghdr *cmsg;
+  gssize ret;
+
+  memset (&mh, 0, sizeof (mh));
+  iov.iov_base = msg;
+  iov.iov_len = size;
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = control.buf;
+  mh.msg_controllen = sizeof (control.buf);
+
+  *n_received = 0;
+  do {
+    ret = recvmsg (sock, &mh, MSG_CMSG_CLOEXEC);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0)
+    return ret;
+
+  for (cmsg = CMSG_FIRSTHDR (&mh); cmsg; cmsg = CMSG_NXTHDR (&mh, cmsg)) {
+    guint n, i;
+    gint *received = (gint *) CMSG_DATA (cmsg);
+
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (gint);
+    for (i = 0; i < n; i++) {
+      if (*n_received < n_fds)
+        fds[(*n_received)++] = received[i];
+      else
+        close (received[i]);
+    }
+  }
+  return ret;
+}
+
+GstVQEIpcClient *
+gst_vqe_ipc_client_connect (const gchar * path, const gchar * sdp,
+    guint slot_size, guint n_slots, GError ** error)
+{
+  GstVQEIpcClient *client;
+  struct sockaddr_un addr;
+  GstVQEIpcTuneRequest req;
+  GstVQEIpcTuneReply reply;
+  gsize sdp_len;
+  gchar *msg;
+  gint fds[2] = { -1, -1 };
+  guint n_fds, i;
+  gboolean sent;
+  struct stat st;
+
+  if (!sdp || !sdp[0]) {
+    g_set_error (error, GST_VQE_IPC_ERROR, 0, "No SDP to tune to");
+    return NULL;
+  }
+  sdp_len = strlen (sdp);
+  if (strlen (path) >= sizeof (addr.sun_path) ||
+      sdp_len > GST_VQE_IPC_MAX_SDP_LEN) {
+    g_set_error (error, GST_VQE_IPC_ERROR, 0, "Socket path or SDP too long");
+    return NULL;
+  }
+
+  client = g_new0 (GstVQEIpcClient, 1);
+  client->refcount = 1;
+  client->event_fd = -1;
+  g_mutex_init (&client->lock);
+
+  client->sock = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (client->sock < 0)
+    goto errno_error;
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  if (connect (client->sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    goto errno_error;
+
+  req.magic = GST_VQE_IPC_MAGIC;
+  req.version = GST_VQE_IPC_VERSION;
+  req.slot_size = slot_size;
+  req.n_slots = n_slots;
+  msg = g_malloc (sizeof (req) + sdp_len);
+  memcpy (msg, &req, sizeof (req));
+  memcpy (msg + sizeof (req), sdp, sdp_len);
+  sent = gst_vqe_ipc_send_fds (client->sock, msg, sizeof (req) + sdp_len,
+      NULL, 0);
+  g_free (msg);
+  if (!sent)
+    goto errno_error;
+
+  if (gst_vqe_ipc_recv_fds (client->sock, &reply, sizeof (reply), fds, 2,
+          &n_fds) != sizeof (reply) || reply.magic != GST_VQE_IPC_MAGIC) {
+    g_set_error (error, GST_VQE_IPC_ERROR, 0, "Bad reply from daemon");
+    goto error;
+  }
+  if (reply.status != 0) {
+    reply.error[sizeof (reply.error) - 1] = '\0';
+    g_set_error (error, GST_VQE_IPC_ERROR, reply.status, "Daemon failed to "
+        "tune: %s", reply.error);
+    goto error;
+  }
+  if (n_fds != 2) {
+    g_set_error (error, GST_VQE_IPC_ERROR, 0, "Daemon didn't pass the ring");
+    goto error;
+  }
+  client->event_fd = fds[1];
+  fds[1] = -1;
+  reply.stream_uri[sizeof (reply.stream_uri) - 1] = '\0';
+  g_strlcpy (client->stream_uri, reply.stream_uri, sizeof (client->stream_uri));
+
+  /* don't trust the header until we know the mapping covers what it says */
+  if (fstat (fds[0], &st) < 0 || st.st_size < (off_t) sizeof (GstVQEIpcRing))
+    goto bad_ring;
+  client->ring_size = st.st_size;
+  client->ring = mmap (NULL, client->ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fds[0], 0);
+  close (fds[0]);
+  fds[0] = -1;
+  if (client->ring == MAP_FAILED) {
+    client->ring = NULL;
+    goto errno_error;
+  }
+  if (client->ring->magic != GST_VQE_IPC_MAGIC ||
+      client->ring->n_slots == 0 ||
+      client->ring->n_slots > GST_VQE_IPC_MAX_SLOTS ||
+      (client->ring->n_slots & (client->ring->n_slots - 1)) != 0 ||
+      GST_VQE_IPC_RING_SIZE (client->ring->slot_size,
+          client->ring->n_slots) > client->ring_size)
+    goto bad_ring;
+
+  client->n_slots = client->ring->n_slots;
+  client->slot_size = client->ring->slot_size;
+  client->mask = client->n_slots - 1;
+  client->next = g_atomic_int_get (&client->ring->tail);
+  client->released = g_new0 (gboolean, client->n_slots);
+  client->slots = g_new (GstVQEIpcSlotRef, client->n_slots);
+  for (i = 0; i < client->n_slots; i++) {
+    client->slots[i].client = client;
+    client->slots[i].index = i;
+  }
+
+  return client;
+
+errno_error:
+  g_set_error (error, GST_VQE_IPC_ERROR, errno, "%s", g_strerror (errno));
+  goto error;
+bad_ring:
+  g_set_error (error, GST_VQE_IPC_ERROR, 0, "Daemon passed a bad ring");
+error:
+  for (i = 0; i < G_N_ELEMENTS (fds); i++)
+    if (fds[i] >= 0)
+      close (fds[i]);
+  gst_vqe_ipc_client_unref (client);
+  return NULL;
+}
+
+GstVQEIpcClient *
+gst_vqe_ipc_client_ref (GstVQEIpcClient * client)
+{
+  g_atomic_int_inc (&client->refcount);
+  return client;
+}
+
+void
+gst_vqe_ipc_client_unref (GstVQEIpcClient * client)
+{
+  if (!g_atomic_int_dec_and_test (&client->refcount))
+    return;
+
+  if (client->ring)
+    munmap (client->ring, client->ring_size);
+  if (client->event_fd >= 0)
+    close (client->event_fd);
+  if (client->sock >= 0)
+    close (client->sock);
+  g_free (client->released);
+  g_free (client->slots);
+  g_mutex_clear (&client->lock);
+  g_free (client);
+}
+
+/* Hangs up, so the daemon unbinds the tuner.  Slots still downstream stay
+   mapped until they're released. */
+void
+gst_vqe_ipc_client_close (GstVQEIpcClient * client)
+{
+  if (client->sock >= 0)
+    shutdown (client->sock, SHUT_RDWR);
+}
+
+const gchar *
+gst_vqe_ipc_client_get_stream_uri (GstVQEIpcClient * client)
+{
+  return client->stream_uri;
+}
+
+guint
+gst_vqe_ipc_client_get_overruns (GstVQEIpcClient * client)
+{
+  return g_atomic_int_get (&client->ring->overruns);
+}
+
+/**
+ * gst_vqe_ipc_client_receive:
+ *
+ * Waits up to @timeout_ms for the daemon to publish a slot.  On success @data
+ * and @size describe its contents, which stay valid until @slot is passed to
+ * gst_vqe_ipc_client_release(); @slot holds a reference to @client.
+ *
+ * Returns: 1 if a slot was received, 0 on timeout or -1 if the daemon has
+ * gone away.
+ */
+gint
+gst_vqe_ipc_client_receive (GstVQEIpcClient * client, gint timeout_ms,
+    const guint8 ** data, gsize * size, gpointer * slot)
+{
+  GstVQEIpcRing *ring = client->ring;
+  GstVQEIpcSlot *s;
+  guint head = g_atomic_int_get (&ring->head);
+  guint index;
+
+  if (head == client->next) {
+    struct pollfd fds[2];
+    guint64 count;
+
+    if (g_atomic_int_get (&ring->closed))
+      return -1;
+
+    fds[0].fd = client->event_fd;
+    fds[0].events = POLLIN;
+    /* the daemon never sends anything after the reply so readable means
+       hung up */
+    fds[1].fd = client->sock;
+    fds[1].events = POLLIN;
+    if (poll (fds, 2, timeout_ms) < 0) {
+      if (errno != EINTR)
+        return -1;
+      /* interrupted, so nothing to look at but the head */
+      fds[0].revents = fds[1].revents = 0;
+    }
+    if (fds[1].revents)
+      return -1;
+    /* the eventfd is non-blocking, so another reader beating us to it is
+       EAGAIN; anything else and we can't wait on it any more */
+    if ((fds[0].revents & POLLIN) &&
+        read (client->event_fd, &count, sizeof (count)) < 0 &&
+        errno != EAGAIN && errno != EINTR)
+      return -1;
+
+    head = g_atomic_int_get (&ring->head);
+    if (head == client->next)
+      return 0;
+  }
+
+  index = client->next & client->mask;
+  s = (GstVQEIpcSlot *) ((guint8 *) ring + sizeof (GstVQEIpcRing) +
+      (gsize) index * GST_VQE_IPC_SLOT_STRIDE (client->slot_size));
+  client->next++;
+
+  *data = (const guint8 *) (s + 1);
+  *size = MIN (s->size, client->slot_size);
+  *slot = &client->slots[index];
+  gst_vqe_ipc_client_ref (client);
+  return 1;
+}
+
+/* A GDestroyNotify so it can be given straight to gst_buffer_new_wrapped_full
+   and friends. */
+void
+gst_vqe_ipc_client_release (gpointer slot)
+{
+  GstVQEIpcSlotRef *ref = slot;
+  GstVQEIpcClient *client = ref->client;
+  guint tail;
+
+  g_mutex_lock (&client->lock);
+  client->released[ref->index] = TRUE;
+  tail = client->ring->tail;
+  while (tail != client->next && client->released[tail & client->mask]) {
+    client->released[tail & client->mask] = FALSE;
+    tail++;
+  }
+  g_atomic_int_set (&client->ring->tail, tail);
+  g_mutex_unlock (&client->lock);
+
+  gst_vqe_ipc_client_unref (client);
+}
@@ -0,0 +1,132 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_IPC_H__
+#define __GST_VQE_IPC_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Transport between vqesrc and gst-vqe-daemon, which owns VQE-C and its
+ * tuners on behalf of any number of pipeline processes.
+ *
+ * A client connects to the daemon's SOCK_SEQPACKET unix socket and sends a
+ * GstVQEIpcTuneRequest followed by the SDP.  The daemon tunes and answers
+ * with a GstVQEIpcTuneReply carrying, via SCM_RIGHTS, a memfd holding a
+ * GstVQEIpcRing and an eventfd it writes to whenever it publishes a slot.
+ * The daemon fills slots with compounded post-repair TS and the client hands
+ * them downstream in place, releasing them in order as buffers are freed.
+ * Closing the socket unbinds the tuner; either side going away is seen by
+ * the other as a hangup.
+ */
+
+#define GST_VQE_IPC_MAGIC             0x56514544        /* "VQED" */
+#define GST_VQE_IPC_VERSION           1
+#define GST_VQE_IPC_DEFAULT_SOCKET    "/var/run/gst-vqe.sock"
+#define GST_VQE_IPC_MAX_SDP_LEN       (64 * 1024)
+#define GST_VQE_IPC_MAX_SLOTS         1024
+
+#define GST_VQE_IPC_ERROR (gst_vqe_ipc_error_quark ())
+GQuark gst_vqe_ipc_error_quark (void);
+
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint32 slot_size;            /* bytes of TS the client wants per slot */
+  guint32 n_slots;
+  /* followed by the SDP, not NUL terminated */
+} GstVQEIpcTuneRequest;
+
+typedef struct {
+  guint32 magic;
+  gint32 status;                /* 0 on success, in which case the fds follow */
+  gchar stream_uri[128];
+  gchar error[128];
+} GstVQEIpcTuneReply;
+
+/* Lives at the start of the memfd and is followed by n_slots slots of
+   GST_VQE_IPC_SLOT_STRIDE() bytes.  head is only written by the daemon and
+   tail only by the client; they sit on their own cache lines. */
+typedef struct {
+  guint32 magic;
+  guint32 n_slots;              /* a power of two */
+  guint32 slot_size;
+  gint closed;                  /* the daemon has given up on this tuner */
+  gint overruns;                /* slots dropped as the client was behind */
+  guint8 pad0[44];
+  gint head;                    /* slots published */
+  guint8 pad1[60];
+  gint tail;                    /* slots released */
+  guint8 pad2[60];
+} GstVQEIpcRing;
+
+typedef struct {
+  guint32 size;
+  guint32 reserved;
+  /* followed by slot_size bytes of data */
+} GstVQEIpcSlot;
+
+#define GST_VQE_IPC_SLOT_STRIDE(slot_size) \
+  ((sizeof (GstVQEIpcSlot) + (slot_size) + 63) & ~(gsize) 63)
+#define GST_VQE_IPC_RING_SIZE(slot_size, n_slots) \
+  (sizeof (GstVQEIpcRing) + (gsize) (n_slots) * \
+      GST_VQE_IPC_SLOT_STRIDE (slot_size))
+
+/* daemon side */
+GstVQEIpcRing *gst_vqe_ipc_ring_new      (guint slot_size, guint n_slots,
+                                          gint * fd);
+void           gst_vqe_ipc_ring_free     (GstVQEIpcRing * ring);
+guint8        *gst_vqe_ipc_ring_reserve  (GstVQEIpcRing * ring);
+void           gst_vqe_ipc_ring_publish  (GstVQEIpcRing * ring, gsize size);
+
+gboolean       gst_vqe_ipc_send_fds      (gint sock, gconstpointer msg,
+                                          gsize size, const gint * fds,
+                                          guint n_fds);
+
+/* client side */
+typedef struct _GstVQEIpcClient GstVQEIpcClient;
+
+GstVQEIpcClient *gst_vqe_ipc_client_connect (const gchar * path,
+                                             const gchar * sdp,
+                                             guint slot_size, guint n_slots,
+                                             GError ** error);
+GstVQEIpcClient *gst_vqe_ipc_client_ref     (GstVQEIpcClient * client);
+void             gst_vqe_ipc_client_unref   (GstVQEIpcClient * client);
+void             gst_vqe_ipc_client_close   (GstVQEIpcClient * client);
+
+const gchar     *gst_vqe_ipc_client_get_stream_uri (GstVQEIpcClient * client);
+guint            gst_vqe_ipc_client_get_overruns   (GstVQEIpcClient * client);
+
+gint             gst_vqe_ipc_client_receive (GstVQEIpcClient * client,
+                                             gint timeout_ms,
+                                             const guint8 ** data,
+                                             gsize * size,
+                                             gpointer * slot);
+void             gst_vqe_ipc_client_release (gpointer slot);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_IPC_H__ */
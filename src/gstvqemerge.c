@@ -0,0 +1,251 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqemerge.h"
+
+#include <string.h>
+
+/**
+ * gst_vqe_merge_init:
+ *
+ * Sets up @merge to hold datagrams of up to @slot_size bytes.
+ */
+void
+gst_vqe_merge_init (GstVQEMerge * merge, gsize slot_size)
+{
+  memset (merge, 0, sizeof (*merge));
+  merge->slot_size = slot_size;
+  merge->data = g_malloc (slot_size * GST_VQE_MERGE_WINDOW);
+}
+
+void
+gst_vqe_merge_clear (GstVQEMerge * merge)
+{
+  g_free (merge->data);
+  merge->data = NULL;
+}
+
+/* Forget what's held and where we are in the sequence, e.g. on a channel
+   change.  The counters carry on. */
+void
+gst_vqe_merge_reset (GstVQEMerge * merge)
+{
+  guint i;
+
+  for (i = 0; i < GST_VQE_MERGE_WINDOW; i++)
+    merge->slots[i].valid = FALSE;
+  for (i = 0; i < GST_VQE_MERGE_N_PATHS; i++)
+    merge->paths[i].have_seq = FALSE;
+  merge->held = 0;
+  merge->have_next = FALSE;
+  merge->stale = 0;
+}
+
+/**
+ * gst_vqe_rtp_parse:
+ *
+ * Finds the payload of an RTP packet, FALSE if it doesn't look like one.
+ * MPEG-TS starts with a sync byte which can't be the start of an RTP v2
+ * header.
+ */
+gboolean
+gst_vqe_rtp_parse (const guint8 * data, gsize size, guint16 * seq,
+    gsize * offset, gsize * payload_size)
+{
+  gsize header, padding = 0;
+
+  if (size < GST_VQE_RTP_HEADER_SIZE || (data[0] & 0xc0) != 0x80)
+    return FALSE;
+
+  header = GST_VQE_RTP_HEADER_SIZE + 4 * (data[0] & 0x0f);
+  if (data[0] & 0x10) {
+    if (size < header + 4)
+      return FALSE;
+    header += 4 + 4 * ((data[header + 2] << 8) | data[header + 3]);
+  }
+  if (data[0] & 0x20)
+    padding = data[size - 1];
+  if (size < header + padding)
+    return FALSE;
+
+  *seq = (data[2] << 8) | data[3];
+  *offset = header;
+  *payload_size = size - header - padding;
+  return TRUE;
+}
+
+static void
+merge_store (GstVQEMerge * merge, guint16 seq, const guint8 * data,
+    gsize size, gint64 now)
+{
+  guint i = seq % GST_VQE_MERGE_WINDOW;
+  GstVQEMergeSlot *slot = &merge->slots[i];
+
+  size = MIN (size, merge->slot_size);
+  memcpy (merge->data + i * merge->slot_size, data, size);
+  slot->valid = TRUE;
+  slot->seq = seq;
+  slot->size = size;
+  slot->arrival = now;
+  merge->held++;
+}
+
+/**
+ * gst_vqe_merge_push:
+ *
+ * Adds a datagram which arrived on @path at @now.  Returns TRUE if it was
+ * the first copy of its packet and will be output.
+ */
+gboolean
+gst_vqe_merge_push (GstVQEMerge * merge, guint path, const guint8 * data,
+    gsize size, gint64 now)
+{
+  GstVQEMergePath *p = &merge->paths[path];
+  GstVQEMergeSlot *slot;
+  gsize offset, payload_size;
+  guint16 seq;
+  gint16 ahead;
+
+  p->received++;
+  if (!gst_vqe_rtp_parse (data, size, &seq, &offset, &payload_size)) {
+    p->not_rtp++;
+    if (path != 0)
+      return FALSE;
+    if (!merge->have_next) {
+      merge->have_next = TRUE;
+      merge->next = merge->passthrough_seq;
+    }
+    /* if the window's full the oldest has been waiting longest anyway */
+    if ((guint16) (merge->passthrough_seq - merge->next) >=
+        GST_VQE_MERGE_WINDOW)
+      return FALSE;
+    merge_store (merge, merge->passthrough_seq++, data, size, now);
+    p->used++;
+    return TRUE;
+  }
+
+  if (p->have_seq) {
+    guint16 gap = seq - p->last_seq - 1;
+
+    if (gap < 0x8000) {
+      p->lost += gap;
+      p->last_seq = seq;
+    }
+  } else {
+    p->have_seq = TRUE;
+    p->last_seq = seq;
+  }
+
+  if (!merge->have_next) {
+    merge->have_next = TRUE;
+    merge->next = seq;
+  }
+
+  ahead = (gint16) (seq - merge->next);
+  if (ahead < 0 || ahead >= GST_VQE_MERGE_WINDOW) {
+    /* A late copy of something already output or given up on, or a stray.
+       But a run of them with nothing we can use in between means the
+       stream has jumped, e.g. the head end restarted, so what's held will
+       never be output and we start again from here. */
+    if (++merge->stale < GST_VQE_MERGE_RESYNC) {
+      if (ahead < 0 && ahead >= -GST_VQE_MERGE_WINDOW)
+        p->duplicates++;
+      return FALSE;
+    }
+    merge->lost += merge->held;
+    gst_vqe_merge_reset (merge);
+    merge->resyncs++;
+    merge->have_next = TRUE;
+    merge->next = seq;
+    p->have_seq = TRUE;
+    p->last_seq = seq;
+  }
+
+  slot = &merge->slots[seq % GST_VQE_MERGE_WINDOW];
+  if (slot->valid) {
+    p->duplicates++;
+    return FALSE;
+  }
+  if (merge->keep_rtp)
+    merge_store (merge, seq, data, size, now);
+  else
+    merge_store (merge, seq, data + offset, payload_size, now);
+  merge->stale = 0;
+  p->used++;
+  return TRUE;
+}
+
+/**
+ * gst_vqe_merge_pop:
+ *
+ * Copies the next datagram to output at @now into @out, giving up on
+ * packets missing from both paths once the first one held after them has
+ * waited @delay.  Returns its size, or 0 if there's nothing to output yet,
+ * in which case @wake is set to when there might be, or -1 if only another
+ * push can help.  A datagram too big for @out_size is dropped and counted
+ * as lost rather than left blocking the ones behind it.
+ */
+gsize
+gst_vqe_merge_pop (GstVQEMerge * merge, gint64 now, gint64 delay,
+    guint8 * out, gsize out_size, gint64 * wake)
+{
+  GstVQEMergeSlot *slot;
+  guint16 seq;
+  guint i;
+
+  *wake = -1;
+  while (merge->held) {
+    slot = &merge->slots[merge->next % GST_VQE_MERGE_WINDOW];
+    if (!slot->valid) {
+      /* a gap: find the first packet after it */
+      for (seq = merge->next + 1;; seq++) {
+        slot = &merge->slots[seq % GST_VQE_MERGE_WINDOW];
+        if (slot->valid)
+          break;
+      }
+      if (now < slot->arrival + delay) {
+        *wake = slot->arrival + delay;
+        return 0;
+      }
+      merge->lost += (guint16) (seq - merge->next);
+      merge->next = seq;
+    }
+
+    i = merge->next % GST_VQE_MERGE_WINDOW;
+    slot->valid = FALSE;
+    merge->held--;
+    merge->next++;
+    if (slot->size > out_size) {
+      merge->lost++;
+      continue;
+    }
+    memcpy (out, merge->data + i * merge->slot_size, slot->size);
+    merge->output++;
+    return slot->size;
+  }
+  return 0;
+}
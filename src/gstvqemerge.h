@@ -0,0 +1,100 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_VQE_MERGE_H__
+#define __GST_VQE_MERGE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GST_VQE_MERGE_N_PATHS   2
+#define GST_VQE_MERGE_WINDOW    512     /* packets held at most */
+#define GST_VQE_MERGE_RESYNC    128     /* stale packets in a row before
+                                           starting again from them */
+#define GST_VQE_RTP_HEADER_SIZE 12      /* without CSRCs or extension */
+
+/*
+ * Merges two feeds of the same RTP stream, SMPTE 2022-7 style: each packet
+ * is output once, in sequence number order, from whichever feed delivered it
+ * first.  A packet missing from both is waited for until the first packet
+ * after it has been held for the merge delay, and then given up on.  Packets
+ * from before the one due next, or too far ahead of it to hold, are dropped,
+ * unless GST_VQE_MERGE_RESYNC of them arrive in a row with nothing usable in
+ * between, as they do when the head end restarts its sequence: then the
+ * merge starts again from there.  Output is the RTP payload, or with
+ * keep_rtp the whole packet.  Datagrams which
+ * aren't RTP can't be merged, so those of path 0 are passed through in order
+ * of arrival and those of path 1 are dropped.  Not thread safe.
+ */
+typedef struct {
+  guint64 received;
+  guint64 used;                 /* arrived first, so were output */
+  guint64 duplicates;           /* already output or given up on */
+  guint64 lost;                 /* gaps in this path's own sequence */
+  guint64 not_rtp;
+
+  gboolean have_seq;
+  guint16 last_seq;
+} GstVQEMergePath;
+
+typedef struct {
+  gboolean valid;
+  guint16 seq;
+  gsize size;
+  gint64 arrival;
+} GstVQEMergeSlot;
+
+typedef struct {
+  GstVQEMergePath paths[GST_VQE_MERGE_N_PATHS];
+  guint64 output;
+  guint64 lost;                 /* missing from both paths, or dropped */
+  guint64 resyncs;              /* starting again after a jump */
+
+  gsize slot_size;
+  guint8 *data;
+  GstVQEMergeSlot slots[GST_VQE_MERGE_WINDOW];
+  guint held;
+  gboolean have_next;
+  guint16 next;
+  guint stale;                  /* packets in a row behind next or beyond
+                                   the window */
+  guint16 passthrough_seq;
+  gboolean keep_rtp;
+} GstVQEMerge;
+
+void     gst_vqe_merge_init   (GstVQEMerge * merge, gsize slot_size);
+void     gst_vqe_merge_clear  (GstVQEMerge * merge);
+void     gst_vqe_merge_reset  (GstVQEMerge * merge);
+gboolean gst_vqe_merge_push   (GstVQEMerge * merge, guint path,
+                               const guint8 * data, gsize size, gint64 now);
+gsize    gst_vqe_merge_pop    (GstVQEMerge * merge, gint64 now, gint64 delay,
+                               guint8 * out, gsize out_size, gint64 * wake);
+
+gboolean gst_vqe_rtp_parse    (const guint8 * data, gsize size,
+                               guint16 * seq, gsize * offset,
+                               gsize * payload_size);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_MERGE_H__ */
@@ -0,0 +1,765 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * vqerelay sends a post-repair transport stream back out, as RTP or bare
+ * UDP, so that one vqesrc can feed many clients on a LAN:
+ *
+ *   vqesrc sdp=... ! vqerelay host=239.255.1.1 port=5000 multicast-iface=...
+ *
+ * Datagrams go out at the rate measured between the stream's PCRs rather
+ * than as they arrive, which smooths out the bursts VQE-C and the network
+ * upstream introduce.  Each pacing-interval's worth is handed to the kernel
+ * in a single sendmmsg().  Data that queued up behind a burst is sent
+ * faster until it's caught up, and isn't paced at all once it's waited
+ * longer than max-backlog.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* sendmmsg */
+#endif
+
+#include "gstvqerelay.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (vqerelay_debug);
+#define GST_CAT_DEFAULT (vqerelay_debug)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts"));
+
+#define VQE_RELAY_DEFAULT_HOST          NULL
+#define VQE_RELAY_DEFAULT_PORT          5000
+#define VQE_RELAY_DEFAULT_IFACE         NULL
+#define VQE_RELAY_DEFAULT_TTL           1
+#define VQE_RELAY_DEFAULT_LOOP          TRUE
+#define VQE_RELAY_DEFAULT_RTP           TRUE
+#define VQE_RELAY_DEFAULT_PACKETS       7
+#define VQE_RELAY_DEFAULT_PACE          TRUE
+#define VQE_RELAY_DEFAULT_INTERVAL      GST_MSECOND
+#define VQE_RELAY_DEFAULT_MAX_BACKLOG   (100 * GST_MSECOND)
+
+#define PCR_INVALID G_MAXUINT64
+#define MAX_BATCH 64
+#define RTP_HEADER_SIZE 12
+#define RTP_PT_MP2T 33          /* RFC 3551 */
+
+enum
+{
+  PROP_0,
+  PROP_HOST,
+  PROP_PORT,
+  PROP_MULTICAST_IFACE,
+  PROP_TTL,
+  PROP_LOOP,
+  PROP_RTP,
+  PROP_PACKETS_PER_DATAGRAM,
+  PROP_PACE,
+  PROP_PACING_INTERVAL,
+  PROP_MAX_BACKLOG,
+  PROP_BITRATE,
+  PROP_DATAGRAMS_SENT,
+  PROP_SEND_CALLS,
+  PROP_SEND_ERRORS
+};
+
+/* Datagrams on their way to one sendmmsg(), pointing into the buffer being
+   rendered or the carried remainder of the last one */
+typedef struct {
+  struct mmsghdr msgs[MAX_BATCH];
+  struct iovec iov[MAX_BATCH][2];
+  guint8 headers[MAX_BATCH][RTP_HEADER_SIZE];
+  guint n;
+  GstClockTime first_due;
+} GstVQERelayBatch;
+
+#define gst_vqe_relay_parent_class parent_class
+G_DEFINE_TYPE (GstVQERelay, gst_vqe_relay, GST_TYPE_BASE_SINK);
+
+static void gst_vqe_relay_finalize (GObject * object);
+static void gst_vqe_relay_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_vqe_relay_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static gboolean gst_vqe_relay_start (GstBaseSink * sink);
+static gboolean gst_vqe_relay_stop (GstBaseSink * sink);
+static gboolean gst_vqe_relay_unlock (GstBaseSink * sink);
+static gboolean gst_vqe_relay_unlock_stop (GstBaseSink * sink);
+static gboolean gst_vqe_relay_event (GstBaseSink * sink, GstEvent * event);
+static GstFlowReturn gst_vqe_relay_render (GstBaseSink * sink,
+    GstBuffer * buffer);
+
+static void
+gst_vqe_relay_class_init (GstVQERelayClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+  GstBaseSinkClass *gstbasesink_class = (GstBaseSinkClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (vqerelay_debug, "vqerelay", 0,
+      "VQE post-repair relay");
+
+  gobject_class->set_property = gst_vqe_relay_set_property;
+  gobject_class->get_property = gst_vqe_relay_get_property;
+  gobject_class->finalize = gst_vqe_relay_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_HOST,
+      g_param_spec_string ("host", "Host",
+          "IPv4 address, usually a multicast group, to send to",
+          VQE_RELAY_DEFAULT_HOST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT,
+      g_param_spec_int ("port", "Port", "Port to send to",
+          1, 65535, VQE_RELAY_DEFAULT_PORT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MULTICAST_IFACE,
+      g_param_spec_string ("multicast-iface", "Multicast interface",
+          "Address of the local interface to send multicast from, or NULL "
+          "for the routing table's choice",
+          VQE_RELAY_DEFAULT_IFACE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TTL,
+      g_param_spec_int ("ttl", "TTL", "Multicast time to live",
+          0, 255, VQE_RELAY_DEFAULT_TTL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOOP,
+      g_param_spec_boolean ("loop", "Loop",
+          "Deliver multicast to receivers on this host too",
+          VQE_RELAY_DEFAULT_LOOP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTP,
+      g_param_spec_boolean ("rtp", "RTP",
+          "Send RTP (MP2T, payload type 33) rather than bare UDP",
+          VQE_RELAY_DEFAULT_RTP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PACKETS_PER_DATAGRAM,
+      g_param_spec_uint ("packets-per-datagram", "Packets per datagram",
+          "TS packets to put in each datagram",
+          1, 7, VQE_RELAY_DEFAULT_PACKETS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PACE,
+      g_param_spec_boolean ("pace", "Pace",
+          "Send at the rate measured from the stream's PCRs rather than as "
+          "fast as data arrives",
+          VQE_RELAY_DEFAULT_PACE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PACING_INTERVAL,
+      g_param_spec_uint64 ("pacing-interval", "Pacing interval",
+          "Nanoseconds' worth of datagrams to send in one system call. "
+          "Longer costs less CPU but sends in bigger bursts",
+          0, GST_SECOND, VQE_RELAY_DEFAULT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BACKLOG,
+      g_param_spec_uint64 ("max-backlog", "Max backlog",
+          "Most nanoseconds data may have queued up behind pacing, e.g. after "
+          "a rapid channel change burst, going by buffer timestamps. Below "
+          "this the queue is sent faster until it's gone, above it as fast "
+          "as possible",
+          0, 10 * GST_SECOND, VQE_RELAY_DEFAULT_MAX_BACKLOG,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BITRATE,
+      g_param_spec_uint64 ("bitrate", "Bitrate",
+          "Rate of the stream in bits per second, measured between PCRs, or "
+          "0 until it has been",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DATAGRAMS_SENT,
+      g_param_spec_uint64 ("datagrams-sent", "Datagrams sent",
+          "Datagrams handed to the kernel",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_CALLS,
+      g_param_spec_uint64 ("send-calls", "Send calls",
+          "System calls made to send them",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_ERRORS,
+      g_param_spec_uint64 ("send-errors", "Send errors",
+          "Datagrams the kernel refused, e.g. for want of buffer space",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_template));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "VQE relay", "Sink/Network",
+      "Send a repaired transport stream on to local clients, paced by its "
+      "PCRs", "William Manley <william.manley@youview.com>");
+
+  gstbasesink_class->start = gst_vqe_relay_start;
+  gstbasesink_class->stop = gst_vqe_relay_stop;
+  gstbasesink_class->unlock = gst_vqe_relay_unlock;
+  gstbasesink_class->unlock_stop = gst_vqe_relay_unlock_stop;
+  gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_vqe_relay_event);
+  gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_vqe_relay_render);
+}
+
+static void
+gst_vqe_relay_init (GstVQERelay * relay)
+{
+  relay->host = g_strdup (VQE_RELAY_DEFAULT_HOST);
+  relay->port = VQE_RELAY_DEFAULT_PORT;
+  relay->multicast_iface = g_strdup (VQE_RELAY_DEFAULT_IFACE);
+  relay->ttl = VQE_RELAY_DEFAULT_TTL;
+  relay->loop = VQE_RELAY_DEFAULT_LOOP;
+  relay->rtp = VQE_RELAY_DEFAULT_RTP;
+  relay->packets_per_datagram = VQE_RELAY_DEFAULT_PACKETS;
+  relay->pace = VQE_RELAY_DEFAULT_PACE;
+  relay->pacing_interval = VQE_RELAY_DEFAULT_INTERVAL;
+  relay->max_backlog = VQE_RELAY_DEFAULT_MAX_BACKLOG;
+  relay->sock = -1;
+  g_mutex_init (&relay->lock);
+  g_cond_init (&relay->cond);
+  relay->flushing = FALSE;
+
+  /* the PCRs do the pacing, not the pipeline clock */
+  gst_base_sink_set_sync (GST_BASE_SINK (relay), FALSE);
+}
+
+static void
+gst_vqe_relay_finalize (GObject * object)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (object);
+
+  g_free (relay->host);
+  g_free (relay->multicast_iface);
+  g_mutex_clear (&relay->lock);
+  g_cond_clear (&relay->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_vqe_relay_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (object);
+
+  GST_OBJECT_LOCK (relay);
+  switch (prop_id) {
+    case PROP_HOST:
+      g_free (relay->host);
+      relay->host = g_value_dup_string (value);
+      break;
+    case PROP_PORT:
+      relay->port = g_value_get_int (value);
+      break;
+    case PROP_MULTICAST_IFACE:
+      g_free (relay->multicast_iface);
+      relay->multicast_iface = g_value_dup_string (value);
+      break;
+    case PROP_TTL:
+      relay->ttl = g_value_get_int (value);
+      break;
+    case PROP_LOOP:
+      relay->loop = g_value_get_boolean (value);
+      break;
+    case PROP_RTP:
+      relay->rtp = g_value_get_boolean (value);
+      break;
+    case PROP_PACKETS_PER_DATAGRAM:
+      relay->packets_per_datagram = g_value_get_uint (value);
+      break;
+    case PROP_PACE:
+      relay->pace = g_value_get_boolean (value);
+      break;
+    case PROP_PACING_INTERVAL:
+      relay->pacing_interval = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_BACKLOG:
+      relay->max_backlog = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (relay);
+}
+
+static void
+gst_vqe_relay_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (object);
+
+  GST_OBJECT_LOCK (relay);
+  switch (prop_id) {
+    case PROP_HOST:
+      g_value_set_string (value, relay->host);
+      break;
+    case PROP_PORT:
+      g_value_set_int (value, relay->port);
+      break;
+    case PROP_MULTICAST_IFACE:
+      g_value_set_string (value, relay->multicast_iface);
+      break;
+    case PROP_TTL:
+      g_value_set_int (value, relay->ttl);
+      break;
+    case PROP_LOOP:
+      g_value_set_boolean (value, relay->loop);
+      break;
+    case PROP_RTP:
+      g_value_set_boolean (value, relay->rtp);
+      break;
+    case PROP_PACKETS_PER_DATAGRAM:
+      g_value_set_uint (value, relay->packets_per_datagram);
+      break;
+    case PROP_PACE:
+      g_value_set_boolean (value, relay->pace);
+      break;
+    case PROP_PACING_INTERVAL:
+      g_value_set_uint64 (value, relay->pacing_interval);
+      break;
+    case PROP_MAX_BACKLOG:
+      g_value_set_uint64 (value, relay->max_backlog);
+      break;
+    case PROP_BITRATE:
+      g_value_set_uint64 (value, relay->bitrate);
+      break;
+    case PROP_DATAGRAMS_SENT:
+      g_value_set_uint64 (value, relay->datagrams_sent);
+      break;
+    case PROP_SEND_CALLS:
+      g_value_set_uint64 (value, relay->send_calls);
+      break;
+    case PROP_SEND_ERRORS:
+      g_value_set_uint64 (value, relay->send_errors);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (relay);
+}
+
+static gboolean
+gst_vqe_relay_start (GstBaseSink * sink)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (sink);
+  struct sockaddr_in addr;
+  struct in_addr iface;
+  guchar ttl = relay->ttl, loop = relay->loop;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (relay->port);
+  if (!relay->host || !inet_aton (relay->host, &addr.sin_addr)) {
+    GST_ELEMENT_ERROR (relay, RESOURCE, SETTINGS, (NULL),
+        ("host must be an IPv4 address, not %s", GST_STR_NULL (relay->host)));
+    return FALSE;
+  }
+  if (relay->multicast_iface && !inet_aton (relay->multicast_iface, &iface)) {
+    GST_ELEMENT_ERROR (relay, RESOURCE, SETTINGS, (NULL),
+        ("multicast-iface must be an IPv4 address, not %s",
+            relay->multicast_iface));
+    return FALSE;
+  }
+
+  relay->sock = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (relay->sock < 0)
+    goto failed;
+  if (IN_MULTICAST (ntohl (addr.sin_addr.s_addr)) &&
+      ((relay->multicast_iface && setsockopt (relay->sock, IPPROTO_IP,
+                  IP_MULTICAST_IF, &iface, sizeof (iface)) < 0) ||
+          setsockopt (relay->sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl,
+              sizeof (ttl)) < 0 ||
+          setsockopt (relay->sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+              sizeof (loop)) < 0))
+    goto failed;
+  /* so that datagrams need no address of their own */
+  if (connect (relay->sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    goto failed;
+
+  relay->seq = g_random_int ();
+  relay->ssrc = g_random_int ();
+  relay->rtp_base = g_random_int ();
+  gst_vqe_ts_scanner_reset (&relay->scanner);
+  relay->last_pcr = PCR_INVALID;
+  relay->bytes_since_pcr = 0;
+  relay->next_due = 0;
+  relay->carried = 0;
+
+  GST_OBJECT_LOCK (relay);
+  relay->bitrate = 0;
+  relay->datagrams_sent = 0;
+  relay->send_calls = 0;
+  relay->send_errors = 0;
+  GST_OBJECT_UNLOCK (relay);
+
+  GST_INFO_OBJECT (relay, "Sending %s to %s:%d", relay->rtp ? "RTP" : "UDP",
+      relay->host, relay->port);
+  return TRUE;
+
+failed:
+  GST_ELEMENT_ERROR (relay, RESOURCE, OPEN_WRITE, (NULL),
+      ("Failed to set up socket to %s:%d: %s", relay->host, relay->port,
+          g_strerror (errno)));
+  if (relay->sock >= 0)
+    close (relay->sock);
+  relay->sock = -1;
+  return FALSE;
+}
+
+static gboolean
+gst_vqe_relay_stop (GstBaseSink * sink)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (sink);
+
+  if (relay->sock >= 0)
+    close (relay->sock);
+  relay->sock = -1;
+
+  GST_OBJECT_LOCK (relay);
+  GST_INFO_OBJECT (relay, "Sent %" G_GUINT64_FORMAT " datagrams in %"
+      G_GUINT64_FORMAT " calls, %" G_GUINT64_FORMAT " refused",
+      relay->datagrams_sent, relay->send_calls, relay->send_errors);
+  GST_OBJECT_UNLOCK (relay);
+  return TRUE;
+}
+
+static gboolean
+gst_vqe_relay_unlock (GstBaseSink * sink)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (sink);
+
+  g_mutex_lock (&relay->lock);
+  relay->flushing = TRUE;
+  g_cond_broadcast (&relay->cond);
+  g_mutex_unlock (&relay->lock);
+  return TRUE;
+}
+
+static gboolean
+gst_vqe_relay_unlock_stop (GstBaseSink * sink)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (sink);
+
+  g_mutex_lock (&relay->lock);
+  relay->flushing = FALSE;
+  g_mutex_unlock (&relay->lock);
+  return TRUE;
+}
+
+/*
+ *  Pacing
+ */
+
+/* Follow the stream's rate from the bytes between one PCR and the next */
+static void
+gst_vqe_relay_measure (GstVQERelay * relay, const guint8 * data, gsize size)
+{
+  gsize offset;
+  guint64 pcr, delta, rate;
+
+  for (offset = 0; offset + GST_VQE_TS_PACKET_SIZE <= size;
+      offset += GST_VQE_TS_PACKET_SIZE) {
+    const guint8 *pkt = &data[offset];
+
+    if ((gst_vqe_ts_scanner_scan_packet (&relay->scanner, pkt) &
+            GST_VQE_TS_PACKET_PCR) && gst_vqe_ts_packet_get_pcr (pkt, &pcr)) {
+      if (relay->last_pcr != PCR_INVALID) {
+        delta = (pcr + GST_VQE_TS_PCR_WRAP - relay->last_pcr) %
+            GST_VQE_TS_PCR_WRAP;
+        /* anything more than a second apart is a discontinuity */
+        if (delta > 0 && delta < GST_VQE_TS_PCR_HZ) {
+          rate = gst_util_uint64_scale (relay->bytes_since_pcr * 8,
+              GST_VQE_TS_PCR_HZ, delta);
+          GST_OBJECT_LOCK (relay);
+          relay->bitrate = relay->bitrate ?
+              (7 * relay->bitrate + rate) / 8 : rate;
+          GST_OBJECT_UNLOCK (relay);
+        }
+      }
+      relay->last_pcr = pcr;
+      relay->bytes_since_pcr = 0;
+    }
+    relay->bytes_since_pcr += GST_VQE_TS_PACKET_SIZE;
+  }
+}
+
+/* How long @buffer waited upstream before we got it, from its timestamp
+   and the pipeline clock, or 0 if there's no telling */
+static GstClockTime
+gst_vqe_relay_lag (GstVQERelay * relay, GstBuffer * buffer)
+{
+  GstClockTime running, now;
+  GstClock *clock;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return 0;
+  running = gst_segment_to_running_time (&GST_BASE_SINK (relay)->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running) ||
+      !(clock = gst_element_get_clock (GST_ELEMENT (relay))))
+    return 0;
+  now = gst_clock_get_time (clock) -
+      gst_element_get_base_time (GST_ELEMENT (relay));
+  gst_object_unref (clock);
+  return now > running ? now - running : 0;
+}
+
+/* When the next @size bytes, which waited @lag upstream, should go out, in
+   monotonic time */
+static GstClockTime
+gst_vqe_relay_due (GstVQERelay * relay, gsize size, GstClockTime now,
+    GstClockTime lag)
+{
+  GstClockTime due, interval;
+
+  if (!relay->pace || relay->bitrate == 0)
+    return now;
+
+  /* after a gap, or with upstream having fallen behind, carry on from now
+     rather than catch up all at once */
+  if (relay->next_due + relay->pacing_interval < now)
+    relay->next_due = now;
+
+  /* a burst from upstream, e.g. of RCC, queues up behind us while we pace
+     it out, and once upstream is back to the stream's rate the queue would
+     stay on as latency for good.  So the longer data has waited the faster
+     it goes, and past max-backlog it isn't paced at all */
+  if (lag > relay->max_backlog) {
+    relay->next_due = now;
+    return now;
+  }
+  interval = gst_util_uint64_scale (size * 8, GST_SECOND, relay->bitrate);
+  if (lag > relay->pacing_interval)
+    interval = gst_util_uint64_scale (interval, relay->max_backlog,
+        relay->max_backlog + lag);
+
+  due = relay->next_due;
+  relay->next_due += interval;
+  return due;
+}
+
+/* Returns FALSE if unlock() cut the wait short */
+static gboolean
+gst_vqe_relay_wait (GstVQERelay * relay, GstClockTime until)
+{
+  gint64 end = until / GST_USECOND;
+  gboolean flushing;
+
+  g_mutex_lock (&relay->lock);
+  while (!relay->flushing && g_get_monotonic_time () < end)
+    g_cond_wait_until (&relay->cond, &relay->lock, end);
+  flushing = relay->flushing;
+  g_mutex_unlock (&relay->lock);
+  return !flushing;
+}
+
+/*
+ *  Sending
+ */
+
+static void
+gst_vqe_relay_batch_add (GstVQERelay * relay, GstVQERelayBatch * batch,
+    const guint8 * data, gsize size, GstClockTime due)
+{
+  struct msghdr *msg = &batch->msgs[batch->n].msg_hdr;
+  struct iovec *iov = batch->iov[batch->n];
+  guint8 *header = batch->headers[batch->n];
+  guint n_iov = 0;
+
+  if (batch->n++ == 0)
+    batch->first_due = due;
+
+  if (relay->rtp) {
+    /* RFC 2250: the timestamp is when the datagram is sent, at 90kHz */
+    header[0] = 0x80;
+    header[1] = RTP_PT_MP2T;
+    GST_WRITE_UINT16_BE (&header[2], relay->seq);
+    GST_WRITE_UINT32_BE (&header[4], relay->rtp_base +
+        (guint32) gst_util_uint64_scale (due, 90000, GST_SECOND));
+    GST_WRITE_UINT32_BE (&header[8], relay->ssrc);
+    relay->seq++;
+    iov[n_iov].iov_base = header;
+    iov[n_iov++].iov_len = RTP_HEADER_SIZE;
+  }
+  iov[n_iov].iov_base = (gpointer) data;
+  iov[n_iov++].iov_len = size;
+
+  memset (msg, 0, sizeof (*msg));
+  msg->msg_iov = iov;
+  msg->msg_iovlen = n_iov;
+}
+
+static void
+gst_vqe_relay_batch_send (GstVQERelay * relay, GstVQERelayBatch * batch)
+{
+  guint sent = 0, calls = 0, errors = 0;
+  gint ret, err = 0;
+
+  while (sent < batch->n) {
+#ifdef HAVE_SENDMMSG
+    ret = sendmmsg (relay->sock, &batch->msgs[sent], batch->n - sent, 0);
+#else
+    ret = sendmsg (relay->sock, &batch->msgs[sent].msg_hdr, 0) < 0 ? -1 : 1;
+#endif
+    calls++;
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      /* lost, as it would have been on the wire */
+      err = errno;
+      errors++;
+      ret = 1;
+    }
+    sent += ret;
+  }
+
+  if (G_UNLIKELY (errors))
+    GST_WARNING_OBJECT (relay, "%u of %u datagrams not sent: %s", errors,
+        batch->n, g_strerror (err));
+
+  GST_OBJECT_LOCK (relay);
+  relay->datagrams_sent += batch->n - errors;
+  relay->send_calls += calls;
+  relay->send_errors += errors;
+  GST_OBJECT_UNLOCK (relay);
+  batch->n = 0;
+}
+
+/* Adds a datagram to @batch once it's due, sending what's already in it
+   first if need be.  Returns FALSE if unlock() cut the wait short. */
+static gboolean
+gst_vqe_relay_queue (GstVQERelay * relay, GstVQERelayBatch * batch,
+    const guint8 * data, gsize size, GstClockTime lag)
+{
+  GstClockTime now, due;
+
+  gst_vqe_relay_measure (relay, data, size);
+
+  now = g_get_monotonic_time () * GST_USECOND;
+  due = gst_vqe_relay_due (relay, size, now, lag);
+
+  /* a batch is sent when its first datagram is due and takes everything
+     due within pacing-interval of that */
+  if (batch->n == MAX_BATCH ||
+      (batch->n > 0 && due > batch->first_due + relay->pacing_interval))
+    gst_vqe_relay_batch_send (relay, batch);
+  if (batch->n == 0 && due > now && !gst_vqe_relay_wait (relay, due))
+    return FALSE;
+  gst_vqe_relay_batch_add (relay, batch, data, size, due);
+  return TRUE;
+}
+
+/* Buffers needn't hold a whole number of datagrams, so what's left over at
+   the end of one is carried into the first datagram of the next rather than
+   sent short */
+static GstFlowReturn
+gst_vqe_relay_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (sink);
+  GstVQERelayBatch batch;
+  GstMapInfo info;
+  gsize datagram_size = relay->packets_per_datagram * GST_VQE_TS_PACKET_SIZE;
+  gsize offset = 0, size;
+  GstClockTime lag = gst_vqe_relay_lag (relay, buffer);
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    GST_ELEMENT_ERROR (relay, RESOURCE, READ, (NULL),
+        ("Failed to map buffer"));
+    return GST_FLOW_ERROR;
+  }
+
+  batch.n = 0;
+  if (relay->carried > 0) {
+    if (relay->carried < datagram_size) {
+      offset = MIN (datagram_size - relay->carried, info.size);
+      memcpy (relay->carry + relay->carried, info.data, offset);
+      relay->carried += offset;
+    }
+    if (relay->carried >= datagram_size) {
+      /* carry isn't touched again until the batch has gone */
+      if (!gst_vqe_relay_queue (relay, &batch, relay->carry, relay->carried,
+              lag))
+        ret = GST_FLOW_FLUSHING;
+      relay->carried = 0;
+    }
+  }
+
+  for (; ret == GST_FLOW_OK && offset + datagram_size <= info.size;
+      offset += datagram_size) {
+    if (!gst_vqe_relay_queue (relay, &batch, &info.data[offset],
+            datagram_size, lag))
+      ret = GST_FLOW_FLUSHING;
+  }
+  if (batch.n > 0)
+    gst_vqe_relay_batch_send (relay, &batch);
+
+  if (ret == GST_FLOW_OK && offset < info.size) {
+    size = info.size - offset;
+    memcpy (relay->carry + relay->carried, &info.data[offset], size);
+    relay->carried += size;
+  }
+
+  gst_buffer_unmap (buffer, &info);
+  return ret;
+}
+
+/* What's carried goes at the end of the stream, and is dropped with
+   everything else on a flush */
+static gboolean
+gst_vqe_relay_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstVQERelay *relay = GST_VQE_RELAY (sink);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      if (relay->carried > 0 && relay->sock >= 0) {
+        GstVQERelayBatch batch;
+
+        batch.n = 0;
+        gst_vqe_relay_batch_add (relay, &batch, relay->carry, relay->carried,
+            g_get_monotonic_time () * GST_USECOND);
+        gst_vqe_relay_batch_send (relay, &batch);
+      }
+      relay->carried = 0;
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      relay->carried = 0;
+      break;
+    default:
+      break;
+  }
+  return GST_BASE_SINK_CLASS (parent_class)->event (sink, event);
+}
@@ -0,0 +1,102 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_VQE_RELAY_H__
+#define __GST_VQE_RELAY_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+#include "gstvqets.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_VQE_RELAY \
+  (gst_vqe_relay_get_type())
+#define GST_VQE_RELAY(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_VQE_RELAY,GstVQERelay))
+#define GST_VQE_RELAY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_VQE_RELAY,GstVQERelayClass))
+#define GST_IS_VQE_RELAY(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_VQE_RELAY))
+#define GST_IS_VQE_RELAY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_VQE_RELAY))
+#define GST_VQE_RELAY_CAST(obj) ((GstVQERelay *)(obj))
+
+typedef struct _GstVQERelay GstVQERelay;
+typedef struct _GstVQERelayClass GstVQERelayClass;
+
+struct _GstVQERelay {
+  GstBaseSink parent;
+
+  /* properties */
+  gchar *host;
+  gint port;
+  gchar *multicast_iface;
+  gint ttl;
+  gboolean loop;
+  gboolean rtp;
+  guint packets_per_datagram;
+  gboolean pace;
+  GstClockTime pacing_interval;
+  GstClockTime max_backlog;
+
+  gint sock;
+
+  /* RTP header state */
+  guint16 seq;
+  guint32 ssrc;
+  guint32 rtp_base;
+
+  /* the stream's rate, measured between its PCRs, which sets when each
+     datagram is due, in nanoseconds of g_get_monotonic_time() */
+  GstVQETSScanner scanner;
+  guint64 last_pcr;
+  guint64 bytes_since_pcr;
+  guint64 bitrate;              /* 0 until measured */
+  gint64 next_due;
+
+  /* the end of the last buffer, short of a whole datagram */
+  guint8 carry[7 * GST_VQE_TS_PACKET_SIZE];
+  gsize carried;
+
+  /* lets unlock() cut a pacing wait short */
+  GMutex lock;
+  GCond cond;
+  gboolean flushing;
+
+  /* stats, under the object lock */
+  guint64 datagrams_sent;
+  guint64 send_calls;
+  guint64 send_errors;
+};
+
+struct _GstVQERelayClass {
+  GstBaseSinkClass parent_class;
+};
+
+GType gst_vqe_relay_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_RELAY_H__ */
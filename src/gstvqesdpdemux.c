@@ -27,7 +27,6 @@
 #include "gstvqesdpdemux.h"
 #include <gst/gst.h>
 
-#include <assert.h>
 #include <stdlib.h>
 
 #define GST_VQE_SDP_DEMUX_GET_LOCK(demux) (((GstVQESDPDemux*)(demux))->lock)
@@ -48,7 +47,8 @@ static GstFlowReturn gst_vqe_sdp_demux_sink_chain(
 static gboolean gst_vqe_sdp_demux_sink_event(
     GstPad *pad, GstObject *parent, GstEvent *event);
 static void gst_vqe_sdp_demux_reset(GstVQESDPDemux * demux);
-static void gst_vqe_sdp_demux_create_vqesrc(GstVQESDPDemux * demux, gchar * sdp);
+static gboolean gst_vqe_sdp_demux_create_vqesrc(GstVQESDPDemux * demux);
+static void gst_vqe_sdp_demux_tune(GstVQESDPDemux * demux, gchar * sdp);
 
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
@@ -159,7 +159,13 @@ static gboolean gst_vqe_sdp_demux_sink_event(
           "Got EOS on the sink pad: SDP file fetched");
 
       sdp = gst_vqe_buf_to_utf8_sdp (demux->sdpfile);
-      gst_vqe_sdp_demux_create_vqesrc(demux, sdp);
+      if (!sdp) {
+        GST_ELEMENT_ERROR (demux, STREAM, DECODE, (NULL),
+            ("SDP file isn't valid UTF-8"));
+        gst_event_unref (event);
+        return FALSE;
+      }
+      gst_vqe_sdp_demux_tune(demux, sdp);
       g_free(sdp);
 
       gst_event_unref (event);
@@ -176,43 +182,48 @@ static gboolean gst_vqe_sdp_demux_sink_event(
   return gst_pad_event_default (pad, parent, event);
 }
 
-static void
-gst_vqe_sdp_demux_create_vqesrc(GstVQESDPDemux * demux, gchar * sdp)
+static gboolean
+gst_vqe_sdp_demux_create_vqesrc(GstVQESDPDemux * demux)
 {
-  GstPad * vqesrcpad = NULL;
-  GstPad * ghostpad = NULL;
-  GstPadTemplate * template = NULL;
-  gboolean success;
-  assert(!demux->vqesrc);
-  assert(sdp);
   demux->vqesrc = gst_element_factory_make ("vqesrc", "vqesrc");
   if (!demux->vqesrc) {
-    /* TODO: Handle this error */
-    abort();
+    GST_ELEMENT_ERROR (demux, CORE, MISSING_PLUGIN, (NULL),
+        ("Failed to create vqesrc"));
+    return FALSE;
   }
-  g_object_set(G_OBJECT(demux->vqesrc), "sdp", sdp, NULL);
 
-  /* We must hold a seperate reference to the fdsink than our GstBin base class
-     as we have a member that points to it */
+  /* We must hold a seperate reference to the vqesrc than our GstBin base
+     class as we have a member that points to it */
   g_object_ref(demux->vqesrc);
   gst_bin_add (GST_BIN (demux), demux->vqesrc);
+  return TRUE;
+}
+
+/* The SDP is complete.  vqesrc is already started, at least PAUSED, so
+   setting it binds the channel straight away, and the pad goes up now so
+   that downstream can be autoplugged while the RCC burst arrives. */
+static void
+gst_vqe_sdp_demux_tune(GstVQESDPDemux * demux, gchar * sdp)
+{
+  GstPad * vqesrcpad = NULL;
+  GstPadTemplate * template = NULL;
 
-  vqesrcpad = gst_element_get_static_pad (GST_ELEMENT(demux->vqesrc), "src");
-  template = gst_static_pad_template_get (&srctemplate);
-  ghostpad = gst_ghost_pad_new_from_template("src", vqesrcpad, template);
-  gst_pad_set_active(ghostpad, TRUE);
-  gst_element_add_pad (GST_ELEMENT (demux), ghostpad);
-  ghostpad = NULL;
-  gst_object_unref(template);
-  template = NULL;
-  gst_object_unref (vqesrcpad);
-  vqesrcpad = NULL;
-
-  success = gst_element_sync_state_with_parent(demux->vqesrc);
-  if (!success) {
-    GST_ELEMENT_ERROR(GST_ELEMENT(demux), STREAM, FAILED, (NULL), ("Failed to sync state with parent."));
+  /* Setting the SDP can have vqesrc bind and start pushing straight away,
+     so the pad goes up, and gets linked, first */
+  if (!demux->srcpad) {
+    vqesrcpad = gst_element_get_static_pad (GST_ELEMENT(demux->vqesrc), "src");
+    template = gst_static_pad_template_get (&srctemplate);
+    demux->srcpad = gst_ghost_pad_new_from_template("src", vqesrcpad, template);
+    gst_pad_set_active(demux->srcpad, TRUE);
+    gst_element_add_pad (GST_ELEMENT (demux), demux->srcpad);
+    gst_element_no_more_pads (GST_ELEMENT (demux));
+    gst_object_unref(template);
+    template = NULL;
+    gst_object_unref (vqesrcpad);
+    vqesrcpad = NULL;
   }
-  gst_element_set_state(demux->vqesrc, GST_STATE_PLAYING);
+
+  g_object_set(G_OBJECT(demux->vqesrc), "sdp", sdp, NULL);
 }
 
 static void
@@ -223,11 +234,11 @@ gst_vqe_sdp_demux_reset(GstVQESDPDemux * demux)
     demux->sdpfile = NULL;
   }
   demux->sdpfile_complete = FALSE;
-  if (demux->vqesrc) {
-    g_object_unref(demux->vqesrc);
-    demux->vqesrc = NULL;
+  if (demux->srcpad) {
+    gst_pad_set_active(demux->srcpad, FALSE);
+    gst_element_remove_pad (GST_ELEMENT (demux), demux->srcpad);
+    demux->srcpad = NULL;
   }
-  /* TODO: Remove source pad? */
 }
 
 static GstStateChangeReturn
@@ -238,6 +249,12 @@ gst_vqe_sdp_demux_change_state (GstElement * element,
   GstVQESDPDemux *demux = GST_VQE_SDP_DEMUX (element);
 
   switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      /* vqesrc starts along with us, tuned to nothing until the SDP is
+         complete, and as a live source has GstBin return NO_PREROLL */
+      if (!demux->vqesrc && !gst_vqe_sdp_demux_create_vqesrc(demux))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       gst_vqe_sdp_demux_reset(demux);
       break;
@@ -248,16 +265,10 @@ gst_vqe_sdp_demux_change_state (GstElement * element,
   ret = GST_ELEMENT_CLASS (gst_vqe_sdp_demux_parent_class)->change_state (element, transition);
 
   switch (transition) {
-    case GST_STATE_CHANGE_READY_TO_PAUSED:
-      if (ret == GST_STATE_CHANGE_SUCCESS) {
-        /* We (will) contain a live source, so preroll is not available
-           TODO: Create vqesrc before entering the PLAYING state so GstBin
-           takes care of this. */
-        ret = GST_STATE_CHANGE_NO_PREROLL;
-      }
-      break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       gst_vqe_sdp_demux_reset(demux);
+      /* so that it isn't tuned to the old channel when next started */
+      g_object_set(G_OBJECT(demux->vqesrc), "sdp", "", NULL);
       break;
     default:
       break;
@@ -51,7 +51,10 @@ struct _GstVQESDPDemux
   GstBuffer * sdpfile;
   gboolean sdpfile_complete;
 
+  /* Lives in the bin from READY on, so that it's a live source GstBin
+     knows about and starts binding as soon as the SDP is complete */
   GstElement * vqesrc;
+  GstPad * srcpad;              /* exposed once we have the SDP */
 };
 
 struct _GstVQESDPDemuxClass
@@ -38,6 +38,12 @@
 #endif
 
 #include "gstvqesrc.h"
+#include "gstvqebufferpool.h"
+#include "gstvqecfg.h"
+#include "gstvqetracer.h"
+#include "gstvqehistogram.h"
+#include "gstvqebackend.h"
+#include "gstvqesynth.h"
 
 #include <gst/net/gstnetaddressmeta.h>
 
@@ -62,13 +68,59 @@
 GST_DEBUG_CATEGORY_STATIC (vqesrc_debug);
 #define GST_CAT_DEFAULT (vqesrc_debug)
 
+#define TS_CAPS  "video/mpegts"
+#define RTP_CAPS "application/x-rtp, media = (string) video, " \
+    "clock-rate = (int) 90000, encoding-name = (string) MP2T"
+
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS("video/mpegts"));
+    GST_STATIC_CAPS(TS_CAPS "; " RTP_CAPS));
+
+static GstStaticCaps ts_caps = GST_STATIC_CAPS (TS_CAPS);
+static GstStaticCaps rtp_caps = GST_STATIC_CAPS (RTP_CAPS);
 
 #define VQE_DEFAULT_SDP                 ""
 #define VQE_DEFAULT_CFG                 ""
+#define VQE_DEFAULT_DAEMON_SOCKET       NULL
+#define VQE_DEFAULT_LOSS                NULL
+#define VQE_DEFAULT_BACKUP_SDP          NULL
+#define VQE_DEFAULT_MERGE_DELAY         (50 * GST_MSECOND)
+#define VQE_DEFAULT_TIMESHIFT_DURATION  0
+#define VQE_DEFAULT_TIMESHIFT_MAX_BYTES (128 * 1024 * 1024)
+#define VQE_DEFAULT_TIMESHIFT_LOCATION  NULL
+#define VQE_DEFAULT_RCC                 TRUE
+#define VQE_DEFAULT_FASTFILL            TRUE
+#define VQE_DEFAULT_MAX_RECEIVE_BANDWIDTH 0
+#define VQE_DEFAULT_FAST_START          FALSE
+#define VQE_DEFAULT_PSI_CACHE           FALSE
+#define VQE_DEFAULT_PROVIDE_CLOCK       FALSE
+#define VQE_DEFAULT_DO_PCR_TIMESTAMP    FALSE
+#define VQE_DEFAULT_BUFFER_DURATION     0
+#define VQE_DEFAULT_ALLOCATOR           GST_VQE_ALLOCATOR_BACKING_SYSTEM
+#define VQE_DEFAULT_OUTPUT              GST_VQESRC_OUTPUT_TS
+#define VQE_DEFAULT_LIST_BUFFERS        1
+#define VQE_DEFAULT_LIST_LATENCY        (20 * GST_MSECOND)
+
+/* VQE-C's own defaults if jitter_buff_size and rcc_max_fill aren't in its
+   config file */
+#define VQEC_DEFAULT_JITTER_BUFF_SIZE_MS 200
+#define VQEC_DEFAULT_RCC_MAX_FILL_MS    1500
+/* How long we average the channel bitrate over */
+#define BITRATE_WINDOW                  GST_SECOND
+/* how often VQE-C's counters are sampled for the loss and repair
+   histograms, which is also the resolution of the repair round trip.  Each
+   sample takes VQE-C's global lock, so not every create(). */
+#define HISTOGRAM_SAMPLE                (100 * GST_MSECOND)
+
+#define PCR_INVALID                     G_MAXUINT64
+/* PCRs further apart than this are a discontinuity rather than a gap */
+#define PCR_MAX_GAP                     GST_VQE_TS_PCR_HZ
+/* MP2T's static payload type, for the RTP headers we write ourselves */
+#define RTP_PT_MP2T                     33
+/* A feed whose tuner has failed this many reads in a row, about 5s worth
+   with VQE-C's 100ms receive timeout, is given up on */
+#define FEED_MAX_ERRORS                 50
 
 /*
  * A word of explanation here...
@@ -89,11 +141,52 @@ GRecMutex vqe_owner_task_mutex;      /* gstreamer task lock           */
 GstTask *vqe_owner_task = NULL;      /* worker thread task            */
 size_t  vqe_owner_refcount = 0;      /* shared state refcout          */
 
+static gchar *vqec_config_path = NULL; /* file VQE-C was initialised with */
+static const GstVQEBackend *backend;  /* VQE-C or a stand-in for it */
+static gint vqec_ready = 0;           /* VQE-C is initialised in this process */
+
+/* The last PAT and PMT seen on each channel keyed by stream uri, shared
+   between all vqesrc instances so a zap back to a channel can hand them
+   straight to the demuxer rather than waiting for the next repetition. */
+typedef struct {
+  guint8 pat[GST_VQE_TS_PACKET_SIZE];
+  guint8 pmt[GST_VQE_TS_PACKET_SIZE];
+} GstVQEPsiCacheEntry;
+
+static GMutex psi_cache_mutex;
+static GHashTable *psi_cache = NULL;
+
+/* How late a thread running alongside the VQE-C worker, at its priority,
+   wakes from a periodic sleep: a stand-in for how late VQE-C's own timers,
+   and so repair requests, fire when the worker is starved of CPU.  In
+   microseconds, accumulated for the life of the process. */
+static GMutex lag_mutex;
+static GstVQEHistogram lag_histogram;
+static GThread *lag_monitor_thread = NULL;
+static gint lag_monitor_stop = 0;
+#define LAG_MONITOR_INTERVAL_US 10000
+
 static const size_t default_compound_buffer_size = VQEC_MSG_MAX_DATAGRAM_LEN*32; 
 static const size_t max_compound_buffer_size = 5*1024*1024;
 
+/* what we assume an RTP payload is until we've seen one: 7 TS packets */
+static const size_t default_datagram_size = 7 * 188;
+
 static const size_t max_buffers = 0;  /* have unlimited buffers*/
-static const size_t min_buffers = 1;  /* start with one buffer */
+/* enough for one being filled, one being pushed and a couple queued
+   downstream, so that steady state doesn't need to allocate */
+static const size_t min_buffers = 4;
+/* slots carved out of an allocator region, beyond which buffers come from
+   system memory */
+static const guint allocator_slots = 32;
+/* give up waiting for the rest of a channel change timeline after this */
+#define TIMELINE_TIMEOUT (10 * GST_SECOND)
+
+/* slots in the ring shared with gst-vqe-daemon */
+static const guint daemon_slots = 32;
+/* how long to wait for the daemon before returning an empty buffer, as
+   VQEC_MSG_MAX_RECV_TIMEOUT does in-process */
+static const gint daemon_timeout_ms = 100;
 
 enum
 {
@@ -129,7 +222,7 @@ enum
   PROP_VQEC_REPAIRS_REQUESTED,
   PROP_VQEC_REPAIRS_POLICED,
   PROP_VQEC_FEC_RECOVERED_PAKS,
-  /* TODO: not implemented yet */
+  /* process wide */
   PROP_VQEC_CHANNEL_CHANGE_REQUESTS,
   PROP_VQEC_RCC_REQUESTS,
   PROP_VQEC_CONCURRENT_RCCS_LIMITED,
@@ -155,6 +248,57 @@ enum
 
   PROP_GST_BUFFERSIZE_SIZE,
 
+  PROP_FAST_START,
+  PROP_FAST_START_BYTES_SKIPPED,
+  PROP_FAST_START_TIME_TO_RAP,
+
+  PROP_PSI_CACHE,
+  PROP_PSI_CACHE_MISMATCHES,
+
+  PROP_PROVIDE_CLOCK,
+  PROP_DO_PCR_TIMESTAMP,
+
+  PROP_BUFFER_DURATION,
+  PROP_CURRENT_BUFFER_SIZE,
+
+  PROP_POOL_ALLOCATIONS,
+  PROP_POOL_MISSES,
+  PROP_POOL_DISCARDS,
+
+  PROP_ALLOCATOR,
+  PROP_ALLOCATOR_IN_USE,
+  PROP_ALLOCATOR_FD,
+  PROP_ALLOCATOR_FALLBACKS,
+
+  PROP_DAEMON_SOCKET,
+  PROP_DAEMON_OVERRUNS,
+
+  PROP_RCC,
+  PROP_FASTFILL,
+  PROP_MAX_RECEIVE_BANDWIDTH_RCC,
+  PROP_MAX_RECEIVE_BANDWIDTH_ER,
+
+  PROP_EVENT_LOOP_LAG,
+  PROP_CHANNEL_HISTOGRAMS,
+
+  PROP_PRIMARY_LOSS,
+  PROP_REPAIR_LOSS,
+
+  PROP_BACKUP_SDP,
+  PROP_MERGE_DELAY,
+  PROP_MERGE_STATS,
+
+  PROP_TIMESHIFT_DURATION,
+  PROP_TIMESHIFT_MAX_BYTES,
+  PROP_TIMESHIFT_LOCATION,
+  PROP_TIMESHIFT_DELAY,
+
+  PROP_OUTPUT,
+
+  PROP_LIST_BUFFERS,
+  PROP_LIST_LATENCY,
+  PROP_LIST_STATS,
+
   PROP_LAST
 };
 
@@ -162,11 +306,52 @@ static GstFlowReturn gst_vqesrc_create (GstPushSrc * psrc, GstBuffer ** buf);
 
 static gboolean gst_vqesrc_start (GstBaseSrc * bsrc);
 
+static gboolean gst_vqesrc_retune (GstVQESrc * src);
+
+static gboolean gst_vqesrc_attach_daemon (GstVQESrc * src, const gchar * sdp);
+
+static gboolean gst_vqesrc_check_retune (GstVQESrc * src);
+
+static void gst_vqesrc_feeds_start (GstVQESrc * src);
+
+static void gst_vqesrc_feeds_stop (GstVQESrc * src);
+
+static GstFlowReturn gst_vqesrc_wait_tuned (GstVQESrc * src);
+
+static void gst_vqesrc_sdp_changed (GstVQESrc * src);
+
+static gboolean gst_vqesrc_has_vqec (GstVQESrc * src);
+
+static void gst_vqesrc_histograms_reset (GstVQESrc * src);
+
+static void gst_vqesrc_timeshift_observe_pcr (GstVQESrc * src, guint64 pcr);
+
+static GstFlowReturn gst_vqesrc_create_buffer (GstVQESrc * src,
+    GstBuffer ** buf);
+
+static vqec_error_t gst_vqesrc_merge_recv (GstVQESrc * src,
+    vqec_iobuf_t * iobuf, int32_t * len, int32_t timeout);
+
+static GstStructure *gst_vqesrc_merge_stats (GstVQESrc * src);
+
 static gboolean gst_vqesrc_stop (GstBaseSrc * bsrc);
 
 static gboolean gst_vqesrc_unlock (GstBaseSrc * bsrc);
 
-static gboolean gst_vqesrc_unlock_stop (GstBaseSrc * bsrc){ return FALSE; }
+static gboolean gst_vqesrc_unlock_stop (GstBaseSrc * bsrc);
+
+static GstCaps *gst_vqesrc_get_caps (GstBaseSrc * bsrc, GstCaps * filter);
+
+static GstClock *gst_vqesrc_provide_clock (GstElement * element);
+
+static GstStateChangeReturn gst_vqesrc_change_state (GstElement * element,
+    GstStateChange transition);
+
+static gboolean gst_vqesrc_query (GstBaseSrc * bsrc, GstQuery * query);
+
+static gboolean gst_vqesrc_is_seekable (GstBaseSrc * bsrc);
+
+static gboolean gst_vqesrc_do_seek (GstBaseSrc * bsrc, GstSegment * segment);
 
 static void gst_vqesrc_finalize (GObject * object);
 
@@ -178,6 +363,23 @@ static void gst_vqesrc_get_property (GObject * object, guint prop_id,
 #define gst_vqesrc_parent_class parent_class
 G_DEFINE_TYPE (GstVQESrc, gst_vqesrc, GST_TYPE_PUSH_SRC);
 
+GType
+gst_vqesrc_output_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_VQESRC_OUTPUT_TS, "MPEG-TS, compounded into large buffers", "ts"},
+    {GST_VQESRC_OUTPUT_RTP, "RTP packets, in buffer lists", "rtp"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&type)) {
+    GType tmp = g_enum_register_static ("GstVQESrcOutput", values);
+    g_once_init_leave (&type, tmp);
+  }
+  return type;
+}
+
 static void
 gst_vqesrc_class_init (GstVQESrcClass * klass)
 {
@@ -185,7 +387,6 @@ gst_vqesrc_class_init (GstVQESrcClass * klass)
   GstElementClass *gstelement_class;
   GstBaseSrcClass *gstbasesrc_class;
   GstPushSrcClass *gstpushsrc_class;
-  int err=0;
   const char* vqec_config = NULL;
 
   gobject_class = (GObjectClass *) klass;
@@ -201,12 +402,19 @@ gst_vqesrc_class_init (GstVQESrcClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_SDP,
       g_param_spec_string ("sdp", "SDP",
-          "Stream description in SDP format", VQE_DEFAULT_SDP,
+          "Stream description in SDP format. Setting it while started tunes "
+          "to the new stream, and until it's set we output nothing",
+          VQE_DEFAULT_SDP,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (gobject_class, PROP_CFG,
-      g_param_spec_string ("cfg", "Server Configuration file",
-          "cfg in form of file path /tmp/sample-vqec.config", VQE_DEFAULT_CFG,
+      g_param_spec_string ("cfg", "Channel configuration file",
+          "Path of a file of per-channel settings applied on top of the "
+          "global VQE-C configuration whenever we tune: error_repair_enable, "
+          "fec_enable, rcc_enable, fastfill_enable, max_receive_bandwidth_er "
+          "and max_receive_bandwidth_rcc, in vqe-c.cfg syntax. Setting it "
+          "while playing (even to the same path) rebinds the tuner with the "
+          "file's current contents", VQE_DEFAULT_CFG,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (gobject_class, PROP_VQEC_PRIMARY_UDP_INPUTS,
@@ -370,6 +578,42 @@ gst_vqesrc_class_init (GstVQESrcClass * klass)
            0, G_MAXUINT64, 0,
           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  /*
+   *    RCC stats.  VQE-C only counts these for the process as a whole.
+   */
+
+  g_object_class_install_property (gobject_class, PROP_VQEC_CHANNEL_CHANGE_REQUESTS,
+      g_param_spec_uint64 ("channel-change-requests", "PROP_VQEC_CHANNEL_CHANGE_REQUESTS",
+           "channel changes requested of all tuners in this process",
+           0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VQEC_RCC_REQUESTS,
+      g_param_spec_uint64 ("rcc-requests", "PROP_VQEC_RCC_REQUESTS",
+           "channel changes for which a rapid channel change burst was "
+           "requested",
+           0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VQEC_CONCURRENT_RCCS_LIMITED,
+      g_param_spec_uint64 ("concurrent-rccs-limited", "PROP_VQEC_CONCURRENT_RCCS_LIMITED",
+           "RCCs which weren't requested because another was in progress",
+           0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VQEC_RCC_WITH_LOSS,
+      g_param_spec_uint64 ("rcc-with-loss", "PROP_VQEC_RCC_WITH_LOSS",
+           "RCCs with unrepaired losses in their burst",
+           0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VQEC_RCC_ABORTS_TOTAL,
+      g_param_spec_uint64 ("rcc-aborts-total", "PROP_VQEC_RCC_ABORTS_TOTAL",
+           "RCCs which were aborted, after which the tuner joins the "
+           "multicast as normal",
+           0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /*
    *    TR135 stats
    */
@@ -475,6 +719,300 @@ gst_vqesrc_class_init (GstVQESrcClass * klass)
            default_compound_buffer_size, 
            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_FAST_START,
+      g_param_spec_boolean ("fast-start", "Fast start",
+          "After tuning, discard data until PAT, PMT and a random access "
+          "point on the video PID have been seen, then start output at that "
+          "point with the PAT and PMT in front of it",
+          VQE_DEFAULT_FAST_START,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FAST_START_BYTES_SKIPPED,
+      g_param_spec_uint64 ("fast-start-bytes-skipped", "Fast start bytes skipped",
+          "Number of bytes discarded by fast-start before the first random "
+          "access point of the current channel",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FAST_START_TIME_TO_RAP,
+      g_param_spec_uint64 ("fast-start-time-to-rap", "Fast start time to RAP",
+          "Time in nanoseconds from tuning to the first random access point "
+          "of the current channel, or GST_CLOCK_TIME_NONE if not yet seen",
+          0, G_MAXUINT64, GST_CLOCK_TIME_NONE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PSI_CACHE,
+      g_param_spec_boolean ("psi-cache", "PSI cache",
+          "Remember the PAT and PMT of each channel and send them at the "
+          "start of output the next time the channel is tuned",
+          VQE_DEFAULT_PSI_CACHE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PSI_CACHE_MISMATCHES,
+      g_param_spec_uint64 ("psi-cache-mismatches", "PSI cache mismatches",
+          "Number of times a cached PAT or PMT turned out to differ from the "
+          "live one",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PROVIDE_CLOCK,
+      g_param_spec_boolean ("provide-clock", "Provide clock",
+          "Offer the pipeline a clock slaved to the PCRs of the stream so "
+          "playback follows the head-end encoder clock. Set in NULL state",
+          VQE_DEFAULT_PROVIDE_CLOCK,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DO_PCR_TIMESTAMP,
+      g_param_spec_boolean ("do-pcr-timestamp", "Timestamp from PCR clock",
+          "Timestamp buffers with the running time of the PCR clock rather "
+          "than that of the pipeline clock. Set in NULL state",
+          VQE_DEFAULT_DO_PCR_TIMESTAMP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BUFFER_DURATION,
+      g_param_spec_uint64 ("buffer-duration", "Buffer duration",
+          "Adapt the size of the buffers we produce to the measured bitrate "
+          "of the channel so each holds about this many nanoseconds of "
+          "stream, instead of using buffer-size. 0 = disabled",
+          0, G_MAXUINT64, VQE_DEFAULT_BUFFER_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CURRENT_BUFFER_SIZE,
+      g_param_spec_ulong ("current-buffer-size", "Current buffer size",
+          "The size of the buffers currently being produced",
+          0, G_MAXULONG, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_ALLOCATIONS,
+      g_param_spec_uint ("pool-allocations", "Pool allocations",
+          "Number of buffers allocated by our buffer pools, including the "
+          "ones allocated up front",
+          0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_MISSES,
+      g_param_spec_uint ("pool-misses", "Pool misses",
+          "Number of times a buffer had to be allocated because none were "
+          "free. Should stop increasing once the stream is flowing",
+          0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_DISCARDS,
+      g_param_spec_uint ("pool-discards", "Pool discards",
+          "Number of buffers which came back from downstream in a state "
+          "where they couldn't be reused",
+          0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOCATOR,
+      g_param_spec_enum ("allocator", "Allocator",
+          "Memory to carve buffers out of. memfd and hugepage regions are "
+          "faulted in up front; hugepage falls back to memfd, and either to "
+          "system memory, if the kernel can't provide it. Takes effect on "
+          "start",
+          GST_TYPE_VQE_ALLOCATOR_BACKING, VQE_DEFAULT_ALLOCATOR,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOCATOR_IN_USE,
+      g_param_spec_enum ("allocator-in-use", "Allocator in use",
+          "The memory buffers are actually being allocated from",
+          GST_TYPE_VQE_ALLOCATOR_BACKING, GST_VQE_ALLOCATOR_BACKING_SYSTEM,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOCATOR_FD,
+      g_param_spec_int ("allocator-fd", "Allocator fd",
+          "memfd holding the current buffers, for passing to other "
+          "processes, or -1 if buffers are in system memory. Only valid "
+          "while the element holds a reference to it, so dup() it",
+          -1, G_MAXINT, -1,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOCATOR_FALLBACKS,
+      g_param_spec_uint ("allocator-fallbacks", "Allocator fallbacks",
+          "Number of buffers allocated from system memory because every "
+          "memfd or hugepage slot was in use. Should stay at 0 once the "
+          "stream is flowing",
+          0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DAEMON_SOCKET,
+      g_param_spec_string ("daemon-socket", "Daemon socket",
+          "Unix socket of a gst-vqe-daemon to receive through instead of "
+          "running VQE-C in this process. VQE-C statistics are then only "
+          "available from the daemon. Takes effect on start",
+          VQE_DEFAULT_DAEMON_SOCKET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RCC,
+      g_param_spec_boolean ("rcc", "Rapid channel change",
+          "Ask the server for a unicast burst when tuning so that output "
+          "starts sooner, at the cost of extra bandwidth. Overrides the "
+          "configuration if set; changes rebind the tuner. Reads back what "
+          "the tuner was bound with",
+          VQE_DEFAULT_RCC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FASTFILL,
+      g_param_spec_boolean ("fastfill", "Fast fill",
+          "Output the RCC burst as fast as it arrives rather than at the "
+          "stream rate, so downstream buffers fill quickly. Overrides the "
+          "configuration if set; changes rebind the tuner. Reads back what "
+          "the tuner was bound with",
+          VQE_DEFAULT_FASTFILL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_MAX_RECEIVE_BANDWIDTH_RCC,
+      g_param_spec_uint ("max-receive-bandwidth-rcc",
+          "Max receive bandwidth during RCC",
+          "Access link bandwidth in bits per second the RCC burst may use, "
+          "0 for the configured value; changes rebind the tuner",
+          0, G_MAXUINT, VQE_DEFAULT_MAX_RECEIVE_BANDWIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_MAX_RECEIVE_BANDWIDTH_ER,
+      g_param_spec_uint ("max-receive-bandwidth-er",
+          "Max receive bandwidth during repair",
+          "Access link bandwidth in bits per second the stream and its "
+          "retransmissions may use, 0 for the configured value; changes "
+          "rebind the tuner",
+          0, G_MAXUINT, VQE_DEFAULT_MAX_RECEIVE_BANDWIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_EVENT_LOOP_LAG,
+      g_param_spec_boxed ("event-loop-lag", "Event loop lag",
+          "How late, in microseconds, a periodic timer beside the VQE-C "
+          "event loop fires, for the whole process: samples, p50, p90, p99, "
+          "p999 and max. Empty when receiving through a daemon",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHANNEL_HISTOGRAMS,
+      g_param_spec_boxed ("channel-histograms", "Channel histograms",
+          "Distributions for the current channel: interarrival, the "
+          "datagram inter-arrival time in microseconds; sampled-loss-burst, "
+          "the mean loss burst length in packets over each 100ms sample of "
+          "VQE-C's counters; and sampled-repair-rtt, the repair round trip "
+          "in microseconds to the nearest sample. Each has count, mean, p50, "
+          "p90, p99, max and power of two buckets. Empty when receiving "
+          "through a daemon",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PRIMARY_LOSS,
+      g_param_spec_string ("primary-loss", "Primary stream loss",
+          "Drop primary stream packets on arrival, for testing repair: "
+          "\"uniform:P\" for each with probability P, \"gilbert:P:R\" for "
+          "Gilbert-Elliott bursts entered with probability P and left with "
+          "R, \"periodic:N\" for every Nth, or none. With VQE-C this drives "
+          "its drop simulator, which affects every tuner in the process",
+          VQE_DEFAULT_LOSS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_REPAIR_LOSS,
+      g_param_spec_string ("repair-loss", "Repair stream loss",
+          "Drop retransmitted packets on arrival, with patterns as for "
+          "primary-loss",
+          VQE_DEFAULT_LOSS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BACKUP_SDP,
+      g_param_spec_string ("backup-sdp", "Backup SDP",
+          "SDP of a second feed of the same stream over a diverse path. "
+          "Both are received and merged by RTP sequence number, so each "
+          "packet is output once from whichever feed delivers it first. "
+          "Needs VQE-C to leave RTP headers on (strip_rtp = false), which "
+          "applies to the whole process; vqesrc takes them off its MPEG-TS "
+          "output itself. Not available through a daemon. Takes effect on "
+          "start",
+          VQE_DEFAULT_BACKUP_SDP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MERGE_DELAY,
+      g_param_spec_uint64 ("merge-delay", "Merge delay",
+          "How long in nanoseconds to wait for a packet missing from both "
+          "feeds before giving up on it, which should cover the skew "
+          "between the feeds",
+          0, G_MAXUINT64, VQE_DEFAULT_MERGE_DELAY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MERGE_STATS,
+      g_param_spec_boxed ("merge-stats", "Merge statistics",
+          "With a backup feed, for each of the primary and backup feeds the "
+          "packets received, used, duplicated and lost, and the packets "
+          "output and lost from both",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TIMESHIFT_DURATION,
+      g_param_spec_uint64 ("timeshift-duration", "Timeshift duration",
+          "Keep this many nanoseconds of what we output so that it can be "
+          "seeked back into, 0 for none. Seek positions are times since the "
+          "channel was tuned and land on the random access point before "
+          "them; seeking past the newest goes back to live. Times follow "
+          "the stream's PCRs where it has them. While PAUSED the stream "
+          "is still recorded, and playback resumes from where it was "
+          "paused. Not available through a daemon. Takes effect on start",
+          0, G_MAXUINT64, VQE_DEFAULT_TIMESHIFT_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TIMESHIFT_MAX_BYTES,
+      g_param_spec_uint64 ("timeshift-max-bytes", "Timeshift max bytes",
+          "Most memory, or with timeshift-location roughly the most disk, "
+          "the timeshift window may use, shortening it if need be. Takes "
+          "effect on start",
+          0, G_MAXUINT64, VQE_DEFAULT_TIMESHIFT_MAX_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TIMESHIFT_LOCATION,
+      g_param_spec_string ("timeshift-location", "Timeshift location",
+          "Directory to keep the timeshift window in, as segment files, "
+          "rather than in memory. Played back from mappings of the files "
+          "without copying. Takes effect on start",
+          VQE_DEFAULT_TIMESHIFT_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TIMESHIFT_DELAY,
+      g_param_spec_uint64 ("timeshift-delay", "Timeshift delay",
+          "How many nanoseconds behind live output is, 0 when live",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DAEMON_OVERRUNS,
+      g_param_spec_uint ("daemon-overruns", "Daemon overruns",
+          "Buffers the daemon had to drop because we weren't keeping up",
+          0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT,
+      g_param_spec_enum ("output", "Output",
+          "What to output. rtp pushes lists of buffers each holding one RTP "
+          "packet with its original header, or if VQE-C is stripping them "
+          "with a new one, for rtpjitterbuffer and the like to take. rtp "
+          "leaves out fast-start, psi-cache and timeshift, which need to "
+          "edit the TS, and isn't available through a daemon. Takes effect "
+          "on start",
+          GST_TYPE_VQESRC_OUTPUT, VQE_DEFAULT_OUTPUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LIST_BUFFERS,
+      g_param_spec_uint ("list-buffers", "List buffers",
+          "Push up to this many buffers at a time as a buffer list, saving "
+          "the cost of a push for each at high bitrates, 1 to push them "
+          "one at a time. Needs GStreamer 1.14 or later. output rtp always "
+          "pushes lists, of packets. Takes effect on start",
+          1, 256, VQE_DEFAULT_LIST_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LIST_LATENCY,
+      g_param_spec_uint64 ("list-latency", "List latency",
+          "Longest to hold on to the first buffer of a list while gathering "
+          "the rest, in nanoseconds. No more buffers are started once, at "
+          "the current bitrate, they couldn't be filled in time. Added to "
+          "the latency we report when list-buffers is more than 1. Takes "
+          "effect on start",
+          0, G_MAXUINT64, VQE_DEFAULT_LIST_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LIST_STATS,
+      g_param_spec_boxed ("list-stats", "List stats",
+          "Buffers per list pushed since start, as list-size-count, -mean, "
+          "-p50, -p90, -p99, -max and -buckets (power of two buckets), and "
+          "deadline-closes, the lists list-latency cut short",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&src_template));
 
@@ -483,10 +1021,17 @@ gst_vqesrc_class_init (GstVQESrcClass * klass)
       "Tune to multicast RTP streams",
       "William Manley <william.manley@youview.com>");
 
+  gstelement_class->provide_clock = GST_DEBUG_FUNCPTR (gst_vqesrc_provide_clock);
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_vqesrc_change_state);
+
   gstbasesrc_class->start = gst_vqesrc_start;
   gstbasesrc_class->stop = gst_vqesrc_stop;
   gstbasesrc_class->unlock = gst_vqesrc_unlock;
   gstbasesrc_class->unlock_stop = gst_vqesrc_unlock_stop;
+  gstbasesrc_class->get_caps = GST_DEBUG_FUNCPTR (gst_vqesrc_get_caps);
+  gstbasesrc_class->query = GST_DEBUG_FUNCPTR (gst_vqesrc_query);
+  gstbasesrc_class->is_seekable = GST_DEBUG_FUNCPTR (gst_vqesrc_is_seekable);
+  gstbasesrc_class->do_seek = GST_DEBUG_FUNCPTR (gst_vqesrc_do_seek);
 
   gstpushsrc_class->create = gst_vqesrc_create;
 
@@ -496,21 +1041,72 @@ gst_vqesrc_class_init (GstVQESrcClass * klass)
   {
     vqec_config = CONFIG_DIR "/vqe-c/vqe-c.cfg";
   }
-  GST_INFO(stderr, "VQEC: initialising with config file: %s\n", vqec_config );
-  err = vqec_ifclient_init( vqec_config );
-  if (err) {
-    GST_INFO(stderr, "Failed to initialise VQE-C: %s\n", vqec_err2str(err));
-  }
+  vqec_config_path = g_strdup (vqec_config);
+  backend = gst_vqe_backend_get (g_getenv ("GSTVQE_BACKEND"));
 
   g_mutex_init ( &vqe_owner_mutex );
   g_rec_mutex_init ( &vqe_owner_task_mutex );
+
+  g_mutex_init (&psi_cache_mutex);
+  g_mutex_init (&lag_mutex);
+  psi_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 }
 
 static void
 gst_vqesrc_init (GstVQESrc * vqesrc)
 {
+  guint i;
+
   vqesrc->sdp = g_strdup (VQE_DEFAULT_SDP);
   vqesrc->cfg = g_strdup (VQE_DEFAULT_CFG);
+  vqesrc->daemon_socket = g_strdup (VQE_DEFAULT_DAEMON_SOCKET);
+  vqesrc->primary_loss = g_strdup (VQE_DEFAULT_LOSS);
+  vqesrc->repair_loss = g_strdup (VQE_DEFAULT_LOSS);
+  vqesrc->backup_sdp = g_strdup (VQE_DEFAULT_BACKUP_SDP);
+  vqesrc->merge_delay = VQE_DEFAULT_MERGE_DELAY;
+  vqesrc->merging = FALSE;
+  g_mutex_init (&vqesrc->merge_lock);
+  g_cond_init (&vqesrc->merge_cond);
+  g_cond_init (&vqesrc->tune_cond);
+  g_mutex_init (&vqesrc->tune_lock);
+  vqesrc->tuner_ready = FALSE;
+  vqesrc->timeshift_duration = VQE_DEFAULT_TIMESHIFT_DURATION;
+  vqesrc->timeshift_max_bytes = VQE_DEFAULT_TIMESHIFT_MAX_BYTES;
+  vqesrc->timeshift_location = g_strdup (VQE_DEFAULT_TIMESHIFT_LOCATION);
+  vqesrc->timeshifting = FALSE;
+  vqesrc->timeshift_pcr = PCR_INVALID;
+  vqesrc->timeshift_time = 0;
+  vqesrc->recorder = NULL;
+  vqesrc->recorder_stop = FALSE;
+  vqesrc->recording = FALSE;
+  gst_vqe_timeshift_init (&vqesrc->timeshift, vqesrc->timeshift_duration,
+      vqesrc->timeshift_max_bytes);
+  vqesrc->output = VQE_DEFAULT_OUTPUT;
+  vqesrc->rtp_output = FALSE;
+  vqesrc->rtp_seq = 0;
+  vqesrc->rtp_ssrc = 0;
+  vqesrc->rtp_packets = g_array_new (FALSE, FALSE, sizeof (GstVQESrcPacket));
+  vqesrc->rtp_base = 0;
+  vqesrc->flushing = FALSE;
+  vqesrc->list_buffers = VQE_DEFAULT_LIST_BUFFERS;
+  vqesrc->list_latency = VQE_DEFAULT_LIST_LATENCY;
+  vqesrc->current_list_buffers = VQE_DEFAULT_LIST_BUFFERS;
+  vqesrc->current_list_latency = VQE_DEFAULT_LIST_LATENCY;
+  gst_vqe_histogram_reset (&vqesrc->list_sizes);
+  vqesrc->list_deadlines = 0;
+  vqesrc->use_daemon = FALSE;
+  vqesrc->daemon = NULL;
+  vqesrc->retune_pending = FALSE;
+  vqesrc->loss_pending = FALSE;
+  vqesrc->tuned = FALSE;
+  vqesrc->rcc = VQE_DEFAULT_RCC;
+  vqesrc->rcc_set = FALSE;
+  vqesrc->fastfill = VQE_DEFAULT_FASTFILL;
+  vqesrc->fastfill_set = FALSE;
+  vqesrc->bound_rcc = VQE_DEFAULT_RCC;
+  vqesrc->bound_fastfill = VQE_DEFAULT_FASTFILL;
+  vqesrc->max_receive_bandwidth_rcc = VQE_DEFAULT_MAX_RECEIVE_BANDWIDTH;
+  vqesrc->max_receive_bandwidth_er = VQE_DEFAULT_MAX_RECEIVE_BANDWIDTH;
 
   /* configure basesrc to be a live source */
   gst_base_src_set_live (GST_BASE_SRC (vqesrc), TRUE);
@@ -525,7 +1121,13 @@ gst_vqesrc_init (GstVQESrc * vqesrc)
   vqesrc->tr135_params.severe_loss_min_distance = 2;
   vqesrc->stream_uri[0] = '\0';
 
-  vqesrc->bufferPool = gst_buffer_pool_new();
+  vqesrc->bufferPool = gst_vqe_buffer_pool_new ();
+  vqesrc->retired_pool_allocations = 0;
+  vqesrc->retired_pool_misses = 0;
+  vqesrc->retired_pool_discards = 0;
+  vqesrc->retired_allocator_fallbacks = 0;
+  vqesrc->allocator_backing = VQE_DEFAULT_ALLOCATOR;
+  vqesrc->allocator = NULL;
   
   /* 
    * When we compound the backets to form larger buffers we need to take
@@ -533,6 +1135,65 @@ gst_vqesrc_init (GstVQESrc * vqesrc)
    * size requested by the user will be slightly larger to accomodate for that.
    */
   vqesrc->compound_buffer_size = default_compound_buffer_size;
+
+  vqesrc->buffer_duration = VQE_DEFAULT_BUFFER_DURATION;
+  vqesrc->current_buffer_size = vqesrc->compound_buffer_size;
+  vqesrc->compound_limit =
+      vqesrc->compound_buffer_size - VQEC_MSG_MAX_DATAGRAM_LEN;
+  vqesrc->pool_buffer_size = vqesrc->compound_buffer_size;
+  vqesrc->datagram_size = default_datagram_size;
+
+  vqesrc->fast_start = VQE_DEFAULT_FAST_START;
+  vqesrc->fast_start_pending = FALSE;
+  gst_vqe_ts_scanner_reset (&vqesrc->scanner);
+  vqesrc->tune_time = GST_CLOCK_TIME_NONE;
+  vqesrc->fast_start_bytes_skipped = 0;
+  vqesrc->fast_start_time_to_rap = GST_CLOCK_TIME_NONE;
+
+  vqesrc->psi_cache = VQE_DEFAULT_PSI_CACHE;
+  vqesrc->psi_scan_pending = FALSE;
+  vqesrc->psi_inject_pending = FALSE;
+  vqesrc->have_cached_psi = FALSE;
+  vqesrc->psi_seen = 0;
+  vqesrc->psi_cache_mismatches = 0;
+  vqesrc->psi_discont_pid[0] = GST_VQE_TS_PID_INVALID;
+  vqesrc->psi_discont_pid[1] = GST_VQE_TS_PID_INVALID;
+  vqesrc->psi_discont_pending = FALSE;
+
+  /* A system clock which starts off in step with the monotonic clock and is
+     then calibrated against the PCRs we see. */
+  vqesrc->pcr_clock = g_object_new (GST_TYPE_SYSTEM_CLOCK,
+      "name", "GstVQEPcrClock", "clock-type", GST_CLOCK_TYPE_MONOTONIC, NULL);
+  gst_object_ref_sink (vqesrc->pcr_clock);
+  vqesrc->provide_clock = VQE_DEFAULT_PROVIDE_CLOCK;
+  vqesrc->do_pcr_timestamp = VQE_DEFAULT_DO_PCR_TIMESTAMP;
+  vqesrc->track_pcr = FALSE;
+  vqesrc->last_pcr = PCR_INVALID;
+  vqesrc->pcr_time = GST_CLOCK_TIME_NONE;
+  vqesrc->pcr_anchor_base_time = GST_CLOCK_TIME_NONE;
+
+  for (i = 0; i < GST_VQESRC_N_PHASES; i++)
+    vqesrc->timeline[i] = GST_CLOCK_TIME_NONE;
+  vqesrc->timeline_pending = FALSE;
+  vqesrc->rcc_resolved = FALSE;
+  vqesrc->rcc_burst = FALSE;
+  vqesrc->timeline_primary_inputs = 0;
+  vqesrc->timeline_repair_inputs = 0;
+
+  gst_vqesrc_histograms_reset (vqesrc);
+
+  vqesrc->probe_recv_time = 0;
+  vqesrc->probe_acquire_time = 0;
+  vqesrc->probe_datagrams = 0;
+  vqesrc->probe_idle = FALSE;
+
+  vqesrc->vqec_jitter = 0;
+  vqesrc->vqec_rcc_fill = 0;
+  vqesrc->vqec_latency = 0;
+  vqesrc->bitrate = 0;
+  vqesrc->bitrate_bytes = 0;
+  vqesrc->bitrate_window_start = GST_CLOCK_TIME_NONE;
+  vqesrc->reported_latency = GST_CLOCK_TIME_NONE;
 }
 
 static void
@@ -549,176 +1210,2244 @@ gst_vqesrc_finalize (GObject * object)
 
   g_free (vqesrc->cfg);
   vqesrc->cfg = NULL;
+
+  g_free (vqesrc->daemon_socket);
+  vqesrc->daemon_socket = NULL;
+
+  g_free (vqesrc->primary_loss);
+  vqesrc->primary_loss = NULL;
+  g_free (vqesrc->repair_loss);
+  vqesrc->repair_loss = NULL;
+
+  g_free (vqesrc->backup_sdp);
+  vqesrc->backup_sdp = NULL;
+  g_mutex_clear (&vqesrc->merge_lock);
+  g_cond_clear (&vqesrc->merge_cond);
+  g_cond_clear (&vqesrc->tune_cond);
+  g_mutex_clear (&vqesrc->tune_lock);
+
+  gst_vqe_timeshift_free (&vqesrc->timeshift);
+  g_free (vqesrc->timeshift_location);
+  vqesrc->timeshift_location = NULL;
+  g_array_free (vqesrc->rtp_packets, TRUE);
+  vqesrc->rtp_packets = NULL;
   
   gst_object_unref(vqesrc->bufferPool);
   vqesrc->bufferPool = NULL;
 
+  if (vqesrc->allocator)
+    gst_object_unref (vqesrc->allocator);
+  vqesrc->allocator = NULL;
+
+  gst_object_unref (vqesrc->pcr_clock);
+  vqesrc->pcr_clock = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 
   GST_OBJECT_UNLOCK (vqesrc);
 }
 
-static GstFlowReturn
-gst_vqesrc_create (GstPushSrc * psrc, GstBuffer ** buf)
+/*
+ *  Latency
+ */
+
+/* How long a compound buffer takes to fill at the channel's bitrate, 0 if
+   we don't know it yet.  Called with the object lock held. */
+static GstClockTime
+gst_vqesrc_get_fill_time_unlocked (GstVQESrc * src)
 {
-  GstVQESrc *vqesrc;
-  GstBuffer *outbuf;
-  GstFlowReturn ret;
-  GstBuffer *buffer;
-  GstMemory *mem;
-  GstMapInfo info;
-  int32_t bytes_read = 0;
-  int32_t compounded_bytes_read = 0;
-  vqec_iobuf_t buflist[1] = {0};
-  vqec_error_t err=0;
+  if (src->bitrate == 0)
+    return 0;
+  return gst_util_uint64_scale (src->current_buffer_size, 8 * GST_SECOND,
+      src->bitrate);
+}
 
-  vqesrc = GST_VQESRC_CAST (psrc);
+/* The latency we add is the time VQE-C holds packets back for so it has a
+   chance to repair them plus the time it takes to fill a compound buffer,
+   and any time buffers are held to go out together in a list, plus, when
+   merging feeds, the time a packet missing from both may be waited for.
+   Called with
+   the object lock held. */
+static GstClockTime
+gst_vqesrc_get_latency_unlocked (GstVQESrc * src)
+{
+  GstClockTime latency = src->vqec_latency;
+
+  latency += gst_vqesrc_get_fill_time_unlocked (src);
+  if (src->current_list_buffers > 1 && !src->rtp_output)
+    latency += src->current_list_latency;
+  if (src->merging)
+    latency += src->merge_delay;
+  return latency;
+}
 
-  /* It is not necessary (nor desirable) to lock the vqesrc mutex here as VQE
-   * does it's own internal locking and the only vqesrc member we need to
-   * access is tuner id which is set in _start and _stop which GstBaseSrc
-   * guarantees will not be called at the same time as _create.  We don't want
-   * to hold the mutex to avoid blocking other methods (notably get_property)
-   * while waiting for data */
+/* How much later than that we can read before packets are lost: VQE-C
+   keeps about a jitter buffer's worth once it is due, and the pool has
+   min_buffers compound buffers ready to take it.  Called with the object
+   lock held. */
+static GstClockTime
+gst_vqesrc_get_max_lateness_unlocked (GstVQESrc * src)
+{
+  return src->vqec_jitter +
+      min_buffers * gst_vqesrc_get_fill_time_unlocked (src);
+}
 
-  /* TODO: deal with cancellation somehow... Probably need to return
-     GST_FLOW_FLUSHING */
-  
-  memset(buflist, 0, sizeof(buflist));
+/* Work out what VQE-C holds back on the channel bound with @cfg: its
+   jitter buffer, the FEC block it waits for when FEC is on and, when RCC
+   is on, the backfill it buffers at the start of the burst.  The per
+   channel cfg and the rcc property are already folded into @cfg. */
+static void
+gst_vqesrc_set_vqec_latency (GstVQESrc * src, const vqec_chan_cfg_t * cfg)
+{
+  GstClockTime latency;
 
-  ret = gst_buffer_pool_acquire_buffer (vqesrc->bufferPool, &buffer, NULL);
-  if (G_UNLIKELY (ret != GST_FLOW_OK))
-  {
-    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
-                      FAILED, (NULL),
-                      ("Failed to acquire buffer from buffer pool."));
-    goto error;
-  }
+  GST_OBJECT_LOCK (src);
+  latency = src->vqec_jitter;
+  if (cfg->fec_enable && src->bitrate)
+    latency += gst_util_uint64_scale ((guint64) cfg->fec_l_value *
+        MAX (cfg->fec_d_value, 1) * default_datagram_size,
+        8 * GST_SECOND, src->bitrate);
+  if (cfg->rcc_enable)
+    latency += src->vqec_rcc_fill;
+  src->vqec_latency = latency;
+  GST_OBJECT_UNLOCK (src);
 
-  guint memIdx = gst_buffer_n_memory( buffer );
-  if ( memIdx != 1)
-  {
-    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
-                      FAILED, (NULL),
-                      ("This is not ideal..."));
-    goto error;
-  }
+  GST_DEBUG_OBJECT (src, "VQE-C holds back %" GST_TIME_FORMAT " (fec %d, "
+      "rcc %d)", GST_TIME_ARGS (latency), cfg->fec_enable, cfg->rcc_enable);
+}
 
-  mem = gst_buffer_peek_memory(buffer, memIdx-1) ;
-  if ( !gst_memory_map( mem,&info,GST_MAP_WRITE ) )
-  {
-    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
-                  FAILED, (NULL),
-                  ("gst_memory_map failed"));
-    goto error;
+static gboolean
+gst_vqesrc_query (GstBaseSrc * bsrc, GstQuery * query)
+{
+  GstVQESrc *src = GST_VQESRC (bsrc);
+  GstClockTime min, max;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+      GST_OBJECT_LOCK (src);
+      min = gst_vqesrc_get_latency_unlocked (src);
+      max = min + gst_vqesrc_get_max_lateness_unlocked (src);
+      src->reported_latency = min;
+      GST_OBJECT_UNLOCK (src);
+
+      GST_DEBUG_OBJECT (src, "Reporting latency of %" GST_TIME_FORMAT
+          " to %" GST_TIME_FORMAT, GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+      gst_query_set_latency (query, TRUE, min, max);
+      return TRUE;
+    case GST_QUERY_SEEKING:{
+      GstFormat format;
+      GstClockTime start, end;
+
+      gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
+      if (!src->timeshifting || format != GST_FORMAT_TIME)
+        return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
+
+      GST_OBJECT_LOCK (src);
+      start = gst_vqe_timeshift_start (&src->timeshift);
+      end = gst_vqe_timeshift_end (&src->timeshift);
+      GST_OBJECT_UNLOCK (src);
+
+      gst_query_set_seeking (query, GST_FORMAT_TIME,
+          GST_CLOCK_TIME_IS_VALID (start), start, end);
+      return TRUE;
+    }
+    default:
+      return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
   }
+}
 
-  // read at buffer_size amount of data
-  while ( compounded_bytes_read
-          <= (vqesrc->compound_buffer_size - VQEC_MSG_MAX_DATAGRAM_LEN) && 
-          !err )
-  {
-    bytes_read = 0;
-    buflist[0].buf_ptr = &info.data[compounded_bytes_read];
-    buflist[0].buf_len = info.maxsize - compounded_bytes_read;
-
-  /* VQEC_MSG_MAX_RECV_TIMEOUT this is 100ms for the current version of VQEC */
-    err = vqec_ifclient_tuner_recvmsg(
-        vqesrc->tuner, buflist, 1, &bytes_read, VQEC_MSG_MAX_RECV_TIMEOUT );
+/* Tell the pipeline to ask for our latency again if it has moved more than
+   10% from what we last told it. */
+static void
+gst_vqesrc_check_latency (GstVQESrc * src)
+{
+  GstClockTime latency, reported;
 
-    if ( err ==VQEC_OK && bytes_read==0 )
-    {
-      /* We're spinning for 100ms without data arriving. We need to exit this
-         function to allow pipeline to shutdown properly if data will never
-         come. Without this exit condition we're hitting a deadlock when
-         GstBaseSrc wants to change it's state but can't because we're
-         spinning in here. 
-      */
-      break;
-    }
+  GST_OBJECT_LOCK (src);
+  latency = gst_vqesrc_get_latency_unlocked (src);
+  reported = src->reported_latency;
+  GST_OBJECT_UNLOCK (src);
 
-    compounded_bytes_read+=bytes_read;
+  if (!GST_CLOCK_TIME_IS_VALID (reported))
+    return;
+  if (latency > reported + reported / 10 || latency < reported - reported / 10) {
+    GST_INFO_OBJECT (src, "Latency changed from %" GST_TIME_FORMAT " to %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (reported), GST_TIME_ARGS (latency));
+    gst_element_post_message (GST_ELEMENT (src),
+        gst_message_new_latency (GST_OBJECT (src)));
   }
+}
 
-  if (err) {
-    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
-                      READ, (NULL),
-                      ("Error receiving data from VQE: %s", vqec_err2str(err)));
-    goto buf_error;
-  }
+/*
+ *  Buffer pool and bitrate-adaptive buffer sizing
+ */
 
-  gst_memory_resize (mem,0,compounded_bytes_read);
-  gst_memory_unmap ( mem, &info);
+/* Called with the object lock held */
+static void
+gst_vqesrc_get_pool_stats_unlocked (GstVQESrc * src, guint * allocations,
+    guint * misses, guint * discards)
+{
+  gst_vqe_buffer_pool_get_stats (GST_VQE_BUFFER_POOL (src->bufferPool),
+      allocations, misses, discards);
+  *allocations += src->retired_pool_allocations;
+  *misses += src->retired_pool_misses;
+  *discards += src->retired_pool_discards;
+}
 
-  /* Perhaps this is also a good idea: */
-#if 0
-  /* use buffer metadata so receivers can also track the address */
-  if (saddr) {
-    gst_buffer_add_net_address_meta (outbuf, saddr);
-    g_object_unref (saddr);
-  }
-  saddr = NULL;
-#endif
-  *buf = buffer;
-  return GST_FLOW_OK;
-buf_error:
-  gst_memory_unmap (mem, &info);
-  gst_buffer_pool_release_buffer (vqesrc->bufferPool, buffer);
-error:
-  return GST_FLOW_ERROR;
+/* Called with the object lock held */
+static guint
+gst_vqesrc_get_allocator_fallbacks_unlocked (GstVQESrc * src)
+{
+  guint fallbacks = src->retired_allocator_fallbacks;
+
+  if (src->allocator)
+    fallbacks += g_atomic_int_get (&GST_VQE_ALLOCATOR (src->allocator)->
+        fallbacks);
+  return fallbacks;
 }
 
-static gboolean
-gst_vqesrc_set_sdp (GstVQESrc * src, const gchar * sdp, GError ** error)
+/* Keep the counts of a pool we're about to replace.  Called with the object
+   lock held. */
+static void
+gst_vqesrc_retire_pool_stats (GstVQESrc * src)
 {
-  /* Won't have any affect until the source is stopped and restarted. */
-  /* TODO: A bit of preliminary validation of the SDP contents */
-  g_free(src->sdp);
-  src->sdp = g_strdup(sdp);
-  return TRUE;
+  gst_vqesrc_get_pool_stats_unlocked (src, &src->retired_pool_allocations,
+      &src->retired_pool_misses, &src->retired_pool_discards);
 }
 
 static gboolean
-gst_vqesrc_set_cfg (GstVQESrc * src, const gchar * cfg, GError ** error)
+gst_vqesrc_configure_pool (GstVQESrc * src, GstBufferPool * pool, guint size)
 {
-  /* Won't have any affect until the source is stopped and restarted. */
-  g_free(src->cfg);
-  src->cfg = g_strdup(cfg);
+  GstStructure *config;
+  GstAllocationParams allocParams;
+  GstAllocator *allocator, *old;
+
+  gst_allocation_params_init (&allocParams);
+
+  /* NULL if the backing is system memory or couldn't be set up */
+  GST_OBJECT_LOCK (src);
+  allocator = gst_vqe_allocator_new (src->allocator_backing, size,
+      allocator_slots, allocParams.align);
+  GST_OBJECT_UNLOCK (src);
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config,
+      gst_static_pad_template_get_caps (&src_template),
+      size, min_buffers, max_buffers);
+  gst_buffer_pool_config_set_allocator (config, allocator, &allocParams);
+  if (!gst_buffer_pool_set_config (pool, config) ||
+      !gst_buffer_pool_set_active (pool, TRUE)) {
+    if (allocator)
+      gst_object_unref (allocator);
+    return FALSE;
+  }
+
+  /* the pool keeps its own reference, as do buffers still downstream, so
+     the old region lives on until they're all gone */
+  GST_OBJECT_LOCK (src);
+  old = src->allocator;
+  src->allocator = allocator;
+  if (old)
+    src->retired_allocator_fallbacks +=
+        g_atomic_int_get (&GST_VQE_ALLOCATOR (old)->fallbacks);
+  GST_OBJECT_UNLOCK (src);
+  if (old)
+    gst_object_unref (old);
+
   return TRUE;
 }
 
+/* Pick a buffer size holding buffer-duration worth of stream at the current
+   bitrate, in whole datagrams.  The pool is only replaced if its buffers are
+   too small, or more than twice as big as we need; buffers still downstream
+   go back to the old pool, which frees them, so the stream isn't
+   interrupted. */
 static void
-gst_vqesrc_set_property (GObject * object, guint prop_id, const GValue * value,
-    GParamSpec * pspec)
+gst_vqesrc_adapt_buffer_size (GstVQESrc * src)
 {
-  GstVQESrc *vqesrc = GST_VQESRC (object);
+  guint64 target, datagrams;
+  guint min_size, max_size, limit, pool_size;
+  GstBufferPool *pool;
+
+  GST_OBJECT_LOCK (src);
+  if (src->buffer_duration == 0 || src->bitrate == 0) {
+    GST_OBJECT_UNLOCK (src);
+    return;
+  }
+
+  target = gst_util_uint64_scale (src->bitrate / 8, src->buffer_duration,
+      GST_SECOND);
+  datagrams = (target + src->datagram_size / 2) / src->datagram_size;
+  min_size = VQEC_MSG_MAX_DATAGRAM_LEN * 2;
+  max_size = max_compound_buffer_size;
+  target = CLAMP (MAX (datagrams, 1) * src->datagram_size, min_size,
+      max_size - VQEC_MSG_MAX_DATAGRAM_LEN);
+
+  /* don't chase every wobble in the bitrate */
+  if (target > src->current_buffer_size - src->current_buffer_size / 4 &&
+      target < src->current_buffer_size + src->current_buffer_size / 4) {
+    GST_OBJECT_UNLOCK (src);
+    return;
+  }
+
+  GST_INFO_OBJECT (src, "Buffer size %u -> %" G_GUINT64_FORMAT
+      " for %" G_GUINT64_FORMAT " bit/s", src->current_buffer_size, target,
+      src->bitrate);
+
+  limit = target - MIN (target, src->datagram_size);
+  pool_size = limit + VQEC_MSG_MAX_DATAGRAM_LEN;
+  src->current_buffer_size = target;
+  GST_OBJECT_UNLOCK (src);
+
+  if (pool_size > src->pool_buffer_size || pool_size < src->pool_buffer_size / 2) {
+    pool = gst_vqe_buffer_pool_new ();
+    if (!gst_vqesrc_configure_pool (src, pool, pool_size)) {
+      GST_WARNING_OBJECT (src, "Failed to configure pool of %u byte buffers",
+          pool_size);
+      gst_object_unref (pool);
+      return;
+    }
+    gst_buffer_pool_set_active (src->bufferPool, FALSE);
+    GST_OBJECT_LOCK (src);
+    gst_vqesrc_retire_pool_stats (src);
+    gst_object_unref (src->bufferPool);
+    src->bufferPool = pool;
+    GST_OBJECT_UNLOCK (src);
+    src->pool_buffer_size = pool_size;
+  }
+  src->compound_limit = limit;
+
+  gst_vqesrc_check_latency (src);
+}
+
+static void
+gst_vqesrc_update_bitrate (GstVQESrc * src, gsize bytes)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+  GstClockTime elapsed;
+  guint64 bitrate;
+
+  if (!GST_CLOCK_TIME_IS_VALID (src->bitrate_window_start)) {
+    src->bitrate_window_start = now;
+    src->bitrate_bytes = 0;
+    return;
+  }
+
+  src->bitrate_bytes += bytes;
+  elapsed = now - src->bitrate_window_start;
+  if (elapsed < BITRATE_WINDOW)
+    return;
+
+  bitrate = gst_util_uint64_scale (src->bitrate_bytes, 8 * GST_SECOND,
+      elapsed);
+  src->bitrate_window_start = now;
+  src->bitrate_bytes = 0;
+
+  GST_OBJECT_LOCK (src);
+  src->bitrate = src->bitrate ? (3 * src->bitrate + bitrate) / 4 : bitrate;
+  GST_OBJECT_UNLOCK (src);
+
+  GST_LOG_OBJECT (src, "Channel bitrate %" G_GUINT64_FORMAT " bit/s",
+      src->bitrate);
+  gst_vqesrc_adapt_buffer_size (src);
+  gst_vqesrc_check_latency (src);
+}
+
+/* Our best guess at the bitrate before we've measured it is the "b=AS:" line
+   of the SDP, in kbit/s. */
+static guint64
+gst_vqesrc_sdp_bitrate (const gchar * sdp)
+{
+  const gchar *p = sdp ? strstr (sdp, "b=AS:") : NULL;
+
+  if (!p)
+    return 0;
+  return g_ascii_strtoull (p + 5, NULL, 10) * 1000;
+}
+
+/*
+ *  Per channel PAT/PMT cache
+ */
+
+static void
+gst_vqesrc_psi_cache_lookup (GstVQESrc * src)
+{
+  GstVQEPsiCacheEntry *entry;
+
+  g_mutex_lock (&psi_cache_mutex);
+  entry = g_hash_table_lookup (psi_cache, src->stream_uri);
+  src->have_cached_psi = (entry != NULL);
+  if (entry) {
+    memcpy (src->cached_pat, entry->pat, GST_VQE_TS_PACKET_SIZE);
+    memcpy (src->cached_pmt, entry->pmt, GST_VQE_TS_PACKET_SIZE);
+  }
+  g_mutex_unlock (&psi_cache_mutex);
+
+  if (src->have_cached_psi) {
+    /* Prime the scanner so fast-start only has to wait for a random access
+       point.  If the live tables differ they'll replace these. */
+    gst_vqe_ts_scanner_scan_packet (&src->scanner, src->cached_pat);
+    gst_vqe_ts_scanner_scan_packet (&src->scanner, src->cached_pmt);
+  }
+}
+
+static void
+gst_vqesrc_psi_cache_store (GstVQESrc * src)
+{
+  GstVQEPsiCacheEntry *entry = g_new (GstVQEPsiCacheEntry, 1);
+
+  memcpy (entry->pat, src->scanner.pat, GST_VQE_TS_PACKET_SIZE);
+  memcpy (entry->pmt, src->scanner.pmt, GST_VQE_TS_PACKET_SIZE);
+
+  g_mutex_lock (&psi_cache_mutex);
+  g_hash_table_replace (psi_cache, g_strdup (src->stream_uri), entry);
+  g_mutex_unlock (&psi_cache_mutex);
+}
+
+/* Called for each live PAT or PMT until both have been seen after a tune */
+static void
+gst_vqesrc_psi_cache_validate (GstVQESrc * src, GstVQETSPacketFlags table)
+{
+  const guint8 *cached, *live;
+
+  if (src->psi_seen & table)
+    return;
+  src->psi_seen |= table;
+
+  if (src->have_cached_psi) {
+    cached = (table == GST_VQE_TS_PACKET_PAT) ? src->cached_pat :
+        src->cached_pmt;
+    live = (table == GST_VQE_TS_PACKET_PAT) ? src->scanner.pat :
+        src->scanner.pmt;
+    if (!gst_vqe_ts_psi_equal (cached, live)) {
+      GST_INFO_OBJECT (src, "Cached %s for %s is stale",
+          (table == GST_VQE_TS_PACKET_PAT) ? "PAT" : "PMT", src->stream_uri);
+      src->psi_cache_mismatches++;
+    }
+  }
+
+  if ((src->psi_seen & GST_VQE_TS_PACKET_PAT) &&
+      (src->psi_seen & GST_VQE_TS_PACKET_PMT)) {
+    gst_vqesrc_psi_cache_store (src);
+    src->psi_scan_pending = FALSE;
+  }
+}
+
+/* Called for each packet, before it's scanned, while the first live PAT or
+   PMT after the cached ones is still to come */
+static void
+gst_vqesrc_psi_discont_packet (GstVQESrc * src, guint8 * pkt)
+{
+  guint16 pid = GST_VQE_TS_PID (pkt);
+  gint i;
+
+  if (pkt[0] != GST_VQE_TS_SYNC_BYTE)
+    return;
+
+  for (i = 0; i < 2; i++) {
+    if (pid != src->psi_discont_pid[i])
+      continue;
+    if (!gst_vqe_ts_packet_set_discontinuity (pkt))
+      GST_INFO_OBJECT (src, "No room to mark PID %u discontinuous", pid);
+    src->psi_discont_pid[i] = GST_VQE_TS_PID_INVALID;
+  }
+
+  /* the live PAT moved the PMT, so nothing we sent is on the old PID */
+  if (src->scanner.have_pat && src->scanner.pmt_pid != src->psi_discont_pid[1])
+    src->psi_discont_pid[1] = GST_VQE_TS_PID_INVALID;
+
+  src->psi_discont_pending =
+      src->psi_discont_pid[0] != GST_VQE_TS_PID_INVALID ||
+      src->psi_discont_pid[1] != GST_VQE_TS_PID_INVALID;
+}
+
+/*
+ *  Channel change timeline
+ */
+
+static const gchar *timeline_phase_names[GST_VQESRC_N_PHASES] = {
+  "start", "tuner-created", "sdp-parsed", "bound", "first-datagram",
+  "rcc-complete", "first-buffer", "first-rap"
+};
+
+static void
+gst_vqesrc_timeline_reset (GstVQESrc * src)
+{
+  guint i;
+
+  for (i = 0; i < GST_VQESRC_N_PHASES; i++)
+    src->timeline[i] = GST_CLOCK_TIME_NONE;
+  src->timeline[GST_VQESRC_PHASE_START] = gst_util_get_timestamp ();
+  src->timeline_pending = TRUE;
+  src->rcc_resolved = FALSE;
+  src->rcc_burst = FALSE;
+}
+
+static inline void
+gst_vqesrc_timeline_mark (GstVQESrc * src, GstVQESrcPhase phase)
+{
+  if (G_UNLIKELY (src->timeline_pending &&
+          !GST_CLOCK_TIME_IS_VALID (src->timeline[phase]))) {
+    src->timeline[phase] = gst_util_get_timestamp ();
+    GST_DEBUG_OBJECT (src, "Channel change phase %s after %" GST_TIME_FORMAT,
+        timeline_phase_names[phase], GST_TIME_ARGS (src->timeline[phase] -
+            src->timeline[GST_VQESRC_PHASE_START]));
+  }
+}
+
+/* Note where the channel's counters start so we can tell an RCC burst, which
+   arrives on the repair session, from the multicast that follows it. */
+static void
+gst_vqesrc_timeline_bound (GstVQESrc * src)
+{
+  vqec_ifclient_stats_channel_t stats;
+
+  gst_vqesrc_timeline_mark (src, GST_VQESRC_PHASE_BOUND);
+
+  memset (&stats, 0, sizeof (stats));
+  if (src->daemon ||
+      backend->get_stats_channel (src->stream_uri, &stats) != VQEC_OK) {
+    src->rcc_resolved = TRUE;
+    return;
+  }
+  src->timeline_primary_inputs = stats.primary_rtp_inputs;
+  src->timeline_repair_inputs = stats.repair_rtp_inputs;
+}
+
+/* The burst is over once multicast starts arriving.  If nothing came on the
+   repair session before that there was no burst. */
+static void
+gst_vqesrc_timeline_check_rcc (GstVQESrc * src)
+{
+  vqec_ifclient_stats_channel_t stats;
+
+  memset (&stats, 0, sizeof (stats));
+  if (backend->get_stats_channel (src->stream_uri, &stats) != VQEC_OK) {
+    src->rcc_resolved = TRUE;
+    return;
+  }
+  if (stats.primary_rtp_inputs == src->timeline_primary_inputs)
+    return;
+
+  src->rcc_resolved = TRUE;
+  src->rcc_burst = stats.repair_rtp_inputs != src->timeline_repair_inputs;
+  if (src->rcc_burst)
+    gst_vqesrc_timeline_mark (src, GST_VQESRC_PHASE_RCC_COMPLETE);
+}
+
+/* Post the timeline as an element message, which tracers also see, once
+   everything we're waiting for has happened or we've given up on it.  Times
+   are nanoseconds since start, or GST_CLOCK_TIME_NONE for phases which
+   didn't happen. */
+static void
+gst_vqesrc_timeline_post (GstVQESrc * src)
+{
+  GstClockTime start = src->timeline[GST_VQESRC_PHASE_START];
+  GstStructure *s;
+  guint i;
+
+  s = gst_structure_new ("vqesrc-timeline",
+      "stream-uri", G_TYPE_STRING, src->stream_uri,
+      "start-time", G_TYPE_UINT64, start,
+      "rcc", G_TYPE_BOOLEAN, src->rcc_burst, NULL);
+  for (i = GST_VQESRC_PHASE_START + 1; i < GST_VQESRC_N_PHASES; i++)
+    gst_structure_set (s, timeline_phase_names[i], G_TYPE_UINT64,
+        GST_CLOCK_TIME_IS_VALID (src->timeline[i]) ?
+        src->timeline[i] - start : GST_CLOCK_TIME_NONE, NULL);
+
+  GST_INFO_OBJECT (src, "Channel change timeline: %" GST_PTR_FORMAT, s);
+  src->timeline_pending = FALSE;
+  gst_element_post_message (GST_ELEMENT (src),
+      gst_message_new_element (GST_OBJECT (src), s));
+}
+
+/* Called from create once a buffer is ready */
+static void
+gst_vqesrc_timeline_update (GstVQESrc * src, GstBuffer * buffer)
+{
+  if (G_LIKELY (!src->timeline_pending))
+    return;
+
+  if (gst_buffer_get_size (buffer) > 0)
+    gst_vqesrc_timeline_mark (src, GST_VQESRC_PHASE_FIRST_BUFFER);
+  if (!src->rcc_resolved &&
+      GST_CLOCK_TIME_IS_VALID (src->timeline[GST_VQESRC_PHASE_FIRST_DATAGRAM]))
+    gst_vqesrc_timeline_check_rcc (src);
+
+  if ((src->rcc_resolved &&
+          GST_CLOCK_TIME_IS_VALID (src->timeline[GST_VQESRC_PHASE_FIRST_BUFFER])
+          && GST_CLOCK_TIME_IS_VALID (src->timeline[GST_VQESRC_PHASE_FIRST_RAP]))
+      || gst_util_get_timestamp () - src->timeline[GST_VQESRC_PHASE_START] >
+      TIMELINE_TIMEOUT)
+    gst_vqesrc_timeline_post (src);
+}
+
+/*
+ *  Channel histograms
+ */
+
+/* Called with the object lock, or before anyone else can see src */
+static void
+gst_vqesrc_histograms_reset (GstVQESrc * src)
+{
+  gst_vqe_histogram_reset (&src->interarrival);
+  gst_vqe_histogram_reset (&src->loss_burst);
+  gst_vqe_histogram_reset (&src->repair_rtt);
+  gst_vqe_histogram_reset (&src->interarrival_pending);
+  src->last_arrival = 0;
+  src->histogram_sample_time = GST_CLOCK_TIME_NONE;
+  src->repair_request_time = GST_CLOCK_TIME_NONE;
+}
+
+/* Called for each datagram, so only touches what the streaming thread owns */
+static void
+gst_vqesrc_histograms_arrival (GstVQESrc * src)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (src->last_arrival)
+    gst_vqe_histogram_add (&src->interarrival_pending,
+        now - src->last_arrival);
+  src->last_arrival = now;
+}
+
+/* VQE-C doesn't tell us about individual losses or repairs, and what comes
+   out of it is already repaired, so these come from how its counters move
+   between samples: each sample with loss events adds their mean length,
+   once per event, and a repair's round trip is from the sample which first
+   saw it requested to the one which first saw repair packets arrive.
+   Hence the sampled- names they're published under. */
+static void
+gst_vqesrc_histograms_sample (GstVQESrc * src)
+{
+  vqec_ifclient_stats_channel_t stats;
+  GstClockTime now = gst_util_get_timestamp ();
+  guint64 losses, events;
+  gboolean first;
+  gchar stream_uri[sizeof (src->stream_uri)];
+
+  /* once per create(), rather than taking the lock for every datagram */
+  GST_OBJECT_LOCK (src);
+  if (src->interarrival_pending.count) {
+    gst_vqe_histogram_merge (&src->interarrival, &src->interarrival_pending);
+    gst_vqe_histogram_reset (&src->interarrival_pending);
+  }
+  g_strlcpy (stream_uri, src->stream_uri, sizeof (stream_uri));
+  GST_OBJECT_UNLOCK (src);
+
+  first = !GST_CLOCK_TIME_IS_VALID (src->histogram_sample_time);
+  if (!first && now - src->histogram_sample_time < HISTOGRAM_SAMPLE)
+    return;
+  src->histogram_sample_time = now;
+
+  memset (&stats, 0, sizeof (stats));
+  if (backend->get_stats_channel (stream_uri, &stats) != VQEC_OK)
+    return;
+
+  losses = stats.tr135_packets_lost_before_ec - src->sampled_losses;
+  events = stats.tr135_loss_events_before_ec - src->sampled_loss_events;
+
+  GST_OBJECT_LOCK (src);
+  if (!first && events)
+    gst_vqe_histogram_add_n (&src->loss_burst,
+        MAX ((losses + events / 2) / events, 1), events);
+
+  if (!first && stats.repair_rtp_inputs != src->sampled_repair_inputs &&
+      GST_CLOCK_TIME_IS_VALID (src->repair_request_time)) {
+    gst_vqe_histogram_add (&src->repair_rtt,
+        (now - src->repair_request_time) / GST_USECOND);
+    src->repair_request_time = GST_CLOCK_TIME_NONE;
+  }
+  if (!first && stats.repairs_requested != src->sampled_repairs_requested &&
+      !GST_CLOCK_TIME_IS_VALID (src->repair_request_time))
+    src->repair_request_time = now;
+  GST_OBJECT_UNLOCK (src);
+
+  src->sampled_losses = stats.tr135_packets_lost_before_ec;
+  src->sampled_loss_events = stats.tr135_loss_events_before_ec;
+  src->sampled_repairs_requested = stats.repairs_requested;
+  src->sampled_repair_inputs = stats.repair_rtp_inputs;
+}
+
+static void
+gst_vqesrc_histogram_to_structure (GstStructure * s, const gchar * name,
+    const GstVQEHistogram * hist)
+{
+  gchar *buckets = gst_vqe_histogram_to_string (hist);
+  gchar *field;
+
+#define SET_FIELD(suffix, type, value) G_STMT_START { \
+    field = g_strconcat (name, "-", suffix, NULL); \
+    gst_structure_set (s, field, type, value, NULL); \
+    g_free (field); \
+  } G_STMT_END
+
+  SET_FIELD ("count", G_TYPE_UINT64, hist->count);
+  SET_FIELD ("mean", G_TYPE_UINT64, hist->count ? hist->sum / hist->count : 0);
+  SET_FIELD ("p50", G_TYPE_UINT64, gst_vqe_histogram_percentile (hist, 50));
+  SET_FIELD ("p90", G_TYPE_UINT64, gst_vqe_histogram_percentile (hist, 90));
+  SET_FIELD ("p99", G_TYPE_UINT64, gst_vqe_histogram_percentile (hist, 99));
+  SET_FIELD ("max", G_TYPE_UINT64, hist->max);
+  SET_FIELD ("buckets", G_TYPE_STRING, buckets);
+#undef SET_FIELD
+
+  g_free (buckets);
+}
+
+/*
+ *  PCR clock recovery
+ */
+
+static GstClock *
+gst_vqesrc_provide_clock (GstElement * element)
+{
+  GstVQESrc *src = GST_VQESRC (element);
+
+  if (!src->provide_clock)
+    return NULL;
+  return gst_object_ref (src->pcr_clock);
+}
+
+/* Feed one PCR observation to the clock.  The PCR is turned into a time that
+   starts off where the clock already is, so that the clock only ever adjusts
+   its rate and doesn't jump when a channel is tuned or the PCR is
+   discontinuous. */
+static void
+gst_vqesrc_observe_pcr (GstVQESrc * src, guint64 pcr)
+{
+  GstClockTime internal;
+  guint64 delta;
+  gdouble r_squared;
+
+  internal = gst_clock_get_internal_time (src->pcr_clock);
+
+  delta = (pcr + GST_VQE_TS_PCR_WRAP - src->last_pcr) % GST_VQE_TS_PCR_WRAP;
+  if (src->last_pcr == PCR_INVALID || delta > PCR_MAX_GAP) {
+    GST_OBJECT_LOCK (src->pcr_clock);
+    src->pcr_time = gst_clock_adjust_unlocked (src->pcr_clock, internal);
+    GST_OBJECT_UNLOCK (src->pcr_clock);
+    GST_DEBUG_OBJECT (src, "PCR discontinuity, resyncing at %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (src->pcr_time));
+  } else {
+    src->pcr_time += gst_util_uint64_scale (delta, GST_SECOND,
+        GST_VQE_TS_PCR_HZ);
+  }
+  src->last_pcr = pcr;
+
+  gst_clock_add_observation (src->pcr_clock, internal, src->pcr_time,
+      &r_squared);
+}
+
+/* The running time now, going at the rate of the PCR clock.  base_time is in
+   the domain of the pipeline's @clock, so unless the pipeline picked the PCR
+   clock the two are lined up whenever base_time changes and from then on the
+   pipeline clock's time then is moved on by how far the PCR clock has got. */
+static GstClockTime
+gst_vqesrc_pcr_running_time (GstVQESrc * src, GstClock * clock,
+    GstClockTime base_time)
+{
+  GstClockTime now;
+
+  if (clock == src->pcr_clock) {
+    now = gst_clock_get_time (clock);
+  } else {
+    GstClockTime pcr_now = gst_clock_get_time (src->pcr_clock);
+
+    if (base_time != src->pcr_anchor_base_time) {
+      src->pcr_anchor = pcr_now;
+      src->pcr_anchor_pipeline = gst_clock_get_time (clock);
+      src->pcr_anchor_base_time = base_time;
+    }
+    now = src->pcr_anchor_pipeline + (pcr_now - src->pcr_anchor);
+  }
+  return (now > base_time) ? now - base_time : 0;
+}
+
+/*
+ * Feed a datagram through the TS scanner, checking live PSI against the
+ * cache, marking the first live PAT and PMT after cached ones discontinuous
+ * and tracking the PCR.  Returns the offset of the first random access
+ * point in data, or -1 if there isn't one we can start from.
+ */
+static gssize
+gst_vqesrc_scan_datagram (GstVQESrc * src, guint8 * data, gsize size)
+{
+  gssize rap = -1;
+  gsize offset;
+  GstVQETSPacketFlags flags;
+  gboolean have_pcr = FALSE;
+  guint64 pcr;
+
+  for (offset = 0; offset + GST_VQE_TS_PACKET_SIZE <= size;
+      offset += GST_VQE_TS_PACKET_SIZE) {
+    if (G_UNLIKELY (src->psi_discont_pending))
+      gst_vqesrc_psi_discont_packet (src, &data[offset]);
+    flags = gst_vqe_ts_scanner_scan_packet (&src->scanner, &data[offset]);
+    if (src->psi_scan_pending &&
+        (flags & (GST_VQE_TS_PACKET_PAT | GST_VQE_TS_PACKET_PMT)))
+      gst_vqesrc_psi_cache_validate (src,
+          flags & (GST_VQE_TS_PACKET_PAT | GST_VQE_TS_PACKET_PMT));
+    if (G_UNLIKELY (src->psi_scan_pending &&
+            (flags & GST_VQE_TS_PACKET_PSI_SPLIT))) {
+      GST_INFO_OBJECT (src, "PAT or PMT of %s spans several packets, so "
+          "won't be cached", src->stream_uri);
+      src->psi_scan_pending = FALSE;
+    }
+    if (rap < 0 && (flags & GST_VQE_TS_PACKET_RAP) &&
+        src->scanner.have_pat && src->scanner.have_pmt)
+      rap = offset;
+    /* all packets in a datagram arrive together so one PCR is enough */
+    if (!have_pcr && (flags & GST_VQE_TS_PACKET_PCR))
+      have_pcr = gst_vqe_ts_packet_get_pcr (&data[offset], &pcr);
+  }
+
+  if (have_pcr && src->track_pcr)
+    gst_vqesrc_observe_pcr (src, pcr);
+  if (have_pcr && src->timeshifting)
+    gst_vqesrc_timeshift_observe_pcr (src, pcr);
+  if (rap >= 0)
+    gst_vqesrc_timeline_mark (src, GST_VQESRC_PHASE_FIRST_RAP);
+
+  return rap;
+}
+
+/* Account for @size bytes scanned while waiting for a random access point.
+   Returns TRUE, and stops waiting, if one was found at @rap. */
+static gboolean
+gst_vqesrc_fast_start_check (GstVQESrc * src, gsize size, gssize rap)
+{
+  if (rap < 0) {
+    src->fast_start_bytes_skipped += size;
+    return FALSE;
+  }
+
+  src->fast_start_pending = FALSE;
+  src->fast_start_bytes_skipped += rap;
+  src->fast_start_time_to_rap = gst_util_get_timestamp () - src->tune_time;
+
+  GST_INFO_OBJECT (src, "Found random access point after skipping %"
+      G_GUINT64_FORMAT " bytes in %" GST_TIME_FORMAT,
+      src->fast_start_bytes_skipped,
+      GST_TIME_ARGS (src->fast_start_time_to_rap));
+  return TRUE;
+}
+
+/*
+ * Trim a freshly received datagram at the start of the output buffer to the
+ * first random access point.  If there is one the data before it is thrown
+ * away and the last PAT and PMT seen are put in front so the decoder can
+ * start straight away.  Returns the number of bytes now at the start of data,
+ * which is 0 while we are still waiting.
+ */
+static gsize
+gst_vqesrc_fast_start_trim (GstVQESrc * src, guint8 * data, gsize size,
+    gsize maxsize, gssize rap)
+{
+  const gsize psi_size = 2 * GST_VQE_TS_PACKET_SIZE;
+  gsize offset, tail;
+
+  if (!gst_vqesrc_fast_start_check (src, size, rap))
+    return 0;
+  offset = rap;
+
+  tail = size - offset;
+  if (psi_size + tail > maxsize) {
+    /* Can't happen with the minimum buffer-size, but let's not scribble */
+    GST_WARNING_OBJECT (src, "No room to prepend PAT/PMT");
+    memmove (data, &data[offset], tail);
+    return tail;
+  }
+
+  memmove (&data[psi_size], &data[offset], tail);
+  memcpy (data, src->scanner.pat, GST_VQE_TS_PACKET_SIZE);
+  memcpy (&data[GST_VQE_TS_PACKET_SIZE], src->scanner.pmt,
+      GST_VQE_TS_PACKET_SIZE);
+  return psi_size + tail;
+}
+
+/* A buffer holding a PAT and a PMT to go in front of the stream */
+static GstBuffer *
+gst_vqesrc_psi_buffer (const guint8 * pat, const guint8 * pmt)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL,
+      2 * GST_VQE_TS_PACKET_SIZE, NULL);
+
+  gst_buffer_fill (buffer, 0, pat, GST_VQE_TS_PACKET_SIZE);
+  gst_buffer_fill (buffer, GST_VQE_TS_PACKET_SIZE, pmt,
+      GST_VQE_TS_PACKET_SIZE);
+  return buffer;
+}
+
+/*
+ *  Timeshift
+ */
+
+/* Where the window's time has got to.  Between PCRs, and before the first,
+   it moves on by the capture clock, and it never goes backwards. */
+static GstClockTime
+gst_vqesrc_timeshift_time (GstVQESrc * src)
+{
+  GstClockTime now = gst_util_get_timestamp (), time;
+
+  if (src->timeshift_pcr == PCR_INVALID)
+    time = now - src->tune_time;
+  else
+    time = src->timeshift_pcr_time + (now - src->timeshift_pcr_seen);
+  src->timeshift_time = MAX (src->timeshift_time, time);
+  return src->timeshift_time;
+}
+
+/* Move the window's time on by the stream's clock rather than ours, so that
+   the RCC burst, which arrives faster than real time, or a stall in the
+   network doesn't squash or stretch what the window says it holds */
+static void
+gst_vqesrc_timeshift_observe_pcr (GstVQESrc * src, guint64 pcr)
+{
+  guint64 delta;
+
+  delta = (pcr + GST_VQE_TS_PCR_WRAP - src->timeshift_pcr) %
+      GST_VQE_TS_PCR_WRAP;
+  if (src->timeshift_pcr == PCR_INVALID || delta > PCR_MAX_GAP)
+    src->timeshift_pcr_time = gst_vqesrc_timeshift_time (src);
+  else
+    src->timeshift_pcr_time += gst_util_uint64_scale (delta, GST_SECOND,
+        GST_VQE_TS_PCR_HZ);
+  src->timeshift_pcr = pcr;
+  src->timeshift_pcr_seen = gst_util_get_timestamp ();
+}
+
+/* Keep @buffer, whose first random access point is at @rap or -1, in the
+   timeshift window */
+static void
+gst_vqesrc_timeshift_record (GstVQESrc * src, GstBuffer * buffer, gssize rap)
+{
+  GstVQETimeshiftEntry entry;
+  GError *error = NULL;
+
+  if (gst_buffer_get_size (buffer) == 0)
+    return;
+
+  /* writing to and rolling over segment files can block on the disk, so
+     only putting the result in the window is done under the lock */
+  gst_vqe_timeshift_write (&src->timeshift, buffer,
+      gst_vqesrc_timeshift_time (src), rap, &entry, &error);
+
+  GST_OBJECT_LOCK (src);
+  if (G_UNLIKELY (error)) {
+    /* carry on live rather than stop the stream */
+    gst_vqe_timeshift_clear (&src->timeshift);
+    src->timeshifting = FALSE;
+  } else {
+    gst_vqe_timeshift_append (&src->timeshift, &entry);
+  }
+  GST_OBJECT_UNLOCK (src);
+
+  gst_vqe_timeshift_release (&src->timeshift);
+
+  if (G_UNLIKELY (error)) {
+    GST_ELEMENT_WARNING (src, RESOURCE, WRITE, ("Timeshift stopped"),
+        ("%s", error->message));
+    g_error_free (error);
+  }
+}
+
+/* Keep @buffer, whose first random access point is at @rap or -1, in the
+   timeshift window and return what goes out in its place: the next buffer
+   from the window if we're behind live, or otherwise @buffer.  Either way
+   downstream gets its own GstBuffer sharing the memory, so nothing it does
+   to the metadata touches what the window holds.  For the recorder, which
+   plays nothing back, just @buffer. */
+static GstBuffer *
+gst_vqesrc_timeshift_buffer (GstVQESrc * src, GstBuffer * buffer, gssize rap)
+{
+  GstBuffer *next, *out;
+  gssize start = -1;
+
+  gst_vqesrc_timeshift_record (src, buffer, rap);
+  if (G_UNLIKELY (src->recording))
+    return buffer;
+
+  GST_OBJECT_LOCK (src);
+  next = gst_vqe_timeshift_next (&src->timeshift, &start);
+  GST_OBJECT_UNLOCK (src);
+
+  if (!next)
+    next = gst_buffer_ref (buffer);
+  gst_buffer_unref (buffer);
+
+  out = gst_buffer_copy_region (next, GST_BUFFER_COPY_MEMORY, MAX (start, 0),
+      -1);
+  gst_buffer_unref (next);
+
+  /* playback has started or skipped forward, so give the demuxer the tables
+     it needs to start at the random access point */
+  if (start >= 0) {
+    out = gst_buffer_append (gst_vqesrc_psi_buffer (src->scanner.pat,
+            src->scanner.pmt), out);
+    GST_BUFFER_FLAG_SET (out, GST_BUFFER_FLAG_DISCONT);
+  }
+  return out;
+}
+
+static gboolean
+gst_vqesrc_is_seekable (GstBaseSrc * bsrc)
+{
+  return GST_VQESRC (bsrc)->timeshifting;
+}
+
+/* Called by GstBaseSrc with the streaming thread stopped.  Positions are in
+   the timeshift window's time, since the channel was tuned, but output keeps
+   being timestamped with the running time it goes out at, so the segment
+   says where in the window that starts. */
+static gboolean
+gst_vqesrc_do_seek (GstBaseSrc * bsrc, GstSegment * segment)
+{
+  GstVQESrc *src = GST_VQESRC (bsrc);
+  GstClockTime target = segment->start, start;
+  gboolean shifted;
+
+  if (!src->timeshifting)
+    return GST_BASE_SRC_CLASS (parent_class)->do_seek (bsrc, segment);
+
+  GST_OBJECT_LOCK (src);
+  shifted = gst_vqe_timeshift_seek (&src->timeshift, target, &start);
+  if (!shifted) {
+    /* live carries on from the newest in the window */
+    start = gst_vqe_timeshift_end (&src->timeshift);
+    if (!GST_CLOCK_TIME_IS_VALID (start))
+      start = 0;
+  }
+  GST_OBJECT_UNLOCK (src);
+
+  if (shifted)
+    GST_INFO_OBJECT (src, "Seeking to %" GST_TIME_FORMAT " starts from the "
+        "random access point at %" GST_TIME_FORMAT, GST_TIME_ARGS (target),
+        GST_TIME_ARGS (start));
+  else
+    GST_INFO_OBJECT (src, "Seeking to %" GST_TIME_FORMAT " goes to live",
+        GST_TIME_ARGS (target));
+
+  segment->start = 0;
+  segment->position = 0;
+  segment->stop = GST_CLOCK_TIME_NONE;
+  segment->time = start;
+  return TRUE;
+}
+
+/* While PAUSED a live source outputs nothing, so this reads in the
+   streaming thread's place, into the window only, for playback to carry on
+   from once PLAYING again.  The live lock, which the streaming thread has
+   in create(), keeps the two from reading at once. */
+static gpointer
+gst_vqesrc_recorder_thread (GstVQESrc * src)
+{
+  GstBuffer *buffer;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean tuned;
+
+  while (ret == GST_FLOW_OK && src->timeshifting &&
+      !g_atomic_int_get (&src->recorder_stop)) {
+    GST_LIVE_LOCK (src);
+    if (!gst_vqesrc_check_retune (src))
+      ret = GST_FLOW_ERROR;
+    tuned = src->tuned;
+    if (ret == GST_FLOW_OK && tuned) {
+      src->recording = TRUE;
+      ret = gst_vqesrc_create_buffer (src, &buffer);
+      src->recording = FALSE;
+      if (ret == GST_FLOW_OK)
+        gst_buffer_unref (buffer);
+    }
+    GST_LIVE_UNLOCK (src);
+
+    if (!tuned) {
+      /* nothing to record until there's an SDP */
+      GST_OBJECT_LOCK (src);
+      if (!g_atomic_int_get (&src->recorder_stop))
+        g_cond_wait_until (&src->tune_cond, GST_OBJECT_GET_LOCK (src),
+            g_get_monotonic_time () +
+            VQEC_MSG_MAX_RECV_TIMEOUT * G_TIME_SPAN_MILLISECOND);
+      GST_OBJECT_UNLOCK (src);
+    }
+  }
+  return NULL;
+}
+
+/* Playback stays where it was paused and the recorder keeps the window
+   going until we're PLAYING again */
+static void
+gst_vqesrc_recorder_start (GstVQESrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  gst_vqe_timeshift_hold (&src->timeshift);
+  GST_OBJECT_UNLOCK (src);
+
+  g_atomic_int_set (&src->recorder_stop, FALSE);
+  src->recorder = g_thread_new ("vqe-recorder",
+      (GThreadFunc) gst_vqesrc_recorder_thread, src);
+}
+
+static void
+gst_vqesrc_recorder_stop (GstVQESrc * src)
+{
+  if (!src->recorder)
+    return;
+
+  GST_OBJECT_LOCK (src);
+  g_atomic_int_set (&src->recorder_stop, TRUE);
+  g_cond_broadcast (&src->tune_cond);
+  GST_OBJECT_UNLOCK (src);
+  g_thread_join (src->recorder);
+  src->recorder = NULL;
+}
+
+static GstStateChangeReturn
+gst_vqesrc_change_state (GstElement * element, GstStateChange transition)
+{
+  GstVQESrc *src = GST_VQESRC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* before the streaming thread is let go again, or the tuner is
+         stopped */
+      gst_vqesrc_recorder_stop (src);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      if (ret != GST_STATE_CHANGE_FAILURE && src->timeshifting)
+        gst_vqesrc_recorder_start (src);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
+
+/*
+ *  Buffer lists
+ */
+
+#if GST_CHECK_VERSION(1,14,0)
+/* Called from the streaming thread for each list pushed */
+static void
+gst_vqesrc_list_pushed (GstVQESrc * src, guint length, gboolean deadline)
+{
+  GST_OBJECT_LOCK (src);
+  gst_vqe_histogram_add (&src->list_sizes, length);
+  if (deadline)
+    src->list_deadlines++;
+  GST_OBJECT_UNLOCK (src);
+}
+#endif
+
+/*
+ *  RTP output
+ */
+
+/* Before start the output property says what we're going to output */
+static GstCaps *
+gst_vqesrc_get_caps (GstBaseSrc * bsrc, GstCaps * filter)
+{
+  GstVQESrc *src = GST_VQESRC (bsrc);
+  GstCaps *caps, *tmp;
+  gboolean rtp;
+
+  GST_OBJECT_LOCK (src);
+  rtp = GST_OBJECT_FLAG_IS_SET (src, GST_BASE_SRC_FLAG_STARTED) ?
+      src->rtp_output : (src->output == GST_VQESRC_OUTPUT_RTP);
+  GST_OBJECT_UNLOCK (src);
+
+  caps = gst_static_caps_get (rtp ? &rtp_caps : &ts_caps);
+  if (filter) {
+    tmp = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (caps);
+    caps = tmp;
+  }
+  return caps;
+}
+
+/* Where VQE-C has stripped the RTP header, write one for the datagram
+   following @header.  RFC 2250: the timestamp is when it arrived, at
+   90kHz. */
+static void
+gst_vqesrc_rtp_header (GstVQESrc * src, guint8 * header)
+{
+  header[0] = 0x80;
+  header[1] = RTP_PT_MP2T;
+  GST_WRITE_UINT16_BE (&header[2], src->rtp_seq);
+  GST_WRITE_UINT32_BE (&header[4], src->rtp_base +
+      (guint32) gst_util_uint64_scale (gst_util_get_timestamp (), 90000,
+          GST_SECOND));
+  GST_WRITE_UINT32_BE (&header[8], src->rtp_ssrc);
+  src->rtp_seq++;
+}
+
+/*
+ * Read up to buffer-size of datagrams into a pool buffer as for TS, but
+ * leaving room for an RTP header in front of each, and hand each out as a
+ * buffer of its own wrapping its part of the pool buffer, which goes back
+ * to the pool once they've all been freed.  Sets @list to NULL if nothing
+ * arrived before VQE-C's timeout.
+ */
+static GstFlowReturn
+gst_vqesrc_receive_rtp (GstVQESrc * vqesrc, GstBufferList ** list)
+{
+  GstBuffer *buffer, *packet;
+  GstMemory *mem;
+  GstMapInfo info;
+  GstAllocator *allocator;
+  GstAllocationParams params;
+  GstVQESrcPacket *p;
+  GstClock *clock;
+  GstClockTime base_time, now, dts = GST_CLOCK_TIME_NONE;
+  vqec_iobuf_t iobuf = {0};
+  vqec_error_t err = VQEC_OK;
+  int32_t bytes_read;
+  gsize used = 0, payload_bytes = 0, offset, size, payload_offset,
+      payload_size;
+  guint16 seq;
+  guint8 *data;
+  gboolean probe;
+  GstClockTime t0 = 0;
+  guint i;
+
+  probe = g_atomic_int_get (&gst_vqe_tracer_active);
+  if (G_UNLIKELY (probe)) {
+    vqesrc->probe_recv_time = 0;
+    vqesrc->probe_datagrams = 0;
+    vqesrc->probe_idle = FALSE;
+    t0 = gst_util_get_timestamp ();
+  }
+
+  /* The packets share the memory they're received into, and shared memory
+     can't go back to the pool, so it comes straight from the pool's
+     allocator instead and goes with the last packet */
+  GST_OBJECT_LOCK (vqesrc);
+  allocator = vqesrc->allocator ? gst_object_ref (vqesrc->allocator) : NULL;
+  GST_OBJECT_UNLOCK (vqesrc);
+  gst_allocation_params_init (&params);
+  mem = gst_allocator_alloc (allocator, vqesrc->pool_buffer_size, &params);
+  if (allocator)
+    gst_object_unref (allocator);
+  if (G_UNLIKELY (probe))
+    vqesrc->probe_acquire_time = gst_util_get_timestamp () - t0;
+  if (G_UNLIKELY (!mem)) {
+    GST_ELEMENT_ERROR (vqesrc, RESOURCE, FAILED, (NULL),
+        ("Failed to allocate memory to receive into."));
+    return GST_FLOW_ERROR;
+  }
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer, mem);
+  if (!gst_memory_map (mem, &info, GST_MAP_WRITE)) {
+    GST_ELEMENT_ERROR (vqesrc, RESOURCE, FAILED, (NULL),
+        ("gst_memory_map failed"));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+  g_array_set_size (vqesrc->rtp_packets, 0);
+
+  /* basesrc would only timestamp the first buffer of the list, so each
+     packet gets the running time it arrived at, which is what
+     rtpjitterbuffer wants */
+  clock = gst_element_get_clock (GST_ELEMENT (vqesrc));
+  base_time = gst_element_get_base_time (GST_ELEMENT (vqesrc));
+
+  while (used + GST_VQE_RTP_HEADER_SIZE <= vqesrc->compound_limit && !err) {
+    bytes_read = 0;
+    data = &info.data[used + GST_VQE_RTP_HEADER_SIZE];
+    iobuf.buf_ptr = data;
+    iobuf.buf_len = info.maxsize - used - GST_VQE_RTP_HEADER_SIZE;
+
+    if (G_UNLIKELY (probe))
+      t0 = gst_util_get_timestamp ();
+    if (vqesrc->merging)
+      err = gst_vqesrc_merge_recv (vqesrc, &iobuf, &bytes_read,
+          VQEC_MSG_MAX_RECV_TIMEOUT);
+    else
+      err = backend->tuner_recvmsg (vqesrc->tuner, &iobuf, 1, &bytes_read,
+          VQEC_MSG_MAX_RECV_TIMEOUT);
+    if (G_UNLIKELY (probe)) {
+      vqesrc->probe_recv_time += gst_util_get_timestamp () - t0;
+      if (bytes_read > 0)
+        vqesrc->probe_datagrams++;
+    }
+    if (err == VQEC_OK && bytes_read == 0) {
+      if (G_UNLIKELY (probe))
+        vqesrc->probe_idle = (used == 0);
+      break;
+    }
+    gst_vqesrc_histograms_arrival (vqesrc);
+    gst_vqesrc_timeline_mark (vqesrc, GST_VQESRC_PHASE_FIRST_DATAGRAM);
+
+    if (clock && vqesrc->do_pcr_timestamp) {
+      dts = gst_vqesrc_pcr_running_time (vqesrc, clock, base_time);
+    } else if (clock) {
+      now = gst_clock_get_time (clock);
+      dts = (now > base_time) ? now - base_time : 0;
+    }
+
+    if (gst_vqe_rtp_parse (data, bytes_read, &seq, &payload_offset,
+            &payload_size)) {
+      offset = used + GST_VQE_RTP_HEADER_SIZE;
+      size = bytes_read;
+    } else {
+      gst_vqesrc_rtp_header (vqesrc, &info.data[used]);
+      offset = used;
+      size = GST_VQE_RTP_HEADER_SIZE + bytes_read;
+      payload_offset = 0;
+      payload_size = bytes_read;
+    }
+
+    if (G_UNLIKELY (vqesrc->track_pcr || vqesrc->timeline_pending))
+      gst_vqesrc_scan_datagram (vqesrc, &data[payload_offset], payload_size);
+
+    /* each becomes a buffer of its own once we're done writing */
+    g_array_set_size (vqesrc->rtp_packets, vqesrc->rtp_packets->len + 1);
+    p = &g_array_index (vqesrc->rtp_packets, GstVQESrcPacket,
+        vqesrc->rtp_packets->len - 1);
+    p->offset = offset;
+    p->size = size;
+    p->dts = dts;
+
+    if (G_UNLIKELY (payload_size > vqesrc->datagram_size))
+      vqesrc->datagram_size = payload_size;
+    payload_bytes += payload_size;
+    used = offset + size;
+  }
+
+  gst_memory_unmap (mem, &info);
+  if (clock)
+    gst_object_unref (clock);
+
+  if (err) {
+    GST_ELEMENT_ERROR (vqesrc, RESOURCE, READ, (NULL),
+        ("Error receiving data from VQE: %s", vqec_err2str (err)));
+    gst_buffer_unref (buffer);
+    *list = NULL;
+    return GST_FLOW_ERROR;
+  }
+
+  *list = gst_buffer_list_new_sized (vqesrc->rtp_packets->len);
+  for (i = 0; i < vqesrc->rtp_packets->len; i++) {
+    p = &g_array_index (vqesrc->rtp_packets, GstVQESrcPacket, i);
+    packet = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY,
+        p->offset, p->size);
+    GST_BUFFER_DTS (packet) = p->dts;
+    gst_buffer_list_add (*list, packet);
+  }
+  gst_buffer_unref (buffer);
+
+  gst_vqesrc_update_bitrate (vqesrc, payload_bytes);
+  gst_vqesrc_histograms_sample (vqesrc);
+
+  if (gst_buffer_list_length (*list) == 0) {
+    gst_buffer_list_unref (*list);
+    *list = NULL;
+  } else {
+    gst_vqesrc_timeline_update (vqesrc, gst_buffer_list_get (*list, 0));
+  }
+  return GST_FLOW_OK;
+}
+
+/* An empty buffer, which is what TS output sends when there's been nothing
+   for a while so as not to block state changes, is no good to RTP elements,
+   so we wait on until there's something to send or we're unlocked. */
+static GstFlowReturn
+gst_vqesrc_create_rtp (GstVQESrc * vqesrc, GstBuffer ** buf)
+{
+  GstBufferList *list = NULL;
+  GstFlowReturn ret;
+
+  while (!list) {
+    if (g_atomic_int_get (&vqesrc->flushing))
+      return GST_FLOW_FLUSHING;
+    if (!gst_vqesrc_check_retune (vqesrc))
+      return GST_FLOW_ERROR;
+    ret = gst_vqesrc_wait_tuned (vqesrc);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    ret = gst_vqesrc_receive_rtp (vqesrc, &list);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+#if GST_CHECK_VERSION(1,14,0)
+  gst_vqesrc_list_pushed (vqesrc, gst_buffer_list_length (list), FALSE);
+  gst_base_src_submit_buffer_list (GST_BASE_SRC (vqesrc), list);
+#else
+  /* start won't have let us get this far */
+  gst_buffer_list_unref (list);
+#endif
+  *buf = NULL;
+  return GST_FLOW_OK;
+}
+
+/* The daemon has already compounded the datagrams, and the data stays in
+   the shared ring until downstream is done with it, so where the in-process
+   path edits the buffer in place we build the output out of sub-buffers. */
+static GstFlowReturn
+gst_vqesrc_create_from_daemon (GstVQESrc * vqesrc, GstBuffer ** buf)
+{
+  GstBuffer *buffer;
+  const guint8 *data;
+  gsize size = 0;
+  gpointer slot;
+  gint ret;
+  gboolean probe = g_atomic_int_get (&gst_vqe_tracer_active);
+  GstClockTime t0 = 0;
+
+  if (G_UNLIKELY (probe))
+    t0 = gst_util_get_timestamp ();
+  ret = gst_vqe_ipc_client_receive (vqesrc->daemon, daemon_timeout_ms,
+      &data, &size, &slot);
+  if (G_UNLIKELY (probe)) {
+    /* the daemon has done the compounding, so each slot counts as one */
+    vqesrc->probe_recv_time = gst_util_get_timestamp () - t0;
+    vqesrc->probe_acquire_time = 0;
+    vqesrc->probe_datagrams = (ret > 0);
+    vqesrc->probe_idle = (ret == 0);
+  }
+  if (ret < 0) {
+    GST_ELEMENT_ERROR (GST_ELEMENT (vqesrc), RESOURCE, READ, (NULL),
+        ("Lost connection to VQE-C daemon at %s", vqesrc->daemon_socket));
+    return GST_FLOW_ERROR;
+  }
+
+  /* As in-process, nothing for a while gets an empty buffer so we don't
+     block state changes. */
+  if (ret == 0) {
+    buffer = gst_buffer_new ();
+  } else {
+    buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        (gpointer) data, size, 0, size, slot, gst_vqe_ipc_client_release);
+    gst_vqesrc_timeline_mark (vqesrc, GST_VQESRC_PHASE_FIRST_DATAGRAM);
+  }
+
+  if (G_UNLIKELY (size > 0 && (vqesrc->fast_start_pending ||
+              vqesrc->psi_scan_pending || vqesrc->psi_discont_pending ||
+              vqesrc->track_pcr || vqesrc->timeline_pending))) {
+    GstMapInfo map;
+    gssize rap;
+
+    if (vqesrc->psi_discont_pending) {
+      /* The first live PAT or PMT is about to be edited, which the slot
+         won't allow, so take a copy until then */
+      GstBuffer *copy = gst_buffer_copy_deep (buffer);
+
+      gst_buffer_unref (buffer);
+      buffer = copy;
+      gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+      rap = gst_vqesrc_scan_datagram (vqesrc, map.data, size);
+      gst_buffer_unmap (buffer, &map);
+    } else {
+      /* only written to while psi_discont_pending */
+      rap = gst_vqesrc_scan_datagram (vqesrc, (guint8 *) data, size);
+    }
+
+    if (vqesrc->fast_start_pending) {
+      if (gst_vqesrc_fast_start_check (vqesrc, size, rap)) {
+        GstBuffer *tail = gst_buffer_copy_region (buffer,
+            GST_BUFFER_COPY_MEMORY, rap, size - rap);
+
+        gst_buffer_unref (buffer);
+        buffer = gst_buffer_append (gst_vqesrc_psi_buffer (vqesrc->scanner.pat,
+                vqesrc->scanner.pmt), tail);
+      } else {
+        /* let the ring have the slot back straight away */
+        gst_buffer_unref (buffer);
+        buffer = gst_buffer_new ();
+      }
+    }
+  }
+
+  if (G_UNLIKELY (vqesrc->psi_inject_pending)) {
+    buffer = gst_buffer_append (gst_vqesrc_psi_buffer (vqesrc->cached_pat,
+            vqesrc->cached_pmt), buffer);
+    vqesrc->psi_inject_pending = FALSE;
+  }
+
+  gst_vqesrc_update_bitrate (vqesrc, size);
+
+  *buf = buffer;
+  return GST_FLOW_OK;
+}
+
+/* VQE-C's strip_rtp is process wide, and merging feeds in any vqesrc needs
+   it off, so a datagram can come with its RTP header still on.  Move the
+   payload down over it and give the new size. */
+static int32_t
+gst_vqesrc_strip_rtp (guint8 * data, int32_t size)
+{
+  guint16 seq;
+  gsize offset, payload_size;
+
+  if (G_LIKELY (!gst_vqe_rtp_parse (data, size, &seq, &offset,
+              &payload_size)))
+    return size;
+  memmove (data, data + offset, payload_size);
+  return payload_size;
+}
+
+/* One compound buffer, or an empty one if nothing arrived for a while */
+static GstFlowReturn
+gst_vqesrc_create_buffer (GstVQESrc * vqesrc, GstBuffer ** buf)
+{
+  GstFlowReturn ret;
+  GstBuffer *buffer;
+  GstMemory *mem;
+  GstMapInfo info;
+  int32_t bytes_read = 0;
+  int32_t compounded_bytes_read = 0;
+  vqec_iobuf_t buflist[1] = {0};
+  vqec_error_t err=0;
+  gboolean probe;
+  GstClockTime t0 = 0;
+  gssize buffer_rap = -1;
+
+  if (vqesrc->use_daemon) {
+    /* the daemon binds the channel as it is when we attach, so a change
+       means attaching again */
+    if (!gst_vqesrc_check_retune (vqesrc))
+      goto error;
+    ret = gst_vqesrc_wait_tuned (vqesrc);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    ret = gst_vqesrc_create_from_daemon (vqesrc, &buffer);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    goto timestamp;
+  }
+
+  /* It is not necessary (nor desirable) to lock the vqesrc mutex here as VQE
+   * does it's own internal locking and the only vqesrc member we need to
+   * access is tuner id which is set in _start and _stop which GstBaseSrc
+   * guarantees will not be called at the same time as _create.  We don't want
+   * to hold the mutex to avoid blocking other methods (notably get_property)
+   * while waiting for data */
+
+  if (!gst_vqesrc_check_retune (vqesrc))
+    goto error;
+  /* nothing goes out before there's an SDP, not even an empty buffer, as
+     e.g. vqesdpdemux hasn't linked our pad yet */
+  ret = gst_vqesrc_wait_tuned (vqesrc);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  
+  memset(buflist, 0, sizeof(buflist));
+
+  /* Only pay for the timestamps when vqetracer is there to collect them */
+  probe = g_atomic_int_get (&gst_vqe_tracer_active);
+  if (G_UNLIKELY (probe)) {
+    vqesrc->probe_recv_time = 0;
+    vqesrc->probe_datagrams = 0;
+    vqesrc->probe_idle = FALSE;
+    t0 = gst_util_get_timestamp ();
+  }
+
+  ret = gst_buffer_pool_acquire_buffer (vqesrc->bufferPool, &buffer, NULL);
+  if (G_UNLIKELY (probe))
+    vqesrc->probe_acquire_time = gst_util_get_timestamp () - t0;
+  if (G_UNLIKELY (ret != GST_FLOW_OK))
+  {
+    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
+                      FAILED, (NULL),
+                      ("Failed to acquire buffer from buffer pool."));
+    goto error;
+  }
+
+  guint memIdx = gst_buffer_n_memory( buffer );
+  if ( memIdx != 1)
+  {
+    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
+                      FAILED, (NULL),
+                      ("This is not ideal..."));
+    goto pool_error;
+  }
+
+  mem = gst_buffer_peek_memory(buffer, memIdx-1) ;
+  if ( !gst_memory_map( mem,&info,GST_MAP_WRITE ) )
+  {
+    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
+                  FAILED, (NULL),
+                  ("gst_memory_map failed"));
+    goto pool_error;
+  }
+
+  if (G_UNLIKELY (vqesrc->psi_inject_pending)) {
+    /* Give the demuxer the tables it needs before the first byte of the new
+       channel rather than making it wait for the next repetition. */
+    memcpy (info.data, vqesrc->cached_pat, GST_VQE_TS_PACKET_SIZE);
+    memcpy (&info.data[GST_VQE_TS_PACKET_SIZE], vqesrc->cached_pmt,
+        GST_VQE_TS_PACKET_SIZE);
+    compounded_bytes_read = 2 * GST_VQE_TS_PACKET_SIZE;
+    vqesrc->psi_inject_pending = FALSE;
+  }
+
+  // read at buffer_size amount of data
+  while ( compounded_bytes_read <= vqesrc->compound_limit && !err )
+  {
+    bytes_read = 0;
+    buflist[0].buf_ptr = &info.data[compounded_bytes_read];
+    buflist[0].buf_len = info.maxsize - compounded_bytes_read;
+
+  /* VQEC_MSG_MAX_RECV_TIMEOUT this is 100ms for the current version of VQEC */
+    if (G_UNLIKELY (probe))
+      t0 = gst_util_get_timestamp ();
+    if (vqesrc->merging)
+      err = gst_vqesrc_merge_recv (vqesrc, buflist, &bytes_read,
+          VQEC_MSG_MAX_RECV_TIMEOUT);
+    else
+      err = backend->tuner_recvmsg(
+          vqesrc->tuner, buflist, 1, &bytes_read, VQEC_MSG_MAX_RECV_TIMEOUT );
+    if (G_UNLIKELY (probe)) {
+      vqesrc->probe_recv_time += gst_util_get_timestamp () - t0;
+      if (bytes_read > 0)
+        vqesrc->probe_datagrams++;
+    }
+    if (bytes_read > 0) {
+      /* the merge has already taken off the headers of what it outputs */
+      if (!vqesrc->merging)
+        bytes_read = gst_vqesrc_strip_rtp (buflist[0].buf_ptr, bytes_read);
+      gst_vqesrc_histograms_arrival (vqesrc);
+    }
+
+    if ( err ==VQEC_OK && bytes_read==0 )
+    {
+      /* We're spinning for 100ms without data arriving. We need to exit this
+         function to allow pipeline to shutdown properly if data will never
+         come. Without this exit condition we're hitting a deadlock when
+         GstBaseSrc wants to change it's state but can't because we're
+         spinning in here. 
+      */
+      if (G_UNLIKELY (probe))
+        vqesrc->probe_idle = (compounded_bytes_read == 0);
+      break;
+    }
+    gst_vqesrc_timeline_mark (vqesrc, GST_VQESRC_PHASE_FIRST_DATAGRAM);
+
+    if (G_UNLIKELY (vqesrc->fast_start_pending || vqesrc->psi_scan_pending ||
+            vqesrc->psi_discont_pending || vqesrc->track_pcr ||
+            vqesrc->timeline_pending || vqesrc->timeshifting)) {
+      gssize rap = gst_vqesrc_scan_datagram (vqesrc,
+          &info.data[compounded_bytes_read], bytes_read);
+
+      if (vqesrc->fast_start_pending) {
+        /* Nothing has been compounded yet so the datagram is at the start of
+           the buffer. */
+        compounded_bytes_read = gst_vqesrc_fast_start_trim (vqesrc, info.data,
+            bytes_read, info.maxsize, rap);
+        if (vqesrc->fast_start_pending)
+          continue;
+        /* the PAT and PMT now in front are as good a place to start */
+        buffer_rap = 0;
+        /* Get the random access point out of the door as quickly as
+           possible */
+        break;
+      }
+      if (buffer_rap < 0 && rap >= 0)
+        buffer_rap = compounded_bytes_read + rap;
+    }
+
+    if (G_UNLIKELY (bytes_read > vqesrc->datagram_size))
+      vqesrc->datagram_size = bytes_read;
+
+    compounded_bytes_read+=bytes_read;
+  }
+
+  if (err) {
+    GST_ELEMENT_ERROR(GST_ELEMENT(vqesrc), RESOURCE,
+                      READ, (NULL),
+                      ("Error receiving data from VQE: %s", vqec_err2str(err)));
+    goto buf_error;
+  }
+
+  gst_vqesrc_update_bitrate (vqesrc, compounded_bytes_read);
+  gst_vqesrc_histograms_sample (vqesrc);
+
+  gst_memory_unmap ( mem, &info);
+  /* Only shrinks the view of the memory; the pool grows it back on release
+     so the same buffer and memory are handed out again next time. */
+  gst_buffer_set_size (buffer, compounded_bytes_read);
+
+  if (vqesrc->timeshifting)
+    buffer = gst_vqesrc_timeshift_buffer (vqesrc, buffer, buffer_rap);
+
+timestamp:
+  if (vqesrc->do_pcr_timestamp) {
+    GstClock *clock = gst_element_get_clock (GST_ELEMENT (vqesrc));
+
+    /* not yet PLAYING, so basesrc would have left it alone too */
+    if (clock) {
+      GST_BUFFER_PTS (buffer) = GST_BUFFER_DTS (buffer) =
+          gst_vqesrc_pcr_running_time (vqesrc, clock,
+          gst_element_get_base_time (GST_ELEMENT (vqesrc)));
+      gst_object_unref (clock);
+    }
+  }
+
+  gst_vqesrc_timeline_update (vqesrc, buffer);
+
+  *buf = buffer;
+  return GST_FLOW_OK;
+buf_error:
+  gst_memory_unmap (mem, &info);
+pool_error:
+  /* goes back to whichever pool it came from */
+  gst_buffer_unref (buffer);
+error:
+  return GST_FLOW_ERROR;
+}
+
+#if GST_CHECK_VERSION(1,14,0)
+/* Stamp @buffer with the running time now, as basesrc would have had it
+   gone out on its own rather than after the first in a list */
+static void
+gst_vqesrc_stamp_running_time (GstVQESrc * src, GstBuffer * buffer)
+{
+  GstClock *clock;
+  GstClockTime base_time, now;
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer))
+    return;
+  clock = gst_element_get_clock (GST_ELEMENT (src));
+  if (!clock)
+    return;
+  base_time = gst_element_get_base_time (GST_ELEMENT (src));
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  GST_BUFFER_PTS (buffer) = GST_BUFFER_DTS (buffer) =
+      (now > base_time) ? now - base_time : 0;
+}
+
+/*
+ * Gather buffers into a list until there are list-buffers of them, another
+ * couldn't be filled, at the current bitrate, by list-latency after the
+ * first was ready, or nothing is arriving.  The probes vqetracer reads then
+ * cover the whole list.
+ */
+static GstFlowReturn
+gst_vqesrc_create_list (GstVQESrc * vqesrc, GstBuffer ** buf)
+{
+  GstBufferList *list;
+  GstBuffer *buffer;
+  GstClockTime deadline, fill, recv_time, acquire_time;
+  guint max_buffers, datagrams, length = 1;
+  gboolean deadline_hit = FALSE;
+  GstFlowReturn ret;
+
+  ret = gst_vqesrc_create_buffer (vqesrc, &buffer);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  /* an empty buffer is to keep state changes from blocking, so out it goes */
+  if (gst_buffer_get_size (buffer) == 0) {
+    *buf = buffer;
+    return GST_FLOW_OK;
+  }
+
+  GST_OBJECT_LOCK (vqesrc);
+  max_buffers = vqesrc->current_list_buffers;
+  deadline = gst_util_get_timestamp () + vqesrc->current_list_latency;
+  fill = gst_vqesrc_get_fill_time_unlocked (vqesrc);
+  GST_OBJECT_UNLOCK (vqesrc);
+
+  recv_time = vqesrc->probe_recv_time;
+  acquire_time = vqesrc->probe_acquire_time;
+  datagrams = vqesrc->probe_datagrams;
+
+  list = gst_buffer_list_new_sized (max_buffers);
+  gst_vqesrc_stamp_running_time (vqesrc, buffer);
+  gst_buffer_list_add (list, buffer);
+
+  while (length < max_buffers && !g_atomic_int_get (&vqesrc->flushing)) {
+    if (gst_util_get_timestamp () + fill > deadline) {
+      deadline_hit = TRUE;
+      break;
+    }
+    ret = gst_vqesrc_create_buffer (vqesrc, &buffer);
+    if (ret != GST_FLOW_OK) {
+      /* what's gathered so far goes too: on FLUSHING we're being stopped
+         or seeked, and either way it would only be flushed downstream */
+      gst_buffer_list_unref (list);
+      return ret;
+    }
+    recv_time += vqesrc->probe_recv_time;
+    acquire_time += vqesrc->probe_acquire_time;
+    datagrams += vqesrc->probe_datagrams;
+    if (gst_buffer_get_size (buffer) == 0) {
+      gst_buffer_unref (buffer);
+      break;
+    }
+    gst_vqesrc_stamp_running_time (vqesrc, buffer);
+    gst_buffer_list_add (list, buffer);
+    length++;
+  }
+
+  if (G_UNLIKELY (g_atomic_int_get (&gst_vqe_tracer_active))) {
+    vqesrc->probe_recv_time = recv_time;
+    vqesrc->probe_acquire_time = acquire_time;
+    vqesrc->probe_datagrams = datagrams;
+    vqesrc->probe_idle = FALSE;
+  }
+  gst_vqesrc_list_pushed (vqesrc, length, deadline_hit);
+
+  if (length == 1) {
+    *buf = gst_buffer_ref (gst_buffer_list_get (list, 0));
+    gst_buffer_list_unref (list);
+    return GST_FLOW_OK;
+  }
+  gst_base_src_submit_buffer_list (GST_BASE_SRC (vqesrc), list);
+  *buf = NULL;
+  return GST_FLOW_OK;
+}
+#endif
+
+static GstFlowReturn
+gst_vqesrc_create (GstPushSrc * psrc, GstBuffer ** buf)
+{
+  GstVQESrc *vqesrc = GST_VQESRC_CAST (psrc);
+
+  if (vqesrc->rtp_output)
+    return gst_vqesrc_create_rtp (vqesrc, buf);
+#if GST_CHECK_VERSION(1,14,0)
+  /* only changed by start, which is before we're running */
+  if (vqesrc->current_list_buffers > 1)
+    return gst_vqesrc_create_list (vqesrc, buf);
+#endif
+  return gst_vqesrc_create_buffer (vqesrc, buf);
+}
+
+static gboolean
+gst_vqesrc_set_sdp (GstVQESrc * src, const gchar * sdp, GError ** error)
+{
+  /* Applied when we next bind, which if we're running is straight away */
+  /* TODO: A bit of preliminary validation of the SDP contents */
+  g_free(src->sdp);
+  src->sdp = g_strdup(sdp);
+  g_atomic_int_set (&src->retune_pending, TRUE);
+  g_cond_broadcast (&src->tune_cond);
+  return TRUE;
+}
+
+static gboolean
+gst_vqesrc_set_cfg (GstVQESrc * src, const gchar * cfg, GError ** error)
+{
+  /* Applied when we next bind, which if we're running is straight away */
+  g_free(src->cfg);
+  src->cfg = g_strdup(cfg);
+  g_atomic_int_set (&src->retune_pending, TRUE);
+  return TRUE;
+}
+
+/* Hand the loss patterns to the backend.  Called without the object lock,
+   which mustn't be held while VQE-C takes its own, once the tuner is bound,
+   as binding resets them. */
+static void
+gst_vqesrc_apply_loss (GstVQESrc * src)
+{
+  gchar *primary, *repair;
+
+  if (src->use_daemon)
+    return;
+
+  GST_OBJECT_LOCK (src);
+  primary = g_strdup (src->primary_loss);
+  repair = g_strdup (src->repair_loss);
+  GST_OBJECT_UNLOCK (src);
+
+  if (!backend->tuner_set_loss (src->tuner, primary, repair))
+    GST_WARNING_OBJECT (src, "The %s backend can't inject loss patterns "
+        "\"%s\" and \"%s\"", backend->name, GST_STR_NULL (primary),
+        GST_STR_NULL (repair));
+  g_free (primary);
+  g_free (repair);
+}
+
+static void
+gst_vqesrc_set_loss (GstVQESrc * src, gchar ** loss, const gchar * spec)
+{
+  GstVQESynthLoss parsed;
+
+  if (!gst_vqe_synth_loss_parse (&parsed, spec, 1)) {
+    GST_WARNING_OBJECT (src, "Ignoring invalid loss pattern \"%s\"", spec);
+    return;
+  }
+  g_free (*loss);
+  *loss = (spec && !g_str_equal (spec, "none")) ? g_strdup (spec) : NULL;
+  if (GST_OBJECT_FLAG_IS_SET (src, GST_BASE_SRC_FLAG_STARTED))
+    g_atomic_int_set (&src->loss_pending, TRUE);
+}
+
+static void
+gst_vqesrc_set_property (GObject * object, guint prop_id, const GValue * value,
+    GParamSpec * pspec)
+{
+  GstVQESrc *vqesrc = GST_VQESRC (object);
+  gboolean sdp_changed = FALSE;
 
   GST_OBJECT_LOCK (vqesrc);
 
   switch (prop_id) {
     case PROP_SDP:
       gst_vqesrc_set_sdp (vqesrc, g_value_get_string (value), NULL);
+      sdp_changed = GST_OBJECT_FLAG_IS_SET (vqesrc, GST_BASE_SRC_FLAG_STARTED);
       break;
     case PROP_CFG:
       gst_vqesrc_set_cfg (vqesrc, g_value_get_string (value), NULL);
       break;
 
-    case PROP_TR135_GMIN:
-      vqesrc->tr135_params.gmin = g_value_get_ulong (value);
-      vqec_ifclient_set_tr135_params_channel(vqesrc->stream_uri, &vqesrc->tr135_params);
+    case PROP_TR135_GMIN:
+      vqesrc->tr135_params.gmin = g_value_get_ulong (value);
+      if (gst_vqesrc_has_vqec (vqesrc))
+        backend->set_tr135_params_channel(vqesrc->stream_uri, &vqesrc->tr135_params);
+      break;
+    case PROP_TR135_SEVERE_LOSS_MIN_DISTANCE:
+      vqesrc->tr135_params.severe_loss_min_distance = g_value_get_ulong (value);
+      if (gst_vqesrc_has_vqec (vqesrc))
+        backend->set_tr135_params_channel(vqesrc->stream_uri, &vqesrc->tr135_params);
+      break;
+    case PROP_GST_BUFFERSIZE_SIZE:
+        vqesrc->compound_buffer_size  = g_value_get_ulong ( value );
+        break;
+    case PROP_FAST_START:
+      vqesrc->fast_start = g_value_get_boolean (value);
+      break;
+    case PROP_PSI_CACHE:
+      vqesrc->psi_cache = g_value_get_boolean (value);
+      break;
+    case PROP_PROVIDE_CLOCK:
+      vqesrc->provide_clock = g_value_get_boolean (value);
+      if (vqesrc->provide_clock)
+        GST_OBJECT_FLAG_SET (vqesrc, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
+      else
+        GST_OBJECT_FLAG_UNSET (vqesrc, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
+      break;
+    case PROP_DO_PCR_TIMESTAMP:
+      vqesrc->do_pcr_timestamp = g_value_get_boolean (value);
+      break;
+    case PROP_BUFFER_DURATION:
+      vqesrc->buffer_duration = g_value_get_uint64 (value);
+      break;
+    case PROP_ALLOCATOR:
+      vqesrc->allocator_backing = g_value_get_enum (value);
+      break;
+    case PROP_DAEMON_SOCKET:
+      g_free (vqesrc->daemon_socket);
+      vqesrc->daemon_socket = g_value_dup_string (value);
+      break;
+    case PROP_PRIMARY_LOSS:
+      gst_vqesrc_set_loss (vqesrc, &vqesrc->primary_loss,
+          g_value_get_string (value));
+      break;
+    case PROP_REPAIR_LOSS:
+      gst_vqesrc_set_loss (vqesrc, &vqesrc->repair_loss,
+          g_value_get_string (value));
+      break;
+    case PROP_BACKUP_SDP:
+      g_free (vqesrc->backup_sdp);
+      vqesrc->backup_sdp = g_value_dup_string (value);
+      break;
+    case PROP_MERGE_DELAY:
+      vqesrc->merge_delay = g_value_get_uint64 (value);
+      break;
+    case PROP_TIMESHIFT_DURATION:
+      vqesrc->timeshift_duration = g_value_get_uint64 (value);
+      break;
+    case PROP_TIMESHIFT_MAX_BYTES:
+      vqesrc->timeshift_max_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_TIMESHIFT_LOCATION:
+      g_free (vqesrc->timeshift_location);
+      vqesrc->timeshift_location = g_value_dup_string (value);
+      break;
+    case PROP_OUTPUT:
+      vqesrc->output = g_value_get_enum (value);
+      break;
+    case PROP_LIST_BUFFERS:
+      vqesrc->list_buffers = g_value_get_uint (value);
+      break;
+    case PROP_LIST_LATENCY:
+      vqesrc->list_latency = g_value_get_uint64 (value);
+      break;
+    case PROP_RCC:{
+      gboolean rcc = g_value_get_boolean (value);
+
+      /* setting what's already in effect only stops the cfg changing it */
+      if (rcc != (vqesrc->rcc_set ? vqesrc->rcc : vqesrc->bound_rcc))
+        g_atomic_int_set (&vqesrc->retune_pending, TRUE);
+      vqesrc->rcc = rcc;
+      vqesrc->rcc_set = TRUE;
+      break;
+    }
+    case PROP_FASTFILL:{
+      gboolean fastfill = g_value_get_boolean (value);
+
+      if (fastfill != (vqesrc->fastfill_set ? vqesrc->fastfill :
+              vqesrc->bound_fastfill))
+        g_atomic_int_set (&vqesrc->retune_pending, TRUE);
+      vqesrc->fastfill = fastfill;
+      vqesrc->fastfill_set = TRUE;
+      break;
+    }
+    case PROP_MAX_RECEIVE_BANDWIDTH_RCC:
+      vqesrc->max_receive_bandwidth_rcc = g_value_get_uint (value);
+      g_atomic_int_set (&vqesrc->retune_pending, TRUE);
+      break;
+    case PROP_MAX_RECEIVE_BANDWIDTH_ER:
+      vqesrc->max_receive_bandwidth_er = g_value_get_uint (value);
+      g_atomic_int_set (&vqesrc->retune_pending, TRUE);
+      break;
+
+    default:
+      break;
+  }
+  GST_OBJECT_UNLOCK (vqesrc);
+
+  if (sdp_changed)
+    gst_vqesrc_sdp_changed (vqesrc);
+}
+
+/* Properties which belong to the element rather than to VQE-C and so can be
+ * read whether or not we're tuned.  Called with the object lock held. */
+static gboolean
+gst_vqesrc_get_element_property (GstVQESrc * vqesrc, guint prop_id,
+    GValue * value)
+{
+  switch (prop_id) {
+    case PROP_SDP:
+      g_value_set_string (value, vqesrc->sdp);
+      break;
+    case PROP_CFG:
+      g_value_set_string (value, vqesrc->cfg);
+      break;
+    case PROP_GST_BUFFERSIZE_SIZE:
+      g_value_set_ulong (value, vqesrc->compound_buffer_size);
+      break;
+    case PROP_FAST_START:
+      g_value_set_boolean (value, vqesrc->fast_start);
+      break;
+    case PROP_FAST_START_BYTES_SKIPPED:
+      g_value_set_uint64 (value, vqesrc->fast_start_bytes_skipped);
+      break;
+    case PROP_FAST_START_TIME_TO_RAP:
+      g_value_set_uint64 (value, vqesrc->fast_start_time_to_rap);
+      break;
+    case PROP_PSI_CACHE:
+      g_value_set_boolean (value, vqesrc->psi_cache);
+      break;
+    case PROP_PSI_CACHE_MISMATCHES:
+      g_value_set_uint64 (value, vqesrc->psi_cache_mismatches);
+      break;
+    case PROP_PROVIDE_CLOCK:
+      g_value_set_boolean (value, vqesrc->provide_clock);
+      break;
+    case PROP_DO_PCR_TIMESTAMP:
+      g_value_set_boolean (value, vqesrc->do_pcr_timestamp);
+      break;
+    case PROP_BUFFER_DURATION:
+      g_value_set_uint64 (value, vqesrc->buffer_duration);
+      break;
+    case PROP_CURRENT_BUFFER_SIZE:
+      g_value_set_ulong (value, vqesrc->current_buffer_size);
+      break;
+    case PROP_POOL_ALLOCATIONS:
+    case PROP_POOL_MISSES:
+    case PROP_POOL_DISCARDS:{
+      guint allocations, misses, discards;
+
+      gst_vqesrc_get_pool_stats_unlocked (vqesrc, &allocations, &misses,
+          &discards);
+      g_value_set_uint (value, (prop_id == PROP_POOL_ALLOCATIONS) ?
+          allocations : (prop_id == PROP_POOL_MISSES) ? misses : discards);
+      break;
+    }
+    case PROP_ALLOCATOR:
+      g_value_set_enum (value, vqesrc->allocator_backing);
+      break;
+    case PROP_ALLOCATOR_IN_USE:
+      g_value_set_enum (value, vqesrc->allocator ?
+          GST_VQE_ALLOCATOR (vqesrc->allocator)->backing :
+          GST_VQE_ALLOCATOR_BACKING_SYSTEM);
+      break;
+    case PROP_ALLOCATOR_FD:
+      g_value_set_int (value, vqesrc->allocator ?
+          GST_VQE_ALLOCATOR (vqesrc->allocator)->fd : -1);
+      break;
+    case PROP_ALLOCATOR_FALLBACKS:
+      g_value_set_uint (value,
+          gst_vqesrc_get_allocator_fallbacks_unlocked (vqesrc));
+      break;
+    case PROP_DAEMON_SOCKET:
+      g_value_set_string (value, vqesrc->daemon_socket);
+      break;
+    case PROP_PRIMARY_LOSS:
+      g_value_set_string (value, vqesrc->primary_loss);
+      break;
+    case PROP_REPAIR_LOSS:
+      g_value_set_string (value, vqesrc->repair_loss);
+      break;
+    case PROP_BACKUP_SDP:
+      g_value_set_string (value, vqesrc->backup_sdp);
+      break;
+    case PROP_MERGE_DELAY:
+      g_value_set_uint64 (value, vqesrc->merge_delay);
+      break;
+    case PROP_MERGE_STATS:
+      g_value_take_boxed (value, gst_vqesrc_merge_stats (vqesrc));
+      break;
+    case PROP_TIMESHIFT_DURATION:
+      g_value_set_uint64 (value, vqesrc->timeshift_duration);
+      break;
+    case PROP_TIMESHIFT_MAX_BYTES:
+      g_value_set_uint64 (value, vqesrc->timeshift_max_bytes);
+      break;
+    case PROP_TIMESHIFT_LOCATION:
+      g_value_set_string (value, vqesrc->timeshift_location);
+      break;
+    case PROP_TIMESHIFT_DELAY:
+      g_value_set_uint64 (value,
+          gst_vqe_timeshift_delay (&vqesrc->timeshift));
+      break;
+    case PROP_OUTPUT:
+      g_value_set_enum (value, vqesrc->output);
+      break;
+    case PROP_LIST_BUFFERS:
+      g_value_set_uint (value, vqesrc->list_buffers);
+      break;
+    case PROP_LIST_LATENCY:
+      g_value_set_uint64 (value, vqesrc->list_latency);
+      break;
+    case PROP_LIST_STATS:{
+      GstStructure *s = gst_structure_new ("vqe-list-stats",
+          "deadline-closes", G_TYPE_UINT64, vqesrc->list_deadlines, NULL);
+
+      gst_vqesrc_histogram_to_structure (s, "list-size", &vqesrc->list_sizes);
+      g_value_take_boxed (value, s);
+      break;
+    }
+    case PROP_RCC:
+      g_value_set_boolean (value, vqesrc->rcc_set ? vqesrc->rcc :
+          vqesrc->bound_rcc);
+      break;
+    case PROP_FASTFILL:
+      g_value_set_boolean (value, vqesrc->fastfill_set ? vqesrc->fastfill :
+          vqesrc->bound_fastfill);
+      break;
+    case PROP_MAX_RECEIVE_BANDWIDTH_RCC:
+      g_value_set_uint (value, vqesrc->max_receive_bandwidth_rcc);
+      break;
+    case PROP_MAX_RECEIVE_BANDWIDTH_ER:
+      g_value_set_uint (value, vqesrc->max_receive_bandwidth_er);
+      break;
+    case PROP_CHANNEL_HISTOGRAMS:{
+      GstStructure *hists = gst_structure_new_empty ("vqe-channel-histograms");
+
+      /* nothing measures them through a daemon */
+      if (vqesrc->daemon_socket && vqesrc->daemon_socket[0]) {
+        g_value_take_boxed (value, hists);
+        break;
+      }
+
+      gst_vqesrc_histogram_to_structure (hists, "interarrival",
+          &vqesrc->interarrival);
+      gst_vqesrc_histogram_to_structure (hists, "sampled-loss-burst",
+          &vqesrc->loss_burst);
+      gst_vqesrc_histogram_to_structure (hists, "sampled-repair-rtt",
+          &vqesrc->repair_rtt);
+      g_value_take_boxed (value, hists);
       break;
-    case PROP_TR135_SEVERE_LOSS_MIN_DISTANCE:
-      vqesrc->tr135_params.severe_loss_min_distance = g_value_get_ulong (value);
-      vqec_ifclient_set_tr135_params_channel(vqesrc->stream_uri, &vqesrc->tr135_params);
+    }
+    case PROP_DAEMON_OVERRUNS:
+      g_value_set_uint (value, vqesrc->daemon ?
+          gst_vqe_ipc_client_get_overruns (vqesrc->daemon) : 0);
       break;
-    case PROP_GST_BUFFERSIZE_SIZE:
-        vqesrc->compound_buffer_size  = g_value_get_ulong ( value );
-        break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* Stats VQE-C only keeps for the whole process rather than per channel */
+static gboolean
+gst_vqesrc_get_global_stats_property (GstVQESrc * vqesrc, guint prop_id,
+    GValue * value)
+{
+  vqec_ifclient_stats_t stats;
 
+  switch (prop_id) {
+    case PROP_EVENT_LOOP_LAG:{
+      GstStructure *lag;
+
+      /* the event loop we'd be measuring is the daemon's */
+      if (vqesrc->daemon_socket && vqesrc->daemon_socket[0]) {
+        g_value_take_boxed (value,
+            gst_structure_new_empty ("vqe-event-loop-lag"));
+        return TRUE;
+      }
+
+      g_mutex_lock (&lag_mutex);
+      lag = gst_structure_new ("vqe-event-loop-lag",
+          "samples", G_TYPE_UINT64, lag_histogram.count,
+          "p50", G_TYPE_UINT64,
+          gst_vqe_histogram_percentile (&lag_histogram, 50),
+          "p90", G_TYPE_UINT64,
+          gst_vqe_histogram_percentile (&lag_histogram, 90),
+          "p99", G_TYPE_UINT64,
+          gst_vqe_histogram_percentile (&lag_histogram, 99),
+          "p999", G_TYPE_UINT64,
+          gst_vqe_histogram_percentile (&lag_histogram, 99.9),
+          "max", G_TYPE_UINT64, lag_histogram.max, NULL);
+      g_mutex_unlock (&lag_mutex);
+      g_value_take_boxed (value, lag);
+      return TRUE;
+    }
+    case PROP_VQEC_CHANNEL_CHANGE_REQUESTS:
+    case PROP_VQEC_RCC_REQUESTS:
+    case PROP_VQEC_CONCURRENT_RCCS_LIMITED:
+    case PROP_VQEC_RCC_WITH_LOSS:
+    case PROP_VQEC_RCC_ABORTS_TOTAL:
+      break;
     default:
+      return FALSE;
+  }
+
+  memset (&stats, 0, sizeof (stats));
+  if (!gst_vqesrc_has_vqec (vqesrc)) {
+    g_value_set_uint64 (value, 0);
+    return TRUE;
+  }
+  if (backend->get_stats (&stats) != VQEC_OK) {
+    GST_WARNING_OBJECT (vqesrc, "Failed to get VQE-C stats");
+    g_value_set_uint64 (value, 0);
+    return TRUE;
+  }
+
+  switch (prop_id) {
+    case PROP_VQEC_CHANNEL_CHANGE_REQUESTS:
+      g_value_set_uint64 (value, stats.channel_change_requests);
+      break;
+    case PROP_VQEC_RCC_REQUESTS:
+      g_value_set_uint64 (value, stats.rcc_requests);
+      break;
+    case PROP_VQEC_CONCURRENT_RCCS_LIMITED:
+      g_value_set_uint64 (value, stats.concurrent_rccs_limited);
+      break;
+    case PROP_VQEC_RCC_WITH_LOSS:
+      g_value_set_uint64 (value, stats.rcc_with_loss);
+      break;
+    case PROP_VQEC_RCC_ABORTS_TOTAL:
+      g_value_set_uint64 (value, stats.rcc_aborts_total);
       break;
   }
-  GST_OBJECT_UNLOCK (vqesrc);
+  return TRUE;
 }
 
 static void
@@ -733,7 +3462,18 @@ gst_vqesrc_get_property (GObject * object, guint prop_id, GValue * value,
   memset( &stats, 0, sizeof ( stats ) );
 
   GST_OBJECT_LOCK (vqesrc);
-  error = vqec_ifclient_get_stats_channel( vqesrc->stream_uri, &stats );
+  if (gst_vqesrc_get_element_property (vqesrc, prop_id, value) ||
+      gst_vqesrc_get_global_stats_property (vqesrc, prop_id, value)) {
+    GST_OBJECT_UNLOCK (vqesrc);
+    return;
+  }
+  if (vqesrc->daemon_socket && vqesrc->daemon_socket[0]) {
+    /* the tuner is in the daemon, which doesn't pass its stats on */
+    GST_OBJECT_UNLOCK (vqesrc);
+    g_param_value_set_default (pspec, value);
+    return;
+  }
+  error = backend->get_stats_channel( vqesrc->stream_uri, &stats );
   GST_OBJECT_UNLOCK (vqesrc);
   
   if ( error != VQEC_OK ){
@@ -748,12 +3488,6 @@ gst_vqesrc_get_property (GObject * object, guint prop_id, GValue * value,
     return;
   } else {
     switch (prop_id) {
-      case PROP_SDP:
-        g_value_set_string (value, vqesrc->sdp);
-        break;
-      case PROP_CFG:
-        g_value_set_string (value, vqesrc->cfg);
-        break;
       case PROP_VQEC_PRIMARY_UDP_INPUTS:
         g_value_set_uint64 ( value, stats.primary_udp_inputs );
         break;
@@ -886,27 +3620,158 @@ gst_vqesrc_get_property (GObject * object, guint prop_id, GValue * value,
         g_value_set_boolean ( value, TRUE );
         break;
 
-    case PROP_GST_BUFFERSIZE_SIZE:
-        g_value_set_ulong ( value, vqesrc->compound_buffer_size );
-        break;
-
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
     }
   }
-  GST_OBJECT_UNLOCK (vqesrc);
 }
 
+/* Forget everything we knew about the previous channel.  Called once
+   stream_uri is that of the new one. */
+static void
+gst_vqesrc_new_channel (GstVQESrc * src, const gchar * sdp)
+{
+  /* start timing the zap and, if asked to, hold output back until the first
+     random access point of the new channel */
+  src->tune_time = gst_util_get_timestamp ();
+  gst_vqe_ts_scanner_reset (&src->scanner);
+  src->fast_start_pending = src->fast_start && !src->rtp_output;
+  src->fast_start_bytes_skipped = 0;
+  src->fast_start_time_to_rap = GST_CLOCK_TIME_NONE;
+
+  src->have_cached_psi = FALSE;
+  src->psi_seen = 0;
+  src->psi_scan_pending = src->psi_cache && !src->rtp_output;
+  if (src->psi_scan_pending)
+    gst_vqesrc_psi_cache_lookup (src);
+  /* with fast-start the cached tables go in front of the random access
+     point instead */
+  src->psi_inject_pending = src->have_cached_psi && !src->fast_start;
+  src->psi_discont_pid[0] = src->have_cached_psi ? GST_VQE_TS_PID_PAT :
+      GST_VQE_TS_PID_INVALID;
+  src->psi_discont_pid[1] = src->have_cached_psi ? src->scanner.pmt_pid :
+      GST_VQE_TS_PID_INVALID;
+  src->psi_discont_pending = src->have_cached_psi;
+
+  /* the new channel's PCR has nothing to do with the old one's */
+  src->last_pcr = PCR_INVALID;
+  /* nor, as far as downstream can tell, is it the same RTP source */
+  src->rtp_ssrc = g_random_int ();
+
+  GST_OBJECT_LOCK (src);
+  src->bitrate = gst_vqesrc_sdp_bitrate (sdp);
+  gst_vqesrc_histograms_reset (src);
+  /* what we kept can't be spliced onto the new stream, nor its times onto
+     the new tune_time */
+  gst_vqe_timeshift_clear (&src->timeshift);
+  src->timeshift_pcr = PCR_INVALID;
+  src->timeshift_time = 0;
+  GST_OBJECT_UNLOCK (src);
+  src->bitrate_window_start = GST_CLOCK_TIME_NONE;
+}
+
+/* Override what the SDP and the global configuration say about this channel
+   with the settings in our cfg file, so that different classes of channel
+   can be treated differently within the one process.  Returns whether the
+   cfg file turned fast fill on. */
 static gboolean
-gst_vqesrc_tune (GstVQESrc * src, gchar* sdp)
+gst_vqesrc_apply_cfg (GstVQESrc * src, vqec_chan_cfg_t * cfg,
+    vqec_bind_params_t * bp)
+{
+  gchar *path;
+  GstVQECfg *settings;
+  gboolean enable, fastfill_set, fastfill = FALSE;
+  guint value;
+
+  GST_OBJECT_LOCK (src);
+  path = g_strdup (src->cfg);
+  fastfill_set = src->fastfill_set;
+  GST_OBJECT_UNLOCK (src);
+  if (!path || !path[0]) {
+    g_free (path);
+    return FALSE;
+  }
+
+  settings = gst_vqe_cfg_load (path);
+  if (!settings) {
+    GST_WARNING_OBJECT (src, "Can't read channel configuration %s", path);
+    g_free (path);
+    return FALSE;
+  }
+
+  if (gst_vqe_cfg_lookup_boolean (settings, "error_repair_enable", &enable))
+    cfg->er_enable = enable;
+  if (gst_vqe_cfg_lookup_boolean (settings, "fec_enable", &enable))
+    cfg->fec_enable = enable;
+  if (gst_vqe_cfg_lookup_boolean (settings, "rcc_enable", &enable)) {
+    cfg->rcc_enable = enable;
+    if (enable)
+      vqec_ifclient_bind_params_enable_rcc (bp);
+    else
+      vqec_ifclient_bind_params_disable_rcc (bp);
+  }
+  /* there's no disabling fast fill once enabled, so leave it to the
+     property if that's been set */
+  if (!fastfill_set &&
+      gst_vqe_cfg_lookup_boolean (settings, "fastfill_enable", &enable) &&
+      enable) {
+    vqec_ifclient_bind_params_enable_fastfill (bp);
+    fastfill = TRUE;
+  }
+  if (gst_vqe_cfg_lookup_uint (settings, "max_receive_bandwidth_er", &value))
+    vqec_ifclient_bind_params_set_max_recv_bw_er (bp, value);
+  if (gst_vqe_cfg_lookup_uint (settings, "max_receive_bandwidth_rcc", &value))
+    vqec_ifclient_bind_params_set_max_recv_bw_rcc (bp, value);
+
+  /* VQE-C has one jitter buffer depth for every tuner */
+  if (gst_vqe_cfg_lookup_uint (settings, "jitter_buff_size", &value))
+    GST_WARNING_OBJECT (src, "jitter_buff_size in %s ignored: it can only be "
+        "set in the global VQE-C configuration", path);
+
+  GST_DEBUG_OBJECT (src, "Applied channel configuration %s: er %d fec %d "
+      "rcc %d", path, cfg->er_enable, cfg->fec_enable, cfg->rcc_enable);
+  gst_vqe_cfg_free (settings);
+  g_free (path);
+  return fastfill;
+}
+
+/* The RCC and bandwidth properties are more specific than the cfg file so
+   are applied after it */
+static void
+gst_vqesrc_apply_rcc_properties (GstVQESrc * src, vqec_chan_cfg_t * cfg,
+    vqec_bind_params_t * bp)
+{
+  GST_OBJECT_LOCK (src);
+  if (src->rcc_set) {
+    cfg->rcc_enable = src->rcc;
+    if (src->rcc)
+      vqec_ifclient_bind_params_enable_rcc (bp);
+    else
+      vqec_ifclient_bind_params_disable_rcc (bp);
+  }
+  if (src->fastfill_set && src->fastfill)
+    vqec_ifclient_bind_params_enable_fastfill (bp);
+  if (src->max_receive_bandwidth_rcc)
+    vqec_ifclient_bind_params_set_max_recv_bw_rcc (bp,
+        src->max_receive_bandwidth_rcc);
+  if (src->max_receive_bandwidth_er)
+    vqec_ifclient_bind_params_set_max_recv_bw_er (bp,
+        src->max_receive_bandwidth_er);
+  GST_OBJECT_UNLOCK (src);
+}
+
+/* Bind @tuner to the channel of @sdp with our settings, filling in @cfg */
+static gboolean
+gst_vqesrc_bind (GstVQESrc * src, vqec_tunerid_t tuner, gchar * sdp,
+    vqec_chan_cfg_t * cfg)
 {
   gboolean success = FALSE;
-  vqec_chan_cfg_t cfg;
   /* bind params probably correspond to gstreamer properties?: */
   vqec_bind_params_t *bp = NULL;
   vqec_error_t err = 0;
   uint8_t res;
+  gboolean cfg_fastfill;
 
   bp = vqec_ifclient_bind_params_create();
   if (!bp) {
@@ -922,23 +3787,29 @@ gst_vqesrc_tune (GstVQESrc * src, gchar* sdp)
     goto out;
   }
 
-  res = vqec_ifclient_chan_cfg_parse_sdp(&cfg, sdp,
+  res = vqec_ifclient_chan_cfg_parse_sdp(cfg, sdp,
                                          VQEC_CHAN_TYPE_LINEAR);
   if (!res) {
     GST_ELEMENT_ERROR(GST_ELEMENT(src), STREAM, FAILED, (NULL),
                       ("Failed to parse SDP file:\n===BEGIN SDP===\n%s\n===END SDP===", sdp));
     goto out;
   }
-  err = vqec_ifclient_tuner_bind_chan_cfg(src->tuner, &cfg, bp);
+  if (tuner == src->tuner)
+    gst_vqesrc_timeline_mark (src, GST_VQESRC_PHASE_SDP_PARSED);
+  cfg_fastfill = gst_vqesrc_apply_cfg (src, cfg, bp);
+  gst_vqesrc_apply_rcc_properties (src, cfg, bp);
+  err = backend->tuner_bind_chan_cfg(tuner, cfg, bp);
   if (err) {
     GST_ELEMENT_ERROR(GST_ELEMENT(src), STREAM, FAILED, (NULL),
                       ("Failed to bind channel: %s", vqec_err2str(err)));
     goto out;
   }
-
-  /* format a stream uri to be used for per channel stats queries */
-  snprintf( src->stream_uri, sizeof ( src->stream_uri ),  "rtp://%s:%d",  
-            inet_ntoa( cfg.primary_dest_addr ), (int)ntohs(cfg.primary_dest_port) );
+  if (tuner == src->tuner) {
+    GST_OBJECT_LOCK (src);
+    src->bound_rcc = cfg->rcc_enable;
+    src->bound_fastfill = src->fastfill_set ? src->fastfill : cfg_fastfill;
+    GST_OBJECT_UNLOCK (src);
+  }
 
   success = TRUE;
 out:
@@ -948,14 +3819,467 @@ out:
   return success;
 }
 
+static gboolean
+gst_vqesrc_tune (GstVQESrc * src, gchar* sdp)
+{
+  vqec_chan_cfg_t cfg;
+
+  src->tuned = gst_vqesrc_bind (src, src->tuner, sdp, &cfg);
+  if (!src->tuned)
+    return FALSE;
+
+  /* format a stream uri to be used for per channel stats queries */
+  GST_OBJECT_LOCK (src);
+  snprintf( src->stream_uri, sizeof ( src->stream_uri ),  "rtp://%s:%d",  
+            inet_ntoa( cfg.primary_dest_addr ), (int)ntohs(cfg.primary_dest_port) );
+  GST_OBJECT_UNLOCK (src);
+  gst_vqesrc_timeline_bound (src);
+
+  g_atomic_int_set (&src->loss_pending, FALSE);
+  gst_vqesrc_apply_loss (src);
+
+  gst_vqesrc_new_channel (src, sdp);
+  gst_vqesrc_set_vqec_latency (src, &cfg);
+  gst_vqesrc_check_latency (src);
+
+  return TRUE;
+}
+
+/* Bind the tuner again with the current sdp and cfg.  Called from the
+   streaming thread so it doesn't race with reading. */
+static gboolean
+gst_vqesrc_retune (GstVQESrc * src)
+{
+  gchar *sdp;
+  gboolean ret;
+
+  GST_OBJECT_LOCK (src);
+  sdp = g_strdup (src->sdp);
+  GST_OBJECT_UNLOCK (src);
+
+  if (!src->tuned && (!sdp || !sdp[0])) {
+    g_free (sdp);
+    return TRUE;
+  }
+
+  GST_INFO_OBJECT (src, "Rebinding tuner");
+  if (src->timeline_pending)
+    gst_vqesrc_timeline_post (src);
+  gst_vqesrc_timeline_reset (src);
+  if (src->use_daemon) {
+    ret = gst_vqesrc_attach_daemon (src, sdp);
+    g_free (sdp);
+    return ret;
+  }
+  /* the feed threads mustn't be reading the tuners as they're rebound */
+  if (src->merging)
+    gst_vqesrc_feeds_stop (src);
+  if (src->tuned)
+    backend->tuner_unbind_chan (src->tuner);
+  ret = gst_vqesrc_tune (src, sdp);
+  g_free (sdp);
+
+  if (src->merging) {
+    if (ret) {
+      vqec_chan_cfg_t cfg;
+
+      GST_OBJECT_LOCK (src);
+      sdp = g_strdup (src->backup_sdp);
+      GST_OBJECT_UNLOCK (src);
+
+      backend->tuner_unbind_chan (src->backup_tuner);
+      ret = gst_vqesrc_bind (src, src->backup_tuner, sdp, &cfg);
+      g_free (sdp);
+    }
+
+    g_mutex_lock (&src->merge_lock);
+    gst_vqe_merge_reset (&src->merge);
+    g_mutex_unlock (&src->merge_lock);
+    gst_vqesrc_feeds_start (src);
+  }
+  return ret;
+}
+
+/* Rebind if the settings have changed since, and hand the backend any new
+   loss patterns, before the next read */
+static gboolean
+gst_vqesrc_check_retune (GstVQESrc * src)
+{
+  if (G_UNLIKELY (g_atomic_int_get (&src->loss_pending))) {
+    g_atomic_int_set (&src->loss_pending, FALSE);
+    if (src->tuned)
+      gst_vqesrc_apply_loss (src);
+  }
+  if (G_LIKELY (!g_atomic_int_get (&src->retune_pending)))
+    return TRUE;
+  g_atomic_int_set (&src->retune_pending, FALSE);
+  return gst_vqesrc_retune (src);
+}
+
+/* Until we have an SDP there's nothing to read, so wait for one, binding
+   it when it comes, or for unlock(), which gives FLUSHING */
+static GstFlowReturn
+gst_vqesrc_wait_tuned (GstVQESrc * src)
+{
+  while (G_UNLIKELY (!src->tuned)) {
+    GST_OBJECT_LOCK (src);
+    while (!g_atomic_int_get (&src->retune_pending) &&
+        !g_atomic_int_get (&src->flushing))
+      g_cond_wait (&src->tune_cond, GST_OBJECT_GET_LOCK (src));
+    GST_OBJECT_UNLOCK (src);
+
+    if (g_atomic_int_get (&src->flushing))
+      return GST_FLOW_FLUSHING;
+    if (!gst_vqesrc_check_retune (src))
+      return GST_FLOW_ERROR;
+  }
+  return GST_FLOW_OK;
+}
+
+/* A new SDP while we're started is bound straight away if the streaming
+   thread isn't in create(), as it won't be while we're a live source
+   waiting for PLAYING, so that binding and the RCC burst are under way by
+   the time we get there.  Otherwise the streaming thread, which holds the
+   live lock in create(), does it before its next read, or as soon as it's
+   woken if it's waiting for its first SDP.  tune_lock keeps stop() from
+   destroying the tuner under us. */
+static void
+gst_vqesrc_sdp_changed (GstVQESrc * src)
+{
+  if (!g_mutex_trylock (GST_LIVE_GET_LOCK (src)))
+    return;
+  g_mutex_lock (&src->tune_lock);
+  if (src->tuner_ready)
+    gst_vqesrc_check_retune (src);
+  g_mutex_unlock (&src->tune_lock);
+  GST_LIVE_UNLOCK (src);
+}
+
+/* Reads one of the feeds into the merge until told to stop */
+static gpointer
+gst_vqesrc_feed_thread (GstVQESrcFeed * feed)
+{
+  GstVQESrc *src = feed->src;
+  guint8 datagram[VQEC_MSG_MAX_DATAGRAM_LEN];
+  vqec_iobuf_t iobuf;
+  int32_t len;
+  vqec_error_t err;
+  gboolean warn;
+  guint errors = 0;
+
+  while (!g_atomic_int_get (&src->merge_stop)) {
+    if (feed->path == 0 && G_UNLIKELY (!src->tuned)) {
+      /* no SDP yet; the feeds are stopped and started again around the
+         bind when one comes */
+      GST_OBJECT_LOCK (src);
+      while (!g_atomic_int_get (&src->merge_stop))
+        g_cond_wait (&src->tune_cond, GST_OBJECT_GET_LOCK (src));
+      GST_OBJECT_UNLOCK (src);
+      break;
+    }
+
+    memset (&iobuf, 0, sizeof (iobuf));
+    iobuf.buf_ptr = datagram;
+    iobuf.buf_len = sizeof (datagram);
+    len = 0;
+    err = backend->tuner_recvmsg (feed->tuner, &iobuf, 1, &len,
+        VQEC_MSG_MAX_RECV_TIMEOUT);
+    if (err) {
+      if (errors++ == 0)
+        GST_WARNING_OBJECT (src, "Failed to receive on feed %u: %s",
+            feed->path, vqec_err2str (err));
+      if (errors < FEED_MAX_ERRORS) {
+        g_usleep (VQEC_MSG_MAX_RECV_TIMEOUT * 1000);
+        continue;
+      }
+      /* without the primary there's nothing to merge into; without the
+         backup we carry on as if there were none */
+      if (feed->path == 0)
+        GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL),
+            ("Failed to receive on the primary feed: %s",
+                vqec_err2str (err)));
+      else
+        GST_ELEMENT_WARNING (src, RESOURCE, READ,
+            ("Lost the backup feed"),
+            ("Failed to receive on the backup feed: %s",
+                vqec_err2str (err)));
+      break;
+    }
+    errors = 0;
+    if (len <= 0)
+      continue;
+
+    g_mutex_lock (&src->merge_lock);
+    gst_vqe_merge_push (&src->merge, feed->path, datagram, len,
+        g_get_monotonic_time ());
+    warn = src->merge.paths[feed->path].not_rtp && !src->merge_warned;
+    src->merge_warned |= warn;
+    g_cond_signal (&src->merge_cond);
+    g_mutex_unlock (&src->merge_lock);
+
+    if (G_UNLIKELY (warn))
+      GST_ELEMENT_WARNING (src, STREAM, FAILED,
+          ("Not merging the backup feed"),
+          ("VQE-C strips RTP headers in this process (strip_rtp), which "
+              "merging needs, so only the primary feed is used"));
+  }
+  return NULL;
+}
+
+static void
+gst_vqesrc_feeds_start (GstVQESrc * src)
+{
+  guint i;
+
+  g_atomic_int_set (&src->merge_stop, FALSE);
+  for (i = 0; i < GST_VQE_MERGE_N_PATHS; i++) {
+    GstVQESrcFeed *feed = &src->feeds[i];
+
+    feed->src = src;
+    feed->path = i;
+    feed->tuner = i ? src->backup_tuner : src->tuner;
+    feed->thread = g_thread_new (i ? "vqe-backup-feed" : "vqe-primary-feed",
+        (GThreadFunc) gst_vqesrc_feed_thread, feed);
+  }
+}
+
+/* Must be called without the object lock, as the feed threads may be
+   posting messages */
+static void
+gst_vqesrc_feeds_stop (GstVQESrc * src)
+{
+  guint i;
+
+  /* the primary feed waits on tune_cond until there's an SDP */
+  GST_OBJECT_LOCK (src);
+  g_atomic_int_set (&src->merge_stop, TRUE);
+  g_cond_broadcast (&src->tune_cond);
+  GST_OBJECT_UNLOCK (src);
+  for (i = 0; i < GST_VQE_MERGE_N_PATHS; i++) {
+    g_thread_join (src->feeds[i].thread);
+    src->feeds[i].thread = NULL;
+  }
+}
+
+/* Bind a tuner to the backup feed and start reading both feeds into the
+   merge */
+static gboolean
+gst_vqesrc_merge_start (GstVQESrc * src)
+{
+  char tunerName[64];
+  vqec_chan_cfg_t cfg;
+  vqec_error_t err;
+
+  snprintf (tunerName, sizeof (tunerName), "backup%p", src);
+  err = backend->tuner_create (&src->backup_tuner, tunerName);
+  if (err) {
+    GST_ELEMENT_ERROR (src, RESOURCE, FAILED, (NULL),
+        ("Failed to create backup tuner: %s", vqec_err2str (err)));
+    return FALSE;
+  }
+  if (!gst_vqesrc_bind (src, src->backup_tuner, src->backup_sdp, &cfg)) {
+    backend->tuner_destroy (src->backup_tuner);
+    return FALSE;
+  }
+
+  gst_vqe_merge_init (&src->merge, VQEC_MSG_MAX_DATAGRAM_LEN);
+  src->merge.keep_rtp = src->rtp_output;
+  src->merge_warned = FALSE;
+  gst_vqesrc_feeds_start (src);
+  src->merging = TRUE;
+  return TRUE;
+}
+
+/* Must be called without the object lock, as the feed threads may be
+   posting messages */
+static void
+gst_vqesrc_merge_stop (GstVQESrc * src)
+{
+  if (!src->merging)
+    return;
+
+  gst_vqesrc_feeds_stop (src);
+  backend->tuner_unbind_chan (src->backup_tuner);
+  backend->tuner_destroy (src->backup_tuner);
+
+  g_mutex_lock (&src->merge_lock);
+  src->merging = FALSE;
+  gst_vqe_merge_clear (&src->merge);
+  g_mutex_unlock (&src->merge_lock);
+}
+
+/* Stands in for the tuner's recvmsg while merging: waits up to @timeout
+   milliseconds for the next merged datagram */
+static vqec_error_t
+gst_vqesrc_merge_recv (GstVQESrc * src, vqec_iobuf_t * iobuf, int32_t * len,
+    int32_t timeout)
+{
+  gint64 deadline = g_get_monotonic_time () + timeout * G_GINT64_CONSTANT (1000);
+  gint64 now, wake;
+
+  g_mutex_lock (&src->merge_lock);
+  for (;;) {
+    now = g_get_monotonic_time ();
+    *len = gst_vqe_merge_pop (&src->merge, now,
+        src->merge_delay / GST_USECOND, iobuf->buf_ptr, iobuf->buf_len,
+        &wake);
+    if (*len > 0 || now >= deadline)
+      break;
+    g_cond_wait_until (&src->merge_cond, &src->merge_lock,
+        (wake < 0) ? deadline : MIN (wake, deadline));
+  }
+  g_mutex_unlock (&src->merge_lock);
+  return VQEC_OK;
+}
+
+static GstStructure *
+gst_vqesrc_merge_stats (GstVQESrc * src)
+{
+  static const gchar *names[GST_VQE_MERGE_N_PATHS] = { "primary", "backup" };
+  GstStructure *s = gst_structure_new_empty ("vqe-merge-stats");
+  const gchar *name;
+  gchar *field;
+  guint i;
+
+#define SET_FIELD(suffix, value) G_STMT_START { \
+    field = g_strconcat (name, "-", suffix, NULL); \
+    gst_structure_set (s, field, G_TYPE_UINT64, value, NULL); \
+    g_free (field); \
+  } G_STMT_END
+
+  g_mutex_lock (&src->merge_lock);
+  if (src->merging) {
+    for (i = 0; i < GST_VQE_MERGE_N_PATHS; i++) {
+      GstVQEMergePath *p = &src->merge.paths[i];
+
+      name = names[i];
+      SET_FIELD ("received", p->received);
+      SET_FIELD ("used", p->used);
+      SET_FIELD ("duplicates", p->duplicates);
+      SET_FIELD ("lost", p->lost);
+    }
+    name = "merged";
+    SET_FIELD ("output", src->merge.output);
+    SET_FIELD ("lost", src->merge.lost);
+  }
+  g_mutex_unlock (&src->merge_lock);
+#undef SET_FIELD
+
+  return s;
+}
+
+/* Have gst-vqe-daemon tune to @sdp for us instead of VQE-C in this
+   process, hanging up on it first if it's tuned to something else, as the
+   daemon only binds when we attach. */
+static gboolean
+gst_vqesrc_attach_daemon (GstVQESrc * src, const gchar * sdp)
+{
+  GstVQEIpcClient *daemon;
+  GError *error = NULL;
+
+  GST_OBJECT_LOCK (src);
+  daemon = src->daemon;
+  src->daemon = NULL;
+  GST_OBJECT_UNLOCK (src);
+  if (daemon) {
+    /* buffers still downstream keep their part of the old ring mapped */
+    gst_vqe_ipc_client_close (daemon);
+    gst_vqe_ipc_client_unref (daemon);
+    src->tuned = FALSE;
+  }
+
+  daemon = gst_vqe_ipc_client_connect (src->daemon_socket, sdp,
+      src->compound_buffer_size, daemon_slots, &error);
+  if (!daemon) {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
+        ("Failed to attach to VQE-C daemon at %s: %s", src->daemon_socket,
+            error->message));
+    g_error_free (error);
+    return FALSE;
+  }
+  src->tuned = TRUE;
+
+  GST_OBJECT_LOCK (src);
+  src->daemon = daemon;
+  g_strlcpy (src->stream_uri, gst_vqe_ipc_client_get_stream_uri (src->daemon),
+      sizeof (src->stream_uri));
+  GST_OBJECT_UNLOCK (src);
+  gst_vqesrc_timeline_bound (src);
+  gst_vqesrc_new_channel (src, sdp);
+  return TRUE;
+}
+
 /*
  *  Manage global VQE-C state
  */
 
+static gpointer
+lag_monitor (gpointer data)
+{
+  gint64 expected = g_get_monotonic_time ();
+
+  while (!g_atomic_int_get (&lag_monitor_stop)) {
+    gint64 now;
+
+    expected += LAG_MONITOR_INTERVAL_US;
+    now = g_get_monotonic_time ();
+    if (expected > now)
+      g_usleep (expected - now);
+    now = g_get_monotonic_time ();
+
+    g_mutex_lock (&lag_mutex);
+    gst_vqe_histogram_add (&lag_histogram, MAX (now - expected, 0));
+    g_mutex_unlock (&lag_mutex);
+
+    /* after a long stall measure from now rather than firing a burst of
+       catch-up samples which would all look late */
+    if (now - expected > LAG_MONITOR_INTERVAL_US)
+      expected = now;
+  }
+  return NULL;
+}
+
 static void
 vqe_worker(void)
 {
-  vqec_ifclient_start();
+  /* Started from the worker so that it inherits its scheduling policy and
+     priority, and competes for the CPU as VQE-C does */
+  g_atomic_int_set (&lag_monitor_stop, FALSE);
+  lag_monitor_thread = g_thread_new ("vqe-lag-monitor", lag_monitor, NULL);
+
+  backend->start();
+
+  g_atomic_int_set (&lag_monitor_stop, TRUE);
+  g_thread_join (lag_monitor_thread);
+  lag_monitor_thread = NULL;
+}
+
+/* VQE-C is only initialised in processes which tune in-process, the first
+   time one does so, rather than in every process that loads the plugin.
+   There's no deinitialising it, so it stays up from then on. */
+static gboolean
+init_vqec(void)
+{
+  static gsize initialised = 0;
+  static vqec_error_t err = VQEC_OK;
+
+  if (g_once_init_enter (&initialised)) {
+    GST_INFO ("VQEC: initialising with config file: %s", vqec_config_path);
+    err = backend->init (vqec_config_path);
+    if (err == VQEC_OK)
+      g_atomic_int_set (&vqec_ready, TRUE);
+    g_once_init_leave (&initialised, 1);
+  }
+  return err == VQEC_OK;
+}
+
+/* Whether there's an in-process VQE-C to ask for stats.  Through a daemon
+   there never is. */
+static gboolean
+gst_vqesrc_has_vqec (GstVQESrc * src)
+{
+  return g_atomic_int_get (&vqec_ready) &&
+      !(src->daemon_socket && src->daemon_socket[0]);
 }
 
 static void
@@ -982,7 +4306,7 @@ destroy_worker(void)
   
   if ( vqe_owner_refcount == 1 ) {
     gst_task_stop(vqe_owner_task);
-    vqec_ifclient_stop();
+    backend->stop();
     gst_task_join(vqe_owner_task);
     g_object_unref(vqe_owner_task);
     vqe_owner_task = NULL;
@@ -1000,36 +4324,157 @@ gst_vqesrc_start (GstBaseSrc * bsrc)
   GstVQESrc *src;
   vqec_error_t err = 0;
   char tunerName[64];
-  GstAllocationParams allocParams;
 
   src = GST_VQESRC (bsrc);
+  gst_vqesrc_timeline_reset (src);
 
-  GstStructure* config = gst_buffer_pool_get_config (src->bufferPool);
-  gst_buffer_pool_config_set_params ( config, 
-    gst_static_pad_template_get_caps(&src_template),  
-    src->compound_buffer_size, min_buffers, max_buffers);
-  gst_allocation_params_init (&allocParams);
-  gst_buffer_pool_config_set_allocator (config,NULL, &allocParams);
-  gst_buffer_pool_set_config (src->bufferPool, config);
-  gst_buffer_pool_set_active(src->bufferPool,TRUE);
+  /* We start off with buffer-size and, if buffer-duration is set, adapt
+     from there once we know the bitrate. */
+  GST_OBJECT_LOCK (src);
+  src->current_buffer_size = src->compound_buffer_size;
+  src->compound_limit = src->compound_buffer_size - VQEC_MSG_MAX_DATAGRAM_LEN;
+  src->pool_buffer_size = src->compound_buffer_size;
+  src->datagram_size = default_datagram_size;
+  src->current_list_buffers = src->list_buffers;
+  src->current_list_latency = src->list_latency;
+  GST_OBJECT_UNLOCK (src);
+  gst_vqesrc_configure_pool (src, src->bufferPool, src->pool_buffer_size);
+
+  /* we're about to bind with the current settings anyway */
+  g_atomic_int_set (&src->retune_pending, FALSE);
+  g_atomic_int_set (&src->loss_pending, FALSE);
+
+  src->track_pcr = src->provide_clock || src->do_pcr_timestamp;
+  gst_base_src_set_do_timestamp (bsrc, !src->do_pcr_timestamp);
+  src->pcr_anchor_base_time = GST_CLOCK_TIME_NONE;
+
+  GST_OBJECT_LOCK (src);
+  gst_vqe_timeshift_free (&src->timeshift);
+  gst_vqe_timeshift_init (&src->timeshift, src->timeshift_duration,
+      MIN (src->timeshift_max_bytes, G_MAXSIZE));
+  src->rtp_output = (src->output == GST_VQESRC_OUTPUT_RTP);
+  gst_vqe_histogram_reset (&src->list_sizes);
+  src->list_deadlines = 0;
+  src->timeshifting = src->timeshift_duration > 0 && !src->rtp_output;
+  if (src->timeshifting && src->timeshift_location &&
+      src->timeshift_location[0]) {
+    GError *error = NULL;
+
+    if (!gst_vqe_timeshift_use_files (&src->timeshift,
+            src->timeshift_location, &error)) {
+      GST_OBJECT_UNLOCK (src);
+      GST_ELEMENT_ERROR (src, RESOURCE, OPEN_WRITE, (NULL),
+          ("Can't keep timeshift in %s: %s", src->timeshift_location,
+              error->message));
+      g_error_free (error);
+      return FALSE;
+    }
+  }
+  GST_OBJECT_UNLOCK (src);
+
+  if (src->rtp_output) {
+#if !GST_CHECK_VERSION(1,14,0)
+    GST_ELEMENT_ERROR (src, CORE, NOT_IMPLEMENTED, (NULL),
+        ("RTP output needs GStreamer 1.14 or later"));
+    return FALSE;
+#endif
+    if (src->daemon_socket && src->daemon_socket[0]) {
+      GST_ELEMENT_ERROR (src, CORE, NOT_IMPLEMENTED, (NULL),
+          ("RTP output isn't available through a daemon"));
+      return FALSE;
+    }
+    if (src->fast_start || src->psi_cache || src->timeshift_duration > 0)
+      GST_WARNING_OBJECT (src, "Ignoring fast-start, psi-cache and "
+          "timeshift-duration, which need TS output");
+    src->rtp_seq = g_random_int ();
+    src->rtp_base = g_random_int ();
+  }
+
+  {
+    guint jitter_buff_size = VQEC_DEFAULT_JITTER_BUFF_SIZE_MS;
+    guint rcc_max_fill = VQEC_DEFAULT_RCC_MAX_FILL_MS;
+
+    gst_vqe_cfg_get_uint (vqec_config_path, "jitter_buff_size",
+        &jitter_buff_size);
+    gst_vqe_cfg_get_uint (vqec_config_path, "rcc_max_fill", &rcc_max_fill);
+    GST_OBJECT_LOCK (src);
+    src->vqec_jitter = jitter_buff_size * GST_MSECOND;
+    src->vqec_rcc_fill = rcc_max_fill * GST_MSECOND;
+    /* until a channel is bound and tells us about FEC and RCC */
+    src->vqec_latency = src->vqec_jitter;
+    GST_OBJECT_UNLOCK (src);
+  }
+
+  if (src->daemon_socket && src->daemon_socket[0]) {
+    if (src->backup_sdp && src->backup_sdp[0])
+      GST_WARNING_OBJECT (src, "Ignoring backup-sdp, as merging feeds isn't "
+          "available through a daemon");
+    if (src->timeshifting)
+      GST_WARNING_OBJECT (src, "Ignoring timeshift-duration, as timeshift "
+          "isn't available through a daemon");
+    src->timeshifting = FALSE;
+    /* the daemon's slots are fixed at buffer-size, so there's no adapting
+       the buffer size.  As in-process, without an SDP yet create() waits
+       for one before attaching. */
+    src->use_daemon = TRUE;
+    src->tuned = FALSE;
+    if (src->sdp && src->sdp[0]) {
+      if (!gst_vqesrc_attach_daemon (src, src->sdp))
+        return FALSE;
+    } else {
+      GST_INFO_OBJECT (src, "No SDP yet, attaching once there is one");
+      src->timeline_pending = FALSE;
+    }
+    g_mutex_lock (&src->tune_lock);
+    src->tuner_ready = TRUE;
+    g_mutex_unlock (&src->tune_lock);
+    return TRUE;
+  }
+
+  if (!init_vqec ()) {
+    GST_ELEMENT_ERROR (src, LIBRARY, INIT, (NULL),
+        ("Failed to initialise VQE-C with %s", vqec_config_path));
+    return FALSE;
+  }
 
   /* Create unique tuner name. 
     Unique at least in this process, which is what we care about. */
 
   snprintf( tunerName, sizeof(tunerName), "tuner%p", src );
-  err = vqec_ifclient_tuner_create(&src->tuner, tunerName );
+  err = backend->tuner_create(&src->tuner, tunerName );
   if (err) {
-    GST_INFO(stderr, "Failed to create tuner: %s\n", vqec_err2str(err));
+    GST_ERROR_OBJECT (src, "Failed to create tuner: %s", vqec_err2str (err));
+    GST_ELEMENT_ERROR (src, RESOURCE, FAILED, (NULL),
+        ("Failed to create tuner: %s", vqec_err2str (err)));
     goto err;
   }
-  gst_vqesrc_tune(src, src->sdp);
+  gst_vqesrc_timeline_mark (src, GST_VQESRC_PHASE_TUNER_CREATED);
+  src->tuned = FALSE;
+  if (src->sdp && src->sdp[0]) {
+    gst_vqesrc_tune(src, src->sdp);
+  } else {
+    /* e.g. in vqesdpdemux, which starts us before its SDP has arrived; the
+       timeline starts over when it does */
+    GST_INFO_OBJECT (src, "No SDP yet, tuning once there is one");
+    src->timeline_pending = FALSE;
+  }
+  if (src->backup_sdp && src->backup_sdp[0] && !gst_vqesrc_merge_start (src))
+    goto task_error;
+  /* size buffers from the SDP's idea of the bitrate until we've measured it */
+  gst_vqesrc_adapt_buffer_size (src);
 
   setup_worker();
 
+  g_mutex_lock (&src->tune_lock);
+  src->tuner_ready = TRUE;
+  g_mutex_unlock (&src->tune_lock);
+
   return TRUE;
 
 task_error:
-  vqec_ifclient_tuner_destroy(src->tuner);
+  if (src->tuned)
+    backend->tuner_unbind_chan (src->tuner);
+  backend->tuner_destroy(src->tuner);
 err:
   return FALSE;
 }
@@ -1040,24 +4485,83 @@ gst_vqesrc_unlock (GstBaseSrc * bsrc)
   GstVQESrc *src;
 
   src = GST_VQESRC (bsrc);
+  GST_OBJECT_LOCK (src);
+  g_atomic_int_set (&src->flushing, TRUE);
+  g_cond_broadcast (&src->tune_cond);
+  GST_OBJECT_UNLOCK (src);
 
   return TRUE;
 }
 
+static gboolean
+gst_vqesrc_unlock_stop (GstBaseSrc * bsrc)
+{
+  g_atomic_int_set (&GST_VQESRC (bsrc)->flushing, FALSE);
+  return TRUE;
+}
+
 static gboolean
 gst_vqesrc_stop (GstBaseSrc * bsrc)
 {
   GstVQESrc *src = GST_VQESRC (bsrc);
+  GstVQEIpcClient *daemon;
+  gboolean use_daemon;
+  GstVQETimeshift timeshift;
 
-  /* attempt to shutdown vqe worker thread
-    this is a global refcounted resource  */
-  
+  /* once any bind sdp_changed() has under way is done, it leaves the tuner
+     to us */
+  g_mutex_lock (&src->tune_lock);
+  src->tuner_ready = FALSE;
+  g_mutex_unlock (&src->tune_lock);
+
+  /* a zap away before we've seen everything still gets reported */
+  if (src->timeline_pending)
+    gst_vqesrc_timeline_post (src);
+
+  gst_vqesrc_merge_stop (src);
+
+  /* Only what we're letting go of is taken under the lock.  Tearing it
+     down takes VQE-C's global lock, talks to the daemon and deletes
+     segment files, none of which should hold up get_property. */
   GST_OBJECT_LOCK (src);
-  destroy_worker();  
-  vqec_ifclient_tuner_unbind_chan(src->tuner);
-  vqec_ifclient_tuner_destroy(src->tuner);
+  use_daemon = src->use_daemon;
+  daemon = src->daemon;
+  src->daemon = NULL;
+  src->use_daemon = FALSE;
+  timeshift = src->timeshift;
+  gst_vqe_timeshift_init (&src->timeshift, timeshift.duration,
+      timeshift.max_bytes);
+  {
+    guint allocations, misses, discards;
+
+    gst_vqesrc_get_pool_stats_unlocked (src, &allocations, &misses, &discards);
+    GST_INFO_OBJECT (src, "Buffer pool: %u allocations, %u misses, %u discards",
+        allocations, misses, discards);
+    if (src->allocator)
+      GST_INFO_OBJECT (src, "%u allocations fell back to system memory",
+          gst_vqesrc_get_allocator_fallbacks_unlocked (src));
+  }
   GST_OBJECT_UNLOCK (src);
 
+  if (use_daemon) {
+    /* the daemon unbinds when we hang up; buffers still downstream keep
+       their part of the ring mapped */
+    if (daemon) {
+      gst_vqe_ipc_client_close (daemon);
+      gst_vqe_ipc_client_unref (daemon);
+    }
+  } else {
+    /* attempt to shutdown vqe worker thread
+      this is a global refcounted resource  */
+    destroy_worker();  
+    backend->tuner_unbind_chan(src->tuner);
+    backend->tuner_destroy(src->tuner);
+  }
+  /* buffers played back from the window keep what they refer to */
+  gst_vqe_timeshift_free (&timeshift);
+
+  gst_buffer_pool_set_active (src->bufferPool, FALSE);
+
   /* sadly we have to leak global context of vqec
      vqec_ifclient_deinit(); */
 
@@ -30,6 +30,13 @@
 #include <vqec_ifclient.h>
 #include <vqec_ifclient_read.h>
 
+#include "gstvqets.h"
+#include "gstvqeallocator.h"
+#include "gstvqeipc.h"
+#include "gstvqehistogram.h"
+#include "gstvqemerge.h"
+#include "gstvqetimeshift.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_VQESRC \
@@ -47,23 +54,254 @@ G_BEGIN_DECLS
 typedef struct _GstVQESrc GstVQESrc;
 typedef struct _GstVQESrcClass GstVQESrcClass;
 
+/* Where one packet went in what output rtp received into */
+typedef struct {
+  gsize offset;
+  gsize size;
+  GstClockTime dts;
+} GstVQESrcPacket;
+
+/* One of the feeds being merged, read by its own thread */
+typedef struct {
+  GstVQESrc *src;
+  guint path;
+  vqec_tunerid_t tuner;
+  GThread *thread;
+} GstVQESrcFeed;
+
+/* What goes out of the src pad */
+typedef enum {
+  GST_VQESRC_OUTPUT_TS,
+  GST_VQESRC_OUTPUT_RTP
+} GstVQESrcOutput;
+
+#define GST_TYPE_VQESRC_OUTPUT (gst_vqesrc_output_get_type ())
+GType gst_vqesrc_output_get_type (void);
+
+/* The phases of a channel change, in the order they usually happen */
+typedef enum {
+  GST_VQESRC_PHASE_START,
+  GST_VQESRC_PHASE_TUNER_CREATED,
+  GST_VQESRC_PHASE_SDP_PARSED,
+  GST_VQESRC_PHASE_BOUND,
+  GST_VQESRC_PHASE_FIRST_DATAGRAM,
+  GST_VQESRC_PHASE_RCC_COMPLETE,
+  GST_VQESRC_PHASE_FIRST_BUFFER,
+  GST_VQESRC_PHASE_FIRST_RAP,
+  GST_VQESRC_N_PHASES
+} GstVQESrcPhase;
+
 struct _GstVQESrc {
   GstPushSrc parent;
 
   /* properties */
   gchar     *sdp;
+  gchar     *backup_sdp;
   gchar     *cfg;
+  gchar     *daemon_socket;
+  GstClockTime merge_delay;
+
+  /* RCC and bandwidth settings applied when binding, on top of the cfg
+     file; each only if it has been set */
+  gboolean rcc, rcc_set;
+  gboolean fastfill, fastfill_set;
+  /* what the tuner was last bound with, whether from these, the cfg file
+     or the SDP */
+  gboolean bound_rcc, bound_fastfill;
+  guint max_receive_bandwidth_rcc;
+  guint max_receive_bandwidth_er;
+
+  /* loss injected on each stream, as gst_vqe_synth_loss_parse() patterns,
+     NULL for none.  Changes while started are handed to the backend by the
+     streaming thread once loss_pending is set, as the backend takes locks
+     of its own which mustn't be taken under the object lock */
+  gchar *primary_loss;
+  gchar *repair_loss;
+  gint loss_pending;
+
+  /* set when the tuner needs binding again, e.g. as cfg has changed, which
+     the streaming thread does before its next read */
+  gint retune_pending;
+  /* the tuner is bound to a channel, which it isn't until we have an SDP.
+     Until then create() waits on tune_cond, with the object lock, for a
+     new SDP or unlock(), as does the primary feed thread for merge_stop */
+  gboolean tuned;
+  GCond tune_cond;
+  /* held by sdp_changed() while binding from outside the streaming thread
+     and by stop() while tearing the tuner down; tuner_ready is set, under
+     it, from the end of start() until stop() */
+  GMutex tune_lock;
+  gboolean tuner_ready;
+
+  /* set instead of tuner when gst-vqe-daemon does the receiving, from when
+     there's an SDP to attach with; use_daemon is set by start() */
+  gboolean use_daemon;
+  GstVQEIpcClient *daemon;
+
+  /* with a backup feed both tuners are read by feed threads into merge,
+     under merge_lock, and create() takes from there */
+  gboolean merging;
+  vqec_tunerid_t backup_tuner;
+  GstVQESrcFeed feeds[GST_VQE_MERGE_N_PATHS];
+  gint merge_stop;
+  GMutex merge_lock;
+  GCond merge_cond;
+  GstVQEMerge merge;
+  gboolean merge_warned;
+
+  /* with timeshift-duration set, what we output is also kept in timeshift,
+     under the object lock, so we can seek back into it.  Its times are
+     since the channel was tuned, following the PCRs of the stream from the
+     last one seen, timeshift_pcr, which was at timeshift_pcr_time and seen
+     at timeshift_pcr_seen by the capture clock; timeshift_time is the
+     newest given out. */
+  GstClockTime timeshift_duration;
+  guint64 timeshift_max_bytes;
+  gchar *timeshift_location;
+  gboolean timeshifting;
+  GstVQETimeshift timeshift;
+  guint64 timeshift_pcr;
+  GstClockTime timeshift_pcr_time;
+  GstClockTime timeshift_pcr_seen;
+  GstClockTime timeshift_time;
+  /* while PAUSED the recorder thread reads into timeshift in the streaming
+     thread's place, taking the live lock as create() has it, with
+     recording set so that nothing is played back */
+  GThread *recorder;
+  gint recorder_stop;
+  gboolean recording;
+
+  /* with output rtp each datagram goes out as a buffer of its own, in a
+     list, keeping its RTP header or, where VQE-C has stripped it, with one
+     of ours */
+  GstVQESrcOutput output;
+  gboolean rtp_output;          /* output was rtp as of start */
+  guint16 rtp_seq;
+  guint32 rtp_ssrc;
+  guint32 rtp_base;
+  GArray *rtp_packets;          /* of GstVQESrcPacket, reused each create() */
+  /* set between unlock and unlock_stop */
+  gint flushing;
+
+  /* TS output gathered into lists of up to list_buffers, the first held no
+     longer than list_latency, as they were on start; the sizes of those
+     pushed, and how many the deadline cut short, under the object lock */
+  guint list_buffers;
+  GstClockTime list_latency;
+  guint current_list_buffers;
+  GstClockTime current_list_latency;
+  GstVQEHistogram list_sizes;
+  guint64 list_deadlines;
 
   /* VQE resources */
   
   vqec_tunerid_t tuner;
   vqec_ifclient_tr135_params_t tr135_params;
   GstBufferPool* bufferPool;
+  /* allocation counters of pools we've since replaced */
+  guint retired_pool_allocations;
+  guint retired_pool_misses;
+  guint retired_pool_discards;
+  guint retired_allocator_fallbacks;
+  /* where pool buffers come from: the backing asked for and the allocator
+     actually in use, NULL meaning system memory */
+  GstVQEAllocatorBacking allocator_backing;
+  GstAllocator *allocator;
 
   uint32_t compound_buffer_size;
 
-  /* parsed stream uri used for stats queries */
+  /* bitrate-adaptive buffer sizing: buffer_duration of 0 means use
+     compound_buffer_size as is */
+  GstClockTime buffer_duration;
+  uint32_t current_buffer_size;     /* bytes we aim to put in each buffer  */
+  uint32_t compound_limit;          /* read again while we have <= this    */
+  uint32_t pool_buffer_size;
+  uint32_t datagram_size;
+
+  /* parsed stream uri used for stats queries; written under the object lock
+     by whichever thread is binding, which can read it without */
   char stream_uri[128];
+
+  /* fast-start: hold output back until the first random access point */
+  gboolean fast_start;
+  gboolean fast_start_pending;
+  GstVQETSScanner scanner;
+  GstClockTime tune_time;
+  guint64 fast_start_bytes_skipped;
+  GstClockTime fast_start_time_to_rap;
+
+  /* PAT/PMT remembered from the last time this channel was tuned */
+  gboolean psi_cache;
+  gboolean psi_scan_pending;
+  gboolean psi_inject_pending;
+  gboolean have_cached_psi;
+  GstVQETSPacketFlags psi_seen;
+  guint8 cached_pat[GST_VQE_TS_PACKET_SIZE];
+  guint8 cached_pmt[GST_VQE_TS_PACKET_SIZE];
+  guint64 psi_cache_mismatches;
+  /* cached tables go out with whatever continuity counters they had, so the
+     first live PAT and PMT after them are marked discontinuous */
+  guint16 psi_discont_pid[2];
+  gboolean psi_discont_pending;
+
+  /* clock recovered from the PCRs of the stream */
+  GstClock *pcr_clock;
+  gboolean provide_clock;
+  gboolean do_pcr_timestamp;
+  gboolean track_pcr;
+  guint64 last_pcr;
+  GstClockTime pcr_time;
+  /* the PCR clock and pipeline clock times at which they were lined up for
+     do-pcr-timestamp, when they aren't one and the same, and the base_time
+     then */
+  GstClockTime pcr_anchor;
+  GstClockTime pcr_anchor_pipeline;
+  GstClockTime pcr_anchor_base_time;
+
+  /* channel change timeline, in gst_util_get_timestamp() time; posted as a
+     message once complete */
+  GstClockTime timeline[GST_VQESRC_N_PHASES];
+  gboolean timeline_pending;
+  gboolean rcc_resolved;        /* RCC_COMPLETE happened or never will */
+  gboolean rcc_burst;
+  guint64 timeline_primary_inputs;
+  guint64 timeline_repair_inputs;
+
+  /* distributions for the current channel, under the object lock:
+     datagram inter-arrival time at the output of VQE-C and repair round
+     trip in microseconds, and loss burst length in packets.  The last two
+     are derived from VQE-C's counters, sampled every HISTOGRAM_SAMPLE, so
+     hold the mean burst of each sample and round trips to the nearest
+     sample. */
+  GstVQEHistogram interarrival;
+  GstVQEHistogram loss_burst;
+  GstVQEHistogram repair_rtt;
+  /* inter-arrival times gathered without the lock during a create(), and
+     added to interarrival at the end of it */
+  GstVQEHistogram interarrival_pending;
+  gint64 last_arrival;
+  GstClockTime histogram_sample_time;
+  guint64 sampled_losses;
+  guint64 sampled_loss_events;
+  guint64 sampled_repairs_requested;
+  guint64 sampled_repair_inputs;
+  GstClockTime repair_request_time;  /* oldest unanswered repair request */
+
+  /* what went into the buffer being pushed, measured only while vqetracer
+     is loaded; read by it from the pad-push hook in the streaming thread */
+  GstClockTime probe_recv_time;     /* blocked in recvmsg */
+  GstClockTime probe_acquire_time;  /* waiting for the buffer pool */
+  guint probe_datagrams;
+  gboolean probe_idle;              /* nothing arrived before the timeout */
+
+  /* latency reporting */
+  GstClockTime vqec_jitter;         /* VQE-C's global jitter buffer depth */
+  GstClockTime vqec_rcc_fill;       /* most RCC fills the buffer beyond it */
+  GstClockTime vqec_latency;        /* what VQE-C holds back on this channel */
+  guint64 bitrate;
+  guint64 bitrate_bytes;
+  GstClockTime bitrate_window_start;
+  GstClockTime reported_latency;
 };
 
 struct _GstVQESrcClass {
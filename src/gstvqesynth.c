@@ -0,0 +1,368 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqesynth.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define TS_PACKET_SIZE 188
+#define PROBE_MAGIC "VQESYNTH"
+
+static guint32
+crc32_mpeg (const guint8 * data, gsize size)
+{
+  guint32 crc = 0xffffffff;
+  gsize i;
+  gint bit;
+
+  for (i = 0; i < size; i++) {
+    crc ^= (guint32) data[i] << 24;
+    for (bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+  }
+  return crc;
+}
+
+static void
+write_be32 (guint8 * p, guint32 v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static guint32
+read_be32 (const guint8 * p)
+{
+  return ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* afc: 1 payload only, 3 adaptation field and payload */
+static void
+write_header (guint8 * pkt, guint16 pid, gboolean pusi, guint afc,
+    guint8 * cc)
+{
+  pkt[0] = 0x47;
+  pkt[1] = (pusi ? 0x40 : 0) | ((pid >> 8) & 0x1f);
+  pkt[2] = pid & 0xff;
+  pkt[3] = (afc << 4) | (*cc & 0xf);
+  *cc = (*cc + 1) & 0xf;
+}
+
+/* A single section starting straight after the header, stuffed to the end
+   of the packet */
+static void
+write_section (guint8 * pkt, const guint8 * section, gsize size)
+{
+  guint32 crc = crc32_mpeg (section, size);
+
+  pkt[4] = 0;                   /* pointer_field */
+  memcpy (&pkt[5], section, size);
+  write_be32 (&pkt[5 + size], crc);
+  memset (&pkt[9 + size], 0xff, TS_PACKET_SIZE - 9 - size);
+}
+
+static void
+write_pat (GstVQESynthStream * stream, guint8 * pkt)
+{
+  const guint8 section[] = {
+    0x00, 0xb0, 13,             /* table_id, section_length */
+    0x00, 0x01,                 /* transport_stream_id */
+    0xc1, 0x00, 0x00,           /* version 0, current, section 0 of 0 */
+    0x00, 0x01,                 /* program 1 ... */
+    0xe0 | (GST_VQE_SYNTH_PID_PMT >> 8), GST_VQE_SYNTH_PID_PMT & 0xff
+  };
+
+  write_header (pkt, 0, TRUE, 1, &stream->cc_pat);
+  write_section (pkt, section, sizeof (section));
+}
+
+static void
+write_pmt (GstVQESynthStream * stream, guint8 * pkt)
+{
+  const guint8 section[] = {
+    0x02, 0xb0, 18,             /* table_id, section_length */
+    0x00, 0x01,                 /* program_number */
+    0xc1, 0x00, 0x00,
+    0xe0 | (GST_VQE_SYNTH_PID_VIDEO >> 8), GST_VQE_SYNTH_PID_VIDEO & 0xff,
+    0xf0, 0x00,                 /* program_info_length */
+    0x1b,                       /* H.264 ... */
+    0xe0 | (GST_VQE_SYNTH_PID_VIDEO >> 8), GST_VQE_SYNTH_PID_VIDEO & 0xff,
+    0xf0, 0x00
+  };
+
+  write_header (pkt, GST_VQE_SYNTH_PID_PMT, TRUE, 1, &stream->cc_pmt);
+  write_section (pkt, section, sizeof (section));
+}
+
+/* The first video packet of each datagram carries a PCR and, at a random
+   access point, starts a PES packet with an SPS and IDR slice. */
+static void
+write_video (GstVQESynthStream * stream, guint8 * pkt, gint64 time,
+    gboolean first, gboolean rap)
+{
+  static const guint8 keyframe[] = {
+    0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1e,
+    0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84
+  };
+  guint8 *payload = &pkt[4];
+
+  if (!first) {
+    write_header (pkt, GST_VQE_SYNTH_PID_VIDEO, FALSE, 1, &stream->cc_video);
+  } else {
+    guint64 pcr = (guint64) time * 27;
+    guint64 base = pcr / 300;
+    guint ext = pcr % 300;
+
+    write_header (pkt, GST_VQE_SYNTH_PID_VIDEO, rap, 3, &stream->cc_video);
+    pkt[4] = 7;                 /* adaptation_field_length */
+    pkt[5] = 0x10 | (rap ? 0x40 : 0);   /* PCR, random_access_indicator */
+    pkt[6] = base >> 25;
+    pkt[7] = base >> 17;
+    pkt[8] = base >> 9;
+    pkt[9] = base >> 1;
+    pkt[10] = ((base & 1) << 7) | 0x7e | (ext >> 8);
+    pkt[11] = ext & 0xff;
+    payload = &pkt[12];
+    if (rap) {
+      memcpy (payload, keyframe, sizeof (keyframe));
+      payload += sizeof (keyframe);
+    }
+  }
+  memset (payload, 0xa5, &pkt[TS_PACKET_SIZE] - payload);
+}
+
+static void
+write_probe (GstVQESynthStream * stream, guint8 * pkt, gint64 time)
+{
+  write_header (pkt, GST_VQE_SYNTH_PID_PROBE, FALSE, 1, &stream->cc_probe);
+  memcpy (&pkt[4], PROBE_MAGIC, 8);
+  write_be32 (&pkt[12], stream->channel);
+  write_be32 (&pkt[16], (guint32) stream->datagrams);
+  write_be32 (&pkt[20], (guint64) time >> 32);
+  write_be32 (&pkt[24], (guint64) time & 0xffffffff);
+  memset (&pkt[28], 0xff, TS_PACKET_SIZE - 28);
+}
+
+void
+gst_vqe_synth_stream_init (GstVQESynthStream * stream, guint32 channel,
+    guint64 bitrate, guint rap_interval_ms, gint64 start)
+{
+  memset (stream, 0, sizeof (*stream));
+  stream->channel = channel;
+  stream->bitrate = MAX (bitrate, 8 * GST_VQE_SYNTH_DATAGRAM_SIZE);
+  stream->rap_interval = MAX ((guint64) rap_interval_ms * stream->bitrate /
+      (1000 * 8 * GST_VQE_SYNTH_DATAGRAM_SIZE), 1);
+  stream->ssrc = 0x56510000 | (channel & 0xffff);
+  stream->start = start;
+}
+
+/* When the next datagram should go out */
+gint64
+gst_vqe_synth_stream_due (const GstVQESynthStream * stream)
+{
+  return stream->start + (gint64) ((gdouble) stream->datagrams *
+      (8.0 * GST_VQE_SYNTH_DATAGRAM_SIZE * G_USEC_PER_SEC) / stream->bitrate);
+}
+
+/* Writes the next datagram, with an RTP header if asked for, to @data which
+   must have room for GST_VQE_SYNTH_RTP_HEADER_SIZE +
+   GST_VQE_SYNTH_DATAGRAM_SIZE bytes.  Returns its size. */
+gsize
+gst_vqe_synth_stream_next (GstVQESynthStream * stream, guint8 * data,
+    gboolean rtp)
+{
+  gint64 time = gst_vqe_synth_stream_due (stream);
+  gboolean rap = stream->datagrams % stream->rap_interval == 0;
+  guint8 *pkt = data;
+  guint i = 0;
+
+  if (rtp) {
+    guint32 ts = (guint32) ((guint64) (time - stream->start) * 9 / 100);
+
+    pkt[0] = 0x80;
+    pkt[1] = GST_VQE_SYNTH_RTP_PT;
+    pkt[2] = (stream->datagrams >> 8) & 0xff;
+    pkt[3] = stream->datagrams & 0xff;
+    write_be32 (&pkt[4], ts);
+    write_be32 (&pkt[8], stream->ssrc);
+    pkt += GST_VQE_SYNTH_RTP_HEADER_SIZE;
+  }
+
+  if (rap) {
+    write_pat (stream, pkt);
+    write_pmt (stream, pkt + TS_PACKET_SIZE);
+    i = 2;
+  }
+  for (; i < GST_VQE_SYNTH_TS_PER_DATAGRAM - 1; i++)
+    write_video (stream, pkt + i * TS_PACKET_SIZE, time,
+        i == 0 || (rap && i == 2), rap);
+  write_probe (stream, pkt + i * TS_PACKET_SIZE, time);
+
+  stream->datagrams++;
+  return (rtp ? GST_VQE_SYNTH_RTP_HEADER_SIZE : 0) +
+      GST_VQE_SYNTH_DATAGRAM_SIZE;
+}
+
+gboolean
+gst_vqe_synth_probe_parse (const guint8 * pkt, GstVQESynthProbe * probe)
+{
+  if (pkt[0] != 0x47 || ((pkt[1] & 0x1f) << 8 | pkt[2]) !=
+      GST_VQE_SYNTH_PID_PROBE || memcmp (&pkt[4], PROBE_MAGIC, 8) != 0)
+    return FALSE;
+
+  probe->channel = read_be32 (&pkt[12]);
+  probe->seq = read_be32 (&pkt[16]);
+  probe->time = (gint64) (((guint64) read_be32 (&pkt[20]) << 32) |
+      read_be32 (&pkt[24]));
+  return TRUE;
+}
+
+/* xorshift: cheap, and the same sequence for the same seed everywhere */
+static gdouble
+loss_random (GstVQESynthLoss * loss)
+{
+  guint32 x = loss->state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  loss->state = x;
+  return (x >> 8) / 16777216.0;
+}
+
+/**
+ * gst_vqe_synth_sdp:
+ *
+ * Returns: the SDP describing the stream of @channel multicast to @group
+ * from @source, with its RTCP on the next port and retransmissions on the
+ * two after that.
+ */
+gchar *
+gst_vqe_synth_sdp (guint channel, const gchar * group, guint port,
+    const gchar * source, guint64 bitrate)
+{
+  /* a VQE channel lineup entry: the multicast primary stream and a unicast
+     retransmission stream from the same host, which is where repair
+     requests go */
+  return g_strdup_printf ("v=0\r\n"
+      "o=- %u 1 IN IP4 %s\r\n"
+      "s=vqe-bench channel %u\r\n"
+      "i=Synthetic stream from vqe-bench-sender\r\n"
+      "c=IN IP4 %s/255\r\n"
+      "t=0 0\r\n"
+      "a=rtcp-unicast:rsi\r\n"
+      "a=group:FID 1 2\r\n"
+      "m=video %u RTP/AVPF %u\r\n"
+      "i=Original Source Stream\r\n"
+      "c=IN IP4 %s/255\r\n"
+      "b=AS:%" G_GUINT64_FORMAT "\r\n"
+      "b=RS:0\r\n"
+      "b=RR:53\r\n"
+      "a=rtpmap:%u MP2T/90000\r\n"
+      "a=rtcp:%u IN IP4 %s\r\n"
+      "a=source-filter: incl IN IP4 %s %s\r\n"
+      "a=rtcp-fb:%u nack\r\n"
+      "a=mid:1\r\n"
+      "m=video %u RTP/AVPF 96\r\n"
+      "i=Unicast Retransmission Stream\r\n"
+      "c=IN IP4 %s\r\n"
+      "b=RS:53\r\n"
+      "b=RR:53\r\n"
+      "a=rtpmap:96 rtx/90000\r\n"
+      "a=fmtp:96 apt=%u\r\n"
+      "a=fmtp:96 rtx-time=3000\r\n"
+      "a=rtcp:%u\r\n"
+      "a=mid:2\r\n",
+      channel + 1, source, channel, group, port, GST_VQE_SYNTH_RTP_PT, group,
+      bitrate / 1000, GST_VQE_SYNTH_RTP_PT, port + 1, source, group, source,
+      GST_VQE_SYNTH_RTP_PT, port + 2, source, GST_VQE_SYNTH_RTP_PT, port + 3);
+}
+
+/**
+ * gst_vqe_synth_loss_parse:
+ *
+ * Parses "none", "uniform:P", "gilbert:P:R" or "periodic:N".
+ */
+gboolean
+gst_vqe_synth_loss_parse (GstVQESynthLoss * loss, const gchar * spec,
+    guint32 seed)
+{
+  gchar **parts;
+  guint n;
+  gboolean ok = TRUE;
+
+  memset (loss, 0, sizeof (*loss));
+  loss->state = seed ? seed : 1;
+  if (!spec || !*spec)
+    return TRUE;
+
+  parts = g_strsplit (spec, ":", 3);
+  n = g_strv_length (parts);
+  if (g_str_equal (parts[0], "none") && n == 1) {
+    loss->type = GST_VQE_SYNTH_LOSS_NONE;
+  } else if (g_str_equal (parts[0], "uniform") && n == 2) {
+    loss->type = GST_VQE_SYNTH_LOSS_UNIFORM;
+    loss->p = g_ascii_strtod (parts[1], NULL);
+  } else if (g_str_equal (parts[0], "gilbert") && n == 3) {
+    loss->type = GST_VQE_SYNTH_LOSS_GILBERT;
+    loss->p = g_ascii_strtod (parts[1], NULL);
+    loss->r = g_ascii_strtod (parts[2], NULL);
+  } else if (g_str_equal (parts[0], "periodic") && n == 2) {
+    loss->type = GST_VQE_SYNTH_LOSS_PERIODIC;
+    loss->period = atoi (parts[1]);
+    ok = loss->period > 0;
+  } else {
+    ok = FALSE;
+  }
+  g_strfreev (parts);
+
+  return ok && loss->p >= 0 && loss->p <= 1 && loss->r >= 0 && loss->r <= 1;
+}
+
+gboolean
+gst_vqe_synth_loss_drop (GstVQESynthLoss * loss)
+{
+  switch (loss->type) {
+    case GST_VQE_SYNTH_LOSS_UNIFORM:
+      return loss_random (loss) < loss->p;
+    case GST_VQE_SYNTH_LOSS_GILBERT:
+      if (loss->bad)
+        loss->bad = loss_random (loss) >= loss->r;
+      else
+        loss->bad = loss_random (loss) < loss->p;
+      return loss->bad;
+    case GST_VQE_SYNTH_LOSS_PERIODIC:
+      return ++loss->n % loss->period == 0;
+    case GST_VQE_SYNTH_LOSS_NONE:
+    default:
+      return FALSE;
+  }
+}
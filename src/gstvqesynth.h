@@ -0,0 +1,108 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_SYNTH_H__
+#define __GST_VQE_SYNTH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A synthetic MPEG-TS over RTP stream for exercising vqesrc without a head
+ * end: PAT, PMT and a video PID carrying PCRs and random access points at a
+ * fixed interval, padded to a constant bitrate.  Each datagram also carries
+ * a probe packet on its own PID with the channel, a sequence number and the
+ * time it was generated so that the receiving end can measure latency and
+ * loss after repair.  Times are g_get_monotonic_time() microseconds, so
+ * latency is only meaningful within one machine.
+ */
+
+#define GST_VQE_SYNTH_TS_PER_DATAGRAM   7
+#define GST_VQE_SYNTH_DATAGRAM_SIZE     (GST_VQE_SYNTH_TS_PER_DATAGRAM * 188)
+#define GST_VQE_SYNTH_RTP_HEADER_SIZE   12
+#define GST_VQE_SYNTH_RTP_PT            33      /* MP2T */
+
+#define GST_VQE_SYNTH_PID_PMT           0x1000
+#define GST_VQE_SYNTH_PID_VIDEO         0x0100
+#define GST_VQE_SYNTH_PID_PROBE         0x1ff0
+
+typedef struct {
+  guint32 channel;
+  guint32 seq;                  /* datagrams generated before this one */
+  gint64 time;                  /* when it was due to be sent */
+} GstVQESynthProbe;
+
+typedef struct {
+  guint32 channel;
+  guint64 bitrate;
+  guint64 rap_interval;         /* datagrams between random access points */
+  guint32 ssrc;
+
+  gint64 start;
+  guint64 datagrams;
+  guint8 cc_pat, cc_pmt, cc_video, cc_probe;
+} GstVQESynthStream;
+
+void     gst_vqe_synth_stream_init  (GstVQESynthStream * stream,
+                                     guint32 channel, guint64 bitrate,
+                                     guint rap_interval_ms, gint64 start);
+gint64   gst_vqe_synth_stream_due   (const GstVQESynthStream * stream);
+gsize    gst_vqe_synth_stream_next  (GstVQESynthStream * stream,
+                                     guint8 * data, gboolean rtp);
+
+gboolean gst_vqe_synth_probe_parse  (const guint8 * pkt,
+                                     GstVQESynthProbe * probe);
+
+gchar   *gst_vqe_synth_sdp          (guint channel, const gchar * group,
+                                     guint port, const gchar * source,
+                                     guint64 bitrate);
+
+/* Which of the generated datagrams to throw away */
+typedef enum {
+  GST_VQE_SYNTH_LOSS_NONE,
+  GST_VQE_SYNTH_LOSS_UNIFORM,   /* each lost with probability p */
+  GST_VQE_SYNTH_LOSS_GILBERT,   /* Gilbert-Elliott: p good->bad, r bad->good,
+                                   all lost while bad */
+  GST_VQE_SYNTH_LOSS_PERIODIC   /* every period'th lost */
+} GstVQESynthLossType;
+
+typedef struct {
+  GstVQESynthLossType type;
+  gdouble p;
+  gdouble r;
+  guint period;
+
+  gboolean bad;
+  guint64 n;
+  guint32 state;
+} GstVQESynthLoss;
+
+gboolean gst_vqe_synth_loss_parse   (GstVQESynthLoss * loss,
+                                     const gchar * spec, guint32 seed);
+gboolean gst_vqe_synth_loss_drop    (GstVQESynthLoss * loss);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_SYNTH_H__ */
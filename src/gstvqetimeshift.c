@@ -0,0 +1,662 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqetimeshift.h"
+
+#include <glib/gstdio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTRY(ts, seq) \
+  (&(ts)->entries[((ts)->first + ((seq) - (ts)->first_seq)) % (ts)->capacity])
+#define RAP(ts, i) \
+  ((ts)->raps[((ts)->raps_first + (i)) % (ts)->raps_capacity])
+
+/* Writes to segment files are of this much at offsets a multiple of it,
+   but for the end of each segment */
+#define STAGE_SIZE (1024 * 1024)
+#define MAX_SEGMENT_SIZE (64 * 1024 * 1024)
+
+struct _GstVQETimeshiftSegment {
+  gint refcount;
+  gint fd;
+  guint8 *map;
+  gsize size;
+  gchar *path;
+};
+
+/* Buffers played back right behind live keep the stage they were served
+   from, so a stage still referred to once it has been written out is
+   replaced rather than reused */
+struct _GstVQETimeshiftStage {
+  gint refcount;
+  guint8 *data;
+};
+
+void
+gst_vqe_timeshift_init (GstVQETimeshift * ts, GstClockTime duration,
+    gsize max_bytes)
+{
+  memset (ts, 0, sizeof (*ts));
+  ts->duration = duration;
+  ts->max_bytes = max_bytes;
+  /* several segments to the window so that not much of it goes at once */
+  ts->segment_size = CLAMP (max_bytes / 8, STAGE_SIZE, MAX_SEGMENT_SIZE);
+  ts->segment_size = (ts->segment_size + STAGE_SIZE - 1) / STAGE_SIZE *
+      STAGE_SIZE;
+}
+
+static GstVQETimeshiftStage *
+stage_new (GError ** error)
+{
+  GstVQETimeshiftStage *stage = g_slice_new0 (GstVQETimeshiftStage);
+
+  if (posix_memalign ((void **) &stage->data, getpagesize (),
+          STAGE_SIZE) != 0) {
+    g_slice_free (GstVQETimeshiftStage, stage);
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+        "Failed to allocate timeshift staging buffer");
+    return NULL;
+  }
+  stage->refcount = 1;
+  return stage;
+}
+
+static GstVQETimeshiftStage *
+stage_ref (GstVQETimeshiftStage * stage)
+{
+  g_atomic_int_inc (&stage->refcount);
+  return stage;
+}
+
+/* Also the destroy notify of buffers played back */
+static void
+stage_unref (GstVQETimeshiftStage * stage)
+{
+  if (!g_atomic_int_dec_and_test (&stage->refcount))
+    return;
+
+  free (stage->data);
+  g_slice_free (GstVQETimeshiftStage, stage);
+}
+
+/**
+ * gst_vqe_timeshift_use_files:
+ *
+ * Keeps the window in segment files in the directory @location rather than
+ * in memory.  Call before anything is appended.
+ */
+gboolean
+gst_vqe_timeshift_use_files (GstVQETimeshift * ts, const gchar * location,
+    GError ** error)
+{
+  if (!g_file_test (location, G_FILE_TEST_IS_DIR)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR,
+        "%s is not a directory", location);
+    return FALSE;
+  }
+  g_free (ts->location);
+  ts->location = g_strdup (location);
+  if (!ts->stage && !(ts->stage = stage_new (error)))
+    return FALSE;
+  return TRUE;
+}
+
+/*
+ *  Segments
+ */
+
+static GstVQETimeshiftSegment *
+segment_new_memory (gsize size, GError ** error)
+{
+  GstVQETimeshiftSegment *seg;
+  guint8 *map;
+
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+        "Failed to allocate %" G_GSIZE_FORMAT " byte timeshift segment: %s",
+        size, g_strerror (errno));
+    return NULL;
+  }
+
+  seg = g_slice_new0 (GstVQETimeshiftSegment);
+  seg->refcount = 1;
+  seg->fd = -1;
+  seg->map = map;
+  seg->size = size;
+  return seg;
+}
+
+static GstVQETimeshiftSegment *
+segment_new (const gchar * location, gsize size, GError ** error)
+{
+  GstVQETimeshiftSegment *seg = g_slice_new0 (GstVQETimeshiftSegment);
+  gint err;
+
+  seg->refcount = 1;
+  seg->fd = -1;
+  seg->size = size;
+  seg->path = g_build_filename (location, "vqe-timeshift-XXXXXX.ts", NULL);
+  seg->fd = g_mkstemp_full (seg->path, O_RDWR | O_CLOEXEC, 0600);
+  if (seg->fd < 0)
+    goto failed;
+
+  /* claim the space now so the streaming thread doesn't find the disk full
+     half way through, and so the blocks are laid out together */
+#ifdef HAVE_POSIX_FALLOCATE
+  err = posix_fallocate (seg->fd, 0, size);
+#else
+  err = ftruncate (seg->fd, size) < 0 ? errno : 0;
+#endif
+  if (err) {
+    errno = err;
+    goto failed;
+  }
+
+  seg->map = mmap (NULL, size, PROT_READ, MAP_SHARED, seg->fd, 0);
+  if (seg->map == MAP_FAILED) {
+    seg->map = NULL;
+    goto failed;
+  }
+  madvise (seg->map, size, MADV_SEQUENTIAL);
+
+  return seg;
+
+failed:
+  err = errno;
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (err),
+      "Failed to create %" G_GSIZE_FORMAT " byte timeshift segment in %s: %s",
+      size, location, g_strerror (err));
+  if (seg->map)
+    munmap (seg->map, size);
+  if (seg->fd >= 0) {
+    close (seg->fd);
+    g_unlink (seg->path);
+  }
+  g_free (seg->path);
+  g_slice_free (GstVQETimeshiftSegment, seg);
+  return NULL;
+}
+
+static GstVQETimeshiftSegment *
+segment_ref (GstVQETimeshiftSegment * seg)
+{
+  g_atomic_int_inc (&seg->refcount);
+  return seg;
+}
+
+/* Also the destroy notify of buffers played back, so may be called from
+   any thread */
+static void
+segment_unref (GstVQETimeshiftSegment * seg)
+{
+  if (!g_atomic_int_dec_and_test (&seg->refcount))
+    return;
+
+  munmap (seg->map, seg->size);
+  if (seg->fd >= 0)
+    close (seg->fd);
+  if (seg->path)
+    g_unlink (seg->path);
+  g_free (seg->path);
+  g_slice_free (GstVQETimeshiftSegment, seg);
+}
+
+static gboolean
+write_all (gint fd, const guint8 * data, gsize size, off_t offset,
+    GError ** error)
+{
+  while (size > 0) {
+    gssize ret = offset < 0 ? write (fd, data, size) :
+        pwrite (fd, data, size, offset);
+
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Failed to write timeshift segment: %s", g_strerror (errno));
+      return FALSE;
+    }
+    data += ret;
+    size -= ret;
+    if (offset >= 0)
+      offset += ret;
+  }
+  return TRUE;
+}
+
+/* Write out whatever is staged but not yet in the file */
+static gboolean
+flush (GstVQETimeshift * ts, GError ** error)
+{
+  gsize done = ts->written - ts->stage_offset;
+
+  if (ts->staged > done &&
+      !write_all (ts->segment->fd, ts->stage->data + done, ts->staged - done,
+          ts->written, error))
+    return FALSE;
+  ts->written = ts->stage_offset + ts->staged;
+  return TRUE;
+}
+
+/* Copy @size bytes into the stage, writing it out each time it fills */
+static gboolean
+stage (GstVQETimeshift * ts, const guint8 * data, gsize size, GError ** error)
+{
+  while (size > 0) {
+    gsize n = MIN (size, STAGE_SIZE - ts->staged);
+
+    memcpy (ts->stage->data + ts->staged, data, n);
+    ts->staged += n;
+    data += n;
+    size -= n;
+    if (ts->staged == STAGE_SIZE) {
+      if (!flush (ts, error))
+        return FALSE;
+      ts->stage_offset += STAGE_SIZE;
+      ts->staged = 0;
+      if (g_atomic_int_get (&ts->stage->refcount) > 1) {
+        GstVQETimeshiftStage *fresh = stage_new (error);
+
+        if (!fresh)
+          return FALSE;
+        stage_unref (ts->stage);
+        ts->stage = fresh;
+      }
+    }
+  }
+  return TRUE;
+}
+
+/* Start writing a new segment with room for at least @size bytes */
+static gboolean
+next_segment (GstVQETimeshift * ts, gsize size, GError ** error)
+{
+  GstVQETimeshiftSegment *seg;
+
+  if (ts->segment) {
+    if (ts->location && !flush (ts, error))
+      return FALSE;
+    /* the rest of it is only needed as long as its entries are */
+    segment_unref (ts->segment);
+    ts->segment = NULL;
+  }
+
+  size = (MAX (size, ts->segment_size) + STAGE_SIZE - 1) / STAGE_SIZE *
+      STAGE_SIZE;
+  seg = ts->location ? segment_new (ts->location, size, error) :
+      segment_new_memory (size, error);
+  if (!seg)
+    return FALSE;
+  ts->segment = seg;
+  ts->stage_offset = ts->staged = ts->written = 0;
+  return TRUE;
+}
+
+/*
+ *  The window
+ */
+
+static void
+entry_release (GstVQETimeshiftEntry * e)
+{
+  segment_unref (e->segment);
+  e->segment = NULL;
+}
+
+/* Lets go of what gst_vqe_timeshift_append() dropped from the window.
+   Like gst_vqe_timeshift_write() it needn't be called with the lock. */
+void
+gst_vqe_timeshift_release (GstVQETimeshift * ts)
+{
+  guint i;
+
+  for (i = 0; i < ts->n_dropped; i++)
+    entry_release (&ts->dropped[i]);
+  ts->n_dropped = 0;
+}
+
+void
+gst_vqe_timeshift_clear (GstVQETimeshift * ts)
+{
+  GstClockTime duration = ts->duration;
+  gsize max_bytes = ts->max_bytes;
+  gchar *location = ts->location;
+  gsize segment_size = ts->segment_size;
+  GstVQETimeshiftStage *stage = ts->stage;
+  guint i;
+
+  for (i = 0; i < ts->length; i++)
+    entry_release (&ts->entries[(ts->first + i) % ts->capacity]);
+  gst_vqe_timeshift_release (ts);
+  if (ts->segment)
+    segment_unref (ts->segment);
+  g_free (ts->entries);
+  g_free (ts->raps);
+  g_free (ts->dropped);
+
+  gst_vqe_timeshift_init (ts, duration, max_bytes);
+  ts->location = location;
+  ts->segment_size = segment_size;
+  ts->stage = stage;
+}
+
+/* Also lets go of the files configuration, for when the window is done
+   with altogether */
+void
+gst_vqe_timeshift_free (GstVQETimeshift * ts)
+{
+  gst_vqe_timeshift_clear (ts);
+  g_free (ts->location);
+  if (ts->stage)
+    stage_unref (ts->stage);
+  gst_vqe_timeshift_init (ts, ts->duration, ts->max_bytes);
+}
+
+/* Rings only grow, doubling, and are unrolled as they do */
+static void
+grow (gpointer * ring, gsize elem_size, guint * capacity, guint * first,
+    guint length)
+{
+  guint new_capacity = MAX (*capacity * 2, 64);
+  guint8 *new_ring = g_malloc (new_capacity * elem_size);
+  guint i;
+
+  for (i = 0; i < length; i++)
+    memcpy (new_ring + i * elem_size,
+        (guint8 *) * ring + ((*first + i) % *capacity) * elem_size, elem_size);
+  g_free (*ring);
+  *ring = new_ring;
+  *capacity = new_capacity;
+  *first = 0;
+}
+
+static void
+drop_oldest (GstVQETimeshift * ts)
+{
+  GstVQETimeshiftEntry *e = &ts->entries[ts->first];
+
+  if (ts->raps_length && RAP (ts, 0) == ts->first_seq) {
+    ts->raps_first = (ts->raps_first + 1) % ts->raps_capacity;
+    ts->raps_length--;
+  }
+  ts->bytes -= e->size;
+  if (ts->n_dropped == ts->dropped_capacity) {
+    ts->dropped_capacity = MAX (ts->dropped_capacity * 2, 16);
+    ts->dropped = g_renew (GstVQETimeshiftEntry, ts->dropped,
+        ts->dropped_capacity);
+  }
+  ts->dropped[ts->n_dropped++] = *e;
+  e->segment = NULL;
+  ts->first = (ts->first + 1) % ts->capacity;
+  ts->length--;
+  ts->first_seq++;
+}
+
+/* Copy @buffer into the current segment, filling in where it went */
+static gboolean
+write_to_segment (GstVQETimeshift * ts, GstVQETimeshiftEntry * e,
+    GstBuffer * buffer, GError ** error)
+{
+  GstMapInfo info;
+  gboolean ret;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+        "Failed to map buffer");
+    return FALSE;
+  }
+
+  if ((!ts->segment ||
+          ts->stage_offset + ts->staged + info.size > ts->segment->size) &&
+      !next_segment (ts, info.size, error)) {
+    gst_buffer_unmap (buffer, &info);
+    return FALSE;
+  }
+
+  e->segment = segment_ref (ts->segment);
+  e->offset = ts->stage_offset + ts->staged;
+  e->size = info.size;
+
+  if (!ts->location) {
+    memcpy (ts->segment->map + e->offset, info.data, info.size);
+    ts->staged += info.size;
+    ts->written = ts->staged;
+    gst_buffer_unmap (buffer, &info);
+    return TRUE;
+  }
+
+  ret = stage (ts, info.data, info.size, error);
+  gst_buffer_unmap (buffer, &info);
+  return ret;
+}
+
+/**
+ * gst_vqe_timeshift_write:
+ *
+ * Fills in @e for @buffer, captured at @time, ready to be appended.  This
+ * is where @buffer is copied into the window, and with files written out,
+ * so it may block on the disk and fails if @buffer can't be written.  Only
+ * touches what belongs to the appending thread, so the lock guarding the
+ * window needn't be held.
+ */
+gboolean
+gst_vqe_timeshift_write (GstVQETimeshift * ts, GstBuffer * buffer,
+    GstClockTime time, gssize rap, GstVQETimeshiftEntry * e, GError ** error)
+{
+  memset (e, 0, sizeof (*e));
+  e->time = time;
+  e->rap = rap;
+  if (!write_to_segment (ts, e, buffer, error)) {
+    if (e->segment)
+      segment_unref (e->segment);
+    e->segment = NULL;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * gst_vqe_timeshift_append:
+ *
+ * Adds @e, from gst_vqe_timeshift_write(), to the newest end of the window
+ * and drops what no longer fits.  Playback which falls out of the window
+ * skips forward to the oldest random access point left.  What's dropped is
+ * only let go of by gst_vqe_timeshift_release(), so that closing and
+ * deleting segment files doesn't happen under the window's lock.
+ */
+void
+gst_vqe_timeshift_append (GstVQETimeshift * ts,
+    const GstVQETimeshiftEntry * e)
+{
+  guint64 seq = ts->first_seq + ts->length;
+  GstClockTime time = e->time;
+
+  if (ts->length == ts->capacity)
+    grow ((gpointer *) & ts->entries, sizeof (GstVQETimeshiftEntry),
+        &ts->capacity, &ts->first, ts->length);
+  *ENTRY (ts, seq) = *e;
+  ts->length++;
+  ts->bytes += e->size;
+
+  if (e->rap >= 0) {
+    if (ts->raps_length == ts->raps_capacity)
+      grow ((gpointer *) & ts->raps, sizeof (guint64), &ts->raps_capacity,
+          &ts->raps_first, ts->raps_length);
+    RAP (ts, ts->raps_length) = seq;
+    ts->raps_length++;
+  }
+
+  /* always keep the newest, whatever its size */
+  while (ts->length > 1 && (ts->bytes > ts->max_bytes ||
+          time - ts->entries[ts->first].time > ts->duration))
+    drop_oldest (ts);
+
+  if (ts->reading && ts->read_seq < ts->first_seq) {
+    if (ts->raps_length) {
+      ts->read_seq = RAP (ts, 0);
+      ts->read_rap = ENTRY (ts, ts->read_seq)->rap;
+    } else {
+      ts->reading = FALSE;
+    }
+  }
+}
+
+/**
+ * gst_vqe_timeshift_seek:
+ *
+ * Starts playback from the last random access point at or before @time, or
+ * the first there is if @time is older than that, giving the time it
+ * actually starts from in @start.  Returns FALSE, going back to live, if
+ * @time is newer than anything in the window or there's nowhere to start
+ * from.
+ */
+gboolean
+gst_vqe_timeshift_seek (GstVQETimeshift * ts, GstClockTime time,
+    GstClockTime * start)
+{
+  guint lo = 0, hi = ts->raps_length;
+
+  ts->reading = FALSE;
+  if (!ts->raps_length || !ts->length ||
+      time > ENTRY (ts, ts->first_seq + ts->length - 1)->time)
+    return FALSE;
+
+  /* the first index entry after time */
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (ENTRY (ts, RAP (ts, mid))->time <= time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  ts->read_seq = RAP (ts, lo ? lo - 1 : 0);
+  ts->read_rap = ENTRY (ts, ts->read_seq)->rap;
+  ts->reading = TRUE;
+  *start = ENTRY (ts, ts->read_seq)->time;
+  return TRUE;
+}
+
+/**
+ * gst_vqe_timeshift_hold:
+ *
+ * Has playback carry on from the next buffer appended rather than from
+ * live, so that what's appended while paused is played back afterwards.
+ * Does nothing if playback is already behind live.
+ */
+void
+gst_vqe_timeshift_hold (GstVQETimeshift * ts)
+{
+  if (ts->reading)
+    return;
+  ts->read_seq = ts->first_seq + ts->length;
+  ts->read_rap = -1;
+  ts->reading = TRUE;
+}
+
+/**
+ * gst_vqe_timeshift_next:
+ *
+ * Returns: a reference to the next buffer to play back, or NULL once
+ * playback has caught up with live.  If playback starts or jumps to this
+ * buffer @rap is the offset of the random access point to start from,
+ * otherwise -1.  The buffer wraps the segment it's in.
+ */
+GstBuffer *
+gst_vqe_timeshift_next (GstVQETimeshift * ts, gssize * rap)
+{
+  GstVQETimeshiftEntry *e;
+  GstBuffer *buffer;
+
+  if (!ts->reading)
+    return NULL;
+  if (ts->read_seq >= ts->first_seq + ts->length) {
+    ts->reading = FALSE;
+    return NULL;
+  }
+
+  e = ENTRY (ts, ts->read_seq);
+  if (e->segment != ts->segment || e->offset + e->size <= ts->written) {
+    buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        e->segment->map, e->segment->size, e->offset, e->size,
+        segment_ref (e->segment), (GDestroyNotify) segment_unref);
+  } else {
+    /* only when playback is right behind live: the end of it is still
+       staged, and is served from the stage rather than written out early,
+       which would be a write under the caller's lock */
+    gsize in_file = e->offset < ts->written ? ts->written - e->offset : 0;
+
+    buffer = gst_buffer_new ();
+    if (in_file)
+      gst_buffer_append_memory (buffer,
+          gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, e->segment->map,
+              e->segment->size, e->offset, in_file,
+              segment_ref (e->segment), (GDestroyNotify) segment_unref));
+    gst_buffer_append_memory (buffer,
+        gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, ts->stage->data,
+            STAGE_SIZE, e->offset + in_file - ts->stage_offset,
+            e->size - in_file, stage_ref (ts->stage),
+            (GDestroyNotify) stage_unref));
+  }
+
+  *rap = ts->read_rap;
+  ts->read_seq++;
+  ts->read_rap = -1;
+  return buffer;
+}
+
+/* The capture time of the oldest buffer in the window */
+GstClockTime
+gst_vqe_timeshift_start (GstVQETimeshift * ts)
+{
+  return ts->length ? ts->entries[ts->first].time : GST_CLOCK_TIME_NONE;
+}
+
+/* The capture time of the newest buffer in the window */
+GstClockTime
+gst_vqe_timeshift_end (GstVQETimeshift * ts)
+{
+  return ts->length ? ENTRY (ts, ts->first_seq + ts->length - 1)->time :
+      GST_CLOCK_TIME_NONE;
+}
+
+/* How far behind live playback is */
+GstClockTime
+gst_vqe_timeshift_delay (GstVQETimeshift * ts)
+{
+  if (!ts->reading || ts->read_seq >= ts->first_seq + ts->length)
+    return 0;
+  return gst_vqe_timeshift_end (ts) - ENTRY (ts, ts->read_seq)->time;
+}
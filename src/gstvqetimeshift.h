@@ -0,0 +1,134 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_VQE_TIMESHIFT_H__
+#define __GST_VQE_TIMESHIFT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The last so much of a stream, with an index of the buffers holding random
+ * access points so a seek can go straight to one.  Entries are numbered in
+ * the order they were added; the oldest are dropped once the window is
+ * longer than its duration or holds more than its bytes.
+ *
+ * The data is copied into segments of its own rather than kept by reference,
+ * so the buffers it came from, and the pool they belong to, aren't held on
+ * to for the length of the window.  By default the segments are anonymous
+ * memory.  With files the data is instead staged and written out in large
+ * aligned blocks to preallocated segment files, mapped read-only.  Either
+ * way it's played back without copying, from the segments or, right behind
+ * live, from the stage; buffers played back keep what they were served
+ * from, and segment files are deleted once nothing refers to them.  The
+ * index of random access points is only kept in memory, as the files don't
+ * outlive the window.
+ *
+ * Not thread safe.  Appending is split so that the slow part needn't be
+ * under whatever lock guards the window: gst_vqe_timeshift_write() and
+ * gst_vqe_timeshift_release() only touch state belonging to the appending
+ * thread, and just gst_vqe_timeshift_append() changes the window itself.
+ */
+typedef struct _GstVQETimeshiftSegment GstVQETimeshiftSegment;
+typedef struct _GstVQETimeshiftStage GstVQETimeshiftStage;
+
+typedef struct {
+  GstVQETimeshiftSegment *segment;
+  gsize offset;
+  gsize size;
+  GstClockTime time;            /* when it was captured */
+  gssize rap;                   /* offset of the first random access point,
+                                   or -1 */
+} GstVQETimeshiftEntry;
+
+typedef struct {
+  GstClockTime duration;
+  gsize max_bytes;
+  gchar *location;              /* directory for files, NULL for memory */
+  gsize segment_size;
+
+  GstVQETimeshiftEntry *entries;        /* circular */
+  guint capacity;
+  guint first;
+  guint length;
+  guint64 first_seq;            /* of entries[first] */
+  gsize bytes;                  /* of data */
+
+  guint64 *raps;                /* seqs of entries with a RAP, circular */
+  guint raps_capacity;
+  guint raps_first;
+  guint raps_length;
+
+  /* set while playing back from the window rather than live */
+  gboolean reading;
+  guint64 read_seq;
+  gssize read_rap;              /* where to start in read_seq after a seek or
+                                   a jump, otherwise -1 */
+
+  /* the segment being written.  In memory, data goes straight into it and
+     written is how much is there.  With files data is staged in stage,
+     which is written out at stage_offset once full; up to written it's
+     already in the file */
+  GstVQETimeshiftSegment *segment;
+  GstVQETimeshiftStage *stage;
+  gsize stage_offset;
+  gsize staged;
+  gsize written;
+
+  /* dropped from the window but not yet let go of */
+  GstVQETimeshiftEntry *dropped;
+  guint n_dropped;
+  guint dropped_capacity;
+} GstVQETimeshift;
+
+void          gst_vqe_timeshift_init   (GstVQETimeshift * ts,
+                                        GstClockTime duration,
+                                        gsize max_bytes);
+gboolean      gst_vqe_timeshift_use_files (GstVQETimeshift * ts,
+                                        const gchar * location,
+                                        GError ** error);
+void          gst_vqe_timeshift_clear  (GstVQETimeshift * ts);
+void          gst_vqe_timeshift_free   (GstVQETimeshift * ts);
+gboolean      gst_vqe_timeshift_write  (GstVQETimeshift * ts,
+                                        GstBuffer * buffer,
+                                        GstClockTime time, gssize rap,
+                                        GstVQETimeshiftEntry * e,
+                                        GError ** error);
+void          gst_vqe_timeshift_append (GstVQETimeshift * ts,
+                                        const GstVQETimeshiftEntry * e);
+void          gst_vqe_timeshift_release (GstVQETimeshift * ts);
+gboolean      gst_vqe_timeshift_seek   (GstVQETimeshift * ts,
+                                        GstClockTime time,
+                                        GstClockTime * start);
+void          gst_vqe_timeshift_hold   (GstVQETimeshift * ts);
+GstBuffer    *gst_vqe_timeshift_next   (GstVQETimeshift * ts,
+                                        gssize * rap);
+
+GstClockTime  gst_vqe_timeshift_start  (GstVQETimeshift * ts);
+GstClockTime  gst_vqe_timeshift_end    (GstVQETimeshift * ts);
+GstClockTime  gst_vqe_timeshift_delay  (GstVQETimeshift * ts);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_TIMESHIFT_H__ */
@@ -0,0 +1,344 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-vqetracer
+ *
+ * vqetracer keeps histograms of where each vqesrc streaming thread spends its
+ * time and logs them every few seconds and when the element stops, without
+ * the cost of debug logging and without changes to the application.
+ *
+ * <refsect2>
+ * <title>Example</title>
+ * |[
+ * GST_TRACERS="vqetracer(interval=10)" GST_DEBUG=GST_TRACER:7 \
+ *     gst-launch-1.0 vqesrc sdp="..." ! tsdemux ! ...
+ * ]|
+ * </refsect2>
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqetracer.h"
+
+gint gst_vqe_tracer_active = 0;
+
+#if GST_CHECK_VERSION(1,8,0)
+
+#include "gstvqesrc.h"
+#include "gstvqehistogram.h"
+
+GST_DEBUG_CATEGORY_STATIC (vqetracer_debug);
+#define GST_CAT_DEFAULT (vqetracer_debug)
+
+#define VQE_DEFAULT_TRACER_INTERVAL (5 * GST_SECOND)
+
+/* Kept on each vqesrc; only touched from its streaming thread, and from the
+   state change out of PAUSED once that has stopped. */
+typedef struct {
+  GstVQEHistogram recv_time;
+  GstVQEHistogram acquire_time;
+  GstVQEHistogram push_time;
+  GstVQEHistogram datagrams;
+  guint64 buffers;
+  guint64 idle;
+  GstClockTime push_start;
+  GstClockTime last_log;
+} GstVQETracerStats;
+
+static GQuark stats_quark;
+static GstTracerRecord *histogram_record;
+static GstTracerRecord *idle_record;
+
+#define gst_vqe_tracer_parent_class parent_class
+G_DEFINE_TYPE (GstVQETracer, gst_vqe_tracer, GST_TYPE_TRACER);
+
+static void
+gst_vqe_tracer_stats_free (gpointer data)
+{
+  g_slice_free (GstVQETracerStats, data);
+}
+
+static GstVQESrc *
+gst_vqe_tracer_get_vqesrc (GstPad * pad)
+{
+  GstObject *parent = GST_OBJECT_PARENT (pad);
+
+  if (parent && GST_IS_VQESRC (parent))
+    return GST_VQESRC_CAST (parent);
+  return NULL;
+}
+
+static GstVQETracerStats *
+gst_vqe_tracer_get_stats (GstVQESrc * src, GstClockTime ts)
+{
+  GstVQETracerStats *stats = g_object_get_qdata (G_OBJECT (src), stats_quark);
+
+  if (G_UNLIKELY (!stats)) {
+    stats = g_slice_new0 (GstVQETracerStats);
+    stats->push_start = GST_CLOCK_TIME_NONE;
+    stats->last_log = ts;
+    g_object_set_qdata_full (G_OBJECT (src), stats_quark, stats,
+        gst_vqe_tracer_stats_free);
+  }
+  return stats;
+}
+
+static void
+gst_vqe_tracer_log_histogram (const gchar * element, const gchar * probe,
+    GstVQEHistogram * hist)
+{
+  gchar *buckets;
+
+  if (!hist->count)
+    return;
+
+  buckets = gst_vqe_histogram_to_string (hist);
+  gst_tracer_record_log (histogram_record, element, probe, hist->count,
+      hist->sum / hist->count, gst_vqe_histogram_percentile (hist, 50),
+      gst_vqe_histogram_percentile (hist, 90),
+      gst_vqe_histogram_percentile (hist, 99), hist->max, buckets);
+  g_free (buckets);
+}
+
+/* Logs and resets everything gathered since the last time */
+static void
+gst_vqe_tracer_flush (GstVQESrc * src, GstVQETracerStats * stats,
+    GstClockTime ts)
+{
+  const gchar *name = GST_OBJECT_NAME (src);
+
+  gst_vqe_tracer_log_histogram (name, "recv-time", &stats->recv_time);
+  gst_vqe_tracer_log_histogram (name, "acquire-time", &stats->acquire_time);
+  gst_vqe_tracer_log_histogram (name, "push-time", &stats->push_time);
+  gst_vqe_tracer_log_histogram (name, "datagrams", &stats->datagrams);
+  if (stats->buffers)
+    gst_tracer_record_log (idle_record, name, stats->buffers, stats->idle);
+
+  gst_vqe_histogram_reset (&stats->recv_time);
+  gst_vqe_histogram_reset (&stats->acquire_time);
+  gst_vqe_histogram_reset (&stats->push_time);
+  gst_vqe_histogram_reset (&stats->datagrams);
+  stats->buffers = stats->idle = 0;
+  stats->last_log = ts;
+}
+
+static void
+do_push_pre (GstVQETracer * self, GstClockTime ts, GstPad * pad)
+{
+  GstVQESrc *src = gst_vqe_tracer_get_vqesrc (pad);
+  GstVQETracerStats *stats;
+
+  if (!src)
+    return;
+  stats = gst_vqe_tracer_get_stats (src, ts);
+
+  /* create has just returned in this same thread, so the probes are those
+     of the buffer being pushed */
+  stats->buffers++;
+  if (src->probe_idle) {
+    stats->idle++;
+  } else {
+    gst_vqe_histogram_add (&stats->datagrams, src->probe_datagrams);
+    gst_vqe_histogram_add (&stats->acquire_time, src->probe_acquire_time);
+  }
+  gst_vqe_histogram_add (&stats->recv_time, src->probe_recv_time);
+  stats->push_start = ts;
+}
+
+static void
+do_push_post (GstVQETracer * self, GstClockTime ts, GstPad * pad)
+{
+  GstVQESrc *src = gst_vqe_tracer_get_vqesrc (pad);
+  GstVQETracerStats *stats;
+
+  if (!src)
+    return;
+  stats = gst_vqe_tracer_get_stats (src, ts);
+
+  if (GST_CLOCK_TIME_IS_VALID (stats->push_start)) {
+    gst_vqe_histogram_add (&stats->push_time, ts - stats->push_start);
+    stats->push_start = GST_CLOCK_TIME_NONE;
+  }
+  if (ts - stats->last_log >= self->interval)
+    gst_vqe_tracer_flush (src, stats, ts);
+}
+
+static void
+do_pad_push_pre (GstTracer * tracer, GstClockTime ts, GstPad * pad,
+    GstBuffer * buffer)
+{
+  do_push_pre (GST_VQE_TRACER (tracer), ts, pad);
+}
+
+static void
+do_pad_push_post (GstTracer * tracer, GstClockTime ts, GstPad * pad,
+    GstFlowReturn res)
+{
+  do_push_post (GST_VQE_TRACER (tracer), ts, pad);
+}
+
+static void
+do_pad_push_list_pre (GstTracer * tracer, GstClockTime ts, GstPad * pad,
+    GstBufferList * list)
+{
+  do_push_pre (GST_VQE_TRACER (tracer), ts, pad);
+}
+
+static void
+do_pad_push_list_post (GstTracer * tracer, GstClockTime ts, GstPad * pad,
+    GstFlowReturn res)
+{
+  do_push_post (GST_VQE_TRACER (tracer), ts, pad);
+}
+
+/* Whatever is left over when a vqesrc stops is logged rather than being
+   folded into the next run. */
+static void
+do_element_change_state_post (GstTracer * tracer, GstClockTime ts,
+    GstElement * element, GstStateChange transition,
+    GstStateChangeReturn result)
+{
+  GstVQETracerStats *stats;
+
+  if (transition != GST_STATE_CHANGE_PAUSED_TO_READY ||
+      !GST_IS_VQESRC (element))
+    return;
+
+  stats = g_object_get_qdata (G_OBJECT (element), stats_quark);
+  if (stats)
+    gst_vqe_tracer_flush (GST_VQESRC_CAST (element), stats, ts);
+}
+
+static void
+gst_vqe_tracer_constructed (GObject * object)
+{
+  GstVQETracer *self = GST_VQE_TRACER (object);
+  gchar *params, *tmp;
+  GstStructure *s = NULL;
+
+  g_object_get (self, "params", &params, NULL);
+  if (params) {
+    tmp = g_strdup_printf ("vqetracer,%s", params);
+    s = gst_structure_from_string (tmp, NULL);
+    g_free (tmp);
+    g_free (params);
+  }
+  if (s) {
+    guint interval;
+
+    if (gst_structure_get_uint (s, "interval", &interval) && interval > 0)
+      self->interval = interval * GST_SECOND;
+    gst_structure_free (s);
+  }
+
+  G_OBJECT_CLASS (parent_class)->constructed (object);
+}
+
+static void
+gst_vqe_tracer_finalize (GObject * object)
+{
+  g_atomic_int_dec_and_test (&gst_vqe_tracer_active);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_vqe_tracer_class_init (GstVQETracerClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (vqetracer_debug, "vqetracer", 0,
+      "vqesrc receive path tracer");
+
+  gobject_class->constructed = gst_vqe_tracer_constructed;
+  gobject_class->finalize = gst_vqe_tracer_finalize;
+
+  stats_quark = g_quark_from_static_string ("GstVQETracerStats");
+
+  /* times are in nanoseconds, as for the other tracers */
+  histogram_record = gst_tracer_record_new ("vqe-histogram.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "probe", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "description", G_TYPE_STRING,
+          "recv-time, acquire-time, push-time or datagrams", NULL),
+      "count", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "number of samples", NULL),
+      "mean", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64, NULL),
+      "p50", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64, NULL),
+      "p90", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64, NULL),
+      "p99", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64, NULL),
+      "max", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64, NULL),
+      "buckets", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "description", G_TYPE_STRING,
+          "power of two buckets as <=upper-bound:count", NULL),
+      NULL);
+
+  idle_record = gst_tracer_record_new ("vqe-idle.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "buffers", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64, NULL),
+      "timeouts", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING,
+          "buffers pushed empty as nothing arrived in time", NULL),
+      NULL);
+}
+
+static void
+gst_vqe_tracer_init (GstVQETracer * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+
+  self->interval = VQE_DEFAULT_TRACER_INTERVAL;
+
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_pad_push_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_pad_push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_pad_push_list_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+      G_CALLBACK (do_pad_push_list_post));
+  gst_tracing_register_hook (tracer, "element-change-state-post",
+      G_CALLBACK (do_element_change_state_post));
+
+  g_atomic_int_inc (&gst_vqe_tracer_active);
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_TRACER_H__
+#define __GST_VQE_TRACER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Non-zero while a vqetracer instance exists, so that vqesrc only takes
+   timestamps for its probes when someone is going to look at them. */
+extern gint gst_vqe_tracer_active;
+
+#if GST_CHECK_VERSION(1,8,0)
+
+#define GST_TYPE_VQE_TRACER \
+  (gst_vqe_tracer_get_type())
+#define GST_VQE_TRACER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_VQE_TRACER,GstVQETracer))
+
+typedef struct _GstVQETracer GstVQETracer;
+typedef struct _GstVQETracerClass GstVQETracerClass;
+
+/*
+ * Collects histograms of what each vqesrc's streaming thread spends its time
+ * on: blocked in recvmsg, waiting for the buffer pool and pushing
+ * downstream, plus datagrams per buffer and read timeouts.  Enabled with
+ * GST_TRACERS=vqetracer and logged periodically as "vqe-histogram" records
+ * in the GST_TRACER debug category.
+ */
+struct _GstVQETracer {
+  GstTracer parent;
+
+  /* how often each element's histograms are logged */
+  GstClockTime interval;
+};
+
+struct _GstVQETracerClass {
+  GstTracerClass parent_class;
+};
+
+GType gst_vqe_tracer_get_type (void);
+
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_VQE_TRACER_H__ */
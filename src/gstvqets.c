@@ -0,0 +1,376 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvqets.h"
+
+#include <string.h>
+
+#define TABLE_ID_PAT    0x00
+#define TABLE_ID_PMT    0x02
+
+static gboolean
+is_video_stream_type (guint8 stream_type)
+{
+  switch (stream_type) {
+    case 0x01:                 /* MPEG-1 video */
+    case 0x02:                 /* MPEG-2 video */
+    case 0x10:                 /* MPEG-4 part 2 */
+    case 0x1b:                 /* H.264 */
+    case 0x24:                 /* H.265 */
+    case 0x42:                 /* AVS */
+    case 0xea:                 /* VC-1 */
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/* Returns a pointer to the payload of pkt and its size, or NULL if the
+ * packet carries no payload. */
+static const guint8 *
+packet_payload (const guint8 * pkt, gsize * size)
+{
+  gsize offset = 4;
+
+  if (!(pkt[3] & 0x10))
+    return NULL;
+  if (pkt[3] & 0x20)
+    offset += 1 + pkt[4];
+  if (offset >= GST_VQE_TS_PACKET_SIZE)
+    return NULL;
+
+  *size = GST_VQE_TS_PACKET_SIZE - offset;
+  return pkt + offset;
+}
+
+/* Returns the start of a PSI section with the given table id that begins
+ * and ends in pkt, and the section length excluding the CRC. */
+static const guint8 *
+packet_section (const guint8 * pkt, guint8 table_id, gsize * length)
+{
+  const guint8 *payload;
+  gsize size, section_length;
+
+  if (!GST_VQE_TS_PUSI (pkt))
+    return NULL;
+  payload = packet_payload (pkt, &size);
+  if (!payload || size < 1u + payload[0] + 3)
+    return NULL;
+  size -= 1 + payload[0];
+  payload += 1 + payload[0];
+
+  if (payload[0] != table_id)
+    return NULL;
+  section_length = ((payload[1] & 0x0f) << 8) | payload[2];
+  if (section_length < 9 || 3 + section_length > size)
+    return NULL;
+
+  *length = 3 + section_length - 4;
+  return payload;
+}
+
+/* TRUE if pkt starts a section with the given table id that carries on into
+ * the packets after it, which we don't reassemble. */
+static gboolean
+packet_section_split (const guint8 * pkt, guint8 table_id)
+{
+  const guint8 *payload;
+  gsize size;
+
+  if (!GST_VQE_TS_PUSI (pkt))
+    return FALSE;
+  payload = packet_payload (pkt, &size);
+  if (!payload || size < 1u + payload[0] + 3)
+    return FALSE;
+  size -= 1 + payload[0];
+  payload += 1 + payload[0];
+
+  return payload[0] == table_id &&
+      3u + (((payload[1] & 0x0f) << 8) | payload[2]) > size;
+}
+
+static gboolean
+scan_pat (GstVQETSScanner * scanner, const guint8 * pkt)
+{
+  const guint8 *section, *p;
+  gsize length;
+
+  section = packet_section (pkt, TABLE_ID_PAT, &length);
+  if (!section)
+    return FALSE;
+
+  for (p = section + 8; p + 4 <= section + length; p += 4) {
+    guint16 program_number = (p[0] << 8) | p[1];
+    guint16 pid = ((p[2] & 0x1f) << 8) | p[3];
+
+    /* program 0 is the network PID, not a PMT */
+    if (program_number == 0)
+      continue;
+
+    if (pid != scanner->pmt_pid) {
+      scanner->pmt_pid = pid;
+      scanner->have_pmt = FALSE;
+      scanner->pcr_pid = GST_VQE_TS_PID_INVALID;
+      scanner->video_pid = GST_VQE_TS_PID_INVALID;
+    }
+    memcpy (scanner->pat, pkt, GST_VQE_TS_PACKET_SIZE);
+    scanner->have_pat = TRUE;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static gboolean
+scan_pmt (GstVQETSScanner * scanner, const guint8 * pkt)
+{
+  const guint8 *section, *p, *end;
+  gsize length;
+  guint16 first_pid = GST_VQE_TS_PID_INVALID;
+  guint8 first_type = 0;
+
+  section = packet_section (pkt, TABLE_ID_PMT, &length);
+  if (!section || length < 12)
+    return FALSE;
+
+  scanner->pcr_pid = ((section[8] & 0x1f) << 8) | section[9];
+
+  end = section + length;
+  p = section + 12 + (((section[10] & 0x0f) << 8) | section[11]);
+  scanner->video_pid = GST_VQE_TS_PID_INVALID;
+
+  while (p + 5 <= end) {
+    guint8 stream_type = p[0];
+    guint16 pid = ((p[1] & 0x1f) << 8) | p[2];
+
+    if (first_pid == GST_VQE_TS_PID_INVALID) {
+      first_pid = pid;
+      first_type = stream_type;
+    }
+    if (is_video_stream_type (stream_type)) {
+      scanner->video_pid = pid;
+      scanner->video_stream_type = stream_type;
+      break;
+    }
+    p += 5 + (((p[3] & 0x0f) << 8) | p[4]);
+  }
+
+  /* Radio channels have no video; any PES start on the first elementary
+   * stream is as good a place to start as any. */
+  if (scanner->video_pid == GST_VQE_TS_PID_INVALID) {
+    scanner->video_pid = first_pid;
+    scanner->video_stream_type = first_type;
+  }
+
+  memcpy (scanner->pmt, pkt, GST_VQE_TS_PACKET_SIZE);
+  scanner->have_pmt = TRUE;
+  return TRUE;
+}
+
+/* Look for the start of a decodable picture at the start of a PES packet for
+ * encoders that don't bother setting random_access_indicator. */
+static gboolean
+pes_starts_with_keyframe (GstVQETSScanner * scanner, const guint8 * pkt)
+{
+  const guint8 *payload, *es;
+  gsize size, i;
+
+  payload = packet_payload (pkt, &size);
+  if (!payload || size < 9 || payload[0] != 0 || payload[1] != 0
+      || payload[2] != 1)
+    return FALSE;
+
+  if (!is_video_stream_type (scanner->video_stream_type))
+    return TRUE;
+
+  es = payload + 9 + payload[8];
+  if (es >= payload + size)
+    return FALSE;
+  size -= es - payload;
+
+  for (i = 0; i + 3 < size; i++) {
+    guint8 code;
+
+    if (es[i] != 0 || es[i + 1] != 0 || es[i + 2] != 1)
+      continue;
+    code = es[i + 3];
+
+    switch (scanner->video_stream_type) {
+      case 0x1b:
+        /* SPS or IDR slice */
+        if ((code & 0x1f) == 7 || (code & 0x1f) == 5)
+          return TRUE;
+        break;
+      case 0x24:
+        /* VPS/SPS or an IRAP picture */
+        if (((code >> 1) & 0x3f) == 32 || ((code >> 1) & 0x3f) == 33 ||
+            (((code >> 1) & 0x3f) >= 16 && ((code >> 1) & 0x3f) <= 21))
+          return TRUE;
+        break;
+      case 0x01:
+      case 0x02:
+        /* sequence header */
+        if (code == 0xb3)
+          return TRUE;
+        break;
+      default:
+        break;
+    }
+  }
+  return FALSE;
+}
+
+/* Returns the PSI section starting in pkt along with its full length,
+ * including the CRC. */
+static const guint8 *
+packet_any_section (const guint8 * pkt, gsize * length)
+{
+  const guint8 *payload;
+  gsize size;
+
+  if (!GST_VQE_TS_PUSI (pkt))
+    return NULL;
+  payload = packet_payload (pkt, &size);
+  if (!payload || size < 1u + payload[0] + 3)
+    return NULL;
+  size -= 1 + payload[0];
+  payload += 1 + payload[0];
+
+  *length = 3 + (((payload[1] & 0x0f) << 8) | payload[2]);
+  if (*length > size)
+    return NULL;
+  return payload;
+}
+
+/* Compares the sections carried by two single-packet PSI packets, ignoring
+ * continuity counters and anything else in the transport framing. */
+gboolean
+gst_vqe_ts_psi_equal (const guint8 * a, const guint8 * b)
+{
+  const guint8 *section_a, *section_b;
+  gsize length_a, length_b;
+
+  section_a = packet_any_section (a, &length_a);
+  section_b = packet_any_section (b, &length_b);
+  if (!section_a || !section_b)
+    return FALSE;
+
+  return length_a == length_b && memcmp (section_a, section_b, length_a) == 0;
+}
+
+/* Sets the discontinuity_indicator of a single-packet PSI packet so that its
+ * continuity counter needn't follow on from the last packet of its PID.  If
+ * it has no adaptation field to set it in, one is made out of the stuffing
+ * after the section.  Returns FALSE if there's no room for it. */
+gboolean
+gst_vqe_ts_packet_set_discontinuity (guint8 * pkt)
+{
+  const guint8 *section;
+  gsize length, start, end;
+
+  if ((pkt[3] & 0x20) && pkt[4] > 0) {
+    pkt[5] |= 0x80;
+    return TRUE;
+  }
+
+  section = packet_any_section (pkt, &length);
+  if (!section)
+    return FALSE;
+
+  /* an empty adaptation field is already one of the two bytes we need */
+  start = (pkt[3] & 0x20) ? 5 : 4;
+  end = section - pkt + length;
+  if (end + 6 - start > GST_VQE_TS_PACKET_SIZE)
+    return FALSE;
+
+  memmove (&pkt[6], &pkt[start], end - start);
+  pkt[3] |= 0x20;
+  pkt[4] = 1;
+  pkt[5] = 0x80;
+  return TRUE;
+}
+
+void
+gst_vqe_ts_scanner_reset (GstVQETSScanner * scanner)
+{
+  memset (scanner, 0, sizeof (*scanner));
+  scanner->pmt_pid = GST_VQE_TS_PID_INVALID;
+  scanner->pcr_pid = GST_VQE_TS_PID_INVALID;
+  scanner->video_pid = GST_VQE_TS_PID_INVALID;
+}
+
+/* Extracts the PCR, in 27 MHz ticks, if pkt carries one */
+gboolean
+gst_vqe_ts_packet_get_pcr (const guint8 * pkt, guint64 * pcr)
+{
+  guint64 base;
+
+  if (!(pkt[3] & 0x20) || pkt[4] < 7 || !(pkt[5] & 0x10))
+    return FALSE;
+
+  base = ((guint64) pkt[6] << 25) | (pkt[7] << 17) | (pkt[8] << 9) |
+      (pkt[9] << 1) | (pkt[10] >> 7);
+  *pcr = base * 300 + (((pkt[10] & 0x01) << 8) | pkt[11]);
+  return TRUE;
+}
+
+GstVQETSPacketFlags
+gst_vqe_ts_scanner_scan_packet (GstVQETSScanner * scanner, const guint8 * pkt)
+{
+  GstVQETSPacketFlags flags = 0;
+  guint16 pid;
+
+  if (G_UNLIKELY (pkt[0] != GST_VQE_TS_SYNC_BYTE))
+    return 0;
+
+  pid = GST_VQE_TS_PID (pkt);
+
+  if (pid == GST_VQE_TS_PID_PAT) {
+    if (scan_pat (scanner, pkt))
+      flags |= GST_VQE_TS_PACKET_PAT;
+    else if (packet_section_split (pkt, TABLE_ID_PAT))
+      flags |= GST_VQE_TS_PACKET_PSI_SPLIT;
+  } else if (pid == scanner->pmt_pid) {
+    if (scan_pmt (scanner, pkt))
+      flags |= GST_VQE_TS_PACKET_PMT;
+    else if (packet_section_split (pkt, TABLE_ID_PMT))
+      flags |= GST_VQE_TS_PACKET_PSI_SPLIT;
+    return flags;
+  }
+
+  if (pid == scanner->video_pid) {
+    /* adaptation field with random_access_indicator set */
+    if ((pkt[3] & 0x20) && pkt[4] > 0 && (pkt[5] & 0x40))
+      flags |= GST_VQE_TS_PACKET_RAP;
+    else if (GST_VQE_TS_PUSI (pkt) && pes_starts_with_keyframe (scanner, pkt))
+      flags |= GST_VQE_TS_PACKET_RAP;
+  }
+  if (pid == scanner->pcr_pid && (pkt[3] & 0x20) && pkt[4] > 0 &&
+      (pkt[5] & 0x10))
+    flags |= GST_VQE_TS_PACKET_PCR;
+
+  return flags;
+}
@@ -0,0 +1,91 @@
+/* GStreamer VQE element
+ *
+ * Copyright (C) 2012 YouView TV Ltd.
+ *
+ * Author: William Manley <william.manley@youview.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ * or under the terms of the Cisco style BSD license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VQE_TS_H__
+#define __GST_VQE_TS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Just enough MPEG-TS parsing to find our way around the post-repair stream
+ * VQE-C hands us: PAT, PMT, random access points and PCRs.  This is not a
+ * demuxer; PSI sections are only understood if they fit in a single packet,
+ * which is the case for every head-end we've seen.  Those that don't are
+ * flagged as PSI_SPLIT so callers can give up on them.
+ */
+
+#define GST_VQE_TS_PACKET_SIZE          188
+#define GST_VQE_TS_SYNC_BYTE            0x47
+#define GST_VQE_TS_PID_PAT              0x0000
+#define GST_VQE_TS_PID_INVALID          0xffff
+
+/* PCRs count a 27 MHz clock and wrap after 2^33 ticks of its 90 kHz base */
+#define GST_VQE_TS_PCR_HZ               G_GUINT64_CONSTANT (27000000)
+#define GST_VQE_TS_PCR_WRAP             (G_GUINT64_CONSTANT (300) << 33)
+
+#define GST_VQE_TS_PID(pkt)     ((((pkt)[1] & 0x1f) << 8) | (pkt)[2])
+#define GST_VQE_TS_PUSI(pkt)    (((pkt)[1] & 0x40) != 0)
+
+typedef enum {
+  GST_VQE_TS_PACKET_PAT = (1 << 0),
+  GST_VQE_TS_PACKET_PMT = (1 << 1),
+  GST_VQE_TS_PACKET_RAP = (1 << 2),
+  GST_VQE_TS_PACKET_PCR = (1 << 3),
+  /* starts a PAT or PMT section too long for one packet */
+  GST_VQE_TS_PACKET_PSI_SPLIT = (1 << 4)
+} GstVQETSPacketFlags;
+
+typedef struct _GstVQETSScanner GstVQETSScanner;
+
+struct _GstVQETSScanner {
+  guint16 pmt_pid;
+  guint16 pcr_pid;
+  guint16 video_pid;
+  guint8  video_stream_type;
+
+  /* copies of the most recent single-packet PAT and PMT */
+  gboolean have_pat;
+  gboolean have_pmt;
+  guint8 pat[GST_VQE_TS_PACKET_SIZE];
+  guint8 pmt[GST_VQE_TS_PACKET_SIZE];
+};
+
+void                gst_vqe_ts_scanner_reset       (GstVQETSScanner * scanner);
+
+GstVQETSPacketFlags gst_vqe_ts_scanner_scan_packet (GstVQETSScanner * scanner,
+                                                    const guint8 * pkt);
+
+gboolean            gst_vqe_ts_psi_equal           (const guint8 * a,
+                                                    const guint8 * b);
+
+gboolean            gst_vqe_ts_packet_get_pcr      (const guint8 * pkt,
+                                                    guint64 * pcr);
+
+gboolean            gst_vqe_ts_packet_set_discontinuity (guint8 * pkt);
+
+G_END_DECLS
+
+#endif /* __GST_VQE_TS_H__ */